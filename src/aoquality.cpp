@@ -18,12 +18,18 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <tables/Tables/SetupNewTab.h>
 #include <tables/Tables/TableCopy.h>
 
 #include "msio/measurementset.h"
+#include "msio/system.h"
 
 #include "quality/defaultstatistics.h"
 #include "quality/histogramcollection.h"
@@ -34,6 +40,7 @@
 #include "remote/clusteredobservation.h"
 #include "remote/processcommander.h"
 #include "util/plot.h"
+#include "util/stopwatch.h"
 
 #ifdef HAS_LOFARSTMAN
 #include <LofarStMan/Register.h>
@@ -58,7 +65,173 @@ enum CollectingMode
 	CollectHistograms
 };
 
-void actionCollect(const std::string &filename, enum CollectingMode mode, StatisticsCollection &statisticsCollection, HistogramCollection &histogramCollection, bool mwaChannels, size_t flaggedTimesteps, const std::set<size_t> &flaggedAntennae)
+/**
+ * The state that the collecting threads share. The threads take shards of consecutive rows
+ * from the table; only the reading of a shard is done by one thread at a time. The
+ * mutex protects the shard administration and the progress output, while ioMutex
+ * serializes the table access.
+ */
+struct CollectState
+{
+	enum CollectingMode mode;
+	unsigned polarizationCount;
+	const BandInfo *bands;
+	bool ignoreChannelZero;
+	const bool *correlatorFlags, *correlatorFlagsForBadAntenna;
+	const std::set<size_t> *flaggedAntennae;
+	// The rows before this row are in the flagged (quacked) time steps
+	size_t firstUnflaggedRow;
+	
+	casa::Vector<double> times;
+	casa::Vector<int> antenna1s, antenna2s, windows;
+	casa::ROArrayColumn<casa::Complex> *dataColumn;
+	casa::ROArrayColumn<bool> *flagColumn;
+	
+	boost::mutex mutex, ioMutex;
+	size_t nextRow, rowCount, shardSize;
+	size_t sampleCount;
+	std::string error;
+};
+
+void initializeCollections(StatisticsCollection &statisticsCollection, HistogramCollection &histogramCollection, enum CollectingMode mode, unsigned polarizationCount, unsigned bandCount, const BandInfo *bands, double **frequencies, bool ignoreChannelZero)
+{
+	statisticsCollection.SetPolarizationCount(polarizationCount);
+	if(mode == CollectDefault)
+	{
+		for(unsigned b=0;b<bandCount;++b)
+		{
+			if(ignoreChannelZero)
+				statisticsCollection.InitializeBand(b, (frequencies[b]+1), bands[b].channels.size()-1);
+			else
+				statisticsCollection.InitializeBand(b, frequencies[b], bands[b].channels.size());
+		}
+	}
+	histogramCollection.SetPolarizationCount(polarizationCount);
+}
+
+void collectRow(CollectState &state, size_t row, const casa::Complex *dataIter, const bool *flagIter, StatisticsCollection &statisticsCollection, HistogramCollection &histogramCollection, std::complex<float> *samples, bool *isRFI, size_t maxChannelCount)
+{
+	const double time = state.times[row];
+	const unsigned antenna1Index = state.antenna1s[row];
+	const unsigned antenna2Index = state.antenna2s[row];
+	const unsigned bandIndex = state.windows[row];
+	const BandInfo &band = state.bands[bandIndex];
+	const unsigned polarizationCount = state.polarizationCount;
+	
+	const bool antennaIsFlagged =
+		state.flaggedAntennae->find(antenna1Index) != state.flaggedAntennae->end() ||
+		state.flaggedAntennae->find(antenna2Index) != state.flaggedAntennae->end();
+	
+	const unsigned startChannel = state.ignoreChannelZero ? 1 : 0;
+	if(state.ignoreChannelZero)
+	{
+		for(unsigned p = 0; p < polarizationCount; ++p)
+		{
+			++dataIter;
+			++flagIter;
+		}
+	}
+	for(unsigned channel = startChannel ; channel<band.channels.size(); ++channel)
+	{
+		for(unsigned p = 0; p < polarizationCount; ++p)
+		{
+			samples[p*maxChannelCount + channel - startChannel] = *dataIter;
+			isRFI[p*maxChannelCount + channel - startChannel] = *flagIter;
+			
+			++dataIter;
+			++flagIter;
+		}
+	}
+	
+	for(unsigned p = 0; p < polarizationCount; ++p)
+	{
+		std::complex<float> *polSamples = &samples[p*maxChannelCount];
+		bool *polIsRFI = &isRFI[p*maxChannelCount];
+		switch(state.mode)
+		{
+			case CollectDefault:
+				if(antennaIsFlagged || row < state.firstUnflaggedRow)
+					statisticsCollection.Add(antenna1Index, antenna2Index, time, bandIndex, p, &polSamples->real(), &polSamples->imag(), polIsRFI, state.correlatorFlagsForBadAntenna, band.channels.size() - startChannel, 2, 1, 1);
+				else
+					statisticsCollection.Add(antenna1Index, antenna2Index, time, bandIndex, p, &polSamples->real(), &polSamples->imag(), polIsRFI, state.correlatorFlags, band.channels.size() - startChannel, 2, 1, 1);
+				break;
+			case CollectHistograms:
+				histogramCollection.Add(antenna1Index, antenna2Index, p, polSamples, polIsRFI, band.channels.size() - startChannel);
+				break;
+		}
+	}
+}
+
+/**
+ * Collects the statistics of shards of rows into its own collections, until all rows have
+ * been taken. Each shard is read with one range read per column; since such a read
+ * requires all rows to have the same shape, a shard also ends where the number of
+ * channels changes.
+ */
+struct CollectFunction
+{
+	CollectFunction(CollectState &state, StatisticsCollection &statisticsCollection, HistogramCollection &histogramCollection, size_t maxChannelCount) :
+		_state(state), _statisticsCollection(statisticsCollection), _histogramCollection(histogramCollection), _maxChannelCount(maxChannelCount)
+	{
+	}
+	
+	void operator()()
+	{
+		casa::Array<casa::Complex> dataArray;
+		casa::Array<bool> flagArray;
+		std::vector<std::complex<float> > samples(_state.polarizationCount * _maxChannelCount);
+		bool *isRFI = new bool[_state.polarizationCount * _maxChannelCount];
+		size_t sampleCount = 0;
+		try {
+			while(true)
+			{
+				size_t startRow, endRow, channelCount;
+				{
+					boost::mutex::scoped_lock lock(_state.mutex);
+					if(_state.nextRow == _state.rowCount || !_state.error.empty())
+						break;
+					startRow = _state.nextRow;
+					const size_t maxEndRow = std::min(startRow + _state.shardSize, _state.rowCount);
+					channelCount = _state.bands[_state.windows[startRow]].channels.size();
+					endRow = startRow + 1;
+					while(endRow != maxEndRow && _state.bands[_state.windows[endRow]].channels.size() == channelCount)
+						++endRow;
+					_state.nextRow = endRow;
+					for(size_t row=startRow;row!=endRow;++row)
+						reportProgress(row, _state.rowCount);
+				}
+				
+				{
+					boost::mutex::scoped_lock lock(_state.ioMutex);
+					casa::Slicer rowSlicer(casa::IPosition(1, startRow), casa::IPosition(1, endRow - startRow), casa::Slicer::endIsLength);
+					_state.dataColumn->getColumnRange(rowSlicer, dataArray, true);
+					_state.flagColumn->getColumnRange(rowSlicer, flagArray, true);
+				}
+				sampleCount += dataArray.nelements();
+				
+				const size_t rowSize = channelCount * _state.polarizationCount;
+				const casa::Complex *data = dataArray.data();
+				const bool *flags = flagArray.data();
+				for(size_t row=startRow;row!=endRow;++row)
+					collectRow(_state, row, data + (row-startRow)*rowSize, flags + (row-startRow)*rowSize, _statisticsCollection, _histogramCollection, &samples[0], isRFI, _maxChannelCount);
+			}
+		} catch(std::exception &e)
+		{
+			boost::mutex::scoped_lock lock(_state.mutex);
+			_state.error = e.what();
+		}
+		delete[] isRFI;
+		boost::mutex::scoped_lock lock(_state.mutex);
+		_state.sampleCount += sampleCount;
+	}
+	
+	CollectState &_state;
+	StatisticsCollection &_statisticsCollection;
+	HistogramCollection &_histogramCollection;
+	size_t _maxChannelCount;
+};
+
+void actionCollect(const std::string &filename, enum CollectingMode mode, StatisticsCollection &statisticsCollection, HistogramCollection &histogramCollection, bool mwaChannels, size_t flaggedTimesteps, const std::set<size_t> &flaggedAntennae, size_t threadCount)
 {
 	MeasurementSet *ms = new MeasurementSet(filename);
 	const unsigned polarizationCount = ms->PolarizationCount();
@@ -68,11 +241,13 @@ void actionCollect(const std::string &filename, enum CollectingMode mode, Statis
 	BandInfo *bands = new BandInfo[bandCount];
 	double **frequencies = new double*[bandCount];
 	unsigned totalChannels = 0;
+	size_t maxChannelCount = 0;
 	for(unsigned b=0;b<bandCount;++b)
 	{
 		bands[b] = ms->GetBandInfo(b);
 		frequencies[b] = new double[bands[b].channels.size()];
 		totalChannels += bands[b].channels.size();
+		maxChannelCount = std::max(maxChannelCount, bands[b].channels.size());
 		for(unsigned c=0;c<bands[b].channels.size();++c)
 		{
 			frequencies[b][c] = bands[b].channels[c].frequencyHz;
@@ -80,29 +255,29 @@ void actionCollect(const std::string &filename, enum CollectingMode mode, Statis
 	}
 	delete ms;
 	
+	if(threadCount == 0)
+		threadCount = 1;
 	std::cout
 		<< "Polarizations: " << polarizationCount << '\n'
 		<< "Bands: " << bandCount << '\n'
-		<< "Channels/band: " << (totalChannels / bandCount) << '\n';
+		<< "Channels/band: " << (totalChannels / bandCount) << '\n'
+		<< "Threads: " << threadCount << '\n';
 	if(ignoreChannelZero)
 		std::cout << "Channel zero will be ignored, as this looks like a LOFAR data set with bad channel 0.\n";
 	else
 		std::cout << "Channel zero will be included in the statistics, as it seems that channel 0 is okay.\n";
 	
-	// Initialize statisticscollection
-	statisticsCollection.SetPolarizationCount(polarizationCount);
-	if(mode == CollectDefault)
+	// The first thread collects into the given collections, the others into their own ones,
+	// which are added to the given collections afterwards.
+	initializeCollections(statisticsCollection, histogramCollection, mode, polarizationCount, bandCount, bands, frequencies, ignoreChannelZero);
+	std::vector<StatisticsCollection*> threadStatistics(threadCount, &statisticsCollection);
+	std::vector<HistogramCollection*> threadHistograms(threadCount, &histogramCollection);
+	for(size_t t=1;t<threadCount;++t)
 	{
-		for(unsigned b=0;b<bandCount;++b)
-		{
-			if(ignoreChannelZero)
-				statisticsCollection.InitializeBand(b, (frequencies[b]+1), bands[b].channels.size()-1);
-			else
-				statisticsCollection.InitializeBand(b, frequencies[b], bands[b].channels.size());
-		}
+		threadStatistics[t] = new StatisticsCollection();
+		threadHistograms[t] = new HistogramCollection();
+		initializeCollections(*threadStatistics[t], *threadHistograms[t], mode, polarizationCount, bandCount, bands, frequencies, ignoreChannelZero);
 	}
-	// Initialize Histograms collection
-	histogramCollection.SetPolarizationCount(polarizationCount);
 
 	// get columns
 	casa::Table table(filename, casa::Table::Update);
@@ -117,9 +292,9 @@ void actionCollect(const std::string &filename, enum CollectingMode mode, Statis
 	std::cout << "Collecting statistics..." << std::endl;
 	
 	size_t channelCount = bands[0].channels.size();
-	bool *correlatorFlags = new bool[channelCount];
-	bool *correlatorFlagsForBadAntenna = new bool[channelCount];
-	for(size_t ch=0; ch!=channelCount; ++ch)
+	bool *correlatorFlags = new bool[maxChannelCount];
+	bool *correlatorFlagsForBadAntenna = new bool[maxChannelCount];
+	for(size_t ch=0; ch!=maxChannelCount; ++ch)
 	{
 		correlatorFlags[ch] = false;
 		correlatorFlagsForBadAntenna[ch] = true;
@@ -140,86 +315,66 @@ void actionCollect(const std::string &filename, enum CollectingMode mode, Statis
 		}
 	}
 	
-	const unsigned nrow = table.nrow();
+	CollectState state;
+	state.mode = mode;
+	state.polarizationCount = polarizationCount;
+	state.bands = bands;
+	state.ignoreChannelZero = ignoreChannelZero;
+	state.correlatorFlags = correlatorFlags;
+	state.correlatorFlagsForBadAntenna = correlatorFlagsForBadAntenna;
+	state.flaggedAntennae = &flaggedAntennae;
+	state.times = timeColumn.getColumn();
+	state.antenna1s = antenna1Column.getColumn();
+	state.antenna2s = antenna2Column.getColumn();
+	state.windows = windowColumn.getColumn();
+	state.dataColumn = &dataColumn;
+	state.flagColumn = &flagColumn;
+	state.nextRow = 0;
+	state.rowCount = table.nrow();
+	state.shardSize = 256;
+	state.sampleCount = 0;
+	
+	// The rows are ordered in time, so the flagged time steps are the first rows
 	size_t timestepIndex = (size_t) -1;
 	double prevtime = -1.0;
-	for(unsigned row = 0; row!=nrow; ++row)
+	state.firstUnflaggedRow = state.rowCount;
+	for(size_t row=0;row!=state.rowCount;++row)
 	{
-		const double time = timeColumn(row);
-		const unsigned antenna1Index = antenna1Column(row);
-		const unsigned antenna2Index = antenna2Column(row);
-		const unsigned bandIndex = windowColumn(row);
-		
-		if(time != prevtime)
+		if(state.times[row] != prevtime)
 		{
 			++timestepIndex;
-			prevtime = time;
-		}
-		
-		const BandInfo &band = bands[bandIndex];
-		
-		const casa::Array<casa::Complex> dataArray = dataColumn(row);
-		const casa::Array<bool> flagArray = flagColumn(row);
-		
-		std::vector<std::complex<float>* > samples(polarizationCount);
-		bool **isRFI = new bool*[polarizationCount];
-		for(unsigned p = 0; p < polarizationCount; ++p)
-		{
-			isRFI[p] = new bool[band.channels.size()];
-			samples[p] = new std::complex<float>[band.channels.size()];
-		}
-		const bool antennaIsFlagged =
-			flaggedAntennae.find(antenna1Index) != flaggedAntennae.end() ||
-			flaggedAntennae.find(antenna2Index) != flaggedAntennae.end();
-		
-		casa::Array<casa::Complex>::const_iterator dataIter = dataArray.begin();
-		casa::Array<bool>::const_iterator flagIter = flagArray.begin();
-		const unsigned startChannel = ignoreChannelZero ? 1 : 0;
-		if(ignoreChannelZero)
-		{
-			for(unsigned p = 0; p < polarizationCount; ++p)
-			{
-				++dataIter;
-				++flagIter;
-			}
-		}
-		for(unsigned channel = startChannel ; channel<band.channels.size(); ++channel)
-		{
-			for(unsigned p = 0; p < polarizationCount; ++p)
-			{
-				samples[p][channel - startChannel] = *dataIter;
-				isRFI[p][channel - startChannel] = *flagIter;
-				
-				++dataIter;
-				++flagIter;
-			}
+			prevtime = state.times[row];
 		}
-		
-		for(unsigned p = 0; p < polarizationCount; ++p)
+		if(timestepIndex >= flaggedTimesteps)
 		{
-			switch(mode)
-			{
-				case CollectDefault:
-					if(antennaIsFlagged || timestepIndex < flaggedTimesteps)
-						statisticsCollection.Add(antenna1Index, antenna2Index, time, bandIndex, p, &samples[p]->real(), &samples[p]->imag(), isRFI[p], correlatorFlagsForBadAntenna, band.channels.size() - startChannel, 2, 1, 1);
-					else
-						statisticsCollection.Add(antenna1Index, antenna2Index, time, bandIndex, p, &samples[p]->real(), &samples[p]->imag(), isRFI[p], correlatorFlags, band.channels.size() - startChannel, 2, 1, 1);
-					break;
-				case CollectHistograms:
-					histogramCollection.Add(antenna1Index, antenna2Index, p, samples[p], isRFI[p], band.channels.size() - startChannel);
-					break;
-			}
+			state.firstUnflaggedRow = row;
+			break;
 		}
-
-		for(unsigned p = 0; p < polarizationCount; ++p)
+	}
+	
+	Stopwatch watch(true);
+	boost::thread_group threads;
+	for(size_t t=0;t!=threadCount;++t)
+		threads.create_thread(CollectFunction(state, *threadStatistics[t], *threadHistograms[t], maxChannelCount));
+	threads.join_all();
+	std::cout << "100\n";
+	
+	for(size_t t=1;t<threadCount;++t)
+	{
+		if(state.error.empty())
 		{
-			delete[] isRFI[p];
-			delete[] samples[p];
+			statisticsCollection.Add(*threadStatistics[t]);
+			histogramCollection.Add(*threadHistograms[t]);
 		}
-		delete[] isRFI;
-		
-		reportProgress(row, nrow);
+		delete threadStatistics[t];
+		delete threadHistograms[t];
 	}
+	
+	const double seconds = watch.Seconds();
+	std::cout << "Collected " << state.rowCount << " rows in " << watch.ToString() << " ("
+		<< round(state.rowCount / seconds) << " rows/s, "
+		<< round(state.sampleCount * sizeof(casa::Complex) / (seconds * 1024.0 * 1024.0)) << " MB/s of visibilities).\n";
+	
 	delete[] correlatorFlags;
 	delete[] correlatorFlagsForBadAntenna;
 	
@@ -227,15 +382,17 @@ void actionCollect(const std::string &filename, enum CollectingMode mode, Statis
 		delete[] frequencies[b];
 	delete[] frequencies;
 	delete[] bands;
-	std::cout << "100\n";
+	
+	if(!state.error.empty())
+		throw std::runtime_error("Error while collecting statistics: " + state.error);
 }
 
-void actionCollect(const std::string &filename, enum CollectingMode mode, bool mwaChannels, size_t flaggedTimesteps, const std::set<size_t> &flaggedAntennae)
+void actionCollect(const std::string &filename, enum CollectingMode mode, bool mwaChannels, size_t flaggedTimesteps, const std::set<size_t> &flaggedAntennae, size_t threadCount)
 {
 	StatisticsCollection statisticsCollection;
 	HistogramCollection histogramCollection;
 	
-	actionCollect(filename, mode, statisticsCollection, histogramCollection, mwaChannels, flaggedTimesteps, flaggedAntennae);
+	actionCollect(filename, mode, statisticsCollection, histogramCollection, mwaChannels, flaggedTimesteps, flaggedAntennae, threadCount);
 	
 	switch(mode)
 	{
@@ -260,10 +417,10 @@ void actionCollect(const std::string &filename, enum CollectingMode mode, bool m
 	std::cout << "Done.\n";
 }
 
-void actionCollectHistogram(const std::string &filename, HistogramCollection &histogramCollection, bool mwaChannels, size_t flaggedTimesteps, const std::set<size_t> &flaggedAntennae)
+void actionCollectHistogram(const std::string &filename, HistogramCollection &histogramCollection, bool mwaChannels, size_t flaggedTimesteps, const std::set<size_t> &flaggedAntennae, size_t threadCount)
 {
 	StatisticsCollection tempCollection;
-	actionCollect(filename, CollectHistograms, tempCollection, histogramCollection, mwaChannels, flaggedTimesteps, flaggedAntennae);
+	actionCollect(filename, CollectHistograms, tempCollection, histogramCollection, mwaChannels, flaggedTimesteps, flaggedAntennae, threadCount);
 }
 
 void printStatistics(std::complex<long double> *complexStat, unsigned count)
@@ -505,6 +662,22 @@ void actionCombine(const std::string outFilename, const std::vector<std::string>
 			
 			// TODO fill quality table
 		}
+		else if(!remote)
+		{
+			// The target already holds quality tables: merge the statistics of the inputs into
+			// them, without rewriting the rows that are already stored.
+			QualityTablesFormatter outFormatter(outFilename);
+			for(std::vector<std::string>::const_iterator i=inFilenames.begin();i!=inFilenames.end();++i)
+			{
+				QualityTablesFormatter inFormatter(*i);
+				StatisticsCollection collection(inFormatter.GetPolarizationCount());
+				collection.Load(inFormatter);
+				collection.SaveIncremental(outFormatter);
+				std::cout << "Merged statistics of " << *i << " into " << outFilename << ".\n";
+			}
+		}
+		else
+			throw std::runtime_error("Can not merge a remote observation into an existing measurement set");
 	}
 }
 
@@ -530,7 +703,7 @@ void printRFISlopeForHistogram(const std::map<HistogramCollection::AntennaPair,
 	}
 }
 
-void actionHistogram(const std::string &filename, const std::string &query, bool mwaChannels)
+void actionHistogram(const std::string &filename, const std::string &query, bool mwaChannels, size_t threadCount)
 {
 	HistogramTablesFormatter histogramFormatter(filename);
 	const unsigned polarizationCount = MeasurementSet::PolarizationCount(filename);
@@ -550,7 +723,7 @@ void actionHistogram(const std::string &filename, const std::string &query, bool
 	} else if(query == "rfislope-per-baseline")
 	{
 		HistogramCollection collection;
-		actionCollectHistogram(filename, collection, mwaChannels, 0, std::set<size_t>());
+		actionCollectHistogram(filename, collection, mwaChannels, 0, std::set<size_t>(), threadCount);
 		MeasurementSet set(filename);
 		size_t antennaCount = set.AntennaCount();
 		std::vector<AntennaInfo> antennae(antennaCount);
@@ -620,7 +793,7 @@ int main(int argc, char *argv[])
 				}
 				else if(helpAction == "collect")
 				{
-					std::cout << "Syntax: " << argv[0] << " collect [-a] <ms> [quack timesteps] [list of antennae]\n\n"
+					std::cout << "Syntax: " << argv[0] << " collect [-h] [-j <threads>] <ms> [quack timesteps] [list of antennae]\n\n"
 						"The collect action will go over a whole measurement set and \n"
 						"collect the default statistics. It will write the results in the \n"
 						"quality subtables of the main measurement set.\n\n"
@@ -629,7 +802,10 @@ int main(int argc, char *argv[])
 						"The subtables that will be updated are:\n"
 						"\tQUALITY_KIND_NAME, QUALITY_TIME_STATISTIC,\n"
 						"\tQUALITY_FREQUENCY_STATISTIC and QUALITY_BASELINE_STATISTIC.\n\n"
-						"-c will use the CORRECTED_DATA column.\n";
+						"-h will collect histograms instead of the default statistics.\n"
+						"-j sets the number of threads; by default, one thread per CPU is used. The\n"
+						"   threads each collect the statistics of a part of the rows, and the results\n"
+						"   are combined at the end.\n";
 				}
 				else if(helpAction == "summarize")
 				{
@@ -655,15 +831,18 @@ int main(int argc, char *argv[])
 				{
 					std::cout << "Syntax: " << argv[0] << " combine <target_ms> [<in_ms> [<in_ms> ..]]\n\n"
 						"This will read all given input measurement sets, combine the statistics and \n"
-						"write the results to a target measurement set. The target measurement set should\n"
-						"not exist beforehand.\n";
+						"write the results to a target measurement set. When the target measurement set\n"
+						"already exists, the statistics of the input measurement sets are added to the\n"
+						"statistics in its quality tables.\n";
 				}
 				else if(helpAction == "histogram")
 				{
-					std::cout << "Syntax: " << argv[0] << " histogram <query> <ms>]\n\n"
+					std::cout << "Syntax: " << argv[0] << " histogram [-j <threads>] <query> <ms>]\n\n"
 						"Query can be:\n"
 						"\trfislope - performs linear regression on the part of the histogram that should contain the RFI.\n"
-						"\t           Reports one value per polarisation.\n";
+						"\t           Reports one value per polarisation.\n"
+						"-j sets the number of threads used to collect histograms when the query requires this;\n"
+						"   by default, one thread per CPU is used.\n";
 				}
 				else if(helpAction == "remove")
 				{
@@ -686,8 +865,30 @@ int main(int argc, char *argv[])
 				return -1;
 			}
 			else {
-				bool histograms = (std::string(argv[2]) == "-h");
-				int argi = histograms ? 3 : 2;
+				bool histograms = false;
+				size_t threadCount = System::ProcessorCount();
+				int argi = 2;
+				while(argi != argc && argv[argi][0] == '-')
+				{
+					const std::string option = argv[argi];
+					if(option == "-h")
+						histograms = true;
+					else if(option == "-j" && argi+1 != argc)
+					{
+						++argi;
+						threadCount = atoi(argv[argi]);
+					}
+					else {
+						std::cerr << "Unknown option for collect: " << option << '\n';
+						return -1;
+					}
+					++argi;
+				}
+				if(argi == argc)
+				{
+					std::cerr << "collect actions needs a measurement set as parameter\n";
+					return -1;
+				}
 				std::string filename = argv[argi];
 				size_t flaggedTimesteps = 0;
 				++argi;
@@ -700,7 +901,7 @@ int main(int argc, char *argv[])
 						++argi;
 					}
 				}
-				actionCollect(filename, histograms ? CollectHistograms : CollectDefault, mwacollect, flaggedTimesteps, flaggedAntennae);
+				actionCollect(filename, histograms ? CollectHistograms : CollectDefault, mwacollect, flaggedTimesteps, flaggedAntennae, threadCount);
 			}
 		}
 		else if(action == "combine")
@@ -720,13 +921,20 @@ int main(int argc, char *argv[])
 		}
 		else if(action == "histogram")
 		{
-			if(argc != 4)
+			size_t threadCount = System::ProcessorCount();
+			int argi = 2;
+			if(argc >= 4 && std::string(argv[2]) == "-j")
+			{
+				threadCount = atoi(argv[3]);
+				argi = 4;
+			}
+			if(argc != argi + 2)
 			{
 				std::cerr << "histogram actions needs two parameters (the query and the measurement set)\n";
 				return -1;
 			}
 			else {
-				actionHistogram(argv[3], argv[2], false);
+				actionHistogram(argv[argi+1], argv[argi], false, threadCount);
 			}
 		}
 		else if(action == "summarize")
@@ -49,6 +49,7 @@ MSOptionWindow::MSOptionWindow(RFIGuiWindow &rfiGUiWindow, StrategyController &s
 	_directReadButton("Direct IO"),
 	_indirectReadButton("Indirect IO"),
 	_memoryReadButton("Memory-mode IO"),
+	_packedMemoryReadButton("Packed memory-mode IO (reduced precision)"),
 	_readUVWButton("Read UVW"),
 	_loadOptimizedStrategy("Load optimized strategy")
 {
@@ -63,10 +64,12 @@ MSOptionWindow::MSOptionWindow(RFIGuiWindow &rfiGUiWindow, StrategyController &s
 	_rightVBox.pack_start(_directReadButton);
 	_rightVBox.pack_start(_indirectReadButton);
 	_rightVBox.pack_start(_memoryReadButton);
+	_rightVBox.pack_start(_packedMemoryReadButton);
 	Gtk::RadioButton::Group group;
 	_directReadButton.set_group(group);
 	_indirectReadButton.set_group(group);
 	_memoryReadButton.set_group(group);
+	_packedMemoryReadButton.set_group(group);
 	_directReadButton.set_active(true);
 
 	_rightVBox.pack_start(_readUVWButton);
@@ -132,6 +135,7 @@ void MSOptionWindow::onOpen()
 		BaselineIOMode ioMode = DirectReadMode;
 		if(_indirectReadButton.get_active()) ioMode = IndirectReadMode;
 		else if(_memoryReadButton.get_active()) ioMode = MemoryReadMode;
+		else if(_packedMemoryReadButton.get_active()) ioMode = PackedMemoryReadMode;
 		bool readUVW = _readUVWButton.get_active();
 		rfiStrategy::ImageSet *imageSet = rfiStrategy::ImageSet::Create(_filename, ioMode);
 		if(dynamic_cast<rfiStrategy::MSImageSet*>(imageSet) != 0)
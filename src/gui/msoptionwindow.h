@@ -56,7 +56,7 @@ class MSOptionWindow : public Gtk::Window {
 		Gtk::RadioButton _observedDataButton, _correctedDataButton, _modelDataButton, _residualDataButton, _otherColumnButton;
 		Gtk::Entry _otherColumnEntry;
 		Gtk::RadioButton _allDipolePolarisationButton, _autoDipolePolarisationButton, _stokesIPolarisationButton;
-		Gtk::RadioButton _directReadButton, _indirectReadButton, _memoryReadButton;
+		Gtk::RadioButton _directReadButton, _indirectReadButton, _memoryReadButton, _packedMemoryReadButton;
 		Gtk::CheckButton _readUVWButton, _loadOptimizedStrategy;
 };
 
@@ -44,6 +44,8 @@ class HighPassFilterFrame : public Gtk::Frame {
 		_vKernelSigmaLabel("Vertical kernel sigma:", Gtk::ALIGN_START),
 		_modeContaminatedButton("Store result (i.e. high-pass filtered) in contaminated"),
 		_modeRevisedButton("Store residual (i.e. low-pass filtered) in revised"),
+		_methodKernelButton("Convolve with Gaussian kernel"),
+		_methodBoxFilterButton("Approximate Gaussian with box filters (faster)"),
 		_applyButton(Gtk::Stock::APPLY)
 		{
 			initScales();
@@ -57,6 +59,16 @@ class HighPassFilterFrame : public Gtk::Frame {
 				_modeContaminatedButton.set_active(true);
 			else
 				_modeRevisedButton.set_active(true);
+			
+			_box.pack_start(_methodKernelButton);
+			_box.pack_start(_methodBoxFilterButton);
+			Gtk::RadioButtonGroup methodGroup;
+			_methodKernelButton.set_group(methodGroup);
+			_methodBoxFilterButton.set_group(methodGroup);
+			if(_action.Method() == HighPassFilter::BoxFilterMethod)
+				_methodBoxFilterButton.set_active(true);
+			else
+				_methodKernelButton.set_active(true);
 		
 			_applyButton.signal_clicked().connect(sigc::mem_fun(*this, &HighPassFilterFrame::onApplyClicked));
 			_box.pack_start(_applyButton);
@@ -96,6 +108,7 @@ class HighPassFilterFrame : public Gtk::Frame {
 			_hWindowSizeLabel, _vWindowSizeLabel,
 			_hKernelSigmaLabel, _vKernelSigmaLabel;
 		Gtk::RadioButton _modeContaminatedButton, _modeRevisedButton;
+		Gtk::RadioButton _methodKernelButton, _methodBoxFilterButton;
 		Gtk::Button _applyButton;
 
 		void onApplyClicked()
@@ -108,6 +121,10 @@ class HighPassFilterFrame : public Gtk::Frame {
 				_action.SetMode(rfiStrategy::HighPassFilterAction::StoreContaminated);
 			else
 				_action.SetMode(rfiStrategy::HighPassFilterAction::StoreRevised);
+			if(_methodBoxFilterButton.get_active())
+				_action.SetMethod(HighPassFilter::BoxFilterMethod);
+			else
+				_action.SetMethod(HighPassFilter::GaussianKernelMethod);
 
 			_editStrategyWindow.UpdateAction(&_action);
 		}
@@ -9,6 +9,7 @@
 #include "../strategy/control/defaultstrategy.h"
 #include "../strategy/control/strategyreader.h"
 
+#include "../util/bandthreadpool.h"
 #include "../util/progresslistener.h"
 
 #include "../quality/statisticscollection.h"
@@ -408,6 +409,11 @@ namespace aoflagger {
 		return flagMask;
 	}
 	
+	void AOFlagger::SetImageThreadCount(size_t threadCount)
+	{
+		BandThreadPool::SetThreadCount(threadCount);
+	}
+	
 	QualityStatistics AOFlagger::MakeQualityStatistics(const double *scanTimes, size_t nScans, const double *channelFrequencies, size_t nChannels, size_t nPolarizations)
 	{
 		return QualityStatistics(scanTimes, nScans, channelFrequencies, nChannels, nPolarizations);
@@ -441,4 +447,10 @@ namespace aoflagger {
 		statistics._data->_implementation->statistics.Save(formatter);
 	}
 	
+	void AOFlagger::MergeStatistics(const QualityStatistics& statistics, const std::string& measurementSetPath)
+	{
+		QualityTablesFormatter formatter(measurementSetPath);
+		statistics._data->_implementation->statistics.SaveIncremental(formatter);
+	}
+	
 } // end of namespace aoflagger
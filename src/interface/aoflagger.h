@@ -584,6 +584,21 @@ namespace aoflagger {
 			 */
 			FlagMask Run(Strategy& strategy, ImageSet& input);
 			
+			/** @brief Set the number of threads that process a single image set.
+			 * 
+			 * By default, Run() processes an image set on the calling thread. Applications
+			 * that call Run() for many baselines from different threads should keep it that
+			 * way. When there are only a few, very large image sets to flag, e.g. for a
+			 * single dish, the heavy parts of the strategy can instead be split over several
+			 * threads, so that one image set uses all cores. The threads are shared by all
+			 * calls to Run() and the result does not depend on their number.
+			 * 
+			 * This should not be called while Run() is being executed.
+			 * @param threadCount Number of threads, including the thread that calls Run().
+			 * A value of one disables the splitting.
+			 */
+			void SetImageThreadCount(size_t threadCount);
+			
 			/** @brief Create a new object for collecting statistics.
 			 * 
 			 * See the QualityStatistics class description for info on multithreading and/or combining statistics
@@ -618,6 +633,18 @@ namespace aoflagger {
 			 */
 			void WriteStatistics(const QualityStatistics& statistics, const std::string& measurementSetPath);
 			
+			/** @brief Add collected statistics to the statistics that are stored in a measurement set.
+			 * 
+			 * Unlike @ref WriteStatistics(), which replaces the statistics in the measurement set, this
+			 * sums the statistics with the stored statistics of the same time, frequency or baseline,
+			 * and only appends new entries. This is useful when a measurement set is flagged in
+			 * several parts, e.g. one time range at a time.
+			 * @param statistics The collected statistics
+			 * @param measurementSetPath Path to measurement set to which the statistics will
+			 * be added.
+			 */
+			void MergeStatistics(const QualityStatistics& statistics, const std::string& measurementSetPath);
+			
 		private:
 			/** @brief It is not allowed to copy this class
 			 */
@@ -22,6 +22,8 @@
 #include <set>
 #include <stdexcept>
 
+#include <xmmintrin.h>
+
 #include <ms/MeasurementSets/MeasurementSet.h>
 
 #include <tables/Tables/ExprNode.h>
@@ -30,12 +32,13 @@
 #include <tables/Tables/TableIter.h>
 #include <tables/Tables/TiledStManAccessor.h>
 
+#include "flagwriter.h"
 #include "timefrequencydata.h"
 
 #include "../util/aologger.h"
 
 BaselineReader::BaselineReader(const std::string &msFile)
-	: _measurementSet(msFile), _table(0), _dataColumnName("DATA"), _subtractModel(false), _readData(true), _readFlags(true),
+	: _measurementSet(msFile), _table(0), _flagWriter(0), _dataColumnName("DATA"), _subtractModel(false), _readData(true), _readFlags(true),
 	_polarizationCount(0)
 {
 	try {
@@ -50,9 +53,30 @@ BaselineReader::BaselineReader(const std::string &msFile)
 
 BaselineReader::~BaselineReader()
 {
+	closeFlagWriter();
 	delete _table;
 }
 
+FlagWriter &BaselineReader::flagWriter()
+{
+	if(_flagWriter == 0)
+		_flagWriter = new FlagWriter(*_table, _casaMutex, PolarizationCount());
+	return *_flagWriter;
+}
+
+void BaselineReader::FinishFlagWriting()
+{
+	if(_flagWriter != 0)
+		_flagWriter->Finish();
+}
+
+void BaselineReader::closeFlagWriter()
+{
+	// The destructor of the writer waits for it to finish
+	delete _flagWriter;
+	_flagWriter = 0;
+}
+
 void BaselineReader::initObservationTimes()
 {
 	if(_observationTimes.size() == 0)
@@ -155,6 +179,70 @@ void BaselineReader::initializePolarizations()
 	}
 }
 
+void BaselineReader::copyTimeSteps(const float *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, std::vector<Image2DPtr> &realImages, std::vector<Image2DPtr> &imaginaryImages)
+{
+	size_t x = 0;
+#ifdef NUM_T_IS_FLOAT
+	if(polarizationCount == 4)
+	{
+		// Four time steps are processed at once. Of each, the complex values of the
+		// four polarizations of a channel are split into real and imaginary parts,
+		// after which the 4x4 matrices of (time step, polarization) are transposed,
+		// so that each polarization can store four consecutive time steps.
+		for(;x+4<=width;x+=4)
+		{
+			for(size_t f=0;f<channelCount;++f)
+			{
+				__m128 real[4], imaginary[4];
+				for(size_t t=0;t<4;++t)
+				{
+					const float *sample = timeSteps[x + t] + f * 8;
+					__m128 first = _mm_loadu_ps(sample), second = _mm_loadu_ps(sample + 4);
+					real[t] = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+					imaginary[t] = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+				}
+				_MM_TRANSPOSE4_PS(real[0], real[1], real[2], real[3]);
+				_MM_TRANSPOSE4_PS(imaginary[0], imaginary[1], imaginary[2], imaginary[3]);
+				for(size_t p=0;p<4;++p)
+				{
+					_mm_storeu_ps(realImages[p]->ValuePtr(startX + x, f), real[p]);
+					_mm_storeu_ps(imaginaryImages[p]->ValuePtr(startX + x, f), imaginary[p]);
+				}
+			}
+		}
+	}
+#endif
+	for(;x<width;++x)
+	{
+		const float *sample = timeSteps[x];
+		for(size_t f=0;f<channelCount;++f)
+		{
+			for(size_t p=0;p<polarizationCount;++p)
+			{
+				realImages[p]->SetValue(startX + x, f, sample[0]);
+				imaginaryImages[p]->SetValue(startX + x, f, sample[1]);
+				sample += 2;
+			}
+		}
+	}
+}
+
+void BaselineReader::copyFlagTimeSteps(const bool *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, std::vector<Mask2DPtr> &masks)
+{
+	for(size_t x=0;x<width;++x)
+	{
+		const bool *flags = timeSteps[x];
+		for(size_t f=0;f<channelCount;++f)
+		{
+			for(size_t p=0;p<polarizationCount;++p)
+			{
+				masks[p]->SetValue(startX + x, f, *flags);
+				++flags;
+			}
+		}
+	}
+}
+
 uint64_t BaselineReader::MeasurementSetDataSize(const string& filename)
 {
 	casa::MeasurementSet ms(filename);
@@ -25,6 +25,7 @@
 #include <stdexcept>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "antennainfo.h"
 #include "image2d.h"
@@ -80,9 +81,24 @@ class BaselineReader {
 		{
 			addReadRequest(antenna1, antenna2, spectralWindow, sequenceId, startIndex, endIndex);
 		}
+		/**
+		 * Reads the requested baselines. One thread may perform reads while another
+		 * performs flag writes: the readers lock the table themselves, and the state that
+		 * reads and writes share is initialized by the first read, which precedes the
+		 * first write. Calls to the read functions should be serialized by the caller, as
+		 * should calls to the write functions.
+		 */
 		virtual void PerformReadRequests() = 0;
 		
 		void AddWriteTask(std::vector<Mask2DCPtr> flags, int antenna1, int antenna2, int spectralWindow, unsigned sequenceId)
+		{
+			AddWriteTask(flags, antenna1, antenna2, spectralWindow, sequenceId, 0, flags[0]->Width(), 0, 0);
+		}
+		/**
+		 * Adds a task to write the flags of the time steps startIndex to endIndex, except
+		 * for the left and right border time steps, which are overlapping context only.
+		 */
+		void AddWriteTask(std::vector<Mask2DCPtr> flags, int antenna1, int antenna2, int spectralWindow, unsigned sequenceId, size_t startIndex, size_t endIndex, size_t leftBorder, size_t rightBorder)
 		{
 			initializePolarizations();
 			if(flags.size() != _polarizationCount)
@@ -97,13 +113,21 @@ class BaselineReader {
 			task.antenna2 = antenna2;
 			task.spectralWindow = spectralWindow;
 			task.sequenceId = sequenceId;
-			task.startIndex = 0;
-			task.endIndex = flags[0]->Width();
-			task.leftBorder = 0;
-			task.rightBorder = 0;
+			task.startIndex = startIndex;
+			task.endIndex = endIndex;
+			task.leftBorder = leftBorder;
+			task.rightBorder = rightBorder;
 			_writeRequests.push_back(task);
 		}
 		virtual void PerformFlagWriteRequests() = 0;
+		
+		/**
+		 * Flags are written to the set on a separate thread, so they might not yet be
+		 * stored when PerformFlagWriteRequests() returns. This waits until they are.
+		 * @throws std::runtime_error if writing the flags failed.
+		 */
+		void FinishFlagWriting();
+		
 		virtual void PerformDataWriteTask(std::vector<Image2DCPtr> _realImages, std::vector<Image2DCPtr> _imaginaryImages, int antenna1, int antenna2, int spectralWindow, unsigned sequenceId) = 0;
 		
 		class TimeFrequencyData GetNextResult(std::vector<class UVW> &uvw);
@@ -111,6 +135,13 @@ class BaselineReader {
 		virtual size_t GetMinRecommendedBufferSize(size_t threadCount) { return threadCount; }
 		virtual size_t GetMaxRecommendedBufferSize(size_t threadCount) { return 2*threadCount; }
 		
+		/**
+		 * Whether the reader makes baselines available while the rest of the set is
+		 * still being read. Since this happens in the order of the sequences, baselines
+		 * should then be requested in that order.
+		 */
+		virtual bool LoadsIncrementally() const { return false; }
+		
 		static uint64_t MeasurementSetDataSize(const std::string &filename);
 	protected:
 		struct ReadRequest {
@@ -176,11 +207,39 @@ class BaselineReader {
 			std::vector<class UVW> _uvw;
 			class BandInfo _bandInfo;
 		};
+		/**
+		 * Splits the samples of consecutive time steps into the images of the polarizations.
+		 * Each time step holds, for each channel, the complex values of all polarizations.
+		 * @param timeSteps Pointers to the samples of each time step.
+		 * @param startX The first time index in the images that is written.
+		 */
+		static void copyTimeSteps(const float *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, std::vector<Image2DPtr> &realImages, std::vector<Image2DPtr> &imaginaryImages);
+		
+		/**
+		 * Like copyTimeSteps(), but for flags.
+		 */
+		static void copyFlagTimeSteps(const bool *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, std::vector<Mask2DPtr> &masks);
+		
 		void initializeMeta()
 		{
 			initObservationTimes();
 			initializePolarizations();
 		}
+		
+		/**
+		 * The writer that writes flags back to the set. It is created when it is first
+		 * used, and runs until closeFlagWriter() is called or the reader is destructed.
+		 */
+		class FlagWriter &flagWriter();
+		
+		/**
+		 * Waits until all flags are written and removes the flag writer. Errors are
+		 * logged instead of thrown, so that this can be called from a destructor.
+		 */
+		void closeFlagWriter();
+		
+		// Casacore is not thread safe, so all threads that access the table lock this mutex
+		boost::mutex _casaMutex;
 		//casa::ROArrayColumn<casa::Complex> *CreateDataColumn(const std::string &columnName, class casa::Table &table);
 		//casa::ArrayColumn<casa::Complex> *CreateDataColumnRW(const std::string &columnName, class casa::Table &table);
 
@@ -205,6 +264,7 @@ class BaselineReader {
 
 		MeasurementSet _measurementSet;
 		class casa::MeasurementSet *_table;
+		class FlagWriter *_flagWriter;
 		
 		std::string _dataColumnName;
 		bool _subtractModel;
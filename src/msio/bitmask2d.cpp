@@ -0,0 +1,258 @@
+#include "bitmask2d.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+BitMask2D::BitMask2D(size_t width, size_t height) :
+	_width(width),
+	_height(height),
+	_wordStride(0),
+	_wordsPerRow((width + BitsPerWord - 1) / BitsPerWord)
+{
+	// Round the stride up to two words, so that each row is 16-byte aligned
+	_wordStride = ((_wordsPerRow + 1) / 2) * 2;
+	size_t allocSize = _wordStride * height;
+	if(allocSize == 0) allocSize = 2;
+#ifdef __APPLE__
+	// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
+	_data = (word_t*) malloc(allocSize * sizeof(word_t));
+#else
+	if(posix_memalign((void **) &_data, 16, allocSize * sizeof(word_t)) != 0)
+		throw std::bad_alloc();
+#endif
+	// Unlike Mask2D, the padding needs to be initialized, because all operations
+	// assume it to be false.
+	memset(_data, 0, allocSize * sizeof(word_t));
+	_rows = new word_t*[height];
+	for(size_t y=0;y<height;++y)
+		_rows[y] = &_data[_wordStride * y];
+}
+
+BitMask2D::~BitMask2D()
+{
+	delete[] _rows;
+	free(_data);
+}
+
+BitMask2D *BitMask2D::CreateCopy(const BitMask2D &source)
+{
+	BitMask2D *newMask = new BitMask2D(source._width, source._height);
+	memcpy(newMask->_data, source._data, source._wordStride * source._height * sizeof(word_t));
+	return newMask;
+}
+
+BitMask2D *BitMask2D::CreateFromMask(const Mask2D &source)
+{
+	BitMask2D *newMask = new BitMask2D(source.Width(), source.Height());
+	newMask->SetFrom(source);
+	return newMask;
+}
+
+void BitMask2D::SetFrom(const Mask2D &source)
+{
+	for(size_t y=0;y<_height;++y)
+	{
+		const bool *srcPtr = source.ValuePtr(0, y);
+		word_t *destPtr = _rows[y];
+		for(size_t w=0;w<_wordsPerRow;++w)
+		{
+			const size_t xStart = w * BitsPerWord;
+			const size_t n = (_width - xStart < BitsPerWord) ? (_width - xStart) : BitsPerWord;
+			word_t word = 0;
+			size_t i = 0;
+			// Pack eight bools at a time: since every byte is either 0 or 1, the
+			// multiplication moves the lowest bit of byte i to bit 56+i without carries.
+			// This assumes a little endian machine, as does the SSE code elsewhere.
+			for(;i+8<=n;i+=8)
+			{
+				uint64_t eightBools;
+				memcpy(&eightBools, srcPtr + xStart + i, 8);
+				word |= ((eightBools * 0x0102040810204080ULL) >> 56) << i;
+			}
+			for(;i<n;++i)
+				word |= word_t(srcPtr[xStart + i]) << i;
+			destPtr[w] = word;
+		}
+	}
+}
+
+void BitMask2D::CopyTo(Mask2D &destination) const
+{
+	for(size_t y=0;y<_height;++y)
+	{
+		bool *destPtr = destination.ValuePtr(0, y);
+		const word_t *srcPtr = _rows[y];
+		for(size_t w=0;w<_wordsPerRow;++w)
+		{
+			const size_t xStart = w * BitsPerWord;
+			const size_t n = (_width - xStart < BitsPerWord) ? (_width - xStart) : BitsPerWord;
+			const word_t word = srcPtr[w];
+			size_t i = 0;
+			// Spread eight bits over eight bytes: byte i keeps only bit i, after which
+			// adding 0x7F sets the high bit of each non-zero byte.
+			for(;i+8<=n;i+=8)
+			{
+				const uint64_t byte = (word >> i) & 0xFF;
+				const uint64_t spread = ((byte * 0x0101010101010101ULL) & 0x8040201008040201ULL) + 0x7F7F7F7F7F7F7F7FULL;
+				const uint64_t eightBools = (spread >> 7) & 0x0101010101010101ULL;
+				memcpy(destPtr + xStart + i, &eightBools, 8);
+			}
+			for(;i<n;++i)
+				destPtr[xStart + i] = (word >> i) & 1;
+		}
+	}
+}
+
+void BitMask2D::Join(const BitMask2D &other)
+{
+	const size_t n = _wordStride * _height;
+	for(size_t i=0;i<n;++i)
+		_data[i] |= other._data[i];
+}
+
+void BitMask2D::Intersect(const BitMask2D &other)
+{
+	const size_t n = _wordStride * _height;
+	for(size_t i=0;i<n;++i)
+		_data[i] &= other._data[i];
+}
+
+void BitMask2D::Invert()
+{
+	const size_t n = _wordStride * _height;
+	for(size_t i=0;i<n;++i)
+		_data[i] = ~_data[i];
+	clearPadding();
+}
+
+size_t BitMask2D::countTrue() const
+{
+	// Padding bits are false, so the whole buffer can be counted
+	const size_t n = _wordStride * _height;
+	size_t count = 0;
+	for(size_t i=0;i<n;++i)
+		count += __builtin_popcountll(_data[i]);
+	return count;
+}
+
+bool BitMask2D::AllFalse() const
+{
+	const size_t n = _wordStride * _height;
+	word_t combined = 0;
+	for(size_t i=0;i<n;++i)
+		combined |= _data[i];
+	return combined == 0;
+}
+
+bool BitMask2D::Equals(const BitMask2D &other) const
+{
+	if(_width != other._width || _height != other._height)
+		return false;
+	return memcmp(_data, other._data, _wordStride * _height * sizeof(word_t)) == 0;
+}
+
+void BitMask2D::clearPadding()
+{
+	const size_t usedBits = _width % BitsPerWord;
+	const word_t lastWordMask = (usedBits == 0) ? ~word_t(0) : ((word_t(1) << usedBits) - 1);
+	for(size_t y=0;y<_height;++y)
+	{
+		if(_wordsPerRow != 0)
+			_rows[y][_wordsPerRow-1] &= lastWordMask;
+		for(size_t w=_wordsPerRow;w<_wordStride;++w)
+			_rows[y][w] = 0;
+	}
+}
+
+void BitMask2D::orShiftedRow(word_t *dest, const word_t *src, long shift) const
+{
+	const size_t n = _wordsPerRow;
+	if(shift >= 0)
+	{
+		const size_t q = shift / BitsPerWord, r = shift % BitsPerWord;
+		for(size_t w=q;w<n;++w)
+		{
+			word_t v = src[w-q] << r;
+			if(r != 0 && w-q >= 1)
+				v |= src[w-q-1] >> (BitsPerWord - r);
+			dest[w] |= v;
+		}
+	} else {
+		const size_t q = (-shift) / BitsPerWord, r = (-shift) % BitsPerWord;
+		for(size_t w=0;w+q<n;++w)
+		{
+			word_t v = src[w+q] >> r;
+			if(r != 0 && w+q+1 < n)
+				v |= src[w+q+1] << (BitsPerWord - r);
+			dest[w] |= v;
+		}
+	}
+}
+
+void BitMask2D::DilateHorizontally(size_t distance)
+{
+	if(distance == 0 || _width == 0)
+		return;
+	if(distance > _width) distance = _width;
+
+	// After step k, each row holds the or of the original flags over [x-a, x+a].
+	// Combining that with itself shifted by b <= 2a+1 in both directions gives the
+	// or over [x-a-b, x+a+b], so the reach roughly triples each step.
+	std::vector<word_t> temp(_wordsPerRow);
+	for(size_t y=0;y<_height;++y)
+	{
+		word_t *row = _rows[y];
+		size_t a = 0;
+		while(a < distance)
+		{
+			size_t b = 2*a + 1;
+			if(b > distance - a) b = distance - a;
+			memcpy(&temp[0], row, _wordsPerRow * sizeof(word_t));
+			orShiftedRow(row, &temp[0], b);
+			orShiftedRow(row, &temp[0], -(long) b);
+
+			// Samples within b of the border combine with the border sample, which
+			// covers everything up to a from the border.
+			if(temp[0] & 1)
+			{
+				for(size_t x=0;x<b;++x)
+					SetValue(x, y, true);
+			}
+			if((temp[(_width-1) / BitsPerWord] >> ((_width-1) % BitsPerWord)) & 1)
+			{
+				for(size_t x=_width-b;x<_width;++x)
+					SetValue(x, y, true);
+			}
+			a += b;
+		}
+	}
+	clearPadding();
+}
+
+void BitMask2D::DilateVertically(size_t distance)
+{
+	if(distance == 0 || _height == 0)
+		return;
+	if(distance > _height) distance = _height;
+
+	// Same approach as DilateHorizontally(), but whole rows are combined.
+	BitMask2D temp(_width, _height);
+	size_t a = 0;
+	while(a < distance)
+	{
+		size_t b = 2*a + 1;
+		if(b > distance - a) b = distance - a;
+		memcpy(temp._data, _data, _wordStride * _height * sizeof(word_t));
+		for(size_t y=0;y<_height;++y)
+		{
+			const word_t
+				*above = temp._rows[y >= b ? y-b : 0],
+				*below = temp._rows[y+b < _height ? y+b : _height-1];
+			word_t *row = _rows[y];
+			for(size_t w=0;w<_wordsPerRow;++w)
+				row[w] |= above[w] | below[w];
+		}
+		a += b;
+	}
+}
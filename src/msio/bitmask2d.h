@@ -0,0 +1,212 @@
+#ifndef BITMASK2D_H
+#define BITMASK2D_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "mask2d.h"
+
+typedef boost::shared_ptr<class BitMask2D> BitMask2DPtr;
+typedef boost::shared_ptr<const class BitMask2D> BitMask2DCPtr;
+
+/**
+ * A two dimensional flag mask that stores one bit per sample instead of the one
+ * byte per sample used by Mask2D. Samples are packed 64 per word, with bit (x % 64)
+ * of word (x / 64) holding the flag of column x. Each row starts at a 16-byte
+ * aligned word, such that rows can be processed with SIMD instructions as well.
+ *
+ * Because 64 flags are combined in a single operation, combining masks (Join(),
+ * Intersect()), counting flags (GetCount()) and dilating flags run at memory
+ * bandwidth, and a BitMask2D takes 8 times less memory than a Mask2D of the same
+ * size. The class can be converted from and to a Mask2D with CreateFromMask() and
+ * CopyTo(). The flagging pipeline itself, including the AOFlagger interface, keeps
+ * using Mask2D; BitMask2D is used where masks are temporary or held for a longer
+ * time: inside the dilation of the statistical flagger, for the flags stored by
+ * the memory baseline reader and for the flags buffered by the WriteFlagsAction.
+ *
+ * The bits after the width of a row are always kept false. All operations rely
+ * on this, e.g. to count without having to mask out the last word of each row.
+ */
+class BitMask2D {
+	public:
+		typedef uint64_t word_t;
+
+		static const size_t BitsPerWord = 64;
+
+		~BitMask2D();
+
+		static BitMask2D *CreateUnsetMask(size_t width, size_t height)
+		{
+			return new BitMask2D(width, height);
+		}
+		static BitMask2DPtr CreateUnsetMaskPtr(size_t width, size_t height)
+		{
+			return BitMask2DPtr(new BitMask2D(width, height));
+		}
+
+		template<bool InitValue>
+		static BitMask2D *CreateSetMask(size_t width, size_t height)
+		{
+			BitMask2D *newMask = new BitMask2D(width, height);
+			newMask->SetAll<InitValue>();
+			return newMask;
+		}
+
+		template<bool InitValue>
+		static BitMask2DPtr CreateSetMaskPtr(size_t width, size_t height)
+		{
+			return BitMask2DPtr(CreateSetMask<InitValue>(width, height));
+		}
+
+		static BitMask2D *CreateCopy(const BitMask2D &source);
+		static BitMask2DPtr CreateCopy(BitMask2DCPtr source)
+		{
+			return BitMask2DPtr(CreateCopy(*source));
+		}
+
+		/**
+		 * Creates a packed mask with the same flags as the given Mask2D.
+		 */
+		static BitMask2D *CreateFromMask(const Mask2D &source);
+		static BitMask2DPtr CreateFromMask(Mask2DCPtr source)
+		{
+			return BitMask2DPtr(CreateFromMask(*source));
+		}
+
+		/**
+		 * Unpacks the flags into the given Mask2D, which should have the same
+		 * size as this mask.
+		 */
+		void CopyTo(Mask2D &destination) const;
+		void CopyTo(Mask2DPtr destination) const
+		{
+			CopyTo(*destination);
+		}
+
+		/**
+		 * Creates a new (unpacked) Mask2D with the same flags as this mask.
+		 */
+		Mask2DPtr CreateMask() const
+		{
+			Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(_width, _height);
+			CopyTo(*mask);
+			return mask;
+		}
+
+		/**
+		 * Packs the flags of the given Mask2D into this mask, which should have the
+		 * same size.
+		 */
+		void SetFrom(const Mask2D &source);
+
+		inline bool Value(size_t x, size_t y) const
+		{
+			return (_rows[y][x / BitsPerWord] >> (x % BitsPerWord)) & 1;
+		}
+
+		inline void SetValue(size_t x, size_t y, bool newValue)
+		{
+			const word_t bit = word_t(1) << (x % BitsPerWord);
+			if(newValue)
+				_rows[y][x / BitsPerWord] |= bit;
+			else
+				_rows[y][x / BitsPerWord] &= ~bit;
+		}
+
+		inline size_t Width() const { return _width; }
+
+		inline size_t Height() const { return _height; }
+
+		/**
+		 * Number of words in one row, including the alignment padding. Use this to
+		 * step from one row to the next when using RowPtr().
+		 */
+		inline size_t WordStride() const { return _wordStride; }
+
+		/**
+		 * Number of words that contain samples in one row, i.e., ceil(Width() / 64).
+		 */
+		inline size_t WordsPerRow() const { return _wordsPerRow; }
+
+		inline word_t *RowPtr(size_t y) { return _rows[y]; }
+
+		inline const word_t *RowPtr(size_t y) const { return _rows[y]; }
+
+		template<bool NewValue>
+		void SetAll()
+		{
+			memset(_data, NewValue ? 0xFF : 0x00, _wordStride * _height * sizeof(word_t));
+			if(NewValue)
+				clearPadding();
+		}
+
+		void Join(const BitMask2D &other);
+
+		void Join(BitMask2DCPtr other) { Join(*other); }
+
+		void Intersect(const BitMask2D &other);
+
+		void Intersect(BitMask2DCPtr other) { Intersect(*other); }
+
+		void Invert();
+
+		template<bool BoolValue>
+		size_t GetCount() const
+		{
+			const size_t trueCount = countTrue();
+			return BoolValue ? trueCount : (_width * _height - trueCount);
+		}
+
+		bool AllFalse() const;
+
+		bool Equals(const BitMask2D &other) const;
+
+		/**
+		 * Flags every sample that has a flagged sample within a horizontal distance of
+		 * @p distance. The result is identical to
+		 * StatisticalFlagger::DilateFlagsHorizontally(), but is calculated with
+		 * O(log(distance)) whole-word shift operations per row.
+		 */
+		void DilateHorizontally(size_t distance);
+
+		/**
+		 * Vertical counterpart of DilateHorizontally(); whole rows are combined with
+		 * word-wide or-operations.
+		 */
+		void DilateVertically(size_t distance);
+
+		void Swap(BitMask2D &source)
+		{
+			std::swap(source._width, _width);
+			std::swap(source._height, _height);
+			std::swap(source._wordStride, _wordStride);
+			std::swap(source._wordsPerRow, _wordsPerRow);
+			std::swap(source._rows, _rows);
+			std::swap(source._data, _data);
+		}
+	private:
+		BitMask2D(size_t width, size_t height);
+
+		// Not implemented
+		BitMask2D(const BitMask2D &source);
+		void operator=(const BitMask2D &source);
+
+		size_t countTrue() const;
+		void clearPadding();
+
+		/**
+		 * Ors the row @p src, shifted by @p shift bits, into @p dest. A positive shift
+		 * moves flags to higher x values, a negative shift to lower x values. Bits
+		 * that are shifted out of the row are discarded.
+		 */
+		void orShiftedRow(word_t *dest, const word_t *src, long shift) const;
+
+		size_t _width, _height;
+		size_t _wordStride, _wordsPerRow;
+		word_t **_rows;
+		word_t *_data;
+};
+
+#endif
@@ -19,6 +19,8 @@
  ***************************************************************************/
 #include "directbaselinereader.h"
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <set>
 #include <stdexcept>
@@ -27,18 +29,21 @@
 #include <ms/MeasurementSets/MeasurementSet.h>
 
 #include "arraycolumniterator.h"
+#include "flagwriter.h"
 #include "scalarcolumniterator.h"
 #include "timefrequencydata.h"
 
 #include "../util/aologger.h"
 #include "../util/stopwatch.h"
 
-DirectBaselineReader::DirectBaselineReader(const std::string &msFile) : BaselineReader(msFile)
+DirectBaselineReader::DirectBaselineReader(const std::string &msFile) : BaselineReader(msFile),
+	_readRowCount(0), _readByteCount(0), _readingTime(0.0), _decodingTime(0.0)
 {
 }
 
 DirectBaselineReader::~DirectBaselineReader()
 {
+	closeFlagWriter();
 	ShowStatistics();
 }
 
@@ -52,10 +57,12 @@ void DirectBaselineReader::initBaselineCache()
 		std::vector<size_t> dataIdToSpw;
 		Set().GetDataDescToBandVector(dataIdToSpw);
 		
+		boost::mutex::scoped_lock lock(_casaMutex);
 		casa::ROScalarColumn<int> antenna1Column(*Table(), "ANTENNA1"); 
 		casa::ROScalarColumn<int> antenna2Column(*Table(), "ANTENNA2");
 		casa::ROScalarColumn<int> dataDescIdColumn(*Table(), "DATA_DESC_ID");
 		casa::ROScalarColumn<int> fieldIdColumn(*Table(), "FIELD_ID");
+		casa::ROScalarColumn<double> timeColumn(*Table(), "TIME");
 		
 		int prevFieldId = -1, sequenceId = -1;
 		for(size_t i=0;i<Table()->nrow();++i) {
@@ -70,12 +77,13 @@ void DirectBaselineReader::initBaselineCache()
 				sequenceId++;
 			}
 			int spectralWindow = dataIdToSpw[dataDescId];
-			addRowToBaselineCache(antenna1, antenna2, spectralWindow, sequenceId, i);
+			size_t timeIndex = ObservationTimes(sequenceId).find(timeColumn(i))->second;
+			addRowToBaselineCache(antenna1, antenna2, spectralWindow, sequenceId, i, timeIndex);
 		}
 	}
 }
 
-void DirectBaselineReader::addRowToBaselineCache(int antenna1, int antenna2, int spectralWindow, int sequenceId, size_t row)
+void DirectBaselineReader::addRowToBaselineCache(int antenna1, int antenna2, int spectralWindow, int sequenceId, size_t row, size_t timeIndex)
 {
 	BaselineCacheIndex searchItem;
 	searchItem.antenna1 = antenna1;
@@ -87,9 +95,11 @@ void DirectBaselineReader::addRowToBaselineCache(int antenna1, int antenna2, int
 	{
 		BaselineCacheValue cacheValue;
 		cacheValue.rows.push_back(row);
+		cacheValue.timeIndices.push_back(timeIndex);
 		_baselineCache.insert(std::make_pair(searchItem, cacheValue));
 	} else {
 		cacheItemIter->second.rows.push_back(row);
+		cacheItemIter->second.timeIndices.push_back(timeIndex);
 	}
 }
 
@@ -109,20 +119,18 @@ void DirectBaselineReader::addRequestRows(ReadRequest request, size_t requestInd
 	}
 }
 
-void DirectBaselineReader::addRequestRows(FlagWriteRequest request, size_t requestIndex, std::vector<std::pair<size_t, size_t> > &rows)
+const DirectBaselineReader::BaselineCacheValue *DirectBaselineReader::findBaselineCache(const FlagWriteRequest &request) const
 {
 	BaselineCacheIndex searchItem;
 	searchItem.antenna1 = request.antenna1;
 	searchItem.antenna2 = request.antenna2;
 	searchItem.spectralWindow = request.spectralWindow;
 	searchItem.sequenceId = request.sequenceId;
-	std::map<BaselineCacheIndex,BaselineCacheValue>::iterator cacheItemIter = _baselineCache.find(searchItem);
-	if(cacheItemIter != _baselineCache.end())
-	{
-		const std::vector<size_t> &cacheRows = cacheItemIter->second.rows;
-		for(std::vector<size_t>::const_iterator j=cacheRows.begin();j!=cacheRows.end();++j)
-			rows.push_back(std::pair<size_t, size_t>(*j, requestIndex));
-	}
+	std::map<BaselineCacheIndex,BaselineCacheValue>::const_iterator cacheItemIter = _baselineCache.find(searchItem);
+	if(cacheItemIter == _baselineCache.end())
+		return 0;
+	else
+		return &cacheItemIter->second;
 }
 
 void DirectBaselineReader::PerformReadRequests()
@@ -182,63 +190,228 @@ void DirectBaselineReader::PerformReadRequests()
 
 	casa::Table &table = *Table();
 
+	// The flag writer can access the table at the same time, so it is locked during reading
+	boost::mutex::scoped_lock casaLock(_casaMutex);
 	casa::ROScalarColumn<double> timeColumn(table, "TIME");
-	casa::ROArrayColumn<float> weightColumn(table, "WEIGHT");
 	casa::ROArrayColumn<double> uvwColumn(table, "UVW");
 	casa::ROArrayColumn<bool> flagColumn(table, "FLAG");
-	casa::ROArrayColumn<casa::Complex> *modelColumn;
-
-	casa::ROArrayColumn<casa::Complex> *dataColumn = 0;
+	std::auto_ptr<casa::ROArrayColumn<casa::Complex> > dataColumn;
 	if(ReadData())
-		dataColumn = new casa::ROArrayColumn<casa::Complex>(table, DataColumnName());
+		dataColumn.reset(new casa::ROArrayColumn<casa::Complex>(table, DataColumnName()));
+	
+	std::vector<RowRange> ranges;
+	findRowRanges(rows, ranges);
+
+	casa::Vector<double> timeArray;
+	casa::Array<casa::Complex> dataArray;
+	casa::Array<bool> flagArray;
+	casa::Array<double> uvwArray;
+	Stopwatch readWatch, decodeWatch;
+	size_t rowCount = 0;
+	uint64_t byteCount = 0;
+	for(std::vector<RowRange>::const_iterator range=ranges.begin();range!=ranges.end();++range)
+	{
+		casa::Slicer rowSlicer(casa::IPosition(1, range->startRow), casa::IPosition(1, range->rowCount), casa::IPosition(1, range->rowStride), casa::Slicer::endIsLength);
+		const size_t sampleCount = range->rowCount * range->channelCount * PolarizationCount();
+		
+		readWatch.Start();
+		timeColumn.getColumnRange(rowSlicer, timeArray, true);
+		uvwColumn.getColumnRange(rowSlicer, uvwArray, true);
+		byteCount += range->rowCount * sizeof(double) * 4;
+		if(ReadData())
+		{
+			dataColumn->getColumnRange(rowSlicer, dataArray, true);
+			byteCount += sampleCount * sizeof(casa::Complex);
+		}
+		if(ReadFlags())
+		{
+			flagColumn.getColumnRange(rowSlicer, flagArray, true);
+			byteCount += sampleCount * sizeof(bool);
+		}
+		readWatch.Pause();
+		rowCount += range->rowCount;
+		casaLock.unlock();
+		
+		decodeWatch.Start();
+		const float *data = ReadData() ? reinterpret_cast<const float*>(dataArray.data()) : 0;
+		readRowRange(*range, rows, timeArray.data(), data, ReadFlags() ? flagArray.data() : 0, uvwArray.data());
+		decodeWatch.Pause();
+		casaLock.lock();
+	}
+	
+	_readRowCount += rowCount;
+	_readByteCount += byteCount;
+	_readingTime += readWatch.Seconds();
+	_decodingTime += decodeWatch.Seconds();
+	const long double seconds = stopwatch.Seconds();
+	AOLogger::Debug << "Read " << rowCount << " rows (" << (byteCount/1000000) << " MB) in " << ranges.size() << " ranges in " << stopwatch.ToString();
+	if(seconds > 0.0)
+		AOLogger::Debug << ": " << (size_t) (rowCount / seconds) << " rows/s, " << (byteCount / seconds / 1000000.0) << " MB/s";
+	AOLogger::Debug << " (reading columns: " << readWatch.ToString() << ", decoding: " << decodeWatch.ToString() << ").\n";
 
-	if(SubtractModel()) {
-		modelColumn = new casa::ROArrayColumn<casa::Complex>(table, "MODEL_DATA");
-	} else {
-		modelColumn = 0;
+	_readRequests.clear();
+}
+
+/**
+ * Splits the sorted rows in ranges that can each be read with one call per column.
+ * In a set that is ordered on baseline, the rows of a request are consecutive. In a set
+ * that is ordered on time, the rows of a batch of a few baselines are mostly isolated,
+ * but the rows of one baseline recur at a constant distance. Hence, the rows are
+ * split both in consecutive and in strided ranges, and the split with the fewest ranges
+ * is used. Both read only rows that are requested, except that a row that is needed by
+ * several requests is read once per request in a strided split.
+ */
+void DirectBaselineReader::findRowRanges(const std::vector<std::pair<size_t, size_t> > &rows, std::vector<RowRange> &ranges)
+{
+	findConsecutiveRowRanges(rows, ranges);
+	if(ranges.size() > _readRequests.size())
+	{
+		std::vector<RowRange> stridedRanges;
+		findStridedRowRanges(rows, stridedRanges);
+		if(stridedRanges.size() < ranges.size())
+			ranges.swap(stridedRanges);
 	}
+}
 
-	for(std::vector<std::pair<size_t, size_t> >::const_iterator i=rows.begin();i!=rows.end();++i) {
-		size_t rowIndex = i->first;
-		size_t requestIndex = i->second;
-		
-		double time = timeColumn(rowIndex);
-		const ReadRequest &request = _readRequests[requestIndex];
-		size_t
-			timeIndex = ObservationTimes(request.sequenceId).find(time)->second,
-			startIndex = request.startIndex,
-			endIndex = request.endIndex,
-			band = request.spectralWindow;
-		bool timeIsSelected = timeIndex>=startIndex && timeIndex<endIndex;
-		if(ReadData() && timeIsSelected) {
-			if(DataKind() == WeightData)
-				readWeights(requestIndex, timeIndex-startIndex, Set().FrequencyCount(band), weightColumn(rowIndex));
-			else if(modelColumn == 0)
-				readTimeData(requestIndex, timeIndex-startIndex, Set().FrequencyCount(band), (*dataColumn)(rowIndex), 0);
-			else {
-				const casa::Array<casa::Complex> model = (*modelColumn)(rowIndex); 
-				readTimeData(requestIndex, timeIndex-startIndex, Set().FrequencyCount(band), (*dataColumn)(rowIndex), &model);
+/**
+ * Returns the number of rows of a range of about 64 MB, which is large enough to read
+ * at full speed.
+ */
+size_t DirectBaselineReader::maxRangeRowCount(size_t channelCount)
+{
+	const size_t maxRangeBytes = 64*1024*1024;
+	const size_t rowBytes = channelCount * PolarizationCount() * (sizeof(casa::Complex) + sizeof(bool)) + sizeof(double) * 4;
+	return std::max<size_t>(1, maxRangeBytes / rowBytes);
+}
+
+void DirectBaselineReader::findConsecutiveRowRanges(const std::vector<std::pair<size_t, size_t> > &rows, std::vector<RowRange> &ranges)
+{
+	size_t entry = 0;
+	while(entry != rows.size())
+	{
+		RowRange range;
+		range.startRow = rows[entry].first;
+		range.rowStride = 1;
+		range.channelCount = Set().FrequencyCount(_readRequests[rows[entry].second].spectralWindow);
+		const size_t maxRowCount = maxRangeRowCount(range.channelCount);
+		range.entries.push_back(entry);
+		size_t endRow = range.startRow + 1;
+		++entry;
+		while(entry != rows.size())
+		{
+			const size_t row = rows[entry].first;
+			if(row == endRow - 1)
+				range.entries.push_back(entry);
+			else if(row == endRow && endRow - range.startRow < maxRowCount &&
+				(size_t) Set().FrequencyCount(_readRequests[rows[entry].second].spectralWindow) == range.channelCount)
+			{
+				range.entries.push_back(entry);
+				++endRow;
 			}
+			else
+				break;
+			++entry;
 		}
-		if(ReadFlags() && timeIsSelected) {
-			readTimeFlags(requestIndex, timeIndex-startIndex, Set().FrequencyCount(band), flagColumn(rowIndex));
-		}
-		if(timeIsSelected) {
-			casa::Array<double> arr = uvwColumn(rowIndex);
-			casa::Array<double>::const_iterator i = arr.begin();
-			_results[requestIndex]._uvw[timeIndex-startIndex].u = *i;
-			++i;
-			_results[requestIndex]._uvw[timeIndex-startIndex].v = *i;
+		range.rowCount = endRow - range.startRow;
+		ranges.push_back(range);
+	}
+}
+
+/**
+ * Splits the rows of each request in runs with a constant distance between the rows.
+ */
+void DirectBaselineReader::findStridedRowRanges(const std::vector<std::pair<size_t, size_t> > &rows, std::vector<RowRange> &ranges)
+{
+	// Entries ordered on request, and on row within a request
+	std::vector<std::pair<size_t, size_t> > requestEntries(rows.size());
+	for(size_t entry=0;entry!=rows.size();++entry)
+		requestEntries[entry] = std::make_pair(rows[entry].second, entry);
+	std::sort(requestEntries.begin(), requestEntries.end());
+	
+	size_t i = 0;
+	while(i != requestEntries.size())
+	{
+		const size_t requestIndex = requestEntries[i].first;
+		RowRange range;
+		range.startRow = rows[requestEntries[i].second].first;
+		range.rowStride = 1;
+		range.channelCount = Set().FrequencyCount(_readRequests[requestIndex].spectralWindow);
+		const size_t maxRowCount = maxRangeRowCount(range.channelCount);
+		range.entries.push_back(requestEntries[i].second);
+		range.rowCount = 1;
+		++i;
+		if(i != requestEntries.size() && requestEntries[i].first == requestIndex &&
+			rows[requestEntries[i].second].first != range.startRow)
+			range.rowStride = rows[requestEntries[i].second].first - range.startRow;
+		while(i != requestEntries.size() && requestEntries[i].first == requestIndex && range.rowCount < maxRowCount &&
+			rows[requestEntries[i].second].first == range.startRow + range.rowCount * range.rowStride)
+		{
+			range.entries.push_back(requestEntries[i].second);
+			++range.rowCount;
 			++i;
-			_results[requestIndex]._uvw[timeIndex-startIndex].w = *i;
 		}
+		if(range.rowCount == 1)
+			range.rowStride = 1;
+		ranges.push_back(range);
 	}
-	if(dataColumn != 0)
-		delete dataColumn;
-	
-	AOLogger::Debug << "Time of ReadRequests(): " << stopwatch.ToString() << '\n';
+}
 
-	_readRequests.clear();
+/**
+ * Copies the rows of a range into the results of the requests. The rows of each request
+ * are sorted on time, so that runs of consecutive time steps are copied together.
+ */
+void DirectBaselineReader::readRowRange(const RowRange &range, const std::vector<std::pair<size_t, size_t> > &rows, const double *times, const float *data, const bool *flags, const double *uvw)
+{
+	const size_t polarizationCount = PolarizationCount();
+	const size_t rowSize = range.channelCount * polarizationCount;
+	
+	std::vector<RowPosition> positions;
+	positions.reserve(range.entries.size());
+	for(std::vector<size_t>::const_iterator i=range.entries.begin();i!=range.entries.end();++i)
+	{
+		const ReadRequest &request = _readRequests[rows[*i].second];
+		RowPosition position;
+		position.requestIndex = rows[*i].second;
+		position.rowInRange = (rows[*i].first - range.startRow) / range.rowStride;
+		const size_t timeIndex = ObservationTimes(request.sequenceId).find(times[position.rowInRange])->second;
+		if(timeIndex >= request.startIndex && timeIndex < request.endIndex)
+		{
+			position.x = timeIndex - request.startIndex;
+			positions.push_back(position);
+		}
+	}
+	std::sort(positions.begin(), positions.end());
+	
+	std::vector<const float*> dataSteps;
+	std::vector<const bool*> flagSteps;
+	size_t runStart = 0;
+	while(runStart != positions.size())
+	{
+		Result &result = _results[positions[runStart].requestIndex];
+		size_t runEnd = runStart + 1;
+		while(runEnd != positions.size() && positions[runEnd].requestIndex == positions[runStart].requestIndex &&
+			positions[runEnd].x == positions[runStart].x + (runEnd - runStart))
+			++runEnd;
+		
+		dataSteps.clear();
+		flagSteps.clear();
+		for(size_t i=runStart;i!=runEnd;++i)
+		{
+			const size_t rowInRange = positions[i].rowInRange;
+			if(data != 0)
+				dataSteps.push_back(data + rowInRange * rowSize * 2);
+			if(flags != 0)
+				flagSteps.push_back(flags + rowInRange * rowSize);
+			const double *rowUVW = uvw + rowInRange * 3;
+			result._uvw[positions[i].x] = UVW(rowUVW[0], rowUVW[1], rowUVW[2]);
+		}
+		if(data != 0)
+			copyTimeSteps(&dataSteps[0], positions[runStart].x, runEnd - runStart, range.channelCount, polarizationCount, result._realImages, result._imaginaryImages);
+		if(flags != 0)
+			copyFlagTimeSteps(&flagSteps[0], positions[runStart].x, runEnd - runStart, range.channelCount, polarizationCount, result._flags);
+		
+		runStart = runEnd;
+	}
 }
 
 std::vector<UVW> DirectBaselineReader::ReadUVW(unsigned antenna1, unsigned antenna2, unsigned spectralWindow, unsigned sequenceId)
@@ -265,6 +438,7 @@ std::vector<UVW> DirectBaselineReader::ReadUVW(unsigned antenna1, unsigned anten
 	size_t width = observationTimes.size();
 
 	casa::Table &table = *Table();
+	boost::mutex::scoped_lock casaLock(_casaMutex);
 	casa::ROScalarColumn<double> timeColumn(table, "TIME");
 	casa::ROArrayColumn<double> uvwColumn(table, "UVW");
 	
@@ -300,16 +474,6 @@ void DirectBaselineReader::PerformFlagWriteRequests()
 
 	initBaselineCache();
 
-	// Each element contains (row number, corresponding request index)
-	std::vector<std::pair<size_t, size_t> > rows;
-	
-	for(size_t i=0;i!=_writeRequests.size();++i)
-		addRequestRows(_writeRequests[i], i, rows);
-	std::sort(rows.begin(), rows.end());
-
-	casa::ROScalarColumn<double> timeColumn(*Table(), "TIME");
-	casa::ArrayColumn<bool> flagColumn(*Table(), "FLAG");
-
 	for(std::vector<FlagWriteRequest>::iterator i=_writeRequests.begin();i!=_writeRequests.end();++i)
 	{
 		size_t band = i->spectralWindow;
@@ -323,105 +487,52 @@ void DirectBaselineReader::PerformFlagWriteRequests()
 		}
 	}
 
-	size_t rowsWritten = 0;
-
-	for(std::vector<std::pair<size_t, size_t> >::const_iterator i=rows.begin();i!=rows.end();++i)
+	// The flags are handed to the flag writer, which sorts the rows and writes them on its own thread
+	FlagWriter &writer = flagWriter();
+	const size_t polarizationCount = PolarizationCount();
+	size_t rowCount = 0, rowsWritten = 0;
+	for(std::vector<FlagWriteRequest>::const_iterator i=_writeRequests.begin();i!=_writeRequests.end();++i)
 	{
-		size_t rowIndex = i->first;
-		FlagWriteRequest &request = _writeRequests[i->second];
-		double time = timeColumn(rowIndex);
-		size_t timeIndex = ObservationTimes(request.sequenceId).find(time)->second;
-		if(timeIndex >= request.startIndex + request.leftBorder && timeIndex < request.endIndex - request.rightBorder)
+		const FlagWriteRequest &request = *i;
+		const BaselineCacheValue *cacheValue = findBaselineCache(request);
+		if(cacheValue == 0)
+			continue;
+		const size_t channelCount = Set().FrequencyCount(request.spectralWindow);
+		rowCount += cacheValue->rows.size();
+		for(size_t j=0;j!=cacheValue->rows.size();++j)
 		{
-			casa::Array<bool> flag = flagColumn(rowIndex);
-			casa::Array<bool>::iterator j = flag.begin();
-			for(size_t f=0;f<(size_t) Set().FrequencyCount(request.spectralWindow);++f) {
-				for(size_t p=0;p<PolarizationCount();++p)
-				{
-					*j = request.flags[p]->Value(timeIndex - request.startIndex, f);
-					++j;
+			size_t timeIndex = cacheValue->timeIndices[j];
+			if(timeIndex >= request.startIndex + request.leftBorder && timeIndex < request.endIndex - request.rightBorder)
+			{
+				bool *flagPtr = writer.AddRow(cacheValue->rows[j], channelCount);
+				for(size_t f=0;f<channelCount;++f) {
+					for(size_t p=0;p<polarizationCount;++p)
+					{
+						*flagPtr = request.flags[p]->Value(timeIndex - request.startIndex, f);
+						++flagPtr;
+					}
 				}
+				++rowsWritten;
 			}
-			flagColumn.basePut(rowIndex, flag);
-			++rowsWritten;
 		}
 	}
+	writer.Flush();
 	_writeRequests.clear();
 	
-	AOLogger::Debug << rowsWritten << "/" << rows.size() << " rows written in " << stopwatch.ToString() << '\n';
-}
-
-void DirectBaselineReader::readTimeData(size_t requestIndex, size_t xOffset, int frequencyCount, const casa::Array<casa::Complex> data, const casa::Array<casa::Complex> *model)
-{
-	casa::Array<casa::Complex>::const_iterator i = data.begin();
-	casa::Array<casa::Complex>::const_iterator m;
-	if(DataKind() == ResidualData)
-		m = model->begin();
-
-	size_t polarizationCount = PolarizationCount();
-
-	for(size_t f=0;f<(size_t) frequencyCount;++f) {
-		num_t rv,iv;
-
-		for(size_t p=0;p<polarizationCount;++p)
-		{
-			if(DataKind() == ResidualData)
-			{
-				const casa::Complex &iData = *i;
-				const casa::Complex &iModel = *m;
-				++i; ++m;
-
-				rv = iData.real() - iModel.real();
-				iv = iData.imag() - iModel.imag();
-			} else {
-				const casa::Complex &complex = *i;
-				++i;
-
-				rv = complex.real();
-				iv = complex.imag();
-			}
-			_results[requestIndex]._realImages[p]->SetValue(xOffset, f, rv);
-			_results[requestIndex]._imaginaryImages[p]->SetValue(xOffset, f, iv);
-		}
-	}
-}
-
-void DirectBaselineReader::readTimeFlags(size_t requestIndex, size_t xOffset, int frequencyCount, const casa::Array<bool> flag)
-{
-	size_t polarizationCount = PolarizationCount();
-
-	casa::Array<bool>::const_iterator j = flag.begin();
-	for(size_t f=0;f<(size_t) frequencyCount;++f) {
-		for(size_t p=0;p<polarizationCount;++p)
-		{
-			bool v = *j;
-			++j;
-			_results[requestIndex]._flags[p]->SetValue(xOffset, f, v);
-		} 
-	}
-}
-
-void DirectBaselineReader::readWeights(size_t requestIndex, size_t xOffset, int frequencyCount, const casa::Array<float> weight)
-{
-	size_t polarizationCount = PolarizationCount();
-
-	casa::Array<float>::const_iterator j = weight.begin();
-	std::vector<float> values(polarizationCount);
-	for(size_t p=0;p<polarizationCount;++p) {
-		values[p] = *j;
-		++j;
-	}
-	for(size_t f=0;f<(size_t) frequencyCount;++f) {
-		for(size_t p=0;p<polarizationCount;++p)
-		{
-			_results[requestIndex]._realImages[p]->SetValue(xOffset, f, values[p]);
-			_results[requestIndex]._imaginaryImages[p]->SetValue(xOffset, f, 0.0);
-		}
-	} 
+	AOLogger::Debug << rowsWritten << "/" << rowCount << " rows queued for writing in " << stopwatch.ToString() << '\n';
 }
 
 void DirectBaselineReader::ShowStatistics()
 {
+	if(_readRowCount != 0)
+	{
+		const long double seconds = _readingTime + _decodingTime;
+		AOLogger::Debug << "Direct reader: read " << _readRowCount << " rows (" << (_readByteCount/1000000) << " MB) in "
+			<< _readingTime << " s, decoded in " << _decodingTime << " s";
+		if(seconds > 0.0)
+			AOLogger::Debug << ": " << (size_t) (_readRowCount / seconds) << " rows/s, " << (_readByteCount / seconds / 1000000.0) << " MB/s";
+		AOLogger::Debug << ".\n";
+	}
 	try {
 		casa::ROTiledStManAccessor accessor(*Table(), "LofarStMan");
 		std::stringstream s;
@@ -24,6 +24,8 @@
 #include <vector>
 #include <stdexcept>
 
+#include <stdint.h>
+
 #include "antennainfo.h"
 #include "baselinereader.h"
 #include "image2d.h"
@@ -95,28 +97,65 @@ class DirectBaselineReader : public BaselineReader {
 		class BaselineCacheValue {
 			public:
 			std::vector<size_t> rows;
-			BaselineCacheValue() : rows()
+			std::vector<size_t> timeIndices;
+			BaselineCacheValue() : rows(), timeIndices()
 			{ }
-			BaselineCacheValue(const BaselineCacheValue &source) : rows(source.rows)
+			BaselineCacheValue(const BaselineCacheValue &source) : rows(source.rows), timeIndices(source.timeIndices)
 			{ }
 			void operator=(const BaselineCacheValue &source)
 			{
 				rows = source.rows;
+				timeIndices = source.timeIndices;
+			}
+		};
+		
+		/**
+		 * Rows with the same number of channels at a constant distance of rowStride, which
+		 * are read with one call per column. The entries are the indices of the rows in the
+		 * sorted (row, request index) list. A row occurs more than once in that list when
+		 * several requests need it.
+		 */
+		struct RowRange
+		{
+			size_t startRow, rowCount, rowStride, channelCount;
+			std::vector<size_t> entries;
+		};
+		
+		/**
+		 * A row of a range, together with the request and time index it is copied to.
+		 */
+		struct RowPosition
+		{
+			size_t requestIndex, x, rowInRange;
+			
+			bool operator<(const RowPosition &other) const
+			{
+				if(requestIndex != other.requestIndex)
+					return requestIndex < other.requestIndex;
+				else
+					return x < other.x;
 			}
 		};
 		
 		void initBaselineCache();
 		
 		void addRequestRows(ReadRequest request, size_t requestIndex, std::vector<std::pair<size_t, size_t> > &rows);
-		void addRequestRows(FlagWriteRequest request, size_t requestIndex, std::vector<std::pair<size_t, size_t> > &rows);
-		void addRowToBaselineCache(int antenna1, int antenna2, int spectralWindow, int sequenceId, size_t row);
+		const BaselineCacheValue *findBaselineCache(const FlagWriteRequest &request) const;
+		void addRowToBaselineCache(int antenna1, int antenna2, int spectralWindow, int sequenceId, size_t row, size_t timeIndex);
 		void readUVWData();
 
-		void readTimeData(size_t requestIndex, size_t xOffset, int frequencyCount, const casa::Array<casa::Complex> data, const casa::Array<casa::Complex> *model);
-		void readTimeFlags(size_t requestIndex, size_t xOffset, int frequencyCount, const casa::Array<bool> flag);
-		void readWeights(size_t requestIndex, size_t xOffset, int frequencyCount, const casa::Array<float> weight);
+		void findRowRanges(const std::vector<std::pair<size_t, size_t> > &rows, std::vector<RowRange> &ranges);
+		void findConsecutiveRowRanges(const std::vector<std::pair<size_t, size_t> > &rows, std::vector<RowRange> &ranges);
+		void findStridedRowRanges(const std::vector<std::pair<size_t, size_t> > &rows, std::vector<RowRange> &ranges);
+		size_t maxRangeRowCount(size_t channelCount);
+		void readRowRange(const RowRange &range, const std::vector<std::pair<size_t, size_t> > &rows, const double *times, const float *data, const bool *flags, const double *uvw);
 
 		std::map<BaselineCacheIndex, BaselineCacheValue> _baselineCache;
+		
+		// Totals over all read requests, reported by ShowStatistics()
+		size_t _readRowCount;
+		uint64_t _readByteCount;
+		long double _readingTime, _decodingTime;
 };
 
 #endif // DIRECTBASELINEREADER_H
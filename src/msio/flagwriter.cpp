@@ -0,0 +1,262 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "flagwriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <tables/Tables/ArrayColumn.h>
+#include <tables/Tables/Table.h>
+
+#include "../util/aologger.h"
+#include "../util/stopwatch.h"
+
+FlagWriter::FlagWriter(casa::Table &table, boost::mutex &tableMutex, size_t polarizationCount, size_t maxQueuedBytes) :
+	_table(table),
+	_tableMutex(tableMutex),
+	_polarizationCount(polarizationCount),
+	_maxQueuedBytes(maxQueuedBytes),
+	_currentBatch(new Batch()),
+	_queuedBytes(0),
+	_isWriting(false),
+	_isFinishing(false),
+	_writtenRowCount(0),
+	_skippedRowCount(0),
+	_writingTime(0.0)
+{
+	_thread = new boost::thread(WriteFunction(*this));
+}
+
+FlagWriter::~FlagWriter()
+{
+	try {
+		Finish();
+	} catch(std::exception &e)
+	{
+		AOLogger::Error << "Writing the flags failed: " << e.what() << '\n';
+	}
+	boost::mutex::scoped_lock lock(_queueMutex);
+	_isFinishing = true;
+	_queueChange.notify_all();
+	lock.unlock();
+	_thread->join();
+	delete _thread;
+	
+	for(std::deque<Batch*>::iterator i=_queue.begin();i!=_queue.end();++i)
+		delete *i;
+	delete _currentBatch;
+	
+	if(_writtenRowCount + _skippedRowCount != 0)
+	{
+		AOLogger::Debug << "Flag writer: " << _writtenRowCount << " rows written, " << _skippedRowCount
+			<< " rows unchanged, writing took " << _writingTime << " s.\n";
+	}
+}
+
+bool *FlagWriter::AddRow(size_t row, size_t channelCount)
+{
+	RowFlags rowFlags;
+	rowFlags.row = row;
+	rowFlags.channelCount = channelCount;
+	rowFlags.offset = _currentBatch->flags.size();
+	rowFlags.order = _currentBatch->rows.size();
+	_currentBatch->rows.push_back(rowFlags);
+	_currentBatch->flags.resize(rowFlags.offset + channelCount * _polarizationCount);
+	return reinterpret_cast<bool*>(&_currentBatch->flags[rowFlags.offset]);
+}
+
+void FlagWriter::Flush()
+{
+	boost::mutex::scoped_lock lock(_queueMutex);
+	throwError();
+	if(_currentBatch->rows.empty())
+		return;
+	
+	// A single batch that is larger than the maximum is still accepted once the queue is empty
+	while(_queuedBytes != 0 && _queuedBytes + _currentBatch->flags.size() > _maxQueuedBytes)
+	{
+		_queueChange.wait(lock);
+		throwError();
+	}
+	_queuedBytes += _currentBatch->flags.size();
+	_queue.push_back(_currentBatch);
+	_currentBatch = new Batch();
+	_queueChange.notify_all();
+}
+
+void FlagWriter::Finish()
+{
+	Flush();
+	boost::mutex::scoped_lock lock(_queueMutex);
+	while(!_queue.empty() || _isWriting)
+	{
+		_queueChange.wait(lock);
+	}
+	throwError();
+}
+
+size_t FlagWriter::WrittenRowCount() const
+{
+	boost::mutex::scoped_lock lock(_queueMutex);
+	return _writtenRowCount;
+}
+
+size_t FlagWriter::SkippedRowCount() const
+{
+	boost::mutex::scoped_lock lock(_queueMutex);
+	return _skippedRowCount;
+}
+
+void FlagWriter::throwError()
+{
+	if(!_error.empty())
+		throw std::runtime_error(_error);
+}
+
+/**
+ * Runs on the writing thread. The column object lives as long as the thread, and is
+ * constructed and destructed while the table is locked.
+ */
+void FlagWriter::writeBatches()
+{
+	boost::mutex::scoped_lock tableLock(_tableMutex);
+	casa::ArrayColumn<bool> *flagColumn = 0;
+	std::string columnError;
+	try {
+		flagColumn = new casa::ArrayColumn<bool>(_table, "FLAG");
+	} catch(std::exception &e)
+	{
+		columnError = e.what();
+	}
+	tableLock.unlock();
+	
+	boost::mutex::scoped_lock lock(_queueMutex);
+	if(_error.empty())
+		_error = columnError;
+	while(true)
+	{
+		while(_queue.empty() && !_isFinishing)
+			_queueChange.wait(lock);
+		if(_queue.empty())
+			break;
+		
+		Batch *batch = _queue.front();
+		_queue.pop_front();
+		_isWriting = true;
+		lock.unlock();
+		
+		try {
+			if(_error.empty())
+				writeBatch(*batch, *flagColumn);
+		} catch(std::exception &e)
+		{
+			lock.lock();
+			_error = e.what();
+			lock.unlock();
+		}
+		
+		lock.lock();
+		_queuedBytes -= batch->flags.size();
+		delete batch;
+		_isWriting = false;
+		_queueChange.notify_all();
+	}
+	lock.unlock();
+	
+	tableLock.lock();
+	delete flagColumn;
+}
+
+void FlagWriter::writeBatch(Batch &batch, casa::ArrayColumn<bool> &flagColumn)
+{
+	Stopwatch watch(true);
+	std::vector<RowFlags> &rows = batch.rows;
+	std::sort(rows.begin(), rows.end());
+	
+	// Only the last addition of a row is kept
+	std::vector<RowFlags>::iterator uniqueEnd = rows.begin();
+	for(std::vector<RowFlags>::const_iterator i=rows.begin();i!=rows.end();++i)
+	{
+		if(i+1 == rows.end() || (i+1)->row != i->row)
+		{
+			*uniqueEnd = *i;
+			++uniqueEnd;
+		}
+	}
+	rows.erase(uniqueEnd, rows.end());
+	
+	boost::mutex::scoped_lock tableLock(_tableMutex, boost::defer_lock);
+	
+	// Ranges are limited to about 64 MB of flags, which is large enough to read at full speed
+	const size_t maxRangeSize = 64*1024*1024;
+	casa::Array<bool> currentFlags, changedFlags;
+	size_t writtenRowCount = 0, skippedRowCount = 0;
+	size_t rangeStart = 0;
+	while(rangeStart != rows.size())
+	{
+		const size_t channelCount = rows[rangeStart].channelCount;
+		const size_t rowSize = channelCount * _polarizationCount;
+		size_t rangeEnd = rangeStart + 1;
+		while(rangeEnd != rows.size() && rows[rangeEnd].row == rows[rangeStart].row + (rangeEnd - rangeStart) &&
+			rows[rangeEnd].channelCount == channelCount && (rangeEnd - rangeStart) * rowSize < maxRangeSize)
+			++rangeEnd;
+		
+		casa::Slicer rangeSlicer(casa::IPosition(1, rows[rangeStart].row), casa::IPosition(1, rangeEnd - rangeStart), casa::Slicer::endIsLength);
+		tableLock.lock();
+		flagColumn.getColumnRange(rangeSlicer, currentFlags, true);
+		tableLock.unlock();
+		
+		const bool *current = currentFlags.data();
+		size_t runStart = rangeStart;
+		while(runStart != rangeEnd)
+		{
+			const bool *newFlags = reinterpret_cast<const bool*>(&batch.flags[rows[runStart].offset]);
+			if(memcmp(newFlags, current + (runStart - rangeStart) * rowSize, rowSize * sizeof(bool)) == 0)
+			{
+				++skippedRowCount;
+				++runStart;
+				continue;
+			}
+			
+			size_t runEnd = runStart + 1;
+			while(runEnd != rangeEnd && memcmp(&batch.flags[rows[runEnd].offset], current + (runEnd - rangeStart) * rowSize, rowSize * sizeof(bool)) != 0)
+				++runEnd;
+			
+			changedFlags.resize(casa::IPosition(3, _polarizationCount, channelCount, runEnd - runStart));
+			bool *changed = changedFlags.data();
+			for(size_t i=runStart;i!=runEnd;++i)
+				memcpy(changed + (i - runStart) * rowSize, &batch.flags[rows[i].offset], rowSize * sizeof(bool));
+			
+			casa::Slicer runSlicer(casa::IPosition(1, rows[runStart].row), casa::IPosition(1, runEnd - runStart), casa::Slicer::endIsLength);
+			tableLock.lock();
+			flagColumn.putColumnRange(runSlicer, changedFlags);
+			tableLock.unlock();
+			writtenRowCount += runEnd - runStart;
+			runStart = runEnd;
+		}
+		rangeStart = rangeEnd;
+	}
+	
+	boost::mutex::scoped_lock lock(_queueMutex);
+	_writtenRowCount += writtenRowCount;
+	_skippedRowCount += skippedRowCount;
+	_writingTime += watch.Seconds();
+}
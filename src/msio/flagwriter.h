@@ -0,0 +1,151 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef FLAGWRITER_H
+#define FLAGWRITER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace casa {
+	class Table;
+	template<class T> class ArrayColumn;
+}
+
+/**
+ * Writes flags back to the FLAG column of a measurement set on its own thread.
+ *
+ * The flags of the rows to write are collected in a batch with AddRow(). Flush() hands
+ * the batch to the writing thread, which sorts its rows and splits them in ranges of
+ * consecutive rows. Each range is read with one call, and only the rows whose flags
+ * have changed are written back, again with one call per run of consecutive changed
+ * rows. The reader can meanwhile continue with other work. To bound the memory, Flush()
+ * blocks while the queued batches hold more than the maximum number of bytes.
+ *
+ * Casacore is not thread safe, so the writing thread locks the given mutex while
+ * accessing the table. Other threads that access the table should lock it as well.
+ */
+class FlagWriter
+{
+	public:
+		/**
+		 * @param table The table to write to, which should stay open until the writer is
+		 * destructed.
+		 * @param tableMutex Mutex that serializes all access to the table.
+		 * @param polarizationCount Number of polarizations in the FLAG column.
+		 * @param maxQueuedBytes Number of bytes of flags that may be waiting to be written.
+		 */
+		FlagWriter(casa::Table &table, boost::mutex &tableMutex, size_t polarizationCount, size_t maxQueuedBytes = 256*1024*1024);
+
+		/**
+		 * Waits until all flags are written. Errors are logged, as they can not be thrown;
+		 * call Finish() to have them thrown.
+		 */
+		~FlagWriter();
+
+		/**
+		 * Adds a row to the current batch. When a row is added more than once, the flags
+		 * that were added last are written.
+		 * @returns Space for the flags of the row, ordered as in the FLAG column: for each
+		 * channel the flags of all polarizations. The pointer is valid until the next call
+		 * to AddRow() or Flush().
+		 */
+		bool *AddRow(size_t row, size_t channelCount);
+
+		/**
+		 * Queues the current batch for writing.
+		 * @throws std::runtime_error if writing an earlier batch failed.
+		 */
+		void Flush();
+
+		/**
+		 * Flushes the current batch and waits until all batches are written.
+		 * @throws std::runtime_error if writing failed.
+		 */
+		void Finish();
+
+		/**
+		 * Number of rows that were written and number of rows that were skipped because
+		 * their flags had not changed.
+		 */
+		size_t WrittenRowCount() const;
+		size_t SkippedRowCount() const;
+	private:
+		struct RowFlags
+		{
+			size_t row, channelCount, offset, order;
+
+			bool operator<(const RowFlags &other) const
+			{
+				if(row != other.row)
+					return row < other.row;
+				else
+					return order < other.order;
+			}
+		};
+
+		struct Batch
+		{
+			std::vector<RowFlags> rows;
+			std::vector<char> flags;
+		};
+
+		struct WriteFunction
+		{
+			WriteFunction(FlagWriter &writer) : _writer(writer) { }
+			void operator()() { _writer.writeBatches(); }
+			FlagWriter &_writer;
+		};
+
+		// Not implemented
+		FlagWriter(const FlagWriter &source);
+		void operator=(const FlagWriter &source);
+
+		void writeBatches();
+		void writeBatch(Batch &batch, casa::ArrayColumn<bool> &flagColumn);
+		void waitUntilWritten();
+		void throwError();
+
+		casa::Table &_table;
+		boost::mutex &_tableMutex;
+		const size_t _polarizationCount, _maxQueuedBytes;
+
+		Batch *_currentBatch;
+
+		// Queue state, protected by _queueMutex
+		mutable boost::mutex _queueMutex;
+		boost::condition _queueChange;
+		std::deque<Batch*> _queue;
+		size_t _queuedBytes;
+		bool _isWriting, _isFinishing;
+		std::string _error;
+		size_t _writtenRowCount, _skippedRowCount;
+		long double _writingTime;
+
+		boost::thread *_thread;
+};
+
+#endif
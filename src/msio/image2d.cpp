@@ -20,6 +20,8 @@
 #include "image2d.h"
 #include "pngfile.h"
 #include "fitsfile.h"
+#include "memoryaccounting.h"
+#include "samplepool.h"
 
 #include <algorithm>
 #include <cstring>
@@ -37,14 +39,9 @@ Image2D::Image2D(size_t width, size_t height) :
 	if(_width == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
 	if(height == 0) allocHeight = 0;
-#ifdef __APPLE__
-		// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
-		_dataConsecutive = (num_t*)malloc(_stride * allocHeight * sizeof(num_t));
-#else
-		if(posix_memalign((void **) &_dataConsecutive, 16, _stride * allocHeight * sizeof(num_t)) != 0)
-			throw std::bad_alloc();
-#endif
-	_dataPtr = new num_t*[allocHeight];
+	_dataConsecutive = static_cast<num_t*>(SamplePool::Allocate(_stride * allocHeight * sizeof(num_t)));
+	MemoryAccounting::Allocate(_stride * allocHeight * sizeof(num_t));
+	_dataPtr = static_cast<num_t**>(SamplePool::Allocate(allocHeight * sizeof(num_t*)));
 	for(size_t y=0;y<height;++y)
 	{
 		_dataPtr[y] = &_dataConsecutive[_stride * y];
@@ -75,14 +72,9 @@ Image2D::Image2D(size_t width, size_t height, size_t widthCapacity) :
 	if(widthCapacity == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
 	if(height == 0) allocHeight = 0;
-#ifdef __APPLE__
-		// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
-		_dataConsecutive = (num_t*)malloc(_stride * allocHeight * sizeof(num_t));
-#else
-		if(posix_memalign((void **) &_dataConsecutive, 16, _stride * allocHeight * sizeof(num_t)) != 0)
-			throw std::bad_alloc();
-#endif
-	_dataPtr = new num_t*[allocHeight];
+	_dataConsecutive = static_cast<num_t*>(SamplePool::Allocate(_stride * allocHeight * sizeof(num_t)));
+	MemoryAccounting::Allocate(_stride * allocHeight * sizeof(num_t));
+	_dataPtr = static_cast<num_t**>(SamplePool::Allocate(allocHeight * sizeof(num_t*)));
 	for(size_t y=0;y<height;++y)
 	{
 		_dataPtr[y] = &_dataConsecutive[_stride * y];
@@ -107,8 +99,11 @@ Image2D::Image2D(size_t width, size_t height, size_t widthCapacity) :
 
 Image2D::~Image2D()
 {
-	delete[] _dataPtr;
-	free(_dataConsecutive);
+	unsigned allocHeight = ((((_height-1)/4)+1)*4);
+	if(_height == 0) allocHeight = 0;
+	SamplePool::Free(_dataPtr, allocHeight * sizeof(num_t*));
+	SamplePool::Free(_dataConsecutive, _stride * allocHeight * sizeof(num_t));
+	MemoryAccounting::Free(_stride * allocHeight * sizeof(num_t));
 }
 
 Image2D *Image2D::CreateSetImage(size_t width, size_t height, num_t initialValue) 
@@ -480,25 +475,29 @@ Image2DPtr Image2D::ShrinkHorizontally(size_t factor) const
 	size_t newWidth = (_width + factor - 1) / factor;
 
 	Image2D *newImage = new Image2D(newWidth, _height);
+	ShrinkHorizontally(factor, *newImage, 0, _height);
+	return Image2DPtr(newImage);
+}
 
-	for(size_t x=0;x<newWidth;++x)
+void Image2D::ShrinkHorizontally(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const
+{
+	for(size_t y=yStart;y<yEnd;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		for(size_t x=0;x<output._width;++x)
 		{
+			size_t binSize = factor;
+			if(binSize + x*factor > _width)
+				binSize = _width - x*factor;
+
 			num_t sum = 0.0;
 			for(size_t binX=0;binX<binSize;++binX)
 			{
 				size_t curX = x*factor + binX;
 				sum += Value(curX, y);
 			}
-			newImage->SetValue(x, y, sum / (num_t) binSize);
+			output.SetValue(x, y, sum / (num_t) binSize);
 		}
 	}
-	return Image2DPtr(newImage);
 }
 
 Image2DPtr Image2D::ShrinkVertically(size_t factor) const
@@ -506,8 +505,13 @@ Image2DPtr Image2D::ShrinkVertically(size_t factor) const
 	size_t newHeight = (_height + factor - 1) / factor;
 
 	Image2D *newImage = new Image2D(_width, newHeight);
+	ShrinkVertically(factor, *newImage, 0, newHeight);
+	return Image2DPtr(newImage);
+}
 
-	for(size_t y=0;y<newHeight;++y)
+void Image2D::ShrinkVertically(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const
+{
+	for(size_t y=yStart;y<yEnd;++y)
 	{
 		size_t binSize = factor;
 		if(binSize + y*factor > _height)
@@ -521,43 +525,40 @@ Image2DPtr Image2D::ShrinkVertically(size_t factor) const
 				size_t curY = y*factor + binY;
 				sum += Value(x, curY);
 			}
-			newImage->SetValue(x, y, sum / (num_t) binSize);
+			output.SetValue(x, y, sum / (num_t) binSize);
 		}
 	}
-	return Image2DPtr(newImage);
 }
 
 Image2DPtr Image2D::EnlargeHorizontally(size_t factor, size_t newWidth) const
 {
 	Image2D *newImage = new Image2D(newWidth, _height);
+	EnlargeHorizontally(factor, *newImage, 0, _height);
+	return Image2DPtr(newImage);
+}
 
-	for(size_t x=0;x<newWidth;++x)
+void Image2D::EnlargeHorizontally(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const
+{
+	for(size_t y=yStart;y<yEnd;++y)
 	{
-		size_t xOld = x / factor;
-
-		for(size_t y=0;y<_height;++y)
-		{
-			newImage->SetValue(x, y, Value(xOld, y));
-		}
+		for(size_t x=0;x<output._width;++x)
+			output.SetValue(x, y, Value(x / factor, y));
 	}
-	return Image2DPtr(newImage);
 }
 
 Image2DPtr Image2D::EnlargeVertically(size_t factor, size_t newHeight) const
 {
 	Image2D *newImage = new Image2D(_width, newHeight);
-
-	for(size_t x=0;x<_width;++x)
-	{
-		for(size_t y=0;y<newHeight;++y)
-		{
-			size_t yOld = y / factor;
-			newImage->SetValue(x, y, Value(x, yOld));
-		}
-	}
+	EnlargeVertically(factor, *newImage, 0, newHeight);
 	return Image2DPtr(newImage);
 }
 
+void Image2D::EnlargeVertically(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const
+{
+	for(size_t y=yStart;y<yEnd;++y)
+		memcpy(output._dataPtr[y], _dataPtr[y / factor], _width * sizeof(num_t));
+}
+
 Image2DPtr Image2D::Trim(size_t startX, size_t startY, size_t endX, size_t endY) const
 {
 	size_t
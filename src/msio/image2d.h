@@ -26,6 +26,7 @@
 
 #include "../baseexception.h"
 #include "colormap.h"
+#include "samplepool.h"
 #include "types.h"
 
 #include <boost/shared_ptr.hpp>
@@ -129,6 +130,20 @@ class Image2D {
 		 */
 		~Image2D();
 		
+		/**
+		 * Images are created and destroyed for every baseline, so also the image objects
+		 * themselves are taken from the SamplePool.
+		 */
+		static void *operator new(size_t size)
+		{
+			return SamplePool::Allocate(size);
+		}
+		
+		static void operator delete(void *image, size_t size)
+		{
+			SamplePool::Free(image, size);
+		}
+		
 		/**
 		 * Creates a new image by subtracting two images of the same size.
 		 * @param imageA first image.
@@ -421,6 +436,33 @@ class Image2D {
 		 */
 		Image2DPtr EnlargeVertically(size_t factor, size_t newHeight) const;
 
+		/**
+		 * Like ShrinkHorizontally(size_t), but only fills the rows [yStart, yEnd)
+		 * of the given output image, which should be (Width() + factor - 1) / factor
+		 * wide and as high as this image. Different row ranges of the same output
+		 * can be filled concurrently.
+		 */
+		void ShrinkHorizontally(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const;
+
+		/**
+		 * Like ShrinkVertically(size_t), but only fills the rows [yStart, yEnd)
+		 * of the given output image, which should be as wide as this image and
+		 * (Height() + factor - 1) / factor high.
+		 */
+		void ShrinkVertically(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const;
+
+		/**
+		 * Like EnlargeHorizontally(size_t, size_t), but only fills the rows
+		 * [yStart, yEnd) of the given output image, which has the new width.
+		 */
+		void EnlargeHorizontally(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const;
+
+		/**
+		 * Like EnlargeVertically(size_t, size_t), but only fills the rows
+		 * [yStart, yEnd) of the given output image, which has the new height.
+		 */
+		void EnlargeVertically(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const;
+
 		Image2DPtr Trim(size_t startX, size_t startY, size_t endX, size_t endY) const;
 		
 		void SetTrim(size_t startX, size_t startY, size_t endX, size_t endY);
@@ -21,16 +21,23 @@
 
 #include <ms/MeasurementSets/MeasurementSet.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <set>
+#include <sstream>
 #include <stdexcept>
 #include <vector>
 
 #include <fcntl.h>
+#include <unistd.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "arraycolumniterator.h"
+#include "flagwriter.h"
 #include "scalarcolumniterator.h"
 #include "timefrequencydata.h"
 #include "system.h"
@@ -39,17 +46,30 @@
 #include "../util/stopwatch.h"
 
 IndirectBaselineReader::IndirectBaselineReader(const std::string &msFile) : BaselineReader(msFile), _directReader(msFile),
-_seqIndexTable(0),
+_seqIndexTable(0), _dataMap(0), _flagMap(0), _reorderThreads(0), _rowCount(0), _rowsPerRange(0), _nextRange(0),
 _msIsReordered(false), _removeReorderedFiles(false), _reorderedDataFilesHaveChanged(false), _reorderedFlagFilesHaveChanged(false), _readUVW(false)
 {
 }
 
 IndirectBaselineReader::~IndirectBaselineReader()
 {
-	if(_reorderedDataFilesHaveChanged)
-		updateOriginalMSData();
-	if(_reorderedFlagFilesHaveChanged)
-		updateOriginalMSFlags();
+	waitForReorder();
+	if(_reorderError.empty())
+	{
+		if(_reorderedDataFilesHaveChanged)
+			updateOriginalMSData();
+		if(_reorderedFlagFilesHaveChanged)
+			updateOriginalMSFlags();
+	} else {
+		// The reordered files are incomplete and would overwrite the measurement set with garbage
+		AOLogger::Error << "Reordering failed, the measurement set will not be updated: " << _reorderError << '\n';
+		// The completed ranges are recorded in the meta file, so a next run can resume
+		if(!_reorderedDataFilesHaveChanged && !_reorderedFlagFilesHaveChanged)
+		{
+			_removeReorderedFiles = false;
+			AOLogger::Info << "The temporary files are kept, so that the next run can resume reordering.\n";
+		}
+	}
 	removeTemporaryFiles();
 	
 	delete _seqIndexTable;
@@ -61,62 +81,77 @@ void IndirectBaselineReader::PerformReadRequests()
 	initializeMeta();
 
 	if(!_msIsReordered) reorderedMS();
+	mapReorderedFiles();
 
 	_results.clear();
 	AOLogger::Debug << "Performing " << _readRequests.size() << " read requests...\n";
+	const size_t polarizationCount = PolarizationCount();
+	
+	// Start reading ahead all requested baselines before copying the first
+	for(size_t i=0;i<_readRequests.size();++i)
+	{
+		const ReadRequest &request = _readRequests[i];
+		size_t index = _seqIndexTable->Value(request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
+		size_t timeStepSize = Set().FrequencyCount(request.spectralWindow) * polarizationCount;
+		size_t filePos = _filePositions[index] + request.startIndex * timeStepSize;
+		size_t sampleCount = (request.endIndex - request.startIndex) * timeStepSize;
+		if(ReadData())
+			_dataMap->WillNeed(filePos * (sizeof(float)*2), sampleCount * (sizeof(float)*2));
+		if(ReadFlags())
+			_flagMap->WillNeed(filePos * sizeof(bool), sampleCount * sizeof(bool));
+	}
+	
 	for(size_t i=0;i<_readRequests.size();++i)
 	{
 		const ReadRequest request = _readRequests[i];
 		_results.push_back(Result());
-		const size_t width = ObservationTimes(request.sequenceId).size();
-		for(size_t p=0;p<PolarizationCount();++p)
+		const size_t width = request.endIndex - request.startIndex;
+		const size_t channelCount = Set().FrequencyCount(request.spectralWindow);
+		// The reordered files hold all time steps of a baseline, including missing ones,
+		// which are padded with flagged samples. Therefore, all samples are overwritten.
+		for(size_t p=0;p<polarizationCount;++p)
 		{
 			if(ReadData()) {
-				_results[i]._realImages.push_back(Image2D::CreateZeroImagePtr(width, Set().FrequencyCount(request.spectralWindow)));
-				_results[i]._imaginaryImages.push_back(Image2D::CreateZeroImagePtr(width, Set().FrequencyCount(request.spectralWindow)));
+				_results[i]._realImages.push_back(Image2D::CreateUnsetImagePtr(width, channelCount));
+				_results[i]._imaginaryImages.push_back(Image2D::CreateUnsetImagePtr(width, channelCount));
 			}
 			if(ReadFlags()) {
-				// The flags should be initialized to true, as a baseline might
-				// miss some time scans that other baselines do have, and these
-				// should be flagged.
-				_results[i]._flags.push_back(Mask2D::CreateSetMaskPtr<true>(width, Set().FrequencyCount(request.spectralWindow)));
+				_results[i]._flags.push_back(Mask2D::CreateUnsetMaskPtr(width, channelCount));
 			}
 		}
 		if(_readUVW)
-			_results[i]._uvw = _directReader.ReadUVW(request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
-		else {
+		{
+			boost::mutex::scoped_lock lock(_casaMutex);
+			std::vector<UVW> uvw = _directReader.ReadUVW(request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
+			lock.unlock();
+			_results[i]._uvw.assign(uvw.begin() + request.startIndex, uvw.begin() + request.endIndex);
+		} else {
 			_results[i]._uvw.clear();
 			for(unsigned j=0;j<width;++j)
 			_results[i]._uvw.push_back(UVW(0.0, 0.0, 0.0));
 		}
 
-		std::ifstream dataFile(DataFilename(), std::ifstream::binary);
-		std::ifstream flagFile(FlagFilename(), std::ifstream::binary);
 		size_t index = _seqIndexTable->Value(request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
-		size_t filePos = _filePositions[index];
-		dataFile.seekg(filePos * (sizeof(float)*2), std::ios_base::beg);
-		flagFile.seekg(filePos * sizeof(bool), std::ios_base::beg);
-
-		const size_t bufferSize = Set().FrequencyCount(request.spectralWindow) * PolarizationCount();
-		for(size_t x=0;x<width;++x)
+		size_t filePos = _filePositions[index] + request.startIndex * channelCount * polarizationCount;
+		waitForSegment(index);
+		// The files hold for each time step all channels, and for each channel all
+		// polarizations as complex values.
+		const size_t timeStepSize = channelCount * polarizationCount;
+		if(ReadData())
 		{
-			std::vector<float> dataBuffer(bufferSize*2);
-			std::vector<char> flagBuffer(bufferSize);
-			dataFile.read((char *) &dataBuffer[0], bufferSize * sizeof(float) * 2);
-			size_t dataBufferPtr = 0;
-			flagFile.read((char *) &flagBuffer[0], bufferSize * sizeof(bool));
-			size_t flagBufferPtr = 0;
-			for(size_t f=0;f<Set().FrequencyCount(request.spectralWindow);++f) {
-				for(size_t p=0;p<PolarizationCount();++p)
-				{
-					_results[i]._realImages[p]->SetValue(x, f, dataBuffer[dataBufferPtr]);
-					++dataBufferPtr;
-					_results[i]._imaginaryImages[p]->SetValue(x, f, dataBuffer[dataBufferPtr]);
-					++dataBufferPtr;
-					_results[i]._flags[p]->SetValue(x, f, flagBuffer[flagBufferPtr]);
-					++flagBufferPtr;
-				}
-			}
+			const float *data = reinterpret_cast<const float*>(_dataMap->Data()) + filePos*2;
+			std::vector<const float*> timeSteps(width);
+			for(size_t x=0;x<width;++x)
+				timeSteps[x] = data + x * timeStepSize * 2;
+			copyTimeSteps(&timeSteps[0], 0, width, channelCount, polarizationCount, _results[i]._realImages, _results[i]._imaginaryImages);
+		}
+		if(ReadFlags())
+		{
+			const bool *flags = reinterpret_cast<const bool*>(_flagMap->Data()) + filePos;
+			std::vector<const bool*> timeSteps(width);
+			for(size_t x=0;x<width;++x)
+				timeSteps[x] = flags + x * timeStepSize;
+			copyFlagTimeSteps(&timeSteps[0], 0, width, channelCount, polarizationCount, _results[i]._flags);
 		}
 	}
 	AOLogger::Debug << "Done reading.\n";
@@ -124,44 +159,461 @@ void IndirectBaselineReader::PerformReadRequests()
 	_readRequests.clear();
 }
 
+void IndirectBaselineReader::mapReorderedFiles()
+{
+	if(_dataMap == 0)
+	{
+		_dataMap = new MappedFile(DataFilename(), true);
+		_flagMap = new MappedFile(FlagFilename(), true);
+	}
+}
+
+void IndirectBaselineReader::unmapReorderedFiles()
+{
+	delete _dataMap;
+	_dataMap = 0;
+	delete _flagMap;
+	_flagMap = 0;
+}
+
 void IndirectBaselineReader::PerformFlagWriteRequests()
 {
 	for(size_t i=0;i!=_writeRequests.size();++i)
 	{
 		const FlagWriteRequest request = _writeRequests[i];
-		performFlagWriteTask(request.flags, request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
+		performFlagWriteTask(request);
 	}
 	_writeRequests.clear();
 }
 
+struct IndirectBaselineReader::ReorderColumns
+{
+	ReorderColumns(casa::Table &table, const std::string &dataColumnName) :
+		time(table, "TIME"),
+		antenna1(table, "ANTENNA1"),
+		antenna2(table, "ANTENNA2"),
+		fieldId(table, "FIELD_ID"),
+		dataDescId(table, "DATA_DESC_ID"),
+		flag(table, "FLAG"),
+		data(table, dataColumnName)
+	{
+	}
+	casa::ROScalarColumn<double> time;
+	casa::ROScalarColumn<int> antenna1, antenna2, fieldId, dataDescId;
+	casa::ROArrayColumn<bool> flag;
+	casa::ROArrayColumn<casa::Complex> data;
+};
+
 void IndirectBaselineReader::reorderedMS()
+{
+	size_t fileSize;
+	makeLookupTables(fileSize);
+	
+	_rowCount = Table()->nrow();
+	if(_rowCount == 0)
+		throw std::runtime_error("Measurement set is empty (zero rows)");
+	
+	// The number of ranges only depends on the size of the set, so that a resumed run
+	// uses the same ranges
+	size_t rangeCount = _rowCount < 256 ? _rowCount : 256;
+	_rowsPerRange = (_rowCount + rangeCount - 1) / rangeCount;
+	rangeCount = (_rowCount + _rowsPerRange - 1) / _rowsPerRange;
+	_rangeIsDone.assign(rangeCount, false);
+	_nextRange = 0;
+	_reorderError.clear();
+	
+	bool resume = readMeta(_rowCount, fileSize);
+	size_t doneCount = std::count(_rangeIsDone.begin(), _rangeIsDone.end(), true);
+	if(resume && doneCount == rangeCount)
+	{
+		AOLogger::Debug << "Measurement set has already been reordered; using old temporary files.\n";
+		_remainingRows.assign(_filePositions.size(), 0);
+		_msIsReordered = true;
+		_removeReorderedFiles = false;
+		_reorderedDataFilesHaveChanged = false;
+		_reorderedFlagFilesHaveChanged = false;
+		return;
+	}
+	
+	_reorderWatch.Reset();
+	_reorderWatch.Start();
+	if(resume)
+	{
+		AOLogger::Debug << "Resuming reordering: " << doneCount << " of " << rangeCount << " row ranges were already reordered.\n";
+	} else {
+		AOLogger::Debug << "Opening temporary files.\n";
+		preAllocate(DataFilename(), fileSize*sizeof(float)*2);
+		preAllocate(FlagFilename(), fileSize*sizeof(bool));
+		writeMeta(_rowCount);
+	}
+	mapReorderedFiles();
+	
+	Set().GetDataDescToBandVector(_dataIdToSpw);
+	prepareReorder(_rowCount);
+	
+	// Reading the table is serialized, so more threads do not help much
+	size_t threadCount = System::ProcessorCount();
+	if(threadCount > 4) threadCount = 4;
+	if(threadCount > rangeCount - doneCount) threadCount = rangeCount - doneCount;
+	AOLogger::Debug << "Reordering data set with " << threadCount << " threads...\n";
+	_reorderThreads = new boost::thread_group();
+	for(size_t i=0;i!=threadCount;++i)
+		_reorderThreads->create_thread(ReorderFunction(*this));
+	
+	_msIsReordered = true;
+	_removeReorderedFiles = true;
+	_reorderedDataFilesHaveChanged = false;
+	_reorderedFlagFilesHaveChanged = false;
+}
+
+bool IndirectBaselineReader::readMeta(size_t rowCount, size_t fileSize)
 {
 	boost::filesystem::path path(MetaFilename());
-	bool reorderRequired = true;
+	if(!boost::filesystem::exists(path))
+		return false;
+	std::ifstream str(path.string().c_str());
+	std::string name;
+	std::getline(str, name);
+	if(!boost::filesystem::equivalent(boost::filesystem::path(name), Set().Path()))
+		return false;
+	if(!boost::filesystem::exists(DataFilename()) || !boost::filesystem::exists(FlagFilename()) ||
+		boost::filesystem::file_size(DataFilename()) != fileSize*sizeof(float)*2 ||
+		boost::filesystem::file_size(FlagFilename()) != fileSize*sizeof(bool))
+		return false;
 	
-	if(boost::filesystem::exists(path))
+	size_t metaRowCount, metaRangeCount;
+	if(!(str >> metaRowCount >> metaRangeCount))
+	{
+		// Older versions only wrote the name, after reordering completely
+		_rangeIsDone.assign(_rangeIsDone.size(), true);
+		return true;
+	}
+	if(metaRowCount != rowCount || metaRangeCount != _rangeIsDone.size())
+		return false;
+	std::string record;
+	while(str >> record)
 	{
-		std::ifstream str(path.string().c_str());
-		std::string name;
-		std::getline(str, name);
-		if(boost::filesystem::equivalent(boost::filesystem::path(name), Set().Path()))
+		if(record == ChangedRecord())
 		{
-			AOLogger::Debug << "Measurement set has already been reordered; using old temporary files.\n";
-			reorderRequired = false;
-			_msIsReordered = true;
-			_removeReorderedFiles = false;
-			_reorderedDataFilesHaveChanged = false;
-			_reorderedFlagFilesHaveChanged = false;
+			AOLogger::Debug << "Temporary files were changed by an earlier run, reordering again.\n";
+			_rangeIsDone.assign(_rangeIsDone.size(), false);
+			return false;
 		}
+		size_t range = strtoul(record.c_str(), 0, 10);
+		if(range < _rangeIsDone.size())
+			_rangeIsDone[range] = true;
 	}
-	if(reorderRequired)
+	return true;
+}
+
+void IndirectBaselineReader::writeMeta(size_t rowCount)
+{
+	std::ofstream str(MetaFilename());
+	str << Set().Path() << '\n' << rowCount << ' ' << _rangeIsDone.size() << '\n';
+	if(str.fail())
+		throw std::runtime_error("Error: failed to write temporary meta file! Check access rights and free disk space.");
+}
+
+/**
+ * Appends a record to the meta file and waits until it is on disk.
+ */
+void IndirectBaselineReader::appendToMeta(const std::string &line)
+{
+	int fd = open(MetaFilename(), O_WRONLY | O_APPEND);
+	if(fd < 0)
+		throw std::runtime_error("Error: failed to open temporary meta file! Check access rights.");
+	bool isWritten = write(fd, line.c_str(), line.size()) == (ssize_t) line.size() && fsync(fd) == 0;
+	close(fd);
+	if(!isWritten)
+		throw std::runtime_error("Error: failed to write temporary meta file! Check access rights and free disk space.");
+}
+
+/**
+ * Records in the meta file that the reordered files no longer hold the samples of the
+ * measurement set, before the first flags or data are written to them. A next run
+ * would otherwise resume with these as input.
+ */
+void IndirectBaselineReader::markReorderedFilesChanged()
+{
+	if(!_reorderedDataFilesHaveChanged && !_reorderedFlagFilesHaveChanged)
 	{
-		reorderFull();
-		std::ofstream str(path.string().c_str());
-		str << Set().Path() << '\n';
-	} else {
-		size_t fileSize;
-		makeLookupTables(fileSize);
+		boost::mutex::scoped_lock lock(_reorderMutex);
+		appendToMeta(std::string(ChangedRecord()) + '\n');
+	}
+}
+
+/**
+ * Determines the number of rows that each baseline still needs and the sequence at the
+ * start of each range. Time steps that are missing for a baseline are padded with
+ * flagged samples.
+ *
+ * This pass is serial and has to finish before the reorder threads start: a baseline
+ * can only be handed out once the number of rows it still needs is known, and the
+ * sequence of a row follows from the field changes in all rows before it. It reads
+ * only the scalar columns, one range at a time, which takes little time compared to
+ * reading the data. The reorder threads locate the rows of their range again, so
+ * that no per-row information of the whole set is kept.
+ */
+void IndirectBaselineReader::prepareReorder(size_t rowCount)
+{
+	const std::vector<MeasurementSet::Sequence> &sequences = Set().GetSequences();
+	const size_t polarizationCount = PolarizationCount();
+	std::vector<size_t> timeStepStart(sequences.size());
+	_segmentSampleCounts.resize(sequences.size());
+	size_t timeStepCount = 0;
+	for(size_t i=0;i!=sequences.size();++i)
+	{
+		timeStepStart[i] = timeStepCount;
+		timeStepCount += ObservationTimes(sequences[i].sequenceId).size();
+		_segmentSampleCounts[i] = Set().FrequencyCount(sequences[i].spw) * polarizationCount;
+	}
+	std::vector<bool> isPresent(timeStepCount, false);
+	
+	_remainingRows.assign(sequences.size(), 0);
+	_rangeStarts.resize(_rangeIsDone.size());
+	RangeStart state;
+	state.fieldId = size_t(-1);
+	state.sequenceId = size_t(-1);
+	std::vector<unsigned> rowSegments, rowTimeIndices;
+	// Like the table, the columns are only accessed and destructed under the casa mutex
+	boost::mutex::scoped_lock casaLock(_casaMutex);
+	ReorderColumns *columns = new ReorderColumns(*Table(), DataColumnName());
+	casaLock.unlock();
+	try {
+		for(size_t range=0; range!=_rangeIsDone.size(); ++range)
+		{
+			const size_t
+				startRow = range * _rowsPerRange,
+				endRow = std::min(startRow + _rowsPerRange, rowCount);
+			_rangeStarts[range] = state;
+			locateRows(*columns, startRow, endRow, state, rowSegments, rowTimeIndices);
+			for(size_t i=0; i!=endRow-startRow; ++i)
+			{
+				isPresent[timeStepStart[rowSegments[i]] + rowTimeIndices[i]] = true;
+				if(!_rangeIsDone[range])
+					++_remainingRows[rowSegments[i]];
+			}
+		}
+	} catch(...)
+	{
+		casaLock.lock();
+		delete columns;
+		throw;
+	}
+	casaLock.lock();
+	delete columns;
+	casaLock.unlock();
+	
+	float *data = reinterpret_cast<float*>(_dataMap->Data());
+	bool *flags = reinterpret_cast<bool*>(_flagMap->Data());
+	for(size_t i=0;i!=sequences.size();++i)
+	{
+		size_t sampleCount = _segmentSampleCounts[i];
+		size_t timeSteps = ObservationTimes(sequences[i].sequenceId).size();
+		for(size_t t=0;t!=timeSteps;++t)
+		{
+			if(!isPresent[timeStepStart[i] + t])
+			{
+				size_t filePos = _filePositions[i] + t * sampleCount;
+				memset(data + filePos*2, 0, sampleCount * 2 * sizeof(float));
+				memset(flags + filePos, true, sampleCount * sizeof(bool));
+			}
+		}
+	}
+}
+
+/**
+ * Determines for the rows [startRow, endRow) the baseline sequence (index in
+ * _filePositions) and the time step that they belong to.
+ * @param state The field and sequence before startRow; updated to those of the
+ * last row.
+ */
+void IndirectBaselineReader::locateRows(ReorderColumns &columns, size_t startRow, size_t endRow, RangeStart &state, std::vector<unsigned> &rowSegments, std::vector<unsigned> &rowTimeIndices)
+{
+	casa::Slicer rows(casa::IPosition(1, startRow), casa::IPosition(1, endRow - startRow), casa::Slicer::endIsLength);
+	casa::Vector<double> times;
+	casa::Vector<int> antenna1s, antenna2s, fieldIds, dataDescIds;
+	boost::mutex::scoped_lock casaLock(_casaMutex);
+	columns.time.getColumnRange(rows, times, true);
+	columns.antenna1.getColumnRange(rows, antenna1s, true);
+	columns.antenna2.getColumnRange(rows, antenna2s, true);
+	columns.fieldId.getColumnRange(rows, fieldIds, true);
+	columns.dataDescId.getColumnRange(rows, dataDescIds, true);
+	casaLock.unlock();
+	
+	rowSegments.resize(endRow - startRow);
+	rowTimeIndices.resize(endRow - startRow);
+	double prevTime = -1.0;
+	size_t timeIndex = size_t(-1);
+	for(size_t i = 0; i!=endRow-startRow; ++i)
+	{
+		size_t fieldId = fieldIds[i];
+		if(fieldId != state.fieldId)
+		{
+			state.fieldId = fieldId;
+			state.sequenceId++;
+			prevTime = -1.0;
+		}
+		double time = times[i];
+		if(time != prevTime)
+		{
+			timeIndex = ObservationTimes(state.sequenceId).find(time)->second;
+			prevTime = time;
+		}
+		
+		size_t spw = _dataIdToSpw[dataDescIds[i]];
+		rowSegments[i] = _seqIndexTable->Value(antenna1s[i], antenna2s[i], spw, state.sequenceId);
+		rowTimeIndices[i] = timeIndex;
+	}
+}
+
+void IndirectBaselineReader::reorderRanges()
+{
+	ReorderColumns *columns = 0;
+	try {
+		boost::mutex::scoped_lock casaLock(_casaMutex);
+		columns = new ReorderColumns(*Table(), DataColumnName());
+		casaLock.unlock();
+		
+		while(true)
+		{
+			boost::mutex::scoped_lock lock(_reorderMutex);
+			while(_nextRange < _rangeIsDone.size() && _rangeIsDone[_nextRange])
+				++_nextRange;
+			if(_nextRange == _rangeIsDone.size() || !_reorderError.empty())
+				break;
+			size_t range = _nextRange;
+			++_nextRange;
+			lock.unlock();
+			
+			reorderRange(range, *columns);
+		}
+	} catch(std::exception &e)
+	{
+		boost::mutex::scoped_lock lock(_reorderMutex);
+		_reorderError = e.what();
+		_segmentCompleted.notify_all();
+	}
+	boost::mutex::scoped_lock casaLock(_casaMutex);
+	delete columns;
+}
+
+/**
+ * Reorders the rows of a range. The rows are read in chunks of consecutive rows with
+ * the same number of samples, with one read of the data and flag columns per chunk.
+ * The samples are copied into the mapped files after the table has been unlocked, so
+ * that another thread can read its next chunk in the mean time. When the range is
+ * done, the pages that it wrote are synced before the range is recorded in the meta
+ * file, so that a resumed run never skips a range of which samples were lost. The rows
+ * of a baseline within a range are consecutive time steps, so the written samples form
+ * about one span per baseline, and only those spans are synced.
+ */
+void IndirectBaselineReader::reorderRange(size_t range, ReorderColumns &columns)
+{
+	const size_t
+		startRow = range * _rowsPerRange,
+		endRow = std::min(startRow + _rowsPerRange, _rowCount),
+		maxChunkBytes = 64*1024*1024;
+	float *dataStart = reinterpret_cast<float*>(_dataMap->Data());
+	bool *flagStart = reinterpret_cast<bool*>(_flagMap->Data());
+	
+	RangeStart state = _rangeStarts[range];
+	std::vector<unsigned> rowSegments, rowTimeIndices;
+	locateRows(columns, startRow, endRow, state, rowSegments, rowTimeIndices);
+	
+	casa::Array<casa::Complex> dataArray;
+	casa::Array<bool> flagArray;
+	// The [start, end) sample positions that were written
+	std::vector<std::pair<size_t, size_t> > spans;
+	spans.reserve(endRow - startRow);
+	size_t chunkStart = 0;
+	const size_t rangeRowCount = endRow - startRow;
+	while(chunkStart != rangeRowCount)
+	{
+		const size_t
+			sampleCount = _segmentSampleCounts[rowSegments[chunkStart]],
+			maxRowCount = std::max<size_t>(1, maxChunkBytes / (sampleCount * (sizeof(casa::Complex) + sizeof(bool))));
+		size_t chunkEnd = chunkStart + 1;
+		while(chunkEnd != rangeRowCount && chunkEnd - chunkStart < maxRowCount && _segmentSampleCounts[rowSegments[chunkEnd]] == sampleCount)
+			++chunkEnd;
+		
+		casa::Slicer rows(casa::IPosition(1, startRow + chunkStart), casa::IPosition(1, chunkEnd - chunkStart), casa::Slicer::endIsLength);
+		boost::mutex::scoped_lock casaLock(_casaMutex);
+		columns.data.getColumnRange(rows, dataArray, true);
+		columns.flag.getColumnRange(rows, flagArray, true);
+		casaLock.unlock();
+		
+		const float *data = reinterpret_cast<const float*>(dataArray.data());
+		const bool *flags = flagArray.data();
+		for(size_t rowIndex = chunkStart; rowIndex!=chunkEnd; ++rowIndex)
+		{
+			size_t filePos = _filePositions[rowSegments[rowIndex]] + rowTimeIndices[rowIndex] * sampleCount;
+			memcpy(dataStart + filePos*2, data, sampleCount * 2 * sizeof(float));
+			memcpy(flagStart + filePos, flags, sampleCount * sizeof(bool));
+			data += sampleCount * 2;
+			flags += sampleCount;
+			spans.push_back(std::pair<size_t, size_t>(filePos, filePos + sampleCount));
+		}
+		
+		boost::mutex::scoped_lock lock(_reorderMutex);
+		bool hasCompletedSegment = false;
+		for(size_t rowIndex = chunkStart; rowIndex!=chunkEnd; ++rowIndex)
+		{
+			if(--_remainingRows[rowSegments[rowIndex]] == 0)
+				hasCompletedSegment = true;
+		}
+		if(hasCompletedSegment)
+			_segmentCompleted.notify_all();
+		lock.unlock();
+		
+		chunkStart = chunkEnd;
+	}
+	
+	std::sort(spans.begin(), spans.end());
+	std::vector<std::pair<size_t, size_t> >::const_iterator span = spans.begin();
+	while(span != spans.end())
+	{
+		size_t spanStart = span->first, spanEnd = span->second;
+		++span;
+		while(span != spans.end() && span->first <= spanEnd)
+		{
+			spanEnd = std::max(spanEnd, span->second);
+			++span;
+		}
+		_dataMap->Sync(spanStart * sizeof(float) * 2, (spanEnd - spanStart) * sizeof(float) * 2);
+		_flagMap->Sync(spanStart * sizeof(bool), (spanEnd - spanStart) * sizeof(bool));
+	}
+	
+	std::ostringstream record;
+	record << range << '\n';
+	boost::mutex::scoped_lock lock(_reorderMutex);
+	appendToMeta(record.str());
+	_rangeIsDone[range] = true;
+}
+
+void IndirectBaselineReader::waitForSegment(size_t index)
+{
+	boost::mutex::scoped_lock lock(_reorderMutex);
+	while(_remainingRows[index] != 0 && _reorderError.empty())
+		_segmentCompleted.wait(lock);
+	if(!_reorderError.empty())
+		throw std::runtime_error("Error while reordering the measurement set: " + _reorderError);
+}
+
+void IndirectBaselineReader::waitForReorder()
+{
+	if(_reorderThreads != 0)
+	{
+		_reorderThreads->join_all();
+		delete _reorderThreads;
+		_reorderThreads = 0;
+		
+		_reorderWatch.Pause();
+		if(_reorderError.empty())
+		{
+			uint64_t dataSetSize = (uint64_t) _dataMap->Size() + (uint64_t) _flagMap->Size();
+			AOLogger::Debug << "Done reordering data set of " << dataSetSize/(1024*1024) << " MB in " << _reorderWatch.Seconds() << " s (" << (long double) dataSetSize/(1024.0L*1024.0L*_reorderWatch.Seconds()) << " MB/s)\n";
+		}
 	}
 }
 
@@ -200,130 +652,25 @@ void IndirectBaselineReader::preAllocate(const char *filename, size_t fileSize)
 		throw std::runtime_error(s.str());
 	}
 	int allocResult = posix_fallocate(fd, 0, fileSize);
-	close(fd);
 	if(allocResult != 0)
 	{
 		AOLogger::Warn <<
 			"Could not allocate temporary file '" << filename << "': posix_fallocate returned " << allocResult << ".\n"
 			"Tried to allocate " << (fileSize/(1024*1024)) << " MB.\n"
 			"Disk could be full or filesystem could not support fallocate.\n";
-	}
-}
-
-void IndirectBaselineReader::reorderFull()
-{
-	Stopwatch watch(true);
-	
-	casa::Table &table = *Table();
-
-	casa::ROScalarColumn<double> timeColumn(*Table(), "TIME");
-	casa::ROArrayColumn<bool> flagColumn(table, "FLAG");
-	casa::ROScalarColumn<int> fieldIdColumn(table, "FIELD_ID"); 
-	casa::ROScalarColumn<int> dataDescIdColumn(table, "DATA_DESC_ID"); 
-	casa::ROScalarColumn<int> antenna1Column(table, "ANTENNA1"); 
-	casa::ROScalarColumn<int> antenna2Column(table, "ANTENNA2");
-
-	size_t rowCount = table.nrow();
-	if(rowCount == 0)
-		throw std::runtime_error("Measurement set is empty (zero rows)");
-
-	casa::ROArrayColumn<casa::Complex> *dataColumn = new casa::ROArrayColumn<casa::Complex>(table, DataColumnName());
-
-	std::vector<size_t> dataIdToSpw;
-	Set().GetDataDescToBandVector(dataIdToSpw);
-	
-	size_t fileSize;
-	makeLookupTables(fileSize);
-	
-	AOLogger::Debug << "Opening temporary files.\n";
-	ReorderInfo reorderInfo;
-	preAllocate(DataFilename(), fileSize*sizeof(float)*2);
-	reorderInfo.dataFile.reset(new std::ofstream(DataFilename(), std::ofstream::binary | std::ios_base::in | std::ios_base::out));
-	if(reorderInfo.dataFile->fail())
-		throw std::runtime_error("Error: failed to open temporary data files for writing! Check access rights and free disk space.");
-	
-	preAllocate(FlagFilename(), fileSize*sizeof(bool));
-	reorderInfo.flagFile.reset(new std::ofstream(FlagFilename(), std::ofstream::binary | std::ios_base::in | std::ios_base::out));
-	if(reorderInfo.flagFile->fail())
-		throw std::runtime_error("Error: failed to open temporary data files for writing! Check access rights and free disk space.");
-
-	AOLogger::Debug << "Reordering data set...\n";
-	size_t prevFieldId = size_t(-1), sequenceId = size_t(-1);
-	std::vector<std::size_t> writeFilePositions = _filePositions;
-	std::vector<std::size_t> timePositions(_filePositions.size(), size_t(-1));
-	double prevTime = -1.0;
-	size_t timeIndex = size_t(-1);
-	for(size_t rowIndex = 0; rowIndex!=rowCount; ++rowIndex)
-	{
-		size_t fieldId = fieldIdColumn(rowIndex);
-		if(fieldId != prevFieldId)
+		// The file is memory-mapped, so it needs its full size anyway
+		if(ftruncate(fd, fileSize) != 0)
 		{
-			prevFieldId = fieldId;
-			sequenceId++;
-			prevTime = -1.0;
-		}
-		double time = timeColumn(rowIndex);
-		if(time != prevTime)
-		{
-			timeIndex = ObservationTimes(sequenceId).find(time)->second;
-			prevTime = time;
-		}
-		
-		size_t polarizationCount = PolarizationCount();
-		size_t antenna1 = antenna1Column(rowIndex);
-		size_t antenna2 = antenna2Column(rowIndex);
-		size_t spw = dataIdToSpw[dataDescIdColumn(rowIndex)];
-		size_t channelCount = Set().FrequencyCount(spw);
-		size_t arrayIndex = _seqIndexTable->Value(antenna1, antenna2, spw, sequenceId);
-		size_t &filePos = writeFilePositions[arrayIndex];
-		size_t &timePos = timePositions[arrayIndex];
-		size_t sampleCount = channelCount * polarizationCount;
-		
-		casa::Array<casa::Complex> data = (*dataColumn)(rowIndex);
-		casa::Array<bool> flag = flagColumn(rowIndex);
-		
-		std::ofstream &dataFile = *reorderInfo.dataFile;
-		std::ofstream &flagFile = *reorderInfo.flagFile;
-		
-		dataFile.seekp(filePos * (sizeof(float)*2), std::ios_base::beg);
-		flagFile.seekp(filePos * sizeof(bool), std::ios_base::beg);
-		
-		// If this baseline missed some time steps, pad the files
-		// (we can't just skip over, because the flags should be set to true)
-		++timePos;
-		while(timePos < timeIndex)
-		{
-			const std::vector<float> nullData(sampleCount*2, 0.0);
-			const std::vector<char> nullFlags(sampleCount, (char) true);
-			dataFile.write(reinterpret_cast<const char*>(&*nullData.begin()), sampleCount * 2 * sizeof(float));
-			flagFile.write(reinterpret_cast<const char*>(&*nullFlags.begin()), sampleCount * sizeof(bool));
-			++timePos;
-			filePos += sampleCount;
+			close(fd);
+			throw std::runtime_error("Could not resize temporary file, check free space");
 		}
-		
-		dataFile.write(reinterpret_cast<const char*>(&*data.cbegin()), sampleCount * 2 * sizeof(float));
-		if(dataFile.fail())
-			throw std::runtime_error("Error: failed to write temporary data file! Check access rights and free disk space.");
-		
-		flagFile.write(reinterpret_cast<const char*>(&*flag.cbegin()), sampleCount * sizeof(bool));
-		if(flagFile.fail())
-			throw std::runtime_error("Error: failed to write temporary flag file! Check access rights and free disk space.");
-		
-		filePos += sampleCount;
 	}
-	
-	delete dataColumn;
-
-	uint64_t dataSetSize = (uint64_t) fileSize * (uint64_t) (sizeof(float)*2 + sizeof(bool));
-	AOLogger::Debug << "Done reordering data set of " << dataSetSize/(1024*1024) << " MB in " << watch.Seconds() << " s (" << (long double) dataSetSize/(1024.0L*1024.0L*watch.Seconds()) << " MB/s)\n";
-	_msIsReordered = true;
-	_removeReorderedFiles = true;
-	_reorderedDataFilesHaveChanged = false;
-	_reorderedFlagFilesHaveChanged = false;
+	close(fd);
 }
 
 void IndirectBaselineReader::removeTemporaryFiles()
 {
+	unmapReorderedFiles();
 	if(_msIsReordered && _removeReorderedFiles)
 	{
 		boost::filesystem::remove(MetaFilename());
@@ -355,32 +702,25 @@ void IndirectBaselineReader::PerformDataWriteTask(std::vector<Image2DCPtr> _real
 	}
 	
 	if(!_msIsReordered) reorderedMS();
+	mapReorderedFiles();
 	
 	const size_t width = _realImages[0]->Width();
-	const size_t bufferSize = Set().FrequencyCount(spectralWindow) * PolarizationCount();
+	const size_t channelCount = Set().FrequencyCount(spectralWindow);
 	
-	std::ofstream dataFile(DataFilename(), std::ofstream::binary | std::ios_base::in | std::ios_base::out);
 	size_t index = _seqIndexTable->Value(antenna1, antenna2, spectralWindow, sequenceId);
-	size_t filePos = _filePositions[index];
-	dataFile.seekp(filePos*(sizeof(float)*2), std::ios_base::beg);
-	
-	std::vector<float> dataBuffer(bufferSize*2);
+	waitForSegment(index);
+	markReorderedFilesChanged();
+	float *data = reinterpret_cast<float*>(_dataMap->Data()) + _filePositions[index]*2;
 	for(size_t x=0;x<width;++x)
 	{
-		size_t dataBufferPtr = 0;
-		for(size_t f=0;f<Set().FrequencyCount(spectralWindow);++f) {
-			for(size_t p=0;p<PolarizationCount();++p)
+		for(size_t f=0;f<channelCount;++f) {
+			for(size_t p=0;p<polarizationCount;++p)
 			{
-				dataBuffer[dataBufferPtr] = _realImages[p]->Value(x, f);
-				++dataBufferPtr;
-				dataBuffer[dataBufferPtr] = _imaginaryImages[p]->Value(x, f);
-				++dataBufferPtr;
+				data[0] = _realImages[p]->Value(x, f);
+				data[1] = _imaginaryImages[p]->Value(x, f);
+				data += 2;
 			}
 		}
-
-		dataFile.write(reinterpret_cast<char*>(&dataBuffer[0]), bufferSize * sizeof(float) * 2);
-		if(dataFile.bad())
-			throw std::runtime_error("Error: failed to update temporary data files! Check access rights and free disk space.");
 	}
 	
 	_reorderedDataFilesHaveChanged = true;
@@ -388,10 +728,11 @@ void IndirectBaselineReader::PerformDataWriteTask(std::vector<Image2DCPtr> _real
 	AOLogger::Debug << "Done writing.\n";
 }
 
-void IndirectBaselineReader::performFlagWriteTask(std::vector<Mask2DCPtr> flags, unsigned antenna1, unsigned antenna2, unsigned spw, unsigned sequenceId)
+void IndirectBaselineReader::performFlagWriteTask(const FlagWriteRequest &request)
 {
 	initializeMeta();
 
+	const std::vector<Mask2DCPtr> &flags = request.flags;
 	const unsigned polarizationCount = PolarizationCount();
 	
 	if(flags.size() != polarizationCount)
@@ -404,32 +745,31 @@ void IndirectBaselineReader::performFlagWriteTask(std::vector<Mask2DCPtr> flags,
 	}
 	
 	if(!_msIsReordered) reorderedMS();
+	mapReorderedFiles();
 	
-	const size_t width = flags[0]->Width();
-	const size_t bufferSize = Set().FrequencyCount(spw) * PolarizationCount();
+	if(request.endIndex - request.startIndex != flags[0]->Width())
+		throw std::runtime_error("performFlagWriteTask: number of time steps does not match the flag mask");
 	
-	std::ofstream flagFile(FlagFilename(), std::ofstream::binary | std::ios_base::in | std::ios_base::out);
-	size_t index = _seqIndexTable->Value(antenna1, antenna2, spw, sequenceId);
-	size_t filePos = _filePositions[index];
-	flagFile.seekp(filePos*(sizeof(bool)), std::ios_base::beg);
+	const size_t channelCount = Set().FrequencyCount(request.spectralWindow);
 	
-	bool *flagBuffer = new bool[bufferSize];
-	for(size_t x=0;x<width;++x)
+	// Only the time steps between the borders are written
+	size_t index = _seqIndexTable->Value(request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
+	waitForSegment(index);
+	markReorderedFilesChanged();
+	const size_t
+		firstX = request.leftBorder,
+		endX = flags[0]->Width() - request.rightBorder;
+	bool *flagPtr = reinterpret_cast<bool*>(_flagMap->Data()) + _filePositions[index] + (request.startIndex + firstX) * channelCount * polarizationCount;
+	for(size_t x=firstX;x<endX;++x)
 	{
-		size_t flagBufferPtr = 0;
-		for(size_t f=0;f<Set().FrequencyCount(spw);++f) {
-			for(size_t p=0;p<PolarizationCount();++p)
+		for(size_t f=0;f<channelCount;++f) {
+			for(size_t p=0;p<polarizationCount;++p)
 			{
-				flagBuffer[flagBufferPtr] = flags[p]->Value(x, f);
-				++flagBufferPtr;
+				*flagPtr = flags[p]->Value(x, f);
+				++flagPtr;
 			}
 		}
-
-		flagFile.write(reinterpret_cast<char*>(flagBuffer), bufferSize * sizeof(bool));
-		if(flagFile.bad())
-			throw std::runtime_error("Error: failed to update temporary flag files! Check access rights and free disk space.");
 	}
-	delete[] flagBuffer;
 	
 	_reorderedFlagFilesHaveChanged = true;
 }
@@ -439,15 +779,20 @@ void IndirectBaselineReader::updateOriginalMS()
 {
 	casa::Table &table = *Table();
 
-	casa::ROScalarColumn<double> timeColumn(*Table(), "TIME");
-	casa::ROScalarColumn<int> antenna1Column(table, "ANTENNA1"); 
-	casa::ROScalarColumn<int> antenna2Column(table, "ANTENNA2");
-	casa::ROScalarColumn<int> fieldIdColumn(table, "FIELD_ID");
-	casa::ROScalarColumn<int> dataDescIdColumn(table, "DATA_DESC_ID");
-	casa::ArrayColumn<bool> flagColumn(table, "FLAG");
-	casa::ArrayColumn<casa::Complex> *dataColumn = new casa::ArrayColumn<casa::Complex>(table, DataColumnName());
-
+	// The meta data is read at once, so that the flag writer does not have to wait for
+	// the table while the rows are collected.
+	boost::mutex::scoped_lock casaLock(_casaMutex);
+	casa::Vector<double> times = casa::ROScalarColumn<double>(table, "TIME").getColumn();
+	casa::Vector<int>
+		antenna1s = casa::ROScalarColumn<int>(table, "ANTENNA1").getColumn(),
+		antenna2s = casa::ROScalarColumn<int>(table, "ANTENNA2").getColumn(),
+		fieldIds = casa::ROScalarColumn<int>(table, "FIELD_ID").getColumn(),
+		dataDescIds = casa::ROScalarColumn<int>(table, "DATA_DESC_ID").getColumn();
+	casa::ArrayColumn<casa::Complex> *dataColumn = 0;
+	if(UpdateData)
+		dataColumn = new casa::ArrayColumn<casa::Complex>(table, DataColumnName());
 	int rowCount = table.nrow();
+	casaLock.unlock();
 
 	std::vector<MeasurementSet::Sequence> sequences = Set().GetSequences();
 	std::vector<size_t> dataIdToSpw;
@@ -455,21 +800,15 @@ void IndirectBaselineReader::updateOriginalMS()
 	
 	size_t polarizationCount = PolarizationCount();
 
-	AOLogger::Debug << "Opening updated files\n";
-	UpdateInfo updateInfo;
+	mapReorderedFiles();
+	const float *dataStart = reinterpret_cast<const float*>(_dataMap->Data());
+	const bool *flagStart = reinterpret_cast<const bool*>(_flagMap->Data());
 	
-	if(UpdateData)
-	{
-		updateInfo.dataFile.reset(new std::ifstream(DataFilename(), std::ifstream::binary));
-		if(updateInfo.dataFile->fail())
-			throw std::runtime_error("Failed to open temporary data file");
-	}
-	if(UpdateFlags)
-	{
-		updateInfo.flagFile.reset(new std::ifstream(FlagFilename(), std::ifstream::binary));
-		if(updateInfo.flagFile->fail())
-			throw std::runtime_error("Failed to open temporary flag file");
-	}
+	// Flags are handed to the flag writer in batches of about 16 MB, so that it can
+	// write while the next batch is collected.
+	FlagWriter *writer = UpdateFlags ? &flagWriter() : 0;
+	const size_t batchSize = 16*1024*1024;
+	size_t batchFlagCount = 0;
 
 	size_t prevFieldId = size_t(-1), sequenceId = size_t(-1);
 	std::vector<size_t> updatedFilePos = _filePositions;
@@ -478,30 +817,28 @@ void IndirectBaselineReader::updateOriginalMS()
 	size_t timeIndex = size_t(-1);
 	for(int rowIndex = 0; rowIndex!=rowCount; ++rowIndex)
 	{
-		size_t fieldId = fieldIdColumn(rowIndex);
+		size_t fieldId = fieldIds[rowIndex];
 		if(fieldId != prevFieldId)
 		{
 			prevFieldId = fieldId;
 			sequenceId++;
 		}
-		double time = timeColumn(rowIndex);
+		double time = times[rowIndex];
 		if(time != prevTime)
 		{
 			timeIndex = ObservationTimes(sequenceId).find(time)->second;
 			prevTime = time;
 		}
 		
-		size_t antenna1 = antenna1Column(rowIndex);
-		size_t antenna2 = antenna2Column(rowIndex);
-		size_t spw = dataIdToSpw[dataDescIdColumn(rowIndex)];
+		size_t antenna1 = antenna1s[rowIndex];
+		size_t antenna2 = antenna2s[rowIndex];
+		size_t spw = dataIdToSpw[dataDescIds[rowIndex]];
 		size_t channelCount = Set().FrequencyCount(spw);
 		size_t arrayIndex = _seqIndexTable->Value(antenna1, antenna2, spw, sequenceId);
 		size_t sampleCount = channelCount * polarizationCount;
 		size_t &filePos = updatedFilePos[arrayIndex];
 		size_t &timePos = timePositions[arrayIndex];
 		
-		casa::IPosition shape(2, polarizationCount, channelCount);
-		
 		// Skip over samples in the temporary files that are missing in the measurement set
 		++timePos;
 		while(timePos < timeIndex)
@@ -512,38 +849,30 @@ void IndirectBaselineReader::updateOriginalMS()
 		
 		if(UpdateData)
 		{
+			casa::IPosition shape(2, polarizationCount, channelCount);
 			casa::Array<casa::Complex> data(shape);
-			
-			std::ifstream &dataFile = *updateInfo.dataFile;
-			dataFile.seekg(filePos*(sizeof(float)*2), std::ios_base::beg);
-			dataFile.read(reinterpret_cast<char*>(&*data.cbegin()), sampleCount * 2 * sizeof(float));
-			if(dataFile.fail())
-				throw std::runtime_error("Error: failed to read temporary data files!");
-						
+			memcpy(reinterpret_cast<char*>(&*data.cbegin()), dataStart + filePos*2, sampleCount * 2 * sizeof(float));
+			casaLock.lock();
 			dataColumn->basePut(rowIndex, data);
+			casaLock.unlock();
 		}
 		if(UpdateFlags)
 		{
-			casa::Array<bool> flagArray(shape);
-			
-			std::ifstream &flagFile = *updateInfo.flagFile;
-			flagFile.seekg(filePos*sizeof(bool), std::ios_base::beg);
-			flagFile.read(reinterpret_cast<char*>(&*flagArray.cbegin()), sampleCount * sizeof(bool));
-			if(flagFile.fail())
-				throw std::runtime_error("Error: failed to read temporary flag files!");
-			
-			flagColumn.basePut(rowIndex, flagArray);
+			memcpy(writer->AddRow(rowIndex, channelCount), flagStart + filePos, sampleCount * sizeof(bool));
+			batchFlagCount += sampleCount;
+			if(batchFlagCount >= batchSize)
+			{
+				writer->Flush();
+				batchFlagCount = 0;
+			}
 		}
 		
 		filePos += sampleCount;
 	}
 	
-	AOLogger::Debug << "Freeing the data\n";
-	
-	// Close the files
-	updateInfo.dataFile.reset();
-	updateInfo.flagFile.reset();
-
+	if(UpdateFlags)
+		closeFlagWriter();
+	casaLock.lock();
 	delete dataColumn;
 	
 	if(UpdateData)
@@ -26,12 +26,31 @@
 #include <vector>
 #include <stdexcept>
 
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "baselinereader.h"
 #include "directbaselinereader.h"
+#include "mappedfile.h"
+
+#include "../util/stopwatch.h"
 
 /**
-	@author A.R. Offringa <offringa@astro.rug.nl>
-*/
+ * Reads baselines from a measurement set after reordering it into temporary files that
+ * hold the data and flags of each baseline contiguously. The reordered files are
+ * memory-mapped: reading a baseline copies its samples straight from the mapping into
+ * the images and masks, and flags are written straight into the mapping.
+ *
+ * Reordering is done by several threads, each taking ranges of rows of the main table.
+ * Only access to the table itself is serialized. Reordering continues in the
+ * background while baselines are requested: a request waits until all rows of its
+ * baseline have been reordered. Completed row ranges are recorded in the meta file once
+ * their samples are on disk, so that an interrupted or failed run can resume the
+ * reordering where it stopped. Once flags or data have been written to the reordered
+ * files, they no longer hold the original samples and are not used to resume.
+ * @author A.R. Offringa <offringa@astro.rug.nl>
+ */
 class IndirectBaselineReader : public BaselineReader {
 	public:
 		explicit IndirectBaselineReader(const std::string &msFile);
@@ -45,18 +64,6 @@ class IndirectBaselineReader : public BaselineReader {
 		virtual size_t GetMaxRecommendedBufferSize(size_t /*threadCount*/) { return 2; }
 		void SetReadUVW(bool readUVW) { _readUVW = readUVW; }
 	private:
-		class ReorderInfo
-		{
-		public:
-			std::auto_ptr<std::ofstream> dataFile;
-			std::auto_ptr<std::ofstream> flagFile;
-		};
-		class UpdateInfo
-		{
-		public:
-			std::auto_ptr<std::ifstream> dataFile;
-			std::auto_ptr<std::ifstream> flagFile;
-		};
 		class SeqIndexLookupTable
 		{
 		public:
@@ -83,17 +90,46 @@ class IndirectBaselineReader : public BaselineReader {
 			size_t _antennaCount;
 			std::vector<std::vector<std::vector<size_t> > > _table;
 		};
+		struct ReorderColumns;
+		/**
+		 * The field of the row before a range and the number of field changes up to
+		 * that row, which determine the sequence of the rows in the range.
+		 */
+		struct RangeStart
+		{
+			size_t fieldId, sequenceId;
+		};
+		class ReorderFunction
+		{
+		public:
+			ReorderFunction(IndirectBaselineReader &reader) : _reader(reader) { }
+			void operator()() { _reader.reorderRanges(); }
+		private:
+			IndirectBaselineReader &_reader;
+		};
+		
 		void reorderedMS();
-		void reorderFull();
+		bool readMeta(size_t rowCount, size_t fileSize);
+		void writeMeta(size_t rowCount);
+		void appendToMeta(const std::string &line);
+		void markReorderedFilesChanged();
+		void prepareReorder(size_t rowCount);
+		void reorderRanges();
+		void reorderRange(size_t range, ReorderColumns &columns);
+		void locateRows(ReorderColumns &columns, size_t startRow, size_t endRow, RangeStart &state, std::vector<unsigned> &rowSegments, std::vector<unsigned> &rowTimeIndices);
+		void waitForSegment(size_t index);
+		void waitForReorder();
 		void makeLookupTables(size_t &fileSize);
 		void updateOriginalMSData();
 		void updateOriginalMSFlags();
-		void performFlagWriteTask(std::vector<Mask2DCPtr> flags, unsigned antenna1, unsigned antenna2, unsigned spw, unsigned sequenceId);
+		void performFlagWriteTask(const FlagWriteRequest &request);
 		
 		template<bool UpdateData, bool UpdateFlags>
 		void updateOriginalMS();
 		
 		void removeTemporaryFiles();
+		void mapReorderedFiles();
+		void unmapReorderedFiles();
 		
 		static void preAllocate(const char *filename, size_t fileSize);
 		static const char* DataFilename()
@@ -108,10 +144,27 @@ class IndirectBaselineReader : public BaselineReader {
 		{
 			return "ao-msinfo.tmp";
 		}
+		static const char* ChangedRecord()
+		{
+			return "changed";
+		}
 
 		DirectBaselineReader _directReader;
 		SeqIndexLookupTable *_seqIndexTable;
 		std::vector<size_t> _filePositions;
+		MappedFile *_dataMap, *_flagMap;
+		
+		// Reordering state. The casa mutex of the BaselineReader serializes access to the
+		// tables, the reorder mutex protects the progress.
+		boost::thread_group *_reorderThreads;
+		boost::mutex _reorderMutex;
+		boost::condition _segmentCompleted;
+		std::vector<size_t> _remainingRows, _segmentSampleCounts, _dataIdToSpw;
+		std::vector<RangeStart> _rangeStarts;
+		std::vector<bool> _rangeIsDone;
+		size_t _rowCount, _rowsPerRange, _nextRange;
+		std::string _reorderError;
+		Stopwatch _reorderWatch;
 		bool _msIsReordered;
 		bool _removeReorderedFiles;
 		bool _reorderedDataFilesHaveChanged;
@@ -0,0 +1,102 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "mappedfile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string &filename, bool writable) : _fd(-1), _data(0), _size(0)
+{
+	_fd = open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+	if(_fd < 0)
+	{
+		std::ostringstream s;
+		s << "Could not open file '" << filename << "' for mapping: " << strerror(errno);
+		throw std::runtime_error(s.str());
+	}
+	struct stat fileStat;
+	if(fstat(_fd, &fileStat) != 0)
+	{
+		close(_fd);
+		throw std::runtime_error("Could not determine size of file '" + filename + "'");
+	}
+	_size = fileStat.st_size;
+	// An empty file can not be mapped, but there is nothing to access either
+	if(_size != 0)
+	{
+		int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+		void *data = mmap(0, _size, protection, MAP_SHARED, _fd, 0);
+		if(data == MAP_FAILED)
+		{
+			std::ostringstream s;
+			s << "Could not map file '" << filename << "' of " << (_size/(1024*1024)) << " MB into memory: " << strerror(errno);
+			close(_fd);
+			throw std::runtime_error(s.str());
+		}
+		_data = static_cast<char*>(data);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if(_data != 0)
+		munmap(_data, _size);
+	close(_fd);
+}
+
+void MappedFile::Sync()
+{
+	if(_data != 0 && msync(_data, _size, MS_SYNC) != 0)
+		throw std::runtime_error("Could not write mapped memory back to file");
+}
+
+void MappedFile::Sync(size_t offset, size_t length)
+{
+	if(_data != 0 && offset < _size && length != 0)
+	{
+		// msync() requires an address at the start of a page
+		size_t pageSize = sysconf(_SC_PAGESIZE);
+		size_t start = (offset / pageSize) * pageSize;
+		if(offset + length > _size)
+			length = _size - offset;
+		if(msync(_data + start, offset + length - start, MS_SYNC) != 0)
+			throw std::runtime_error("Could not write mapped memory back to file");
+	}
+}
+
+void MappedFile::WillNeed(size_t offset, size_t length) const
+{
+	if(_data != 0 && offset < _size)
+	{
+		// madvise() requires an address at the start of a page
+		size_t pageSize = sysconf(_SC_PAGESIZE);
+		size_t start = (offset / pageSize) * pageSize;
+		if(offset + length > _size)
+			length = _size - offset;
+		madvise(_data + start, offset + length - start, MADV_WILLNEED);
+	}
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+/**
+ * Maps a whole file into memory with mmap(), so that its contents can be accessed
+ * without read and write calls and without copying them into separate buffers. The
+ * mapping is shared: writes to the mapped memory end up in the file.
+ *
+ * Since pages are only read from disk when they are first accessed, a reader that
+ * knows which part of the file it will need should announce it with WillNeed(), which
+ * lets the kernel read ahead.
+ */
+class MappedFile : private boost::noncopyable
+{
+	public:
+		/**
+		 * Maps the file. Throws a std::runtime_error if the file can not be opened or
+		 * mapped.
+		 * @param writable Whether the mapping may be written to.
+		 */
+		MappedFile(const std::string &filename, bool writable);
+		~MappedFile();
+		
+		char *Data() { return _data; }
+		const char *Data() const { return _data; }
+		size_t Size() const { return _size; }
+		
+		/**
+		 * Advises the kernel that the given byte range will be accessed soon.
+		 */
+		void WillNeed(size_t offset, size_t length) const;
+		
+		/**
+		 * Writes changes to the mapped memory to the file and waits for it to finish.
+		 */
+		void Sync();
+		
+		/**
+		 * Like Sync(), but only for the pages that hold the given byte range.
+		 */
+		void Sync(size_t offset, size_t length);
+	private:
+		int _fd;
+		char *_data;
+		size_t _size;
+};
+
+#endif // MAPPEDFILE_H
@@ -19,9 +19,13 @@
  ***************************************************************************/
 #include "mask2d.h"
 #include "image2d.h"
+#include "memoryaccounting.h"
+#include "samplepool.h"
 
 #include <iostream>
 
+#include <stdint.h>
+
 Mask2D::Mask2D(size_t width, size_t height) :
 	_width(width),
 	_height(height),
@@ -30,9 +34,10 @@ Mask2D::Mask2D(size_t width, size_t height) :
 	if(_width == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
 	if(height == 0) allocHeight = 0;
-	_valuesConsecutive = new bool[_stride * allocHeight * sizeof(bool)];
+	_valuesConsecutive = static_cast<bool*>(SamplePool::Allocate(_stride * allocHeight * sizeof(bool)));
+	MemoryAccounting::Allocate(_stride * allocHeight * sizeof(bool));
 	
-	_values = new bool*[allocHeight];
+	_values = static_cast<bool**>(SamplePool::Allocate(allocHeight * sizeof(bool*)));
 	for(size_t y=0;y<height;++y)
 	{
 		_values[y] = &_valuesConsecutive[_stride * y];
@@ -57,8 +62,11 @@ Mask2D::Mask2D(size_t width, size_t height) :
 
 Mask2D::~Mask2D()
 {
-	delete[] _values;
-	delete[] _valuesConsecutive;
+	unsigned allocHeight = ((((_height-1)/4)+1)*4);
+	if(_height == 0) allocHeight = 0;
+	SamplePool::Free(_values, allocHeight * sizeof(bool*));
+	SamplePool::Free(_valuesConsecutive, _stride * allocHeight * sizeof(bool));
+	MemoryAccounting::Free(_stride * allocHeight * sizeof(bool));
 }
 
 Mask2D *Mask2D::CreateUnsetMask(const Image2D &templateImage)
@@ -92,6 +100,80 @@ Mask2D *Mask2D::CreateCopy(const Mask2D &source)
 	return newMask;
 }
 
+void Mask2D::Join(Mask2DCPtr other)
+{
+	// Values in the padding of the rows are never used, so the whole buffer
+	// can be processed at once.
+	const size_t n = _stride * _height, wordCount = n / sizeof(uint64_t);
+	for(size_t w=0;w<wordCount;++w)
+	{
+		uint64_t dest, src;
+		memcpy(&dest, _valuesConsecutive + w*sizeof(uint64_t), sizeof(uint64_t));
+		memcpy(&src, other->_valuesConsecutive + w*sizeof(uint64_t), sizeof(uint64_t));
+		dest |= src;
+		memcpy(_valuesConsecutive + w*sizeof(uint64_t), &dest, sizeof(uint64_t));
+	}
+	for(size_t i=wordCount*sizeof(uint64_t);i<n;++i)
+		_valuesConsecutive[i] = _valuesConsecutive[i] || other->_valuesConsecutive[i];
+}
+
+void Mask2D::Intersect(Mask2DCPtr other)
+{
+	const size_t n = _stride * _height, wordCount = n / sizeof(uint64_t);
+	for(size_t w=0;w<wordCount;++w)
+	{
+		uint64_t dest, src;
+		memcpy(&dest, _valuesConsecutive + w*sizeof(uint64_t), sizeof(uint64_t));
+		memcpy(&src, other->_valuesConsecutive + w*sizeof(uint64_t), sizeof(uint64_t));
+		dest &= src;
+		memcpy(_valuesConsecutive + w*sizeof(uint64_t), &dest, sizeof(uint64_t));
+	}
+	for(size_t i=wordCount*sizeof(uint64_t);i<n;++i)
+		_valuesConsecutive[i] = _valuesConsecutive[i] && other->_valuesConsecutive[i];
+}
+
+size_t Mask2D::countTrue() const
+{
+	// Every bool is stored as 0 or 1, hence the number of set bits in
+	// eight consecutive bools equals the number of true values.
+	const size_t wordCount = _width / sizeof(uint64_t);
+	size_t count = 0;
+	for(size_t y=0;y<_height;++y)
+	{
+		const bool *row = _values[y];
+		for(size_t w=0;w<wordCount;++w)
+		{
+			uint64_t eightValues;
+			memcpy(&eightValues, row + w*sizeof(uint64_t), sizeof(uint64_t));
+			count += __builtin_popcountll(eightValues);
+		}
+		for(size_t x=wordCount*sizeof(uint64_t);x<_width;++x)
+			count += row[x] ? 1 : 0;
+	}
+	return count;
+}
+
+bool Mask2D::AllFalse() const
+{
+	const size_t wordCount = _width / sizeof(uint64_t);
+	for(size_t y=0;y<_height;++y)
+	{
+		const bool *row = _values[y];
+		uint64_t combined = 0;
+		for(size_t w=0;w<wordCount;++w)
+		{
+			uint64_t eightValues;
+			memcpy(&eightValues, row + w*sizeof(uint64_t), sizeof(uint64_t));
+			combined |= eightValues;
+		}
+		for(size_t x=wordCount*sizeof(uint64_t);x<_width;++x)
+			combined |= row[x];
+		if(combined != 0)
+			return false;
+	}
+	return true;
+}
+
 Mask2DPtr Mask2D::ShrinkHorizontally(int factor) const
 {
 	size_t newWidth = (_width + factor - 1) / factor;
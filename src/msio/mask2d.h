@@ -36,6 +36,16 @@ class Mask2D {
 	public:
 		~Mask2D();
 
+		static void *operator new(size_t size)
+		{
+			return SamplePool::Allocate(size);
+		}
+
+		static void operator delete(void *mask, size_t size)
+		{
+			SamplePool::Free(mask, size);
+		}
+
 		// This method assumes equal height and width.
 		void operator=(Mask2DCPtr source)
 		{
@@ -133,18 +143,11 @@ class Mask2D {
 		
 		inline size_t Height() const { return _height; }
 
-		bool AllFalse() const
-		{
-			for(size_t y=0;y<_height;++y)
-			{
-				for(size_t x=0;x<_width;++x)
-				{
-					if(_values[y][x])
-						return false;
-				}
-			}
-			return true;
-		}
+		/**
+		 * Returns true if none of the samples is flagged. Eight samples are
+		 * tested at a time.
+		 */
+		bool AllFalse() const;
 
 		/**
 		 * Returns a pointer to one row of data. This can be used to step
@@ -264,23 +267,16 @@ class Mask2D {
 		template<bool BoolValue>
 		size_t GetCount() const
 		{
-			size_t count = 0;
-			for(size_t y=0;y<_height;++y)
-			{
-				for(size_t x=0;x<_width;++x)
-					if(BoolValue == _values[y][x])
-						++count;
-			}
-			return count;
+			const size_t trueCount = countTrue();
+			return BoolValue ? trueCount : (_width * _height - trueCount);
 		}
 		
 		bool Equals(Mask2DCPtr other) const
 		{
 			for(size_t y=0;y<_height;++y)
 			{
-				for(size_t x=0;x<_width;++x)
-					if(_values[y][x] != other->_values[y][x])
-						return false;
+				if(memcmp(_values[y], other->_values[y], _width * sizeof(bool)) != 0)
+					return false;
 			}
 			return true;
 		}
@@ -293,21 +289,18 @@ class Mask2D {
 		void EnlargeHorizontallyAndSet(Mask2DCPtr smallMask, int factor);
 		void EnlargeVerticallyAndSet(Mask2DCPtr smallMask, int factor);
 
-		void Join(Mask2DCPtr other)
-		{
-			for(size_t y=0;y<_height;++y) {
-				for(size_t x=0;x<_width;++x)
-					SetValue(x, y, other->Value(x, y) || Value(x, y));
-			}
-		}
+		/**
+		 * Flags all samples that are flagged in either this mask or the other mask.
+		 * Since a bool is always stored as 0 or 1, eight samples are or-ed at a time.
+		 * Both masks should have the same size.
+		 */
+		void Join(Mask2DCPtr other);
 		
-		void Intersect(Mask2DCPtr other)
-		{
-			for(size_t y=0;y<_height;++y) {
-				for(size_t x=0;x<_width;++x)
-					SetValue(x, y, other->Value(x, y) && Value(x, y));
-			}
-		}
+		/**
+		 * Keeps only the flags that are set in both masks. Like Join(), this
+		 * processes eight samples at a time.
+		 */
+		void Intersect(Mask2DCPtr other);
 		
 		Mask2DPtr Trim(size_t startX, size_t startY, size_t endX, size_t endY) const
 		{
@@ -353,6 +346,8 @@ class Mask2D {
 	private:
 		Mask2D(size_t width, size_t height);
 
+		size_t countTrue() const;
+
 		size_t _width, _height;
 		size_t _stride;
 		
@@ -0,0 +1,53 @@
+#include "memoryaccounting.h"
+
+#include <boost/thread/tss.hpp>
+
+namespace {
+	struct ThreadCounter
+	{
+		ThreadCounter() : usage(0), peak(0) { }
+		long usage, peak;
+	};
+	
+	boost::thread_specific_ptr<ThreadCounter> threadCounter;
+	
+	ThreadCounter &counter()
+	{
+		ThreadCounter *c = threadCounter.get();
+		if(c == 0)
+		{
+			c = new ThreadCounter();
+			threadCounter.reset(c);
+		}
+		return *c;
+	}
+}
+
+void MemoryAccounting::Allocate(size_t bytes)
+{
+	ThreadCounter &c = counter();
+	c.usage += bytes;
+	if(c.usage > c.peak)
+		c.peak = c.usage;
+}
+
+void MemoryAccounting::Free(size_t bytes)
+{
+	counter().usage -= bytes;
+}
+
+long MemoryAccounting::ThreadUsage()
+{
+	return counter().usage;
+}
+
+long MemoryAccounting::ThreadPeak()
+{
+	return counter().peak;
+}
+
+void MemoryAccounting::ResetThreadPeak()
+{
+	ThreadCounter &c = counter();
+	c.peak = c.usage;
+}
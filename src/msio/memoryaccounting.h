@@ -0,0 +1,37 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <cstddef>
+
+/**
+ * Keeps track of the memory that each thread allocates for the samples of images
+ * and masks. Image2D and Mask2D report their allocations here. The peak usage of a
+ * thread can be used to measure how much memory processing a baseline takes, which
+ * is used by the ForEachBaselineAction to decide how many baselines fit in memory.
+ *
+ * Memory that is freed by another thread than the one that allocated it is
+ * subtracted from the thread that frees it, so the usage of a thread can be
+ * negative. Only differences in usage are therefore meaningful.
+ */
+class MemoryAccounting
+{
+	public:
+		static void Allocate(size_t bytes);
+		static void Free(size_t bytes);
+		
+		/**
+		 * Bytes allocated minus bytes freed by the calling thread.
+		 */
+		static long ThreadUsage();
+		
+		/**
+		 * Highest value of ThreadUsage() since the last call to ResetThreadPeak().
+		 */
+		static long ThreadPeak();
+		
+		static void ResetThreadPeak();
+	private:
+		MemoryAccounting() { }
+};
+
+#endif
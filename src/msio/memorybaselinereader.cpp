@@ -19,6 +19,7 @@
  ***************************************************************************/
 
 #include "memorybaselinereader.h"
+#include "flagwriter.h"
 #include "system.h"
 
 #include "../util/aologger.h"
@@ -26,18 +27,30 @@
 
 #include <ms/MeasurementSets/MeasurementSet.h>
 
+#include <algorithm>
 #include <vector>
 
 using namespace casa;
 
 void MemoryBaselineReader::clear()
 {
+	waitForLoading();
 	for(std::map<BaselineID, Result*>::iterator i=_baselines.begin(); i!=_baselines.end(); ++i)
 	{
 		// They don't all have to contain objects, but will be zero otherwise so safe to delete right away
-		delete i->second;
+		if(_packSamples)
+			delete static_cast<PackedResult*>(i->second);
+		else
+			delete i->second;
 	}
 	_baselines.clear();
+	std::vector<RowPosition>().swap(_rowPositions);
+	_rowRanges.clear();
+	_groupRemainingRows.clear();
+	_groupBaselineCount.clear();
+	_groupRows.clear();
+	_groupWrittenBaselines.clear();
+	_isGroupChanged.clear();
 	_areFlagsChanged = false;
 	_isRead = false;
 }
@@ -64,8 +77,25 @@ void MemoryBaselineReader::PerformReadRequests()
 				"spw=" << request.spectralWindow << ", sequenceId=" << request.sequenceId << ")";
 			throw std::runtime_error(errorStr.str());
 		}
-		else
-			_results.push_back(*requestedBaselineIter->second);
+		else {
+			waitForGroup(groupIndex(request.spectralWindow, request.sequenceId));
+			if(_packSamples)
+			{
+				const PackedResult &packed = static_cast<const PackedResult&>(*requestedBaselineIter->second);
+				Result result;
+				for(size_t p=0;p!=packed._packedFlags.size();++p)
+				{
+					result._realImages.push_back(packed._packedRealImages[p]->CreateImage());
+					result._imaginaryImages.push_back(packed._packedImaginaryImages[p]->CreateImage());
+					result._flags.push_back(packed._packedFlags[p]->CreateMask());
+				}
+				result._uvw = packed._uvw;
+				result._bandInfo = packed._bandInfo;
+				_results.push_back(result);
+			}
+			else
+				_results.push_back(*requestedBaselineIter->second);
+		}
 	}
 	
 	_readRequests.clear();
@@ -75,7 +105,8 @@ void MemoryBaselineReader::readSet()
 {
 	if(!_isRead)
 	{
-		Stopwatch watch(true);
+		_loadWatch.Reset();
+		_loadWatch.Start();
 		
 		initializeMeta();
 	
@@ -88,12 +119,6 @@ void MemoryBaselineReader::readSet()
 			fieldIdColumn(table, casa::MeasurementSet::columnName(MSMainEnums::FIELD_ID));
 		ROScalarColumn<double>
 			timeColumn(table, casa::MeasurementSet::columnName(MSMainEnums::TIME));
-		ROArrayColumn<casa::Complex>
-			dataColumn(table, DataColumnName());
-		ROArrayColumn<bool>
-			flagColumn(table, casa::MeasurementSet::columnName(MSMainEnums::FLAG));
-		ROArrayColumn<double>
-			uvwColumn(table, casa::MeasurementSet::columnName(MSMainEnums::UVW));
 		
 		size_t
 			antennaCount = Set().AntennaCount(),
@@ -101,6 +126,7 @@ void MemoryBaselineReader::readSet()
 			
 		size_t bandCount = Set().BandCount();
 		size_t sequenceCount = Set().SequenceCount();
+		_bandCount = bandCount;
 		
 		std::vector<size_t> dataIdToSpw;
 		Set().GetDataDescToBandVector(dataIdToSpw);
@@ -125,7 +151,6 @@ void MemoryBaselineReader::readSet()
 				BaselineMatrix &matrix = baselineCube[s*bandCount + b];
 				matrix.resize(antennaCount);
 				
-				BandInfo band = Set().GetBandInfo(0);
 				for(size_t a1=0;a1!=antennaCount;++a1)
 				{
 					matrix[a1].resize(antennaCount);
@@ -135,19 +160,33 @@ void MemoryBaselineReader::readSet()
 			}
 		}
 		
-		// The actual reading of the data
-		AOLogger::Debug << "Reading the data...\n";
+		// The scalar columns are read as a whole, to find the position of each row
+		// and to allocate all baselines before the samples are read.
+		AOLogger::Debug << "Reading the meta data...\n";
+		
+		casa::Vector<int>
+			ant1s = ant1Column.getColumn(),
+			ant2s = ant2Column.getColumn(),
+			dataDescIds = dataDescIdColumn.getColumn(),
+			fieldIds = fieldIdColumn.getColumn();
+		casa::Vector<double>
+			times = timeColumn.getColumn();
 		
 		double prevTime = -1.0;
 		size_t curTimeIndex = size_t(0);
 		unsigned rowCount = table.nrow();
 		
-		casa::Array<casa::Complex> dataArray;
-		casa::Array<bool> flagArray;
+		_rowPositions.resize(rowCount);
+		_rowRanges.clear();
+		_groupRemainingRows.assign(sequenceCount * bandCount, 0);
+		_groupBaselineCount.assign(sequenceCount * bandCount, 0);
+		_groupRows.assign(sequenceCount * bandCount, std::vector<size_t>());
+		_groupWrittenBaselines.assign(sequenceCount * bandCount, std::set<const Result*>());
+		_isGroupChanged.assign(sequenceCount * bandCount, false);
 		size_t prevFieldId = size_t(-1), sequenceId = size_t(-1);
 		for(unsigned rowIndex = 0;rowIndex < rowCount;++rowIndex)
 		{
-			size_t fieldId = fieldIdColumn(rowIndex);
+			size_t fieldId = fieldIds[rowIndex];
 			if(fieldId != prevFieldId)
 			{
 				prevFieldId = fieldId;
@@ -156,16 +195,16 @@ void MemoryBaselineReader::readSet()
 			}
 			const std::map<double, size_t>
 				&observationTimes = ObservationTimes(sequenceId);
-			double time = timeColumn(rowIndex);
+			double time = times[rowIndex];
 			if(time != prevTime)
 			{
 				curTimeIndex = observationTimes.find(time)->second;
 				prevTime = time;
 			}
 			
-			size_t ant1 = ant1Column(rowIndex);
-			size_t ant2 = ant2Column(rowIndex);
-			size_t spw = dataIdToSpw[dataDescIdColumn(rowIndex)];
+			size_t ant1 = ant1s[rowIndex];
+			size_t ant2 = ant2s[rowIndex];
+			size_t spw = dataIdToSpw[dataDescIds[rowIndex]];
 			size_t spwFieldIndex = spw + sequenceId * bandCount;
 			if(ant1 > ant2) std::swap(ant1, ant2);
 			
@@ -173,64 +212,50 @@ void MemoryBaselineReader::readSet()
 			if(result == 0)
 			{
 				const size_t timeStepCount = observationTimes.size();
-				result = new Result();
-				for(size_t p=0;p!=polarizationCount;++p) {
-					result->_realImages.push_back(Image2D::CreateZeroImagePtr(timeStepCount, Set().FrequencyCount(spw)));
-					result->_imaginaryImages.push_back(Image2D::CreateZeroImagePtr(timeStepCount, Set().FrequencyCount(spw)));
-					result->_flags.push_back(Mask2D::CreateSetMaskPtr<true>(timeStepCount, Set().FrequencyCount(spw)));
+				if(_packSamples)
+				{
+					PackedResult *packed = new PackedResult();
+					for(size_t p=0;p!=polarizationCount;++p) {
+						packed->_packedRealImages.push_back(PackedImage2D::CreateZeroImagePtr(timeStepCount, Set().FrequencyCount(spw)));
+						packed->_packedImaginaryImages.push_back(PackedImage2D::CreateZeroImagePtr(timeStepCount, Set().FrequencyCount(spw)));
+						packed->_packedFlags.push_back(BitMask2D::CreateSetMaskPtr<true>(timeStepCount, Set().FrequencyCount(spw)));
+					}
+					result = packed;
+				} else {
+					result = new Result();
+					for(size_t p=0;p!=polarizationCount;++p) {
+						result->_realImages.push_back(Image2D::CreateZeroImagePtr(timeStepCount, Set().FrequencyCount(spw)));
+						result->_imaginaryImages.push_back(Image2D::CreateZeroImagePtr(timeStepCount, Set().FrequencyCount(spw)));
+						result->_flags.push_back(Mask2D::CreateSetMaskPtr<true>(timeStepCount, Set().FrequencyCount(spw)));
+					}
 				}
 				result->_bandInfo = bandInfos[spw];
 				result->_uvw.resize(timeStepCount);
 				baselineCube[spwFieldIndex][ant1][ant2] = result;
+				++_groupBaselineCount[spwFieldIndex];
 			}
+			_rowPositions[rowIndex].result = result;
+			_rowPositions[rowIndex].timeIndex = curTimeIndex;
+			_rowPositions[rowIndex].row = rowIndex;
+			_rowPositions[rowIndex].group = spwFieldIndex;
+			++_groupRemainingRows[spwFieldIndex];
+			_groupRows[spwFieldIndex].push_back(rowIndex);
 			
-			dataArray = dataColumn.get(rowIndex);
-			flagArray = flagColumn.get(rowIndex);
-			
-			Array<double> uvwArray = uvwColumn.get(rowIndex);
-			Array<double>::const_iterator uvwPtr = uvwArray.begin();
-			UVW uvw;
-			uvw.u = *uvwPtr; ++uvwPtr;
-			uvw.v = *uvwPtr; ++uvwPtr;
-			uvw.w = *uvwPtr;
-			result->_uvw[curTimeIndex] = uvw;
-			
-			for(size_t p=0;p!=polarizationCount;++p)
+			// Rows are grouped in ranges of about 64 MB of samples. A range ends where the
+			// number of channels changes, because the rows of a range are read as one array.
+			size_t channelCount = bandInfos[spw].channels.size();
+			if(_rowRanges.empty() || _rowRanges.back().channelCount != channelCount ||
+				_rowRanges.back().rowCount * channelCount * polarizationCount * sizeof(casa::Complex) >= 64*1024*1024)
 			{
-				Array<Complex>::const_contiter dataPtr = dataArray.cbegin();
-				Array<bool>::const_contiter flagPtr = flagArray.cbegin();
-			
-				Image2D *real = &*result->_realImages[p];
-				Image2D *imag = &*result->_imaginaryImages[p];
-				Mask2D *mask = &*result->_flags[p];
-				const size_t imgStride = real->Stride();
-				const size_t mskStride = mask->Stride();
-				num_t *realOutPtr = real->ValuePtr(curTimeIndex, 0);
-				num_t *imagOutPtr = imag->ValuePtr(curTimeIndex, 0);
-				bool *flagOutPtr = mask->ValuePtr(curTimeIndex, 0);
-				
-				for(size_t i=0;i!=p;++i) {
-					++dataPtr;
-					++flagPtr;
-				}
-				size_t frequencyCount = bandInfos[spw].channels.size();
-				for(size_t ch=0;ch!=frequencyCount;++ch)
-				{
-					*realOutPtr = dataPtr->real();
-					*imagOutPtr = dataPtr->imag();
-					*flagOutPtr = *flagPtr;
-					
-					realOutPtr += imgStride;
-					imagOutPtr += imgStride;
-					flagOutPtr += mskStride;
-					
-					for(size_t i=0;i!=polarizationCount;++i) {
-						++dataPtr;
-						++flagPtr;
-					}
-				}
+				RowRange range;
+				range.startRow = rowIndex;
+				range.rowCount = 0;
+				range.channelCount = channelCount;
+				_rowRanges.push_back(range);
 			}
+			++_rowRanges.back().rowCount;
 		}
+		_metaDataTime = _loadWatch.Seconds();
 		
 		// Store elements in matrix to the baseline map.
 		for(size_t s=0; s!=sequenceCount; ++s)
@@ -258,7 +283,233 @@ void MemoryBaselineReader::readSet()
 		_areFlagsChanged = false;
 		_isRead = true;
 		
-		AOLogger::Debug << "Reading toke " << watch.ToString() << ".\n";
+		// The actual reading of the data happens in the background. The rows are read in
+		// order, so the first sequences can be processed while the others are read.
+		size_t threadCount = std::min<size_t>(System::ProcessorCount(), _rowRanges.size());
+		AOLogger::Debug << "Reading the data in " << _rowRanges.size() << " parts with " << threadCount << " threads...\n";
+		_nextRowRange = 0;
+		_activeLoaderCount = threadCount;
+		_readingTime = 0.0;
+		_scatteringTime = 0.0;
+		_loadError.clear();
+		_loaderThreads = new boost::thread_group();
+		for(size_t i=0;i!=threadCount;++i)
+			_loaderThreads->create_thread(LoadFunction(*this));
+	}
+}
+
+/**
+ * Runs in each loader thread. The threads take turns to read a range of rows from
+ * the table, and copy the samples of the range into the baselines while the next
+ * thread reads. Since the baselines were allocated beforehand and each row has its
+ * own position, the threads do not need to lock the baselines.
+ */
+void MemoryBaselineReader::loadRowRanges()
+{
+	try {
+		boost::mutex::scoped_lock casaLock(_casaMutex);
+		casa::Table &table = *Table();
+		ROArrayColumn<casa::Complex>
+			dataColumn(table, DataColumnName());
+		ROArrayColumn<bool>
+			flagColumn(table, casa::MeasurementSet::columnName(MSMainEnums::FLAG));
+		ROArrayColumn<double>
+			uvwColumn(table, casa::MeasurementSet::columnName(MSMainEnums::UVW));
+		casaLock.unlock();
+		
+		casa::Array<casa::Complex> dataArray;
+		casa::Array<bool> flagArray;
+		casa::Array<double> uvwArray;
+		Stopwatch readWatch, scatterWatch;
+		while(true)
+		{
+			boost::mutex::scoped_lock lock(_loadMutex);
+			if(_nextRowRange == _rowRanges.size() || !_loadError.empty())
+				break;
+			const RowRange &range = _rowRanges[_nextRowRange];
+			++_nextRowRange;
+			lock.unlock();
+			
+			casa::Slicer rows(casa::IPosition(1, range.startRow), casa::IPosition(1, range.rowCount), casa::Slicer::endIsLength);
+			casaLock.lock();
+			readWatch.Start();
+			dataColumn.getColumnRange(rows, dataArray, true);
+			flagColumn.getColumnRange(rows, flagArray, true);
+			uvwColumn.getColumnRange(rows, uvwArray, true);
+			readWatch.Pause();
+			casaLock.unlock();
+			
+			scatterWatch.Start();
+			scatterRows(range, reinterpret_cast<const float*>(dataArray.data()), flagArray.data(), uvwArray.data());
+			scatterWatch.Pause();
+		}
+		// The columns are destructed while the table is locked
+		casaLock.lock();
+		
+		boost::mutex::scoped_lock lock(_loadMutex);
+		_readingTime += readWatch.Seconds();
+		_scatteringTime += scatterWatch.Seconds();
+	} catch(std::exception &e)
+	{
+		boost::mutex::scoped_lock lock(_loadMutex);
+		if(_loadError.empty())
+			_loadError = e.what();
+		_groupLoaded.notify_all();
+	}
+	
+	boost::mutex::scoped_lock lock(_loadMutex);
+	--_activeLoaderCount;
+	if(_activeLoaderCount == 0 && _loadError.empty())
+	{
+		AOLogger::Debug << "Reading took " << _loadWatch.ToString() << " (meta data: " << _metaDataTime
+			<< " s, reading columns: " << _readingTime << " s, distributing samples: " << _scatteringTime << " s summed over threads).\n";
+	}
+}
+
+void MemoryBaselineReader::scatterRows(const RowRange &range, const float *data, const bool *flags, const double *uvw)
+{
+	const size_t polarizationCount = PolarizationCount();
+	const size_t rowSize = range.channelCount * polarizationCount;
+	
+	// The rows of one baseline are sorted on time, so that runs of consecutive time
+	// steps can be copied together.
+	std::vector<RowPosition> rows(_rowPositions.begin() + range.startRow, _rowPositions.begin() + range.startRow + range.rowCount);
+	std::stable_sort(rows.begin(), rows.end());
+	
+	std::vector<const float*> dataSteps;
+	std::vector<const bool*> flagSteps;
+	size_t runStart = 0;
+	while(runStart != rows.size())
+	{
+		Result *result = rows[runStart].result;
+		size_t runEnd = runStart + 1;
+		while(runEnd != rows.size() && rows[runEnd].result == result &&
+			rows[runEnd].timeIndex == rows[runStart].timeIndex + (runEnd - runStart))
+			++runEnd;
+		
+		dataSteps.clear();
+		flagSteps.clear();
+		for(size_t i=runStart;i!=runEnd;++i)
+		{
+			size_t rowInRange = rows[i].row - range.startRow;
+			dataSteps.push_back(data + rowInRange * rowSize * 2);
+			flagSteps.push_back(flags + rowInRange * rowSize);
+			const double *rowUVW = uvw + rowInRange * 3;
+			result->_uvw[rows[i].timeIndex] = UVW(rowUVW[0], rowUVW[1], rowUVW[2]);
+		}
+		if(_packSamples)
+		{
+			PackedResult &packed = static_cast<PackedResult&>(*result);
+			packTimeSteps(&dataSteps[0], rows[runStart].timeIndex, runEnd - runStart, range.channelCount, polarizationCount, packed);
+			packFlagTimeSteps(&flagSteps[0], rows[runStart].timeIndex, runEnd - runStart, range.channelCount, polarizationCount, packed);
+		} else {
+			copyTimeSteps(&dataSteps[0], rows[runStart].timeIndex, runEnd - runStart, range.channelCount, polarizationCount, result->_realImages, result->_imaginaryImages);
+			copyFlagTimeSteps(&flagSteps[0], rows[runStart].timeIndex, runEnd - runStart, range.channelCount, polarizationCount, result->_flags);
+		}
+		
+		runStart = runEnd;
+	}
+	
+	boost::mutex::scoped_lock lock(_loadMutex);
+	for(std::vector<RowPosition>::const_iterator i=rows.begin();i!=rows.end();++i)
+		--_groupRemainingRows[i->group];
+	_groupLoaded.notify_all();
+}
+
+/**
+ * Packed counterpart of BaselineReader::copyTimeSteps().
+ */
+void MemoryBaselineReader::packTimeSteps(const float *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, PackedResult &result)
+{
+	size_t x = 0;
+	if(polarizationCount == 4)
+	{
+		// As in copyTimeSteps(), the 4x4 matrices of (time step, polarization) are
+		// transposed, after which four time steps of a polarization are packed at once.
+		for(;x+4<=width;x+=4)
+		{
+			for(size_t f=0;f<channelCount;++f)
+			{
+				__m128 real[4], imaginary[4];
+				for(size_t t=0;t<4;++t)
+				{
+					const float *sample = timeSteps[x + t] + f * 8;
+					__m128 first = _mm_loadu_ps(sample), second = _mm_loadu_ps(sample + 4);
+					real[t] = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+					imaginary[t] = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+				}
+				_MM_TRANSPOSE4_PS(real[0], real[1], real[2], real[3]);
+				_MM_TRANSPOSE4_PS(imaginary[0], imaginary[1], imaginary[2], imaginary[3]);
+				for(size_t p=0;p<4;++p)
+				{
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(result._packedRealImages[p]->ValuePtr(startX + x, f)), PackedImage2D::Pack4(real[p]));
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(result._packedImaginaryImages[p]->ValuePtr(startX + x, f)), PackedImage2D::Pack4(imaginary[p]));
+				}
+			}
+		}
+	}
+	for(;x<width;++x)
+	{
+		const float *sample = timeSteps[x];
+		for(size_t f=0;f<channelCount;++f)
+		{
+			for(size_t p=0;p<polarizationCount;++p)
+			{
+				*result._packedRealImages[p]->ValuePtr(startX + x, f) = PackedImage2D::Pack(sample[0]);
+				*result._packedImaginaryImages[p]->ValuePtr(startX + x, f) = PackedImage2D::Pack(sample[1]);
+				sample += 2;
+			}
+		}
+	}
+}
+
+/**
+ * The packed flags start out set, because time steps without a row stay flagged.
+ * Rows that are copied by other loader threads can share a word of flags, so the
+ * flags are cleared with one atomic operation per word.
+ */
+void MemoryBaselineReader::packFlagTimeSteps(const bool *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, PackedResult &result)
+{
+	for(size_t p=0;p<polarizationCount;++p)
+	{
+		BitMask2D &mask = *result._packedFlags[p];
+		for(size_t f=0;f<channelCount;++f)
+		{
+			BitMask2D::word_t *row = mask.RowPtr(f);
+			const size_t sampleIndex = f * polarizationCount + p;
+			size_t x = 0;
+			while(x < width)
+			{
+				const size_t word = (startX + x) / BitMask2D::BitsPerWord;
+				BitMask2D::word_t clearedBits = 0;
+				for(;x < width && (startX + x) / BitMask2D::BitsPerWord == word;++x)
+				{
+					if(!timeSteps[x][sampleIndex])
+						clearedBits |= BitMask2D::word_t(1) << ((startX + x) % BitMask2D::BitsPerWord);
+				}
+				if(clearedBits != 0)
+					__sync_fetch_and_and(&row[word], ~clearedBits);
+			}
+		}
+	}
+}
+
+void MemoryBaselineReader::waitForGroup(size_t group)
+{
+	boost::mutex::scoped_lock lock(_loadMutex);
+	while(_groupRemainingRows[group] != 0 && _loadError.empty())
+		_groupLoaded.wait(lock);
+	if(!_loadError.empty())
+		throw std::runtime_error("Error while reading the measurement set: " + _loadError);
+}
+
+void MemoryBaselineReader::waitForLoading()
+{
+	if(_loaderThreads != 0)
+	{
+		_loaderThreads->join_all();
+		delete _loaderThreads;
+		_loaderThreads = 0;
 	}
 }
 
@@ -274,112 +525,121 @@ void MemoryBaselineReader::PerformFlagWriteRequests()
 		id.antenna2 = request.antenna2;
 		id.spw = request.spectralWindow;
 		id.sequenceId = request.sequenceId;
-		Result *result = _baselines[id];
-		if(result->_flags.size() != request.flags.size())
-			throw std::runtime_error("Polarizations do not match");
-		for(size_t p=0;p!=result->_flags.size();++p)
-			result->_flags[p] = Mask2D::CreateCopy(request.flags[p]);
+		std::map<BaselineID, Result*>::iterator resultIter = _baselines.find(id);
+		if(resultIter == _baselines.end())
+		{
+			std::ostringstream errorStr;
+			errorStr <<
+				"Exception in PerformFlagWriteRequests(): baseline to be written is not available in measurement set "
+				"(antenna1=" << request.antenna1 << ", antenna2=" << request.antenna2 << ", "
+				"spw=" << request.spectralWindow << ", sequenceId=" << request.sequenceId << ")";
+			throw std::runtime_error(errorStr.str());
+		}
+		Result *result = resultIter->second;
+		size_t group = groupIndex(request.spectralWindow, request.sequenceId);
+		waitForGroup(group);
+		if(_packSamples)
+		{
+			PackedResult &packed = static_cast<PackedResult&>(*result);
+			if(packed._packedFlags.size() != request.flags.size())
+				throw std::runtime_error("Polarizations do not match");
+			for(size_t p=0;p!=packed._packedFlags.size();++p)
+				packed._packedFlags[p]->SetFrom(*request.flags[p]);
+		} else {
+			if(result->_flags.size() != request.flags.size())
+				throw std::runtime_error("Polarizations do not match");
+			for(size_t p=0;p!=result->_flags.size();++p)
+				result->_flags[p] = Mask2D::CreateCopy(request.flags[p]);
+		}
+		
+		// Once all baselines of a group have new flags, they are written while the
+		// other groups are still being read or processed.
+		_isGroupChanged[group] = true;
+		_groupWrittenBaselines[group].insert(result);
+		if(_groupWrittenBaselines[group].size() == _groupBaselineCount[group])
+			writeGroupFlags(group);
+		else
+			_areFlagsChanged = true;
 	}
-	_areFlagsChanged = true;
 	
 	_writeRequests.clear();
 }
 
 void MemoryBaselineReader::writeFlags()
 {
-	casa::Table &table = *Table();
+	AOLogger::Debug << "Flags have changed, writing them back to the set...\n";
 	
-	ROScalarColumn<int>
-		ant1Column(table, casa::MeasurementSet::columnName(MSMainEnums::ANTENNA1)),
-		ant2Column(table, casa::MeasurementSet::columnName(MSMainEnums::ANTENNA2)),
-		dataDescIdColumn(table, casa::MeasurementSet::columnName(MSMainEnums::DATA_DESC_ID)),
-		fieldIdColumn(table, casa::MeasurementSet::columnName(MSMainEnums::FIELD_ID));
-	ROScalarColumn<double>
-		timeColumn(table, casa::MeasurementSet::columnName(MSMainEnums::TIME));
-	ArrayColumn<bool>
-		flagColumn(table, casa::MeasurementSet::columnName(MSMainEnums::FLAG));
-	std::vector<size_t> dataIdToSpw;
-	Set().GetDataDescToBandVector(dataIdToSpw);
+	for(size_t group=0;group!=_isGroupChanged.size();++group)
+	{
+		if(_isGroupChanged[group])
+			writeGroupFlags(group);
+	}
 	
+	_areFlagsChanged = false;
+}
+
+/**
+ * Hands the flags of a group to the flag writer, which writes them on its own thread.
+ */
+void MemoryBaselineReader::writeGroupFlags(size_t group)
+{
+	FlagWriter &writer = flagWriter();
 	size_t polarizationCount = PolarizationCount();
-		
-	AOLogger::Debug << "Flags have changed, writing them back to the set...\n";
 	
-	double prevTime = -1.0;
-	unsigned rowCount = table.nrow();
-	size_t timeIndex = 0;
-	size_t prevFieldId = size_t(-1), sequenceId = size_t(-1);
-	for(unsigned rowIndex = 0;rowIndex < rowCount;++rowIndex)
+	const std::vector<size_t> &rows = _groupRows[group];
+	for(std::vector<size_t>::const_iterator rowIter=rows.begin();rowIter!=rows.end();++rowIter)
 	{
-		size_t fieldId = fieldIdColumn(rowIndex);
-		if(fieldId != prevFieldId)
-		{
-			prevFieldId = fieldId;
-			sequenceId++;
-			prevTime = -1.0;
-		}
-		double time = timeColumn(rowIndex);
-		if(time != prevTime)
-		{
-			timeIndex = ObservationTimes(sequenceId).find(time)->second;
-			prevTime = time;
-		}
-		
-		size_t ant1 = ant1Column(rowIndex);
-		size_t ant2 = ant2Column(rowIndex);
-		size_t spw = dataIdToSpw[dataDescIdColumn(rowIndex)];
-		if(ant1 > ant2) std::swap(ant1, ant2);
-		
-		size_t frequencyCount = Set().FrequencyCount(spw);
-		IPosition flagShape = IPosition(2);
-		flagShape[0] = polarizationCount;
-		flagShape[1] = frequencyCount;
-		casa::Array<bool> flagArray(flagShape);
-		
-		BaselineID baselineID;
-		baselineID.antenna1 = ant1;
-		baselineID.antenna2 = ant2;
-		baselineID.spw = spw;
-		baselineID.sequenceId = sequenceId;
-		std::map<BaselineID, Result*>::iterator resultIter = _baselines.find(baselineID);
-		Result *result = resultIter->second;
+		const RowPosition &position = _rowPositions[*rowIter];
+		size_t frequencyCount = position.result->_bandInfo.channels.size();
 		
-		Array<bool>::contiter flagPtr = flagArray.cbegin();
-		
-		std::vector<Mask2D*> masks(polarizationCount);
-		for(size_t p=0;p!=polarizationCount;++p)
-			masks[p] = &*result->_flags[p];
-		
-		for(size_t ch=0;ch!=frequencyCount;++ch)
+		bool *flagPtr = writer.AddRow(*rowIter, frequencyCount);
+		if(_packSamples)
 		{
-			for(size_t p=0;p!=polarizationCount;++p)
+			const std::vector<BitMask2DPtr> &masks = static_cast<const PackedResult*>(position.result)->_packedFlags;
+			for(size_t ch=0;ch!=frequencyCount;++ch)
+			{
+				for(size_t p=0;p!=polarizationCount;++p)
+				{
+					*flagPtr = masks[p]->Value(position.timeIndex, ch);
+					++flagPtr;
+				}
+			}
+		} else {
+			const std::vector<Mask2DPtr> &masks = position.result->_flags;
+			for(size_t ch=0;ch!=frequencyCount;++ch)
 			{
-				*flagPtr = masks[p]->Value(timeIndex, ch);
-				++flagPtr;
+				for(size_t p=0;p!=polarizationCount;++p)
+				{
+					*flagPtr = masks[p]->Value(position.timeIndex, ch);
+					++flagPtr;
+				}
 			}
 		}
-		
-		flagColumn.put(rowIndex, flagArray);
 	}
+	writer.Flush();
 	
-	_areFlagsChanged = false;
+	_isGroupChanged[group] = false;
+	_groupWrittenBaselines[group].clear();
 }
 
-bool MemoryBaselineReader::IsEnoughMemoryAvailable(const std::string &filename)
+bool MemoryBaselineReader::IsEnoughMemoryAvailable(const std::string &filename, bool packSamples)
 {
 	uint64_t size = MeasurementSetDataSize(filename);
+	// Packed, a complex sample with its flag takes 4 bytes and a bit instead of 9 bytes
+	if(packSamples)
+		size = size * 33 / 72;
 	uint64_t totalMem = System::TotalMemory();
+	const char *modeName = packSamples ? "packed memory read mode" : "memory read mode";
 	
 	if(size * 2 >= totalMem)
 	{
-		AOLogger::Warn
-			<< (size/1000000) << " MB required, but " << (totalMem/1000000) << " MB available.\n"
-			"Because this is not at least twice as much, direct read mode (slower!) will be used.\n";
+		AOLogger::Debug
+			<< (size/1000000) << " MB required for " << modeName << ", but " << (totalMem/1000000) << " MB available.\n";
 		return false;
 	} else {
 		AOLogger::Debug
 			<< (size/1000000) << " MB required, " << (totalMem/1000000)
-			<< " MB available: will use memory read mode.\n";
+			<< " MB available: will use " << modeName << ".\n";
 		return true;
 	}
 }
@@ -21,13 +21,23 @@
 #define MEMORY_BASELINE_READER_H
 
 #include <map>
+#include <set>
+#include <string>
 #include <vector>
 #include <stdexcept>
 
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "antennainfo.h"
 #include "baselinereader.h"
+#include "bitmask2d.h"
 #include "image2d.h"
 #include "mask2d.h"
+#include "packedimage2d.h"
+
+#include "../util/stopwatch.h"
 
 /**
 	@author A.R. Offringa <offringa@astro.rug.nl>
@@ -35,13 +45,15 @@
 class MemoryBaselineReader : public BaselineReader {
 	public:
 		explicit MemoryBaselineReader(const std::string &msFile)
-			: BaselineReader(msFile), _isRead(false), _areFlagsChanged(false)
+			: BaselineReader(msFile), _isRead(false), _areFlagsChanged(false), _packSamples(false), _loaderThreads(0)
 		{
 		}
 		
 		~MemoryBaselineReader()
 		{
-			if(_areFlagsChanged) writeFlags();
+			waitForLoading();
+			if(_areFlagsChanged && _loadError.empty()) writeFlags();
+			closeFlagWriter();
 			clear();
 		}
 
@@ -54,16 +66,102 @@ class MemoryBaselineReader : public BaselineReader {
 			throw std::runtime_error("The full mem reader can not write data back to file: use the indirect reader");
 		}
 		
-		static bool IsEnoughMemoryAvailable(const std::string &msFile);
+		/**
+		 * Whether the set fits in memory.
+		 * @param packSamples Whether the samples would be held packed, see SetPackSamples().
+		 */
+		static bool IsEnoughMemoryAvailable(const std::string &msFile, bool packSamples = false);
+		
+		/**
+		 * Holds the samples in 16 bits (see PackedImage2D) and the flags in one bit (see
+		 * BitMask2D), instead of in 32 bits and one byte. This reduces the memory of a set
+		 * from 9 to a little more than 4 bytes per complex sample, so that about twice as
+		 * large sets can be read in memory. A baseline is unpacked when it is requested.
+		 * This should be set before the first request.
+		 */
+		void SetPackSamples(bool packSamples)
+		{
+			if(_isRead)
+				throw std::runtime_error("Trying to change the sample format after reading the set!");
+			_packSamples = packSamples;
+		}
+		bool PackSamples() const { return _packSamples; }
 		
 		virtual size_t GetMinRecommendedBufferSize(size_t /*threadCount*/) { return 1; }
 		virtual size_t GetMaxRecommendedBufferSize(size_t /*threadCount*/) { return 2; }
+		
+		/**
+		 * The set is read in the background. The baselines of a sequence and band can be
+		 * requested as soon as all their rows have been read, while the later rows are
+		 * still being read.
+		 */
+		virtual bool LoadsIncrementally() const { return true; }
 	private:
+		/**
+		 * A baseline that is held packed. Its images and masks are empty: only the packed
+		 * ones hold its samples.
+		 */
+		struct PackedResult : public Result
+		{
+			std::vector<PackedImage2DPtr> _packedRealImages;
+			std::vector<PackedImage2DPtr> _packedImaginaryImages;
+			std::vector<BitMask2DPtr> _packedFlags;
+		};
+		
+		/**
+		 * The position in the baseline images of a row of the main table.
+		 */
+		struct RowPosition
+		{
+			Result *result;
+			size_t timeIndex, row, group;
+			
+			bool operator<(const RowPosition &other) const
+			{
+				if(result != other.result)
+					return result < other.result;
+				else
+					return timeIndex < other.timeIndex;
+			}
+		};
+		
+		/**
+		 * Consecutive rows with the same number of channels, which can therefore be read
+		 * with one call.
+		 */
+		struct RowRange
+		{
+			size_t startRow, rowCount, channelCount;
+		};
+		
+		struct LoadFunction
+		{
+			LoadFunction(MemoryBaselineReader &reader) : _reader(reader) { }
+			void operator()() { _reader.loadRowRanges(); }
+			MemoryBaselineReader &_reader;
+		};
+		
 		void readSet();
+		void loadRowRanges();
+		void scatterRows(const RowRange &range, const float *data, const bool *flags, const double *uvw);
+		static void packTimeSteps(const float *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, PackedResult &result);
+		static void packFlagTimeSteps(const bool *const *timeSteps, size_t startX, size_t width, size_t channelCount, size_t polarizationCount, PackedResult &result);
+		void waitForGroup(size_t group);
+		void waitForLoading();
 		void writeFlags();
+		void writeGroupFlags(size_t group);
 		void clear();
 		
-		bool _isRead, _areFlagsChanged;
+		/**
+		 * The rows of a sequence and a band form a group, which is complete when all its rows
+		 * have been read.
+		 */
+		size_t groupIndex(size_t spw, size_t sequenceId) const
+		{
+			return sequenceId * _bandCount + spw;
+		}
+		
+		bool _isRead, _areFlagsChanged, _packSamples;
 		
 		class BaselineID
 		{
@@ -88,6 +186,22 @@ class MemoryBaselineReader : public BaselineReader {
 		};
 		
 		std::map<BaselineID, BaselineReader::Result*> _baselines;
+		
+		// State of the loader threads, which keep running after readSet() has returned
+		boost::thread_group *_loaderThreads;
+		std::vector<RowPosition> _rowPositions;
+		std::vector<RowRange> _rowRanges;
+		size_t _nextRowRange, _activeLoaderCount, _bandCount;
+		boost::mutex _loadMutex;
+		boost::condition _groupLoaded;
+		Stopwatch _loadWatch;
+		long double _metaDataTime, _readingTime, _scatteringTime;
+		std::string _loadError;
+		
+		std::vector<size_t> _groupRemainingRows, _groupBaselineCount;
+		std::vector<std::vector<size_t> > _groupRows;
+		std::vector<std::set<const Result*> > _groupWrittenBaselines;
+		std::vector<bool> _isGroupChanged;
 };
 
 #endif // DIRECTBASELINEREADER_H
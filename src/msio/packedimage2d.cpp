@@ -0,0 +1,76 @@
+#include "packedimage2d.h"
+
+#include <cstdlib>
+#include <new>
+
+PackedImage2D::PackedImage2D(size_t width, size_t height) :
+	_width(width),
+	_height(height),
+	// Rows are rounded up to eight values, so that each row is 16-byte aligned
+	_stride(((width + 7) / 8) * 8)
+{
+	size_t allocSize = _stride * height;
+	if(allocSize == 0) allocSize = 8;
+#ifdef __APPLE__
+	// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
+	_data = (value_t*) malloc(allocSize * sizeof(value_t));
+#else
+	if(posix_memalign((void **) &_data, 16, allocSize * sizeof(value_t)) != 0)
+		throw std::bad_alloc();
+#endif
+	memset(_data, 0, allocSize * sizeof(value_t));
+	_rows = new value_t*[height];
+	for(size_t y=0;y<height;++y)
+		_rows[y] = &_data[_stride * y];
+}
+
+PackedImage2D::~PackedImage2D()
+{
+	delete[] _rows;
+	free(_data);
+}
+
+PackedImage2D *PackedImage2D::CreateFromImage(const Image2D &source)
+{
+	PackedImage2D *newImage = new PackedImage2D(source.Width(), source.Height());
+	newImage->SetFrom(source);
+	return newImage;
+}
+
+void PackedImage2D::SetFrom(const Image2D &source)
+{
+	for(size_t y=0;y<_height;++y)
+	{
+		const num_t *srcPtr = source.ValuePtr(0, y);
+		value_t *destPtr = _rows[y];
+		size_t x = 0;
+#ifdef NUM_T_IS_FLOAT
+		for(;x+4<=_width;x+=4)
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(destPtr + x), Pack4(_mm_loadu_ps(srcPtr + x)));
+#endif
+		for(;x<_width;++x)
+			destPtr[x] = Pack(srcPtr[x]);
+	}
+}
+
+void PackedImage2D::CopyTo(Image2D &destination) const
+{
+	for(size_t y=0;y<_height;++y)
+	{
+		const value_t *srcPtr = _rows[y];
+		num_t *destPtr = destination.ValuePtr(0, y);
+		size_t x = 0;
+#ifdef NUM_T_IS_FLOAT
+		// Unpacking places each value in the upper half of a zeroed 32-bit word
+		const __m128i zero = _mm_setzero_si128();
+		for(;x+8<=_width;x+=8)
+		{
+			const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcPtr + x));
+			_mm_storeu_ps(destPtr + x, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, values)));
+			_mm_storeu_ps(destPtr + x + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, values)));
+		}
+#endif
+		for(;x<_width;++x)
+			destPtr[x] = Unpack(srcPtr[x]);
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef PACKEDIMAGE2D_H
+#define PACKEDIMAGE2D_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <emmintrin.h>
+
+#include "image2d.h"
+
+typedef boost::shared_ptr<class PackedImage2D> PackedImage2DPtr;
+typedef boost::shared_ptr<const class PackedImage2D> PackedImage2DCPtr;
+
+/**
+ * A two dimensional image that stores each sample in 16 bits instead of the 32 bits
+ * used by Image2D. Samples are stored as "brain floating point" values: the upper
+ * half of a 32-bit float, rounded to the nearest value. This keeps the exponent range
+ * of a float, so that no scaling is required, while the relative rounding error is at
+ * most 2^-8. That is well below the noise of a single visibility, which makes the
+ * format suitable to hold the data of a whole observation in memory.
+ *
+ * The class can be converted from and to an Image2D with CreateFromImage(), SetFrom()
+ * and CopyTo(), which is how the MemoryBaselineReader uses it: it keeps the packed
+ * samples and unpacks a baseline only when it is requested.
+ */
+class PackedImage2D {
+	public:
+		typedef uint16_t value_t;
+
+		~PackedImage2D();
+
+		/**
+		 * Creates an image with all samples set to zero.
+		 */
+		static PackedImage2D *CreateZeroImage(size_t width, size_t height)
+		{
+			return new PackedImage2D(width, height);
+		}
+		static PackedImage2DPtr CreateZeroImagePtr(size_t width, size_t height)
+		{
+			return PackedImage2DPtr(new PackedImage2D(width, height));
+		}
+
+		static PackedImage2D *CreateFromImage(const Image2D &source);
+		static PackedImage2DPtr CreateFromImage(Image2DCPtr source)
+		{
+			return PackedImage2DPtr(CreateFromImage(*source));
+		}
+
+		/**
+		 * Unpacks the samples into the given Image2D, which should have the same size as
+		 * this image.
+		 */
+		void CopyTo(Image2D &destination) const;
+
+		/**
+		 * Creates a new (unpacked) Image2D with the samples of this image.
+		 */
+		Image2DPtr CreateImage() const
+		{
+			Image2DPtr image = Image2D::CreateUnsetImagePtr(_width, _height);
+			CopyTo(*image);
+			return image;
+		}
+
+		/**
+		 * Packs the samples of the given Image2D into this image, which should have the
+		 * same size.
+		 */
+		void SetFrom(const Image2D &source);
+
+		inline num_t Value(size_t x, size_t y) const
+		{
+			return Unpack(_rows[y][x]);
+		}
+
+		inline void SetValue(size_t x, size_t y, num_t newValue)
+		{
+			_rows[y][x] = Pack(newValue);
+		}
+
+		inline value_t *ValuePtr(size_t x, size_t y) { return &_rows[y][x]; }
+
+		inline const value_t *ValuePtr(size_t x, size_t y) const { return &_rows[y][x]; }
+
+		inline size_t Width() const { return _width; }
+
+		inline size_t Height() const { return _height; }
+
+		/**
+		 * Number of values in one row, including the alignment padding.
+		 */
+		inline size_t Stride() const { return _stride; }
+
+		/**
+		 * Rounds a value to the nearest packed value, with ties to even. Infinities are
+		 * kept and not-a-number values stay not-a-number.
+		 */
+		static value_t Pack(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(float));
+			if((bits & 0x7FFFFFFF) > 0x7F800000)
+				return (bits >> 16) | 0x0040;
+			bits += 0x7FFF + ((bits >> 16) & 1);
+			return bits >> 16;
+		}
+
+		static float Unpack(value_t value)
+		{
+			const uint32_t bits = uint32_t(value) << 16;
+			float result;
+			memcpy(&result, &bits, sizeof(float));
+			return result;
+		}
+
+		/**
+		 * Packs four floats like Pack(). The four packed values are returned in the lower
+		 * 64 bits.
+		 */
+		static __m128i Pack4(__m128 values)
+		{
+			const __m128i bits = _mm_castps_si128(values);
+			const __m128i lowestKeptBit = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+			const __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(lowestKeptBit, _mm_set1_epi32(0x7FFF)));
+			// Rounding could turn a not-a-number into an infinity, so those are made quiet instead
+			const __m128i isNaN = _mm_castps_si128(_mm_cmpunord_ps(values, values));
+			const __m128i quietNaN = _mm_or_si128(bits, _mm_set1_epi32(0x00400000));
+			const __m128i result = _mm_or_si128(_mm_and_si128(isNaN, quietNaN), _mm_andnot_si128(isNaN, rounded));
+			// The arithmetic shift keeps the values within the range of a signed 16-bit
+			// integer, so the saturating pack does not change them.
+			const __m128i shifted = _mm_srai_epi32(result, 16);
+			return _mm_packs_epi32(shifted, shifted);
+		}
+	private:
+		PackedImage2D(size_t width, size_t height);
+
+		// Not implemented
+		PackedImage2D(const PackedImage2D &source);
+		void operator=(const PackedImage2D &source);
+
+		size_t _width, _height, _stride;
+		value_t **_rows;
+		value_t *_data;
+};
+
+#endif
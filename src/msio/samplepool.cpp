@@ -0,0 +1,203 @@
+#include "samplepool.h"
+
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace {
+	typedef std::map<size_t, std::vector<void*> > BlockMap;
+
+	void *heapAllocate(size_t size)
+	{
+		void *block;
+#ifdef __APPLE__
+		// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
+		block = malloc(size);
+		if(block == 0)
+			throw std::bad_alloc();
+#else
+		if(posix_memalign(&block, 64, size) != 0)
+			throw std::bad_alloc();
+#endif
+		return block;
+	}
+
+	void releaseBlocks(BlockMap &blocks)
+	{
+		for(BlockMap::iterator i=blocks.begin();i!=blocks.end();++i)
+		{
+			for(std::vector<void*>::iterator j=i->second.begin();j!=i->second.end();++j)
+				free(*j);
+		}
+		blocks.clear();
+	}
+
+	/**
+	 * Takes a block of the given size class from the map, or returns a null pointer
+	 * if there is none.
+	 */
+	void *takeBlock(BlockMap &blocks, size_t sizeClass)
+	{
+		BlockMap::iterator i = blocks.find(sizeClass);
+		if(i == blocks.end() || i->second.empty())
+			return 0;
+		void *block = i->second.back();
+		i->second.pop_back();
+		return block;
+	}
+
+	/**
+	 * Small requests, such as the row pointers of an image, are rounded to cache lines and
+	 * larger requests to pages. The rounding lets images with slightly different sizes
+	 * share blocks while wasting little memory.
+	 */
+	size_t sizeClass(size_t bytes)
+	{
+		if(bytes <= 4096)
+			return ((bytes + 63) / 64) * 64;
+		else
+			return ((bytes + 4095) / 4096) * 4096;
+	}
+
+	struct ThreadPool
+	{
+		ThreadPool() : bytes(0) { }
+		~ThreadPool() { releaseBlocks(blocks); }
+		BlockMap blocks;
+		size_t bytes;
+		SamplePool::Statistics statistics;
+	};
+
+	boost::thread_specific_ptr<ThreadPool> threadPoolPtr;
+
+	ThreadPool &threadPool()
+	{
+		ThreadPool *p = threadPoolPtr.get();
+		if(p == 0)
+		{
+			p = new ThreadPool();
+			threadPoolPtr.reset(p);
+		}
+		return *p;
+	}
+
+	boost::mutex sharedMutex;
+	BlockMap sharedBlocks;
+	size_t sharedBytes = 0;
+	size_t threadLimit = 0;
+	size_t sharedLimit = 0;
+}
+
+void *SamplePool::Allocate(size_t bytes)
+{
+	if(bytes == 0)
+		return 0;
+	size_t size = sizeClass(bytes);
+	ThreadPool &pool = threadPool();
+	++pool.statistics.allocationCount;
+
+	void *block = takeBlock(pool.blocks, size);
+	if(block != 0)
+	{
+		pool.bytes -= size;
+		++pool.statistics.threadPoolHitCount;
+		return block;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(sharedMutex);
+		block = takeBlock(sharedBlocks, size);
+		if(block != 0)
+			sharedBytes -= size;
+	}
+	if(block != 0)
+	{
+		++pool.statistics.sharedPoolHitCount;
+		return block;
+	}
+
+	++pool.statistics.heapAllocationCount;
+	return heapAllocate(size);
+}
+
+void SamplePool::Free(void *block, size_t bytes)
+{
+	if(block == 0)
+		return;
+	size_t size = sizeClass(bytes);
+	ThreadPool &pool = threadPool();
+	if(pool.bytes + size <= threadLimit)
+	{
+		pool.blocks[size].push_back(block);
+		pool.bytes += size;
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(sharedMutex);
+		if(sharedBytes + size <= sharedLimit)
+		{
+			sharedBlocks[size].push_back(block);
+			sharedBytes += size;
+			return;
+		}
+	}
+
+	++pool.statistics.heapFreeCount;
+	free(block);
+}
+
+void SamplePool::SetLimits(size_t newThreadLimit, size_t newSharedLimit)
+{
+	boost::mutex::scoped_lock lock(sharedMutex);
+	threadLimit = newThreadLimit;
+	sharedLimit = newSharedLimit;
+}
+
+size_t SamplePool::ThreadLimit()
+{
+	boost::mutex::scoped_lock lock(sharedMutex);
+	return threadLimit;
+}
+
+size_t SamplePool::SharedLimit()
+{
+	boost::mutex::scoped_lock lock(sharedMutex);
+	return sharedLimit;
+}
+
+SamplePool::Statistics SamplePool::ThreadStatistics()
+{
+	return threadPool().statistics;
+}
+
+void SamplePool::ResetThreadStatistics()
+{
+	threadPool().statistics = Statistics();
+}
+
+size_t SamplePool::ThreadPoolBytes()
+{
+	return threadPool().bytes;
+}
+
+size_t SamplePool::SharedPoolBytes()
+{
+	boost::mutex::scoped_lock lock(sharedMutex);
+	return sharedBytes;
+}
+
+void SamplePool::Release()
+{
+	ThreadPool &pool = threadPool();
+	releaseBlocks(pool.blocks);
+	pool.bytes = 0;
+
+	boost::mutex::scoped_lock lock(sharedMutex);
+	releaseBlocks(sharedBlocks);
+	sharedBytes = 0;
+}
@@ -0,0 +1,158 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SAMPLEPOOL_H
+#define SAMPLEPOOL_H
+
+#include <cstddef>
+
+/**
+ * Recycles the memory of images and masks. The actions of a strategy create and
+ * destroy many images and masks of the same size for every baseline. Instead of
+ * returning their memory to the heap, Image2D and Mask2D return it to this pool, so
+ * that the next image or mask of the same size can reuse it.
+ *
+ * Every thread has its own pool, which is used without locking. Requests are
+ * grouped in size classes, and a request is served from the pool of the calling
+ * thread if that has a block of the right size class. Blocks that are freed while
+ * the pool of the thread is full go to a pool that is shared by all threads, which is
+ * checked next. This shared pool matters when a block is allocated in one thread and
+ * freed in another, as happens with baselines that are read by a reader thread and
+ * flagged by a processing thread. Only when both pools are empty, the heap is used.
+ *
+ * The amount of memory that is kept in the pools is limited by SetLimits(). By
+ * default, both limits are zero and freed blocks go straight back to the heap: the
+ * pools are only enabled by code that knows how much memory it may use, such as
+ * the ForEachBaselineAction, which takes the limits off its memory budget. When a
+ * thread ends, the blocks in its pool are returned to the heap.
+ *
+ * All blocks are aligned on 64 bytes, which is the cache line size and enough for
+ * all SSE and AVX instructions.
+ */
+class SamplePool
+{
+	public:
+		struct Statistics
+		{
+			Statistics() :
+				allocationCount(0), threadPoolHitCount(0), sharedPoolHitCount(0),
+				heapAllocationCount(0), heapFreeCount(0)
+			{ }
+
+			Statistics &operator+=(const Statistics &rhs)
+			{
+				allocationCount += rhs.allocationCount;
+				threadPoolHitCount += rhs.threadPoolHitCount;
+				sharedPoolHitCount += rhs.sharedPoolHitCount;
+				heapAllocationCount += rhs.heapAllocationCount;
+				heapFreeCount += rhs.heapFreeCount;
+				return *this;
+			}
+
+			/** Number of non-empty requests. */
+			size_t allocationCount;
+			/** Number of requests served by the pool of the requesting thread. */
+			size_t threadPoolHitCount;
+			/** Number of requests served by the shared pool. */
+			size_t sharedPoolHitCount;
+			/** Number of requests that had to be allocated on the heap. */
+			size_t heapAllocationCount;
+			/** Number of blocks that did not fit in a pool and were returned to the heap. */
+			size_t heapFreeCount;
+		};
+
+		/**
+		 * Returns a block of at least the given size. The block should be returned with
+		 * Free() with the same size. For a size of zero, a null pointer is returned.
+		 * @throws std::bad_alloc if the heap is exhausted.
+		 */
+		static void *Allocate(size_t bytes);
+
+		/**
+		 * Returns a block to the pool. The block may have been allocated by another thread.
+		 * @param block A block returned by Allocate(), or a null pointer.
+		 * @param bytes The size that was requested when the block was allocated.
+		 */
+		static void Free(void *block, size_t bytes);
+
+		/**
+		 * Sets the maximum number of bytes that the pool of each thread and the shared pool
+		 * keep. A pool that already holds more does not give back its blocks, but does
+		 * not accept new blocks until it holds less than the limit.
+		 */
+		static void SetLimits(size_t threadLimit, size_t sharedLimit);
+
+		/**
+		 * Sets the limits for the lifetime of the object. When it is destroyed, also
+		 * because of an exception, the previous limits are restored and the blocks of the
+		 * shared pool and of the pool of the destroying thread are returned to the heap.
+		 */
+		class ScopedLimits
+		{
+			public:
+				ScopedLimits(size_t threadLimit, size_t sharedLimit) :
+					_previousThreadLimit(ThreadLimit()), _previousSharedLimit(SharedLimit())
+				{
+					SetLimits(threadLimit, sharedLimit);
+				}
+
+				~ScopedLimits()
+				{
+					SetLimits(_previousThreadLimit, _previousSharedLimit);
+					Release();
+				}
+			private:
+				ScopedLimits(const ScopedLimits &) { }
+				void operator=(const ScopedLimits &) { }
+
+				size_t _previousThreadLimit, _previousSharedLimit;
+		};
+
+		static size_t ThreadLimit();
+
+		static size_t SharedLimit();
+
+		/**
+		 * Statistics of the calling thread since it started or since the last call to
+		 * ResetThreadStatistics().
+		 */
+		static Statistics ThreadStatistics();
+
+		static void ResetThreadStatistics();
+
+		/**
+		 * Number of bytes that are kept in the pool of the calling thread.
+		 */
+		static size_t ThreadPoolBytes();
+
+		/**
+		 * Number of bytes that are kept in the shared pool.
+		 */
+		static size_t SharedPoolBytes();
+
+		/**
+		 * Returns the blocks of the shared pool and of the pool of the calling thread to
+		 * the heap.
+		 */
+		static void Release();
+	private:
+		SamplePool() { }
+};
+
+#endif
@@ -20,6 +20,9 @@
 #ifndef MSIOSYSTEM_H
 #define MSIOSYSTEM_H
 
+#include <fstream>
+#include <string>
+
 #include <casa/OS/HostInfo.h>
 
 class System
@@ -30,6 +33,35 @@ class System
 			return casa::HostInfo::memoryTotal()*1024;
 		}
 		
+		/**
+		 * Memory in bytes that can be allocated without swapping, as reported by the
+		 * kernel in /proc/meminfo. Older kernels have no MemAvailable entry; in that case
+		 * the free memory and the page cache are added. Returns 0 when unknown.
+		 */
+		static long AvailableMemory()
+		{
+			std::ifstream meminfo("/proc/meminfo");
+			long available = -1, freeMemory = 0, buffers = 0, cached = 0;
+			std::string name;
+			long value;
+			std::string unit;
+			while(meminfo >> name >> value)
+			{
+				std::getline(meminfo, unit);
+				if(name == "MemAvailable:")
+					available = value;
+				else if(name == "MemFree:")
+					freeMemory = value;
+				else if(name == "Buffers:")
+					buffers = value;
+				else if(name == "Cached:")
+					cached = value;
+			}
+			if(available < 0)
+				available = freeMemory + buffers + cached;
+			return available * 1024;
+		}
+		
 		static unsigned ProcessorCount()
 		{
 			unsigned cpus = casa::HostInfo::numCPUs();
@@ -35,7 +35,8 @@ class TimeFrequencyMetaData
 {
 	public:
 		TimeFrequencyMetaData()
-			: _antenna1(0), _antenna2(0), _band(0), _sequenceId(0), _field(0), _observationTimes(0), _uvw(0), _valueDescription("Visibility"), _valueUnits("Jy")
+			: _antenna1(0), _antenna2(0), _band(0), _sequenceId(0), _field(0), _observationTimes(0), _uvw(0), _valueDescription("Visibility"), _valueUnits("Jy"),
+			_partLeftBorder(0), _partRightBorder(0)
 		{
 		}
 		TimeFrequencyMetaData(const AntennaInfo &antenna1, const AntennaInfo &antenna2, const BandInfo &band, const FieldInfo &field, const std::vector<double> &observationTimes)
@@ -48,13 +49,17 @@ class TimeFrequencyMetaData
 			_observationTimes(new std::vector<double>(observationTimes)),
 			_uvw(0),
 			_valueDescription("Visibility"),
-			_valueUnits("Jy")
+			_valueUnits("Jy"),
+			_partLeftBorder(0),
+			_partRightBorder(0)
 		{
 		}
 		TimeFrequencyMetaData(const TimeFrequencyMetaData &source)
 			: _antenna1(0), _antenna2(0), _band(0), _sequenceId(source._sequenceId), _field(0), _observationTimes(0), _uvw(0),
 			_valueDescription(source._valueDescription),
-			_valueUnits(source._valueUnits)
+			_valueUnits(source._valueUnits),
+			_partLeftBorder(source._partLeftBorder),
+			_partRightBorder(source._partRightBorder)
 		{
 			if(source._antenna1 != 0)
 				_antenna1 = new AntennaInfo(*source._antenna1);
@@ -198,6 +203,21 @@ class TimeFrequencyMetaData
 		{
 			_valueUnits = valueUnits;
 		}
+
+		/**
+		 * When a baseline is processed in several parts of time, neighbouring parts overlap.
+		 * The part borders are the number of time steps at the start and end of this part
+		 * that are also included in a neighbouring part. Statistics over the full
+		 * baseline should skip them, so that every time step is counted once.
+		 */
+		size_t PartLeftBorder() const { return _partLeftBorder; }
+		size_t PartRightBorder() const { return _partRightBorder; }
+		void SetPartBorders(size_t leftBorder, size_t rightBorder)
+		{
+			_partLeftBorder = leftBorder;
+			_partRightBorder = rightBorder;
+		}
+		bool HasPartBorders() const { return _partLeftBorder != 0 || _partRightBorder != 0; }
 	private:
 		void operator=(const TimeFrequencyMetaData &) { }
 		
@@ -209,6 +229,7 @@ class TimeFrequencyMetaData
 		std::vector<double> *_observationTimes;
 		std::vector<class UVW> *_uvw;
 		std::string _valueDescription, _valueUnits;
+		size_t _partLeftBorder, _partRightBorder;
 };
 
 #endif // MSIO_TIME_FREQUENCY_META_DATA_H
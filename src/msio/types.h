@@ -105,6 +105,6 @@ enum PolarisationType { SinglePolarisation, DipolePolarisation, AutoDipolePolari
 
 class ParmTable;
 
-enum BaselineIOMode { DirectReadMode, IndirectReadMode, MemoryReadMode, AutoReadMode };
+enum BaselineIOMode { DirectReadMode, IndirectReadMode, MemoryReadMode, AutoReadMode, PackedMemoryReadMode };
 
 #endif // MSIO_TYPES
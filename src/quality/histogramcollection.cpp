@@ -68,12 +68,8 @@ void HistogramCollection::Add(const unsigned antenna1, const unsigned antenna2,
 	
 	for(size_t y=0;y<image->Height();++y)
 	{
-		for(size_t x=0;x<image->Width();++x)
-		{
-			const double amplitude = image->Value(x, y);
-			totalHistogram.Add(amplitude);
-			if(mask->Value(x, y))
-				rfiHistogram.Add(amplitude);
-		}
+		const num_t *amplitudes = image->ValuePtr(0, y);
+		totalHistogram.Add(amplitudes, image->Width());
+		rfiHistogram.Add(amplitudes, mask->ValuePtr(0, y), image->Width());
 	}
 }
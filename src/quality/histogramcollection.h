@@ -72,12 +72,12 @@ class HistogramCollection : public Serializable
 			LogHistogram &totalHistogram = GetTotalHistogram(antenna1, antenna2, polarization);
 			LogHistogram &rfiHistogram = GetRFIHistogram(antenna1, antenna2, polarization);
 			
-			for(size_t i=0;i<sampleCount;++i)
+			if(sampleCount != 0)
 			{
-				const double amplitude = sqrt(values[i].real()*values[i].real() + values[i].imag()*values[i].imag());
-				totalHistogram.Add(amplitude);
-				if(isRFI[i])
-					rfiHistogram.Add(amplitude);
+				std::vector<float> amplitudes(sampleCount);
+				LogHistogram::ComplexAmplitudes(values, sampleCount, &amplitudes[0]);
+				totalHistogram.Add(&amplitudes[0], sampleCount);
+				rfiHistogram.Add(&amplitudes[0], isRFI, sampleCount);
 			}
 		}
 		
@@ -0,0 +1,267 @@
+#include "loghistogram.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <stdint.h>
+
+#include <emmintrin.h>
+
+namespace
+{
+	const double BinsPerOctave = 30.10299956639812; // 100 log10(2)
+	
+	// Coefficients of a cubic fit to log2(1+t) on [0, 1]. The estimated bin is at most
+	// 0.04 bins off, which is corrected by comparing the amplitude with the bin boundaries.
+	const double Log2C1 = 1.4234902410721342, Log2C2 = -0.5877534661956468, Log2C3 = 0.1655760775600768;
+	
+	// The boundaries are tabled as 10^decade x 10^((bin-0.5)/100), for the bins of
+	// amplitudes between 10^-300 and 10^300.
+	const int MinTabledDecade = -302, MaxTabledDecade = 302;
+	const double MinTabledAmplitude = 1e-300, MaxTabledAmplitude = 1e300;
+	
+	struct BoundaryTables
+	{
+		BoundaryTables()
+		{
+			for(int d=MinTabledDecade;d<=MaxTabledDecade;++d)
+				decades[d - MinTabledDecade] = pow10((double) d);
+			for(int b=0;b!=100;++b)
+				boundaries[b] = pow10((b - 0.5) / 100.0);
+		}
+		
+		double decades[MaxTabledDecade - MinTabledDecade + 1];
+		double boundaries[100];
+	} boundaryTables;
+	
+	/**
+	 * Returns the smallest amplitude in the given bin, i.e. 10^((bin-0.5)/100).
+	 */
+	inline double lowerBoundary(int bin)
+	{
+		// Division that rounds towards minus infinity
+		const int decade = bin >= 0 ? bin / 100 : -((99 - bin) / 100);
+		return boundaryTables.decades[decade - MinTabledDecade] * boundaryTables.boundaries[bin - decade * 100];
+	}
+	
+	/**
+	 * Returns the bin of a positive amplitude within the tabled range, given an estimate
+	 * that is at most a few bins off.
+	 */
+	inline int correctBin(double amplitude, int estimate)
+	{
+		while(amplitude < lowerBoundary(estimate))
+			--estimate;
+		while(amplitude >= lowerBoundary(estimate + 1))
+			++estimate;
+		return estimate;
+	}
+	
+	/**
+	 * Estimates the bins of four floats from their exponents and mantissas. The returned mask
+	 * is set for the values that are positive and normal; the bins of other values are
+	 * undefined.
+	 */
+	inline __m128i estimateBins(__m128 values, __m128i &isNormal)
+	{
+		const __m128i bits = _mm_castps_si128(values);
+		// Also holds the sign bit, such that negative values are not in [1, 254]
+		const __m128i exponentField = _mm_srli_epi32(bits, 23);
+		isNormal = _mm_and_si128(
+			_mm_cmpgt_epi32(exponentField, _mm_setzero_si128()),
+			_mm_cmplt_epi32(exponentField, _mm_set1_epi32(255)));
+		const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(exponentField, _mm_set1_epi32(127)));
+		const __m128 t = _mm_sub_ps(
+			_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000))),
+			_mm_set1_ps(1.0f));
+		const __m128 log2Mantissa = _mm_mul_ps(t, _mm_add_ps(_mm_set1_ps(Log2C1),
+			_mm_mul_ps(t, _mm_add_ps(_mm_set1_ps(Log2C2), _mm_mul_ps(t, _mm_set1_ps(Log2C3))))));
+		return _mm_cvtps_epi32(_mm_mul_ps(_mm_add_ps(exponent, log2Mantissa), _mm_set1_ps(BinsPerOctave)));
+	}
+}
+
+void LogHistogram::BinRange::Include(int minBin, int maxBin)
+{
+	const int spareBins = 16;
+	if(counts.empty())
+	{
+		firstBin = minBin - spareBins;
+		counts.assign(maxBin - minBin + 1 + spareBins*2, 0);
+		isKept.assign(counts.size(), false);
+	}
+	else {
+		const int lastBin = firstBin + (int) counts.size() - 1;
+		if(minBin < firstBin || maxBin > lastBin)
+		{
+			int newFirstBin = std::min(minBin, firstBin), newLastBin = std::max(maxBin, lastBin);
+			const int spare = std::max(spareBins, (newLastBin - newFirstBin + 1) / 4);
+			if(newFirstBin < firstBin) newFirstBin -= spare;
+			if(newLastBin > lastBin) newLastBin += spare;
+			std::vector<unsigned long> newCounts(newLastBin - newFirstBin + 1, 0);
+			std::vector<bool> newIsKept(newCounts.size(), false);
+			std::copy(counts.begin(), counts.end(), newCounts.begin() + (firstBin - newFirstBin));
+			std::copy(isKept.begin(), isKept.end(), newIsKept.begin() + (firstBin - newFirstBin));
+			counts.swap(newCounts);
+			isKept.swap(newIsKept);
+			firstBin = newFirstBin;
+		}
+	}
+}
+
+void LogHistogram::BinRange::Add(const BinRange &other)
+{
+	size_t first = 0, end = other.Size();
+	while(first != end && !other.IsPresent(first))
+		++first;
+	while(end != first && !other.IsPresent(end - 1))
+		--end;
+	if(first != end)
+	{
+		Include(other.firstBin + (int) first, other.firstBin + (int) end - 1);
+		const size_t offset = other.firstBin - firstBin;
+		for(size_t i=first;i!=end;++i)
+		{
+			counts[i + offset] += other.counts[i];
+			if(other.isKept[i])
+				isKept[i + offset] = true;
+		}
+	}
+}
+
+int LogHistogram::binIndex(double amplitude)
+{
+	if(amplitude > MinTabledAmplitude && amplitude < MaxTabledAmplitude)
+	{
+		uint64_t bits;
+		memcpy(&bits, &amplitude, sizeof(bits));
+		const int exponent = (int) (bits >> 52) - 1023;
+		bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+		double mantissa;
+		memcpy(&mantissa, &bits, sizeof(mantissa));
+		const double t = mantissa - 1.0;
+		const double estimate = (exponent + t*(Log2C1 + t*(Log2C2 + t*Log2C3))) * BinsPerOctave;
+		return correctBin(amplitude, (int) floor(estimate + 0.5));
+	}
+	else {
+		return (int) round(100.0*log10(amplitude));
+	}
+}
+
+void LogHistogram::Add(const float *amplitudes, size_t count)
+{
+	const size_t blockSize = 256;
+	int bins[blockSize];
+	bool isNormal[blockSize];
+	while(count != 0)
+	{
+		const size_t n = std::min(count, blockSize);
+		size_t i = 0;
+		int minBin = 0, maxBin = 0;
+		bool hasNormal = false;
+		for(;i+4<=n;i+=4)
+		{
+			__m128i normalMask;
+			const __m128i estimates = estimateBins(_mm_loadu_ps(amplitudes + i), normalMask);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(bins + i), estimates);
+			const int mask = _mm_movemask_ps(_mm_castsi128_ps(normalMask));
+			for(size_t j=0;j!=4;++j)
+				isNormal[i + j] = (mask >> j) & 1;
+		}
+		for(;i<n;++i)
+		{
+			__m128i normalMask;
+			const __m128i estimate = estimateBins(_mm_set_ss(amplitudes[i]), normalMask);
+			bins[i] = _mm_cvtsi128_si32(estimate);
+			isNormal[i] = _mm_cvtsi128_si32(normalMask) != 0;
+		}
+		
+		// Make room for all bins once, so that the counts can be incremented without checks
+		for(i=0;i!=n;++i)
+		{
+			if(isNormal[i])
+			{
+				if(!hasNormal)
+				{
+					minBin = bins[i];
+					maxBin = bins[i];
+					hasNormal = true;
+				}
+				else {
+					minBin = std::min(minBin, bins[i]);
+					maxBin = std::max(maxBin, bins[i]);
+				}
+			}
+		}
+		if(hasNormal)
+			_positive.Include(minBin - 1, maxBin + 1);
+		
+		for(i=0;i!=n;++i)
+		{
+			if(isNormal[i])
+			{
+				const int bin = correctBin(amplitudes[i], bins[i]);
+				if(_positive.Contains(bin))
+					++_positive.counts[bin - _positive.firstBin];
+				else
+					++_positive.Count(bin);
+			}
+			else
+				Add((double) amplitudes[i]);
+		}
+		amplitudes += n;
+		count -= n;
+	}
+}
+
+void LogHistogram::Add(const float *amplitudes, const bool *isSelected, size_t count)
+{
+	for(size_t i=0;i!=count;++i)
+	{
+		if(isSelected[i])
+			Add((double) amplitudes[i]);
+	}
+}
+
+void LogHistogram::operator-=(const LogHistogram &histogram)
+{
+	for(const_iterator i=histogram.begin();i!=histogram.end();++i)
+	{
+		unsigned long &count = getBin(i.value());
+		if(count >= i.unnormalizedCount())
+			count -= i.unnormalizedCount();
+		else
+			count = 0;
+	}
+}
+
+void LogHistogram::Rescale(double factor)
+{
+	LogHistogram rescaled;
+	for(const_iterator i=begin();i!=end();++i)
+	{
+		const double amplitude = i.value() * factor;
+		if(std::isfinite(amplitude))
+			rescaled.getBin(amplitude) += i.unnormalizedCount();
+	}
+	_negative = rescaled._negative;
+	_positive = rescaled._positive;
+	_zeroCount = rescaled._zeroCount;
+	_isZeroKept = rescaled._isZeroKept;
+}
+
+void LogHistogram::ComplexAmplitudes(const std::complex<float> *values, size_t count, float *amplitudes)
+{
+	const float *floats = reinterpret_cast<const float*>(values);
+	size_t i = 0;
+	for(;i+4<=count;i+=4)
+	{
+		const __m128
+			a = _mm_loadu_ps(floats + i*2),
+			b = _mm_loadu_ps(floats + i*2 + 4),
+			reals = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+			imags = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(amplitudes + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(reals, reals), _mm_mul_ps(imags, imags))));
+	}
+	for(;i<count;++i)
+		amplitudes[i] = sqrtf(values[i].real()*values[i].real() + values[i].imag()*values[i].imag());
+}
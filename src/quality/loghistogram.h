@@ -20,8 +20,9 @@
 #ifndef LOGHISTOGRAM_H
 #define LOGHISTOGRAM_H
 
-#include <map>
 #include <cmath>
+#include <complex>
+#include <limits>
 #include <stdexcept>
 #include <vector>
 
@@ -35,122 +36,151 @@
 #endif
 
 
+/**
+ * Histogram of amplitudes with logarithmically sized bins, 100 per decade. Bin k holds the
+ * amplitudes of which 100 log10(amplitude) rounds to k, and is represented by its central
+ * amplitude 10^(k/100). Zero and negative amplitudes are counted in bins of their own.
+ *
+ * The counts are held in flat arrays that cover the range of bins that is in use. The bin
+ * of an amplitude is estimated from its binary exponent and mantissa, and corrected with a
+ * table of bin boundaries, such that adding a sample needs neither a logarithm nor a
+ * search.
+ */
 class LogHistogram : public Serializable
 {
 	private:
-		class AmplitudeBin : public Serializable
-		{
-		public:
-			AmplitudeBin() :
-				count(0)
+		/**
+		 * The counts of a contiguous range of bins. A bin that has been created without
+		 * counts, e.g. by subtracting or loading a histogram, is marked as kept, such that
+		 * it is still iterated over, like a bin with counts.
+		 */
+		struct BinRange
+		{
+			BinRange() : firstBin(0)
 			{
 			}
-			long unsigned count;
 			
-			long unsigned GetCount() const
-			{
-				return count;
-			}
+			int firstBin;
+			std::vector<unsigned long> counts;
+			std::vector<bool> isKept;
 			
-			AmplitudeBin &operator+=(const AmplitudeBin &other)
-			{
-				count += other.count;
-				return *this;
-			}
-			AmplitudeBin &operator-=(const AmplitudeBin &other)
-			{
-				if(count >= other.count)
-					count -= other.count;
-				else
-					count = 0;
-				return *this;
-			}
+			size_t Size() const { return counts.size(); }
+			
+			bool IsPresent(size_t index) const { return counts[index] != 0 || isKept[index]; }
+			
+			bool Contains(int bin) const { return bin >= firstBin && bin < firstBin + (int) counts.size(); }
 			
-			virtual void Serialize(std::ostream &stream) const
+			unsigned long &Count(int bin)
 			{
-				SerializeToUInt64(stream, count);
+				if(!Contains(bin))
+					Include(bin, bin);
+				return counts[bin - firstBin];
 			}
-			virtual void Unserialize(std::istream &stream)
+			
+			void Keep(int bin)
 			{
-				count = UnserializeUInt64(stream);
+				if(!Contains(bin))
+					Include(bin, bin);
+				isKept[bin - firstBin] = true;
 			}
+			
+			/**
+			 * Makes sure that the range covers the given bins. The range is extended with
+			 * some spare bins, so that it does not grow by one bin at a time.
+			 */
+			void Include(int minBin, int maxBin);
+			
+			void Add(const BinRange &other);
 		};
 		
 	public:
-		LogHistogram()
+		LogHistogram() : _zeroCount(0), _isZeroKept(false)
 		{
 		}
 		
-		LogHistogram(const LogHistogram &source) : _amplitudes(source._amplitudes)
+		LogHistogram(const LogHistogram &source) :
+			_negative(source._negative),
+			_positive(source._positive),
+			_zeroCount(source._zeroCount),
+			_isZeroKept(source._isZeroKept)
 		{
 		}
 		
 		void Add(const double amplitude)
 		{
-			if(std::isfinite(amplitude))
+			// The comparisons also skip NaNs and infinities
+			if(amplitude > 0.0)
 			{
-				const double centralAmp = getCentralAmplitude(amplitude);
-				AmplitudeBin &bin = getBin(centralAmp);
-				++bin.count;
+				if(amplitude < std::numeric_limits<double>::infinity())
+					++_positive.Count(binIndex(amplitude));
 			}
+			else if(amplitude == 0.0)
+				++_zeroCount;
+			else if(amplitude > -std::numeric_limits<double>::infinity())
+				++_negative.Count(binIndex(-amplitude));
 		}
 		
+		/**
+		 * Adds a row of amplitudes, e.g. a row of an Image2D. This is much faster than adding
+		 * the amplitudes one by one, because the bins are estimated with SSE.
+		 */
+		void Add(const float *amplitudes, size_t count);
+		
+		/**
+		 * Adds those amplitudes of a row for which @p isSelected is set.
+		 */
+		void Add(const float *amplitudes, const bool *isSelected, size_t count);
+		
 		void Add(const LogHistogram &histogram)
 		{
-			for(std::map<double, AmplitudeBin>::const_iterator i=histogram._amplitudes.begin(); i!=histogram._amplitudes.end();++i)
-			{
-				AmplitudeBin &bin = getBin(i->first);
-				bin += i->second;
-			}
+			_negative.Add(histogram._negative);
+			_positive.Add(histogram._positive);
+			_zeroCount += histogram._zeroCount;
+			_isZeroKept = _isZeroKept || histogram._isZeroKept;
 		}
 		
-		void operator-=(const LogHistogram &histogram)
-		{
-			for(std::map<double, AmplitudeBin>::const_iterator i=histogram._amplitudes.begin(); i!=histogram._amplitudes.end();++i)
-			{
-				AmplitudeBin &bin = getBin(i->first);
-				bin -= i->second;
-			}
-		}
+		void operator-=(const LogHistogram &histogram);
+		
+		/**
+		 * Calculates the amplitudes of complex values.
+		 */
+		static void ComplexAmplitudes(const std::complex<float> *values, size_t count, float *amplitudes);
 		
 		double MaxAmplitude() const
 		{
-			if(_amplitudes.empty())
+			const_iterator i = end();
+			if(i == begin())
 				return 0.0;
-			return _amplitudes.rbegin()->first;
+			--i;
+			return i.value();
 		}
 		
 		double MinPositiveAmplitude() const
 		{
-			std::map<double, AmplitudeBin>::const_iterator i = _amplitudes.begin();
-			if(i == _amplitudes.end())
-				return 0.0;
-			while(i->first <= 0.0)
+			for(size_t i=0;i!=_positive.Size();++i)
 			{
-				++i;
-				if(i == _amplitudes.end())
-					return 0.0;
+				if(_positive.IsPresent(i))
+					return centralAmplitude(_positive.firstBin + i);
 			}
-			return i->first;
+			return 0.0;
 		}
 		
 		double NormalizedCount(double startAmplitude, double endAmplitude) const
 		{
 			unsigned long count = 0;
-			for(std::map<double, class AmplitudeBin>::const_iterator i=_amplitudes.begin();i!=_amplitudes.end();++i)
+			for(const_iterator i=begin();i!=end();++i)
 			{
-				if(i->first >= startAmplitude && i->first < endAmplitude)
-					count += i->second.GetCount();
+				if(i.value() >= startAmplitude && i.value() < endAmplitude)
+					count += i.unnormalizedCount();
 			}
 			return (double) count / (endAmplitude - startAmplitude);
 		}
 		
 		double NormalizedCount(double centreAmplitude) const
 		{
-			const double key = getCentralAmplitude(centreAmplitude);
-			std::map<double, AmplitudeBin>::const_iterator i = _amplitudes.find(key);
-			if(i == _amplitudes.end()) return 0.0;
-			return (double) i->second.GetCount() / (binEnd(centreAmplitude) - binStart(centreAmplitude));
+			const unsigned long count = findCount(centreAmplitude);
+			if(count == 0) return 0.0;
+			return (double) count / (binEnd(centreAmplitude) - binStart(centreAmplitude));
 		}
 		
 		double MinNormalizedCount() const
@@ -395,108 +425,197 @@ class LogHistogram : public Serializable
 		{
 			for(std::vector<HistogramTablesFormatter::HistogramItem>::const_iterator i=histogramData.begin(); i!=histogramData.end();++i)
 			{
-				const double b = (i->binStart + i->binEnd) * 0.5; // TODO somewhat inefficient...
-				getBin(getCentralAmplitude(b)).count = (unsigned long) i->count;
+				const double b = (i->binStart + i->binEnd) * 0.5;
+				if(std::isfinite(b))
+					getBin(b) = (unsigned long) i->count;
 			}
 		}
 		
-		void Rescale(double factor)
-		{
-			std::map<double, AmplitudeBin> newAmplitudes;
-			std::map<double, AmplitudeBin>::iterator position = newAmplitudes.begin();
-			for(std::map<double, AmplitudeBin>::const_iterator i=_amplitudes.begin();
-					i!=_amplitudes.end();++i)
-			{
-				position = newAmplitudes.insert(position, std::pair<double, AmplitudeBin>(getCentralAmplitude(i->first * factor), i->second));
-			}
-			_amplitudes = newAmplitudes;
-		}
+		/**
+		 * Multiplies the amplitudes of all bins by the given factor. Bins that end up in the
+		 * same bin are summed.
+		 */
+		void Rescale(double factor);
 		
 		class const_iterator
 		{
 			public:
-				const_iterator(const LogHistogram &histogram, std::map<double, AmplitudeBin>::const_iterator iter) :
-					_iterator(iter)
+				const_iterator(const LogHistogram &histogram, size_t slot) :
+					_histogram(&histogram), _slot(slot)
 				{ }
 				const_iterator(const const_iterator &source) :
-					_iterator(source._iterator)
+					_histogram(source._histogram), _slot(source._slot)
 				{ }
 				const_iterator &operator=(const const_iterator &source)
 				{
-					_iterator = source._iterator;
+					_histogram = source._histogram;
+					_slot = source._slot;
+					return *this;
+				}
+				bool operator==(const const_iterator &other) const { return other._slot == _slot; }
+				bool operator!=(const const_iterator &other) const { return other._slot != _slot; }
+				const_iterator &operator++()
+				{
+					do { ++_slot; } while(_slot != _histogram->slotEnd() && !_histogram->isPresent(_slot));
 					return *this;
 				}
-				bool operator==(const const_iterator &other) const { return other._iterator == _iterator; }
-				bool operator!=(const const_iterator &other) const { return other._iterator != _iterator; }
-				const_iterator &operator++() { ++_iterator; return *this; }
-				const_iterator &operator--() { --_iterator; return *this; }
-				double value() const { return _iterator->first; }
-				double normalizedCount() const { return _iterator->second.GetCount() / (binEnd() - binStart()); }
-				long unsigned unnormalizedCount() const { return _iterator->second.GetCount(); }
+				const_iterator &operator--()
+				{
+					do { --_slot; } while(!_histogram->isPresent(_slot));
+					return *this;
+				}
+				double value() const { return _histogram->valueAt(_slot); }
+				double normalizedCount() const { return unnormalizedCount() / (binEnd() - binStart()); }
+				long unsigned unnormalizedCount() const { return _histogram->countAt(_slot); }
 				double binStart() const
 				{
-					return _iterator->first>0.0 ?
-						pow10(log10(_iterator->first)-0.005) :
-						-pow10(log10(-_iterator->first)-0.005);
+					const double v = value();
+					return v>0.0 ?
+						pow10(log10(v)-0.005) :
+						-pow10(log10(-v)-0.005);
 				}
 				double binEnd() const
 				{
-					return _iterator->first>0.0 ?
-						pow10(log10(_iterator->first)+0.005) :
-						-pow10(log10(-_iterator->first)+0.005);
+					const double v = value();
+					return v>0.0 ?
+						pow10(log10(v)+0.005) :
+						-pow10(log10(-v)+0.005);
 				}
 			private:
-				std::map<double, AmplitudeBin>::const_iterator _iterator;
+				const LogHistogram *_histogram;
+				size_t _slot;
 		};
 		typedef const_iterator iterator;
 		
 		const_iterator begin() const
 		{
-			return const_iterator(*this, _amplitudes.begin());
+			size_t slot = 0;
+			while(slot != slotEnd() && !isPresent(slot))
+				++slot;
+			return const_iterator(*this, slot);
 		}
 		
 		const_iterator end() const
 		{
-			return const_iterator(*this, _amplitudes.end());
+			return const_iterator(*this, slotEnd());
 		}
 		
 		virtual void Serialize(std::ostream &stream) const
 		{
-			SerializeToUInt64(stream, _amplitudes.size());
-			for(std::map<double, AmplitudeBin>::const_iterator i=_amplitudes.begin();i!=_amplitudes.end();++i)
+			size_t binCount = 0;
+			for(const_iterator i=begin();i!=end();++i)
+				++binCount;
+			SerializeToUInt64(stream, binCount);
+			for(const_iterator i=begin();i!=end();++i)
 			{
-				SerializeToDouble(stream, i->first);
-				i->second.Serialize(stream);
+				SerializeToDouble(stream, i.value());
+				SerializeToUInt64(stream, i.unnormalizedCount());
 			}
 		}
 		
 		virtual void Unserialize(std::istream &stream)
 		{
-			_amplitudes.clear();
-			size_t mapSize = UnserializeUInt64(stream);
-			std::map<double, AmplitudeBin>::iterator insertPos = _amplitudes.begin();
-			for(size_t i=0;i!=mapSize;++i)
+			_negative = BinRange();
+			_positive = BinRange();
+			_zeroCount = 0;
+			_isZeroKept = false;
+			size_t binCount = UnserializeUInt64(stream);
+			for(size_t i=0;i!=binCount;++i)
 			{
-				std::pair<double, AmplitudeBin> p;
-				p.first = UnserializeDouble(stream);
-				p.second.Unserialize(stream);
-				insertPos = _amplitudes.insert(insertPos, p);
+				const double centralAmplitude = UnserializeDouble(stream);
+				const unsigned long count = UnserializeUInt64(stream);
+				getBin(centralAmplitude) = count;
 			}
 		}
 	private:
-		std::map<double, AmplitudeBin> _amplitudes;
+		// Bins of negative amplitudes are indexed by the bin of their absolute value
+		BinRange _negative, _positive;
+		unsigned long _zeroCount;
+		bool _isZeroKept;
 		
-		AmplitudeBin &getBin(double centralAmplitude)
+		/**
+		 * Returns the bin of a positive, finite amplitude.
+		 */
+		static int binIndex(double amplitude);
+		
+		static double centralAmplitude(int bin)
 		{
-			std::map<double, class AmplitudeBin>::iterator element =
-				_amplitudes.find(centralAmplitude);
-			
-			if(element == _amplitudes.end())
+			return pow10(bin / 100.0);
+		}
+		
+		/**
+		 * Returns the count of the bin of a finite amplitude and creates the bin when it does
+		 * not exist.
+		 */
+		unsigned long &getBin(double amplitude)
+		{
+			if(amplitude > 0.0)
 			{
-				element = _amplitudes.insert(std::pair<double, AmplitudeBin>(centralAmplitude, AmplitudeBin())).first;
+				const int bin = binIndex(amplitude);
+				_positive.Keep(bin);
+				return _positive.Count(bin);
 			}
-			return element->second;
+			else if(amplitude == 0.0)
+			{
+				_isZeroKept = true;
+				return _zeroCount;
+			}
+			else {
+				const int bin = binIndex(-amplitude);
+				_negative.Keep(bin);
+				return _negative.Count(bin);
+			}
+		}
+		
+		unsigned long findCount(double amplitude) const
+		{
+			if(!std::isfinite(amplitude))
+				return 0;
+			else if(amplitude == 0.0)
+				return _zeroCount;
+			const BinRange &range = amplitude > 0.0 ? _positive : _negative;
+			const int bin = binIndex(std::fabs(amplitude));
+			return range.Contains(bin) ? range.counts[bin - range.firstBin] : 0;
 		}
+		
+		// The bins are iterated in order of amplitude by numbering them with slots: first the
+		// negative bins from large to small absolute amplitude, then the zero bin and finally
+		// the positive bins.
+		size_t slotEnd() const { return _negative.Size() + 1 + _positive.Size(); }
+		
+		bool isPresent(size_t slot) const
+		{
+			const size_t negativeCount = _negative.Size();
+			if(slot < negativeCount)
+				return _negative.IsPresent(negativeCount - 1 - slot);
+			else if(slot == negativeCount)
+				return _zeroCount != 0 || _isZeroKept;
+			else
+				return _positive.IsPresent(slot - negativeCount - 1);
+		}
+		
+		unsigned long countAt(size_t slot) const
+		{
+			const size_t negativeCount = _negative.Size();
+			if(slot < negativeCount)
+				return _negative.counts[negativeCount - 1 - slot];
+			else if(slot == negativeCount)
+				return _zeroCount;
+			else
+				return _positive.counts[slot - negativeCount - 1];
+		}
+		
+		double valueAt(size_t slot) const
+		{
+			const size_t negativeCount = _negative.Size();
+			if(slot < negativeCount)
+				return -centralAmplitude(_negative.firstBin + (int) (negativeCount - 1 - slot));
+			else if(slot == negativeCount)
+				return 0.0;
+			else
+				return centralAmplitude(_positive.firstBin + (int) (slot - negativeCount - 1));
+		}
+		
 		double binStart(double x) const
 		{
 			return x>0.0 ?
@@ -509,14 +628,6 @@ class LogHistogram : public Serializable
 				pow10(log10(x)+0.005) :
 				-pow10(log10(x)+0.005);
 		}
-		
-		static double getCentralAmplitude(const double amplitude)
-		{
-			if(amplitude>=0.0)
-				return pow10(round(100.0*log10(amplitude))/100.0);
-			else
-				return -pow10(round(100.0*log10(-amplitude))/100.0);
-		}
 };
 
 #endif
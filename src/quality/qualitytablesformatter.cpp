@@ -21,6 +21,7 @@
 #include "qualitytablesformatter.h"
 
 #include <stdexcept>
+#include <map>
 #include <set>
 
 #include <ms/MeasurementSets/MSColumns.h>
@@ -473,11 +474,212 @@ unsigned QualityTablesFormatter::QueryStatisticEntryCount(enum StatisticDimensio
 
 unsigned QualityTablesFormatter::GetPolarizationCount()
 {
-	casa::Table &table(getTable(TimeStatisticTable, false));
-	casa::ROArrayColumn<casa::Complex> valueColumn(table, ColumnNameValue);
+	return getPolarizationCount(TimeStatisticTable);
+}
+
+unsigned QualityTablesFormatter::getPolarizationCount(enum QualityTable table)
+{
+	casa::Table &casaTable(getTable(table, false));
+	casa::ROArrayColumn<casa::Complex> valueColumn(casaTable, ColumnNameValue);
 	return valueColumn.columnDesc().shape()[0];
 }
 
+namespace {
+	/**
+	 * Keys of the rows in the statistic tables, used to find the row that a merged value
+	 * belongs to.
+	 */
+	struct TimeKey
+	{
+		double time, frequency;
+		int kind;
+		bool operator<(const TimeKey &rhs) const
+		{
+			if(time != rhs.time) return time < rhs.time;
+			if(frequency != rhs.frequency) return frequency < rhs.frequency;
+			return kind < rhs.kind;
+		}
+	};
+	
+	struct FrequencyKey
+	{
+		double frequency;
+		int kind;
+		bool operator<(const FrequencyKey &rhs) const
+		{
+			if(frequency != rhs.frequency) return frequency < rhs.frequency;
+			return kind < rhs.kind;
+		}
+	};
+	
+	struct BaselineKey
+	{
+		int antenna1, antenna2;
+		double frequency;
+		int kind;
+		bool operator<(const BaselineKey &rhs) const
+		{
+			if(antenna1 != rhs.antenna1) return antenna1 < rhs.antenna1;
+			if(antenna2 != rhs.antenna2) return antenna2 < rhs.antenna2;
+			if(frequency != rhs.frequency) return frequency < rhs.frequency;
+			return kind < rhs.kind;
+		}
+	};
+	
+	void addToValueRow(casa::ArrayColumn<casa::Complex> &valueColumn, unsigned row, const StatisticalValue &value)
+	{
+		casa::Array<casa::Complex> valueArray = valueColumn(row);
+		casa::Array<casa::Complex>::iterator iter = valueArray.begin();
+		for(unsigned p=0;p<value.PolarizationCount();++p)
+		{
+			*iter += value.Value(p);
+			++iter;
+		}
+		valueColumn.put(row, valueArray);
+	}
+	
+	void putValueRow(casa::ArrayColumn<casa::Complex> &valueColumn, unsigned row, const StatisticalValue &value)
+	{
+		casa::Vector<casa::Complex> data(value.PolarizationCount());
+		for(unsigned p=0;p<value.PolarizationCount();++p)
+			data[p] = value.Value(p);
+		valueColumn.put(row, data);
+	}
+}
+
+void QualityTablesFormatter::MergeTimeValues(const std::vector<std::pair<TimePosition, StatisticalValue> > &entries)
+{
+	openTimeTable(true);
+	
+	casa::ScalarColumn<double> timeColumn(*_timeTable, ColumnNameTime);
+	casa::ScalarColumn<double> frequencyColumn(*_timeTable, ColumnNameFrequency);
+	casa::ScalarColumn<int> kindColumn(*_timeTable, ColumnNameKind);
+	casa::ArrayColumn<casa::Complex> valueColumn(*_timeTable, ColumnNameValue);
+	
+	// Only the key columns of the existing rows are read to index them
+	const unsigned nrRow = _timeTable->nrow();
+	const casa::Vector<double> times = timeColumn.getColumn();
+	const casa::Vector<double> frequencies = frequencyColumn.getColumn();
+	const casa::Vector<int> kinds = kindColumn.getColumn();
+	std::map<TimeKey, unsigned> rows;
+	for(unsigned i=0;i<nrRow;++i)
+	{
+		TimeKey key;
+		key.time = times[i];
+		key.frequency = frequencies[i];
+		key.kind = kinds[i];
+		rows.insert(std::make_pair(key, i));
+	}
+	
+	for(std::vector<std::pair<TimePosition, StatisticalValue> >::const_iterator e=entries.begin();e!=entries.end();++e)
+	{
+		TimeKey key;
+		key.time = e->first.time;
+		key.frequency = e->first.frequency;
+		key.kind = e->second.KindIndex();
+		std::map<TimeKey, unsigned>::const_iterator row = rows.find(key);
+		if(row != rows.end())
+			addToValueRow(valueColumn, row->second, e->second);
+		else {
+			const unsigned newRow = _timeTable->nrow();
+			_timeTable->addRow();
+			timeColumn.put(newRow, key.time);
+			frequencyColumn.put(newRow, key.frequency);
+			kindColumn.put(newRow, key.kind);
+			putValueRow(valueColumn, newRow, e->second);
+			rows.insert(std::make_pair(key, newRow));
+		}
+	}
+}
+
+void QualityTablesFormatter::MergeFrequencyValues(const std::vector<std::pair<FrequencyPosition, StatisticalValue> > &entries)
+{
+	openFrequencyTable(true);
+	
+	casa::ScalarColumn<double> frequencyColumn(*_frequencyTable, ColumnNameFrequency);
+	casa::ScalarColumn<int> kindColumn(*_frequencyTable, ColumnNameKind);
+	casa::ArrayColumn<casa::Complex> valueColumn(*_frequencyTable, ColumnNameValue);
+	
+	const unsigned nrRow = _frequencyTable->nrow();
+	const casa::Vector<double> frequencies = frequencyColumn.getColumn();
+	const casa::Vector<int> kinds = kindColumn.getColumn();
+	std::map<FrequencyKey, unsigned> rows;
+	for(unsigned i=0;i<nrRow;++i)
+	{
+		FrequencyKey key;
+		key.frequency = frequencies[i];
+		key.kind = kinds[i];
+		rows.insert(std::make_pair(key, i));
+	}
+	
+	for(std::vector<std::pair<FrequencyPosition, StatisticalValue> >::const_iterator e=entries.begin();e!=entries.end();++e)
+	{
+		FrequencyKey key;
+		key.frequency = e->first.frequency;
+		key.kind = e->second.KindIndex();
+		std::map<FrequencyKey, unsigned>::const_iterator row = rows.find(key);
+		if(row != rows.end())
+			addToValueRow(valueColumn, row->second, e->second);
+		else {
+			const unsigned newRow = _frequencyTable->nrow();
+			_frequencyTable->addRow();
+			frequencyColumn.put(newRow, key.frequency);
+			kindColumn.put(newRow, key.kind);
+			putValueRow(valueColumn, newRow, e->second);
+			rows.insert(std::make_pair(key, newRow));
+		}
+	}
+}
+
+void QualityTablesFormatter::MergeBaselineValues(const std::vector<std::pair<BaselinePosition, StatisticalValue> > &entries)
+{
+	openBaselineTable(true);
+	
+	casa::ScalarColumn<int> antenna1Column(*_baselineTable, ColumnNameAntenna1);
+	casa::ScalarColumn<int> antenna2Column(*_baselineTable, ColumnNameAntenna2);
+	casa::ScalarColumn<double> frequencyColumn(*_baselineTable, ColumnNameFrequency);
+	casa::ScalarColumn<int> kindColumn(*_baselineTable, ColumnNameKind);
+	casa::ArrayColumn<casa::Complex> valueColumn(*_baselineTable, ColumnNameValue);
+	
+	const unsigned nrRow = _baselineTable->nrow();
+	const casa::Vector<int> antenna1s = antenna1Column.getColumn();
+	const casa::Vector<int> antenna2s = antenna2Column.getColumn();
+	const casa::Vector<double> frequencies = frequencyColumn.getColumn();
+	const casa::Vector<int> kinds = kindColumn.getColumn();
+	std::map<BaselineKey, unsigned> rows;
+	for(unsigned i=0;i<nrRow;++i)
+	{
+		BaselineKey key;
+		key.antenna1 = antenna1s[i];
+		key.antenna2 = antenna2s[i];
+		key.frequency = frequencies[i];
+		key.kind = kinds[i];
+		rows.insert(std::make_pair(key, i));
+	}
+	
+	for(std::vector<std::pair<BaselinePosition, StatisticalValue> >::const_iterator e=entries.begin();e!=entries.end();++e)
+	{
+		BaselineKey key;
+		key.antenna1 = e->first.antenna1;
+		key.antenna2 = e->first.antenna2;
+		key.frequency = e->first.frequency;
+		key.kind = e->second.KindIndex();
+		std::map<BaselineKey, unsigned>::const_iterator row = rows.find(key);
+		if(row != rows.end())
+			addToValueRow(valueColumn, row->second, e->second);
+		else {
+			const unsigned newRow = _baselineTable->nrow();
+			_baselineTable->addRow();
+			antenna1Column.put(newRow, key.antenna1);
+			antenna2Column.put(newRow, key.antenna2);
+			frequencyColumn.put(newRow, key.frequency);
+			kindColumn.put(newRow, key.kind);
+			putValueRow(valueColumn, newRow, e->second);
+			rows.insert(std::make_pair(key, newRow));
+		}
+	}
+}
+
 void QualityTablesFormatter::QueryTimeStatistic(unsigned kindIndex, std::vector<std::pair<TimePosition, StatisticalValue> > &entries)
 {
 	casa::Table &table(getTable(TimeStatisticTable, false));
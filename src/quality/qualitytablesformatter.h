@@ -22,6 +22,8 @@
 
 #include <ms/MeasurementSets/MeasurementSet.h>
 
+#include <stdexcept>
+
 /**
 	@author A.R. Offringa <offringa@astro.rug.nl>
 */
@@ -204,6 +206,23 @@ class QualityTablesFormatter {
 			}
 		}
 		
+		/**
+		 * Makes sure the kind name table and the table of the given dimension exist, without
+		 * removing rows that are already stored. This is used before merging values into the
+		 * table with one of the Merge..Values() methods.
+		 */
+		void InitializeStatisticTable(enum StatisticDimension dimension, unsigned polarizationCount)
+		{
+			if(!TableExists(KindNameTable))
+				createKindNameTable();
+			
+			QualityTable table = DimensionToTable(dimension);
+			if(!TableExists(table))
+				createTable(table, polarizationCount);
+			else if(getPolarizationCount(table) != polarizationCount)
+				throw std::runtime_error("Can not merge statistics into " + TableToName(table) + ": it holds a different number of polarizations");
+		}
+		
 		void InitializeEmptyTable(enum QualityTable table, unsigned polarizationCount)
 		{
 			if(TableExists(table))
@@ -246,6 +265,18 @@ class QualityTablesFormatter {
 		void StoreBaselineValue(unsigned antenna1, unsigned antenna2, double frequency, const class StatisticalValue &value);
 		void StoreBaselineTimeValue(unsigned antenna1, unsigned antenna2, double time, double frequency, const class StatisticalValue &value);
 		
+		/**
+		 * Adds the given values to the rows that have the same position and kind index, and
+		 * appends a row for each value of which the position is not stored yet. Existing rows
+		 * are neither removed nor rewritten: only their key columns are scanned, and only the
+		 * values of merged rows are read and written. All stored statistic kinds (counts and
+		 * sums) are additive, so merging the statistics of several passes gives the same values
+		 * as collecting them in one pass.
+		 */
+		void MergeTimeValues(const std::vector<std::pair<TimePosition, class StatisticalValue> > &entries);
+		void MergeFrequencyValues(const std::vector<std::pair<FrequencyPosition, class StatisticalValue> > &entries);
+		void MergeBaselineValues(const std::vector<std::pair<BaselinePosition, class StatisticalValue> > &entries);
+		
 		unsigned QueryKindIndex(enum StatisticKind kind);
 		bool QueryKindIndex(enum StatisticKind kind, unsigned &destKindIndex);
 		unsigned StoreOrQueryKindIndex(enum StatisticKind kind)
@@ -291,6 +322,7 @@ class QualityTablesFormatter {
 		casa::Table *_baselineTimeTable;
 		
 		bool hasOneEntry(enum QualityTable table, unsigned kindIndex);
+		unsigned getPolarizationCount(enum QualityTable table);
 		void removeStatisticFromStatTable(enum QualityTable table, enum StatisticKind kind);
 		void removeKindNameEntry(enum StatisticKind kind);
 		void removeEntries(enum QualityTable table);
@@ -0,0 +1,532 @@
+#include "statisticsaccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <emmintrin.h>
+
+namespace {
+	/**
+	 * Returns the flags of two samples as the masks (b0, b0, b1, b1), such that each
+	 * flag covers the real and imaginary value of its sample.
+	 */
+	inline __m128 flagPairMask(const bool *flags)
+	{
+		const __m128i values = _mm_set_epi32(flags[1], flags[1], flags[0], flags[0]);
+		return _mm_castsi128_ps(_mm_cmpgt_epi32(values, _mm_setzero_si128()));
+	}
+
+	/**
+	 * Returns a mask for two interleaved complex samples that is set for the samples
+	 * of which both the real and imaginary value are finite.
+	 */
+	inline __m128 finitePairMask(__m128 values)
+	{
+		// Subtracting a value from itself only gives zero when it is finite
+		const __m128 isFinite = _mm_cmpeq_ps(_mm_sub_ps(values, values), _mm_setzero_ps());
+		return _mm_and_ps(isFinite, _mm_shuffle_ps(isFinite, isFinite, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+
+	/**
+	 * Converts the counts (c0, c0, c1, c1) of two samples into the doubles (c0, c1).
+	 */
+	inline __m128d pairCounts(__m128 counts)
+	{
+		return _mm_cvtps_pd(_mm_shuffle_ps(counts, counts, _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+
+	inline void addTo(double *destination, __m128d values)
+	{
+		_mm_storeu_pd(destination, _mm_add_pd(_mm_loadu_pd(destination), values));
+	}
+
+	inline double horizontalSum(__m128d values)
+	{
+		double elements[2];
+		_mm_storeu_pd(elements, values);
+		return elements[0] + elements[1];
+	}
+}
+
+StatisticsAccumulator::StatisticsAccumulator(unsigned polarizationCount, const double *frequencies, unsigned channelCount) :
+	_polarizationCount(polarizationCount),
+	_centralFrequency((frequencies[0] + frequencies[channelCount-1]) / 2.0),
+	_isEmpty(true),
+	_frequencies(frequencies, frequencies + channelCount),
+	_lastTime(0.0),
+	_lastTimeIndex(0),
+	_antennaCapacity(0)
+{
+	SetPolarizationCount(polarizationCount);
+}
+
+void StatisticsAccumulator::SetPolarizationCount(unsigned polarizationCount)
+{
+	_polarizationCount = polarizationCount;
+	_frequencySums.resize(polarizationCount);
+	Clear();
+}
+
+void StatisticsAccumulator::Clear()
+{
+	_frequencyCells.assign(_frequencies.size() * _polarizationCount, Cell());
+	for(std::vector<ElementSums>::iterator i=_frequencySums.begin();i!=_frequencySums.end();++i)
+		i->Reset(_frequencies.size());
+
+	_times.clear();
+	_timeIndices.clear();
+	_timeCells.clear();
+	_imageTimes.clear();
+	_imageTimeIndices.clear();
+
+	_baselines.clear();
+	_baselineCells.clear();
+	std::fill(_baselineMatrix.begin(), _baselineMatrix.end(), -1);
+
+	_isEmpty = true;
+}
+
+void StatisticsAccumulator::ElementSums::Reset(size_t size)
+{
+	count.assign(size, 0.0);
+	rfiCount.assign(size, 0.0);
+	sum.assign(size * 2, 0.0);
+	sumP2.assign(size * 2, 0.0);
+	dCount.assign(size, 0.0);
+	dSum.assign(size * 2, 0.0);
+	dSumP2.assign(size * 2, 0.0);
+	rowCount = 0;
+}
+
+StatisticsAccumulator::Cell::Cell() : count(0), rfiCount(0), dCount(0)
+{
+	for(size_t i=0;i!=2;++i)
+	{
+		sum[i].sum = 0.0; sum[i].compensation = 0.0;
+		sumP2[i].sum = 0.0; sumP2[i].compensation = 0.0;
+		dSum[i].sum = 0.0; dSum[i].compensation = 0.0;
+		dSumP2[i].sum = 0.0; dSumP2[i].compensation = 0.0;
+	}
+}
+
+void StatisticsAccumulator::Cell::Add(const RowSums &rowSums)
+{
+	count += (unsigned long) rowSums.count;
+	rfiCount += (unsigned long) rowSums.rfiCount;
+	dCount += (unsigned long) rowSums.dCount;
+	for(size_t i=0;i!=2;++i)
+	{
+		sum[i].Add(rowSums.sum[i]);
+		sumP2[i].Add(rowSums.sumP2[i]);
+		dSum[i].Add(rowSums.dSum[i]);
+		dSumP2[i].Add(rowSums.dSumP2[i]);
+	}
+}
+
+void StatisticsAccumulator::Cell::Add(const ElementSums &elementSums, size_t index)
+{
+	count += (unsigned long) elementSums.count[index];
+	rfiCount += (unsigned long) elementSums.rfiCount[index];
+	dCount += (unsigned long) elementSums.dCount[index];
+	for(size_t i=0;i!=2;++i)
+	{
+		sum[i].Add(elementSums.sum[index*2 + i]);
+		sumP2[i].Add(elementSums.sumP2[index*2 + i]);
+		dSum[i].Add(elementSums.dSum[index*2 + i]);
+		dSumP2[i].Add(elementSums.dSumP2[index*2 + i]);
+	}
+}
+
+void StatisticsAccumulator::Cell::AddTo(DefaultStatistics &destination, unsigned polarization) const
+{
+	destination.count[polarization] += count;
+	destination.rfiCount[polarization] += rfiCount;
+	destination.sum[polarization] += std::complex<long double>(sum[0].Value(), sum[1].Value());
+	destination.sumP2[polarization] += std::complex<long double>(sumP2[0].Value(), sumP2[1].Value());
+	destination.dCount[polarization] += dCount;
+	destination.dSum[polarization] += std::complex<long double>(dSum[0].Value(), dSum[1].Value());
+	destination.dSumP2[polarization] += std::complex<long double>(dSumP2[0].Value(), dSumP2[1].Value());
+}
+
+/**
+ * Adds n interleaved complex samples. A sample counts when it is not flagged by the
+ * correlator and both its values are finite; it then adds either to the RFI count or to
+ * the sums. The element sums can be zero.
+ */
+void StatisticsAccumulator::accumulateValues(const float *samples, const bool *isRFI, const bool *origFlags, size_t n, ElementSums *elementSums, RowSums &rowSums)
+{
+	const __m128 ones = _mm_set1_ps(1.0f);
+	__m128d
+		count = _mm_setzero_pd(), rfiCount = _mm_setzero_pd(),
+		sum = _mm_setzero_pd(), sumP2 = _mm_setzero_pd();
+	size_t j = 0;
+	for(;j+2<=n;j+=2)
+	{
+		const __m128 values = _mm_loadu_ps(samples + j*2);
+		const __m128 isValid = _mm_andnot_ps(flagPairMask(origFlags + j), finitePairMask(values));
+		const __m128 rfiFlags = flagPairMask(isRFI + j);
+		const __m128 isGood = _mm_andnot_ps(rfiFlags, isValid);
+
+		const __m128 goodValues = _mm_and_ps(isGood, values);
+		const __m128d
+			first = _mm_cvtps_pd(goodValues),
+			second = _mm_cvtps_pd(_mm_movehl_ps(goodValues, goodValues)),
+			firstP2 = _mm_mul_pd(first, first),
+			secondP2 = _mm_mul_pd(second, second),
+			goodCount = pairCounts(_mm_and_ps(isGood, ones)),
+			badCount = pairCounts(_mm_and_ps(_mm_and_ps(rfiFlags, isValid), ones));
+
+		sum = _mm_add_pd(sum, _mm_add_pd(first, second));
+		sumP2 = _mm_add_pd(sumP2, _mm_add_pd(firstP2, secondP2));
+		count = _mm_add_pd(count, goodCount);
+		rfiCount = _mm_add_pd(rfiCount, badCount);
+
+		if(elementSums != 0)
+		{
+			addTo(&elementSums->sum[j*2], first);
+			addTo(&elementSums->sum[j*2 + 2], second);
+			addTo(&elementSums->sumP2[j*2], firstP2);
+			addTo(&elementSums->sumP2[j*2 + 2], secondP2);
+			addTo(&elementSums->count[j], goodCount);
+			addTo(&elementSums->rfiCount[j], badCount);
+		}
+	}
+
+	double sums[2], sumsP2[2];
+	_mm_storeu_pd(sums, sum);
+	_mm_storeu_pd(sumsP2, sumP2);
+	rowSums.count += horizontalSum(count);
+	rowSums.rfiCount += horizontalSum(rfiCount);
+	for(size_t i=0;i!=2;++i)
+	{
+		rowSums.sum[i] += sums[i];
+		rowSums.sumP2[i] += sumsP2[i];
+	}
+
+	for(;j<n;++j)
+	{
+		const float real = samples[j*2], imag = samples[j*2 + 1];
+		if(!origFlags[j] && std::isfinite(real) && std::isfinite(imag))
+		{
+			if(isRFI[j])
+			{
+				rowSums.rfiCount += 1.0;
+				if(elementSums != 0)
+					elementSums->rfiCount[j] += 1.0;
+			} else {
+				const double r = real, i = imag;
+				rowSums.count += 1.0;
+				rowSums.sum[0] += r; rowSums.sum[1] += i;
+				rowSums.sumP2[0] += r*r; rowSums.sumP2[1] += i*i;
+				if(elementSums != 0)
+				{
+					elementSums->count[j] += 1.0;
+					elementSums->sum[j*2] += r; elementSums->sum[j*2 + 1] += i;
+					elementSums->sumP2[j*2] += r*r; elementSums->sumP2[j*2 + 1] += i*i;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Adds the differences between n interleaved complex samples and the samples that
+ * follow them, scaled by sqrt(1/2). A difference counts when neither sample is flagged
+ * and all values are finite. With @p addToNextElement, a difference is added to the
+ * element sums of both samples, otherwise only to those of the first.
+ */
+void StatisticsAccumulator::accumulateDifferences(const float *samples, const bool *isRFI, const bool *origFlags, const float *nextSamples, const bool *nextIsRFI, const bool *nextOrigFlags, size_t n, ElementSums *elementSums, bool addToNextElement, RowSums &rowSums)
+{
+	const __m128 ones = _mm_set1_ps(1.0f);
+	const __m128d scale = _mm_set1_pd(M_SQRT1_2);
+	__m128d
+		count = _mm_setzero_pd(),
+		sum = _mm_setzero_pd(), sumP2 = _mm_setzero_pd();
+	size_t j = 0;
+	for(;j+2<=n;j+=2)
+	{
+		const __m128
+			values = _mm_loadu_ps(samples + j*2),
+			nextValues = _mm_loadu_ps(nextSamples + j*2);
+		const __m128 isFlagged = _mm_or_ps(
+			_mm_or_ps(flagPairMask(origFlags + j), flagPairMask(isRFI + j)),
+			_mm_or_ps(flagPairMask(nextOrigFlags + j), flagPairMask(nextIsRFI + j)));
+		const __m128 isGood = _mm_andnot_ps(isFlagged, _mm_and_ps(finitePairMask(values), finitePairMask(nextValues)));
+
+		// Non-finite differences are removed by the masks, which cover a whole double
+		const __m128d
+			first = _mm_and_pd(_mm_castps_pd(_mm_unpacklo_ps(isGood, isGood)),
+				_mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(nextValues), _mm_cvtps_pd(values)), scale)),
+			second = _mm_and_pd(_mm_castps_pd(_mm_unpackhi_ps(isGood, isGood)),
+				_mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(nextValues, nextValues)), _mm_cvtps_pd(_mm_movehl_ps(values, values))), scale)),
+			firstP2 = _mm_mul_pd(first, first),
+			secondP2 = _mm_mul_pd(second, second),
+			goodCount = pairCounts(_mm_and_ps(isGood, ones));
+
+		sum = _mm_add_pd(sum, _mm_add_pd(first, second));
+		sumP2 = _mm_add_pd(sumP2, _mm_add_pd(firstP2, secondP2));
+		count = _mm_add_pd(count, goodCount);
+
+		if(elementSums != 0)
+		{
+			addTo(&elementSums->dSum[j*2], first);
+			addTo(&elementSums->dSum[j*2 + 2], second);
+			addTo(&elementSums->dSumP2[j*2], firstP2);
+			addTo(&elementSums->dSumP2[j*2 + 2], secondP2);
+			addTo(&elementSums->dCount[j], goodCount);
+			if(addToNextElement)
+			{
+				addTo(&elementSums->dSum[j*2 + 2], first);
+				addTo(&elementSums->dSum[j*2 + 4], second);
+				addTo(&elementSums->dSumP2[j*2 + 2], firstP2);
+				addTo(&elementSums->dSumP2[j*2 + 4], secondP2);
+				addTo(&elementSums->dCount[j + 1], goodCount);
+			}
+		}
+	}
+
+	double sums[2], sumsP2[2];
+	_mm_storeu_pd(sums, sum);
+	_mm_storeu_pd(sumsP2, sumP2);
+	rowSums.dCount += horizontalSum(count);
+	for(size_t i=0;i!=2;++i)
+	{
+		rowSums.dSum[i] += sums[i];
+		rowSums.dSumP2[i] += sumsP2[i];
+	}
+
+	for(;j<n;++j)
+	{
+		const float
+			real = samples[j*2], imag = samples[j*2 + 1],
+			nextReal = nextSamples[j*2], nextImag = nextSamples[j*2 + 1];
+		if(!(origFlags[j] || isRFI[j] || nextOrigFlags[j] || nextIsRFI[j]) &&
+			std::isfinite(real) && std::isfinite(imag) && std::isfinite(nextReal) && std::isfinite(nextImag))
+		{
+			const double
+				r = ((double) nextReal - (double) real) * M_SQRT1_2,
+				i = ((double) nextImag - (double) imag) * M_SQRT1_2;
+			rowSums.dCount += 1.0;
+			rowSums.dSum[0] += r; rowSums.dSum[1] += i;
+			rowSums.dSumP2[0] += r*r; rowSums.dSumP2[1] += i*i;
+			if(elementSums != 0)
+			{
+				const size_t last = addToNextElement ? j+1 : j;
+				for(size_t e=j;e<=last;++e)
+				{
+					elementSums->dCount[e] += 1.0;
+					elementSums->dSum[e*2] += r; elementSums->dSum[e*2 + 1] += i;
+					elementSums->dSumP2[e*2] += r*r; elementSums->dSumP2[e*2 + 1] += i*i;
+				}
+			}
+		}
+	}
+}
+
+void StatisticsAccumulator::interleave(const float *reals, const float *imags, size_t n, float *destination)
+{
+	size_t j = 0;
+	for(;j+4<=n;j+=4)
+	{
+		const __m128 r = _mm_loadu_ps(reals + j), i = _mm_loadu_ps(imags + j);
+		_mm_storeu_ps(destination + j*2, _mm_unpacklo_ps(r, i));
+		_mm_storeu_ps(destination + j*2 + 4, _mm_unpackhi_ps(r, i));
+	}
+	for(;j<n;++j)
+	{
+		destination[j*2] = reals[j];
+		destination[j*2 + 1] = imags[j];
+	}
+}
+
+void StatisticsAccumulator::Add(unsigned antenna1, unsigned antenna2, double time, unsigned polarization, const float *reals, const float *imags, const bool *isRFI, const bool *origFlags, unsigned nsamples, unsigned step, unsigned stepRFI, unsigned stepFlags)
+{
+	if(nsamples == 0) return;
+	if(nsamples > _frequencies.size())
+		throw std::runtime_error("StatisticsAccumulator::Add(): more samples were given than the band has channels");
+
+	// The kernels need interleaved complex values and contiguous flags
+	const float *samples = reals;
+	if(step != 2 || imags != reals + 1)
+	{
+		_rowBuffer.resize(nsamples * 2);
+		for(size_t j=0;j!=nsamples;++j)
+		{
+			_rowBuffer[j*2] = reals[j*step];
+			_rowBuffer[j*2 + 1] = imags[j*step];
+		}
+		samples = &_rowBuffer[0];
+	}
+	if(stepRFI != 1)
+	{
+		_rfiBuffer.resize(nsamples);
+		for(size_t j=0;j!=nsamples;++j)
+			_rfiBuffer[j] = isRFI[j*stepRFI];
+		isRFI = reinterpret_cast<const bool*>(&_rfiBuffer[0]);
+	}
+	if(stepFlags != 1)
+	{
+		_flagBuffer.resize(nsamples);
+		for(size_t j=0;j!=nsamples;++j)
+			_flagBuffer[j] = origFlags[j*stepFlags];
+		origFlags = reinterpret_cast<const bool*>(&_flagBuffer[0]);
+	}
+
+	// Time and frequency statistics are only collected for cross-correlations
+	const bool isCrossCorrelation = antenna1 != antenna2;
+	ElementSums *frequencySums = isCrossCorrelation ? &_frequencySums[polarization] : 0;
+	RowSums rowSums;
+	accumulateValues(samples, isRFI, origFlags, nsamples, frequencySums, rowSums);
+	accumulateDifferences(samples, isRFI, origFlags, samples + 2, isRFI + 1, origFlags + 1, nsamples - 1, frequencySums, true, rowSums);
+
+	if(isCrossCorrelation)
+	{
+		const size_t index = timeIndex(time);
+		timeCell(index, polarization).Add(rowSums);
+		// The per-channel sums are kept short, such that their rounding error stays small
+		++frequencySums->rowCount;
+		if(frequencySums->rowCount == 1024)
+			flushFrequencySums(polarization);
+	}
+	const size_t index = baselineIndex(antenna1, antenna2);
+	baselineCell(index, polarization).Add(rowSums);
+	_isEmpty = false;
+}
+
+void StatisticsAccumulator::AddImage(unsigned antenna1, unsigned antenna2, const double *times, unsigned polarization, const Image2D &realImage, const Image2D &imagImage, const Mask2D &rfiMask, const Mask2D &correlatorMask)
+{
+	const size_t width = realImage.Width(), height = realImage.Height();
+	if(width == 0 || height == 0) return;
+	if(height > _frequencies.size())
+		throw std::runtime_error("StatisticsAccumulator::AddImage(): the image has more channels than the band");
+
+	// Consecutive images mostly have the same time steps
+	if(_imageTimes.size() != width || !std::equal(times, times + width, _imageTimes.begin()))
+	{
+		_imageTimes.assign(times, times + width);
+		_imageTimeIndices.resize(width);
+		for(size_t t=0;t!=width;++t)
+			_imageTimeIndices[t] = timeIndex(times[t]);
+	}
+
+	const bool isCrossCorrelation = antenna1 != antenna2;
+	ElementSums *timeSums = 0;
+	if(isCrossCorrelation)
+	{
+		_imageTimeSums.Reset(width);
+		timeSums = &_imageTimeSums;
+	}
+	Cell &baseline = baselineCell(baselineIndex(antenna1, antenna2), polarization);
+
+	_rowBuffer.resize(width * 2);
+	_nextRowBuffer.resize(width * 2);
+	interleave(realImage.ValuePtr(0, 0), imagImage.ValuePtr(0, 0), width, &_rowBuffer[0]);
+	for(size_t f=0;f!=height;++f)
+	{
+		const bool
+			*isRFI = rfiMask.ValuePtr(0, f),
+			*origFlags = correlatorMask.ValuePtr(0, f);
+		RowSums values, differences;
+		accumulateValues(&_rowBuffer[0], isRFI, origFlags, width, timeSums, values);
+		const bool hasNext = f+1 != height;
+		if(hasNext)
+		{
+			interleave(realImage.ValuePtr(0, f+1), imagImage.ValuePtr(0, f+1), width, &_nextRowBuffer[0]);
+			accumulateDifferences(&_rowBuffer[0], isRFI, origFlags, &_nextRowBuffer[0], rfiMask.ValuePtr(0, f+1), correlatorMask.ValuePtr(0, f+1), width, timeSums, false, differences);
+		}
+
+		if(isCrossCorrelation)
+		{
+			Cell &frequency = frequencyCell(f, polarization);
+			frequency.Add(values);
+			frequency.Add(differences);
+			if(hasNext)
+				frequencyCell(f+1, polarization).Add(differences);
+		}
+		baseline.Add(values);
+		baseline.Add(differences);
+		_rowBuffer.swap(_nextRowBuffer);
+	}
+
+	if(isCrossCorrelation)
+	{
+		for(size_t t=0;t!=width;++t)
+			timeCell(_imageTimeIndices[t], polarization).Add(_imageTimeSums, t);
+	}
+	_isEmpty = false;
+}
+
+size_t StatisticsAccumulator::timeIndex(double time)
+{
+	if(!_times.empty() && time == _lastTime)
+		return _lastTimeIndex;
+
+	std::map<double, size_t>::const_iterator i = _timeIndices.find(time);
+	size_t index;
+	if(i == _timeIndices.end())
+	{
+		index = _times.size();
+		_times.push_back(time);
+		_timeIndices.insert(std::pair<double, size_t>(time, index));
+		_timeCells.resize(_times.size() * _polarizationCount);
+	}
+	else index = i->second;
+	_lastTime = time;
+	_lastTimeIndex = index;
+	return index;
+}
+
+size_t StatisticsAccumulator::baselineIndex(unsigned antenna1, unsigned antenna2)
+{
+	const size_t highestAntenna = std::max(antenna1, antenna2);
+	if(highestAntenna >= _antennaCapacity)
+	{
+		const size_t newCapacity = std::max(highestAntenna + 1, _antennaCapacity * 2);
+		std::vector<int> newMatrix(newCapacity * newCapacity, -1);
+		for(size_t i=0;i!=_baselines.size();++i)
+			newMatrix[_baselines[i].first * newCapacity + _baselines[i].second] = i;
+		_baselineMatrix.swap(newMatrix);
+		_antennaCapacity = newCapacity;
+	}
+	int &index = _baselineMatrix[antenna1 * _antennaCapacity + antenna2];
+	if(index < 0)
+	{
+		index = _baselines.size();
+		_baselines.push_back(std::pair<unsigned, unsigned>(antenna1, antenna2));
+		_baselineCells.resize(_baselines.size() * _polarizationCount);
+	}
+	return index;
+}
+
+void StatisticsAccumulator::flushFrequencySums(unsigned polarization)
+{
+	ElementSums &sums = _frequencySums[polarization];
+	if(sums.rowCount != 0)
+	{
+		for(size_t c=0;c!=_frequencies.size();++c)
+			frequencyCell(c, polarization).Add(sums, c);
+		sums.Reset(_frequencies.size());
+	}
+}
+
+void StatisticsAccumulator::AddTimeStatistic(size_t timeIndex, DefaultStatistics &destination)
+{
+	for(unsigned p=0;p!=_polarizationCount;++p)
+		timeCell(timeIndex, p).AddTo(destination, p);
+}
+
+void StatisticsAccumulator::AddFrequencyStatistic(size_t channel, DefaultStatistics &destination)
+{
+	for(unsigned p=0;p!=_polarizationCount;++p)
+	{
+		flushFrequencySums(p);
+		frequencyCell(channel, p).AddTo(destination, p);
+	}
+}
+
+void StatisticsAccumulator::AddBaselineStatistic(size_t baselineIndex, DefaultStatistics &destination)
+{
+	for(unsigned p=0;p!=_polarizationCount;++p)
+		baselineCell(baselineIndex, p).AddTo(destination, p);
+}
@@ -0,0 +1,193 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef QUALITY__STATISTICS_ACCUMULATOR_H
+#define QUALITY__STATISTICS_ACCUMULATOR_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "../msio/image2d.h"
+#include "../msio/mask2d.h"
+
+#include "defaultstatistics.h"
+
+/**
+ * Collects the statistics of one band in arrays that are indexed by time step, channel
+ * and baseline. StatisticsCollection keys its statistics by time, frequency and antennae
+ * in maps, which made adding a sample cost several map lookups. The accumulator instead
+ * resolves a time step once per row or image and a baseline once per call, and adds the
+ * samples of a row with SSE2 into double precision sums. StatisticsCollection moves the
+ * accumulated values into its maps when they are needed, e.g. when saving or serializing.
+ *
+ * The sums of a row are added to the sums of a time step, channel or baseline with
+ * compensated (Kahan) summation, so that summing millions of rows in double precision
+ * is as accurate as the long double sums of DefaultStatistics.
+ */
+class StatisticsAccumulator
+{
+	public:
+		StatisticsAccumulator(unsigned polarizationCount, const double *frequencies, unsigned channelCount);
+		
+		/**
+		 * Adds the samples of one time step, one sample per channel. This is the
+		 * accumulating counterpart of StatisticsCollection::Add().
+		 */
+		void Add(unsigned antenna1, unsigned antenna2, double time, unsigned polarization, const float *reals, const float *imags, const bool *isRFI, const bool *origFlags, unsigned nsamples, unsigned step, unsigned stepRFI, unsigned stepFlags);
+		
+		/**
+		 * Adds the samples of a time-frequency image, of which the columns correspond with the
+		 * given times. This is the accumulating counterpart of StatisticsCollection::AddImage().
+		 */
+		void AddImage(unsigned antenna1, unsigned antenna2, const double *times, unsigned polarization, const Image2D &realImage, const Image2D &imagImage, const Mask2D &rfiMask, const Mask2D &correlatorMask);
+		
+		/**
+		 * Changes the number of polarizations, which clears the accumulated statistics.
+		 */
+		void SetPolarizationCount(unsigned polarizationCount);
+		
+		/**
+		 * Forgets all accumulated statistics, including the time steps and baselines
+		 * that were seen. The channels are kept.
+		 */
+		void Clear();
+		
+		bool IsEmpty() const { return _isEmpty; }
+		
+		double CentralFrequency() const { return _centralFrequency; }
+		
+		size_t TimeCount() const { return _times.size(); }
+		double Time(size_t timeIndex) const { return _times[timeIndex]; }
+		void AddTimeStatistic(size_t timeIndex, DefaultStatistics &destination);
+		
+		size_t ChannelCount() const { return _frequencies.size(); }
+		double Frequency(size_t channel) const { return _frequencies[channel]; }
+		void AddFrequencyStatistic(size_t channel, DefaultStatistics &destination);
+		
+		size_t BaselineCount() const { return _baselines.size(); }
+		unsigned Antenna1(size_t baselineIndex) const { return _baselines[baselineIndex].first; }
+		unsigned Antenna2(size_t baselineIndex) const { return _baselines[baselineIndex].second; }
+		void AddBaselineStatistic(size_t baselineIndex, DefaultStatistics &destination);
+		
+	private:
+		struct CompensatedSum
+		{
+			double sum, compensation;
+			
+			void Add(double value)
+			{
+				const double y = value - compensation;
+				const double t = sum + y;
+				compensation = (t - sum) - y;
+				sum = t;
+			}
+			
+			long double Value() const { return (long double) sum - (long double) compensation; }
+		};
+		
+		/**
+		 * The sums of the samples (values and differences between neighbouring channels)
+		 * of one row. The real and imaginary parts of the sums are stored as pairs.
+		 */
+		struct RowSums
+		{
+			double count, rfiCount, sum[2], sumP2[2];
+			double dCount, dSum[2], dSumP2[2];
+			
+			RowSums() : count(0.0), rfiCount(0.0), dCount(0.0)
+			{
+				sum[0] = sum[1] = sumP2[0] = sumP2[1] = 0.0;
+				dSum[0] = dSum[1] = dSumP2[0] = dSumP2[1] = 0.0;
+			}
+		};
+		
+		/**
+		 * The sums of several rows, per sample of a row. The elements are laid out like
+		 * in RowSums, i.e. with interleaved real and imaginary sums.
+		 */
+		struct ElementSums
+		{
+			std::vector<double> count, rfiCount, sum, sumP2;
+			std::vector<double> dCount, dSum, dSumP2;
+			size_t rowCount;
+			
+			ElementSums() : rowCount(0) { }
+			void Reset(size_t size);
+		};
+		
+		/**
+		 * The accumulated statistics of one time step, channel or baseline in one
+		 * polarization.
+		 */
+		struct Cell
+		{
+			unsigned long count, rfiCount, dCount;
+			CompensatedSum sum[2], sumP2[2], dSum[2], dSumP2[2];
+			
+			Cell();
+			void Add(const RowSums &rowSums);
+			void Add(const ElementSums &elementSums, size_t index);
+			void AddTo(DefaultStatistics &destination, unsigned polarization) const;
+		};
+		
+		static void accumulateValues(const float *samples, const bool *isRFI, const bool *origFlags, size_t n, ElementSums *elementSums, RowSums &rowSums);
+		static void accumulateDifferences(const float *samples, const bool *isRFI, const bool *origFlags, const float *nextSamples, const bool *nextIsRFI, const bool *nextOrigFlags, size_t n, ElementSums *elementSums, bool addToNextElement, RowSums &rowSums);
+		static void interleave(const float *reals, const float *imags, size_t n, float *destination);
+		
+		size_t timeIndex(double time);
+		size_t baselineIndex(unsigned antenna1, unsigned antenna2);
+		void flushFrequencySums(unsigned polarization);
+		
+		Cell &timeCell(size_t timeIndex, unsigned polarization) { return _timeCells[timeIndex * _polarizationCount + polarization]; }
+		Cell &frequencyCell(size_t channel, unsigned polarization) { return _frequencyCells[channel * _polarizationCount + polarization]; }
+		Cell &baselineCell(size_t baselineIndex, unsigned polarization) { return _baselineCells[baselineIndex * _polarizationCount + polarization]; }
+		
+		unsigned _polarizationCount;
+		double _centralFrequency;
+		bool _isEmpty;
+		
+		std::vector<double> _frequencies;
+		std::vector<Cell> _frequencyCells;
+		// Rows of Add() are summed per channel before they are added to the cells
+		std::vector<ElementSums> _frequencySums;
+		
+		std::vector<double> _times;
+		std::map<double, size_t> _timeIndices;
+		std::vector<Cell> _timeCells;
+		double _lastTime;
+		size_t _lastTimeIndex;
+		// The time indices of the previous AddImage() call, which are mostly the same
+		std::vector<double> _imageTimes;
+		std::vector<size_t> _imageTimeIndices;
+		ElementSums _imageTimeSums;
+		
+		std::vector<std::pair<unsigned, unsigned> > _baselines;
+		std::vector<Cell> _baselineCells;
+		// Matrix of antenna1 x antenna2 with the index of the baseline or -1
+		std::vector<int> _baselineMatrix;
+		size_t _antennaCapacity;
+		
+		// Rows that are not laid out as interleaved complex values with contiguous flags are
+		// copied into these buffers. The flag buffers hold bools.
+		std::vector<float> _rowBuffer, _nextRowBuffer;
+		std::vector<char> _rfiBuffer, _flagBuffer;
+};
+
+#endif
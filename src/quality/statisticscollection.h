@@ -31,8 +31,10 @@
 #include "defaultstatistics.h"
 #include "qualitytablesformatter.h"
 #include "statisticalvalue.h"
+#include "statisticsaccumulator.h"
 
 #include <boost/concept_check.hpp>
+#include <boost/thread/mutex.hpp>
 
 class StatisticsCollection : public Serializable
 {
@@ -47,12 +49,13 @@ class StatisticsCollection : public Serializable
 		{
 		}
 		
-		StatisticsCollection(const StatisticsCollection &source) :
-			_timeStatistics(source._timeStatistics),
-			_frequencyStatistics(source._frequencyStatistics),
-			_baselineStatistics(source._baselineStatistics),
-			_polarizationCount(source._polarizationCount)
+		StatisticsCollection(const StatisticsCollection &source)
 		{
+			source.flushAccumulators();
+			_timeStatistics = source._timeStatistics;
+			_frequencyStatistics = source._frequencyStatistics;
+			_baselineStatistics = source._baselineStatistics;
+			_polarizationCount = source._polarizationCount;
 		}
 		
 		void Clear()
@@ -60,18 +63,21 @@ class StatisticsCollection : public Serializable
 			_timeStatistics.clear();
 			_frequencyStatistics.clear();
 			_baselineStatistics.clear();
+			clearAccumulators();
 		}
 		
+		/**
+		 * Prepares adding samples of a band with Add() or AddImage(). The samples are
+		 * collected in a StatisticsAccumulator, and are moved into the statistics of the
+		 * collection when these are requested.
+		 */
 		void InitializeBand(unsigned band, const double *frequencies, unsigned channelCount)
 		{
-			std::vector<DefaultStatistics *> pointers;
 			for(unsigned i=0;i<channelCount;++i)
 			{
-				pointers.push_back(&getFrequencyStatistic(frequencies[i]));
+				getFrequencyStatistic(frequencies[i]);
 			}
-			_bands.insert(std::pair<unsigned, std::vector<DefaultStatistics *> >(band, pointers));
-			double centralFrequency = (frequencies[0] + frequencies[channelCount-1]) / 2.0;
-			_centralFrequencies.insert(std::pair<unsigned, double>(band, centralFrequency));
+			_bands.insert(std::pair<unsigned, StatisticsAccumulator>(band, StatisticsAccumulator(_polarizationCount, frequencies, channelCount)));
 		}
 		
 		void Add(unsigned antenna1, unsigned antenna2, double time, unsigned band, int polarization, const float *reals, const float *imags, const bool *isRFI, const bool* origFlags, unsigned nsamples, unsigned step, unsigned stepRFI, unsigned stepFlags);
@@ -90,13 +96,30 @@ class StatisticsCollection : public Serializable
 		
 		void Save(QualityTablesFormatter &qualityData) const
 		{
+			flushAccumulators();
 			saveTime(qualityData);
 			saveFrequency(qualityData);
 			saveBaseline(qualityData);
 		}
 		
+		/**
+		 * Adds the statistics to the time, frequency and baseline statistics that are already
+		 * stored in the quality tables, instead of replacing them like Save() does. Rows with
+		 * the same position are summed in place, and rows for new positions are appended. This
+		 * can be used to store the statistics of a partial or repeated pass over a measurement
+		 * set, in time proportional to the amount of new statistics.
+		 */
+		void SaveIncremental(QualityTablesFormatter &qualityData) const
+		{
+			flushAccumulators();
+			saveTime(qualityData, true);
+			saveFrequency(qualityData, true);
+			saveBaseline(qualityData, true);
+		}
+		
 		void Load(QualityTablesFormatter &qualityData)
 		{
+			flushAccumulators();
 			loadTime<false>(qualityData);
 			loadFrequency<false>(qualityData);
 			loadBaseline<false>(qualityData);
@@ -104,11 +127,13 @@ class StatisticsCollection : public Serializable
 		
 		void LoadTimeStatisticsOnly(QualityTablesFormatter &qualityData)
 		{
+			flushAccumulators();
 			loadTime<false>(qualityData);
 		}
 		
 		void Add(QualityTablesFormatter &qualityData)
 		{
+			flushAccumulators();
 			loadTime<true>(qualityData);
 			loadFrequency<true>(qualityData);
 			loadBaseline<true>(qualityData);
@@ -116,6 +141,8 @@ class StatisticsCollection : public Serializable
 		
 		void Add(const StatisticsCollection &collection)
 		{
+			flushAccumulators();
+			collection.flushAccumulators();
 			addTime(collection);
 			addFrequency(collection);
 			addBaseline(collection);
@@ -123,26 +150,31 @@ class StatisticsCollection : public Serializable
 		
 		void GetGlobalTimeStatistics(DefaultStatistics &statistics)
 		{
+			flushAccumulators();
 			statistics = getGlobalStatistics(_timeStatistics);
 		}
 		
 		void GetGlobalFrequencyStatistics(DefaultStatistics &statistics)
 		{
+			flushAccumulators();
 			statistics = getGlobalStatistics(_frequencyStatistics);
 		}
 		
 		void GetGlobalAutoBaselineStatistics(DefaultStatistics &statistics)
 		{
+			flushAccumulators();
 			statistics = getGlobalBaselineStatistics<true>();
 		}
 		
 		void GetGlobalCrossBaselineStatistics(DefaultStatistics &statistics)
 		{
+			flushAccumulators();
 			statistics = getGlobalBaselineStatistics<false>();
 		}
 		
 		const BaselineStatisticsMap &BaselineStatistics() const
 		{
+			flushAccumulators();
 			if(_baselineStatistics.size() == 1)
 				return _baselineStatistics.begin()->second;
 			else
@@ -151,6 +183,7 @@ class StatisticsCollection : public Serializable
 		
 		const std::map<double, DefaultStatistics> &TimeStatistics() const
 		{
+			flushAccumulators();
 			if(_timeStatistics.size() == 1)
 				return _timeStatistics.begin()->second;
 			else
@@ -159,11 +192,13 @@ class StatisticsCollection : public Serializable
 		
 		const std::map<double, std::map<double, DefaultStatistics> > &AllTimeStatistics() const
 		{
+			flushAccumulators();
 			return _timeStatistics;
 		}
 		
 		const std::map<double, DefaultStatistics> &FrequencyStatistics() const
 		{
+			flushAccumulators();
 			return _frequencyStatistics;
 		}
 		
@@ -174,11 +209,15 @@ class StatisticsCollection : public Serializable
 		
 		void SetPolarizationCount(unsigned newCount)
 		{
+			flushAccumulators();
 			_polarizationCount = newCount;
+			for(std::map<unsigned, StatisticsAccumulator>::iterator i=_bands.begin();i!=_bands.end();++i)
+				i->second.SetPolarizationCount(newCount);
 		}
 		
 		virtual void Serialize(std::ostream &stream) const
 		{
+			flushAccumulators();
 			SerializeToUInt64(stream, _polarizationCount);
 			serializeTime(stream);
 			serializeFrequency(stream);
@@ -187,6 +226,7 @@ class StatisticsCollection : public Serializable
 		
 		virtual void Unserialize(std::istream &stream)
 		{
+			clearAccumulators();
 			_polarizationCount = UnserializeUInt64(stream);
 			unserializeTime(stream);
 			unserializeFrequency(stream);
@@ -195,6 +235,7 @@ class StatisticsCollection : public Serializable
 		
 		void IntegrateBaselinesToOneChannel()
 		{
+			flushAccumulators();
 			const size_t size = _baselineStatistics.size();
 			if(size > 1)
 			{
@@ -214,6 +255,7 @@ class StatisticsCollection : public Serializable
 		
 		void IntegrateTimeToOneChannel()
 		{
+			flushAccumulators();
 			const size_t size = _timeStatistics.size();
 			if(size > 1)
 			{
@@ -233,6 +275,7 @@ class StatisticsCollection : public Serializable
 		
 		void LowerTimeResolution(size_t maxSteps)
 		{
+			flushAccumulators();
 			for(std::map<double, DoubleStatMap>::iterator i=_timeStatistics.begin();i!=_timeStatistics.end();++i)
 			{
 				lowerResolution(i->second, maxSteps);
@@ -241,6 +284,7 @@ class StatisticsCollection : public Serializable
 		
 		void LowerFrequencyResolution(size_t maxSteps)
 		{
+			flushAccumulators();
 			lowerResolution(_frequencyStatistics, maxSteps);
 		}
 		
@@ -252,6 +296,7 @@ class StatisticsCollection : public Serializable
 		 */
 		void RegridTime()
 		{
+			flushAccumulators();
 			if(_timeStatistics.size() > 1)
 			{
 				std::map<double, DoubleStatMap>::iterator i = _timeStatistics.begin();
@@ -272,11 +317,18 @@ class StatisticsCollection : public Serializable
 			unsigned antenna1;
 			unsigned antenna2;
 			QualityTablesFormatter *qualityData;
+			// When merging, the values are collected and merged into the table at once by Merge()
+			bool isMerging;
+			std::vector<std::pair<QualityTablesFormatter::TimePosition, StatisticalValue> > timeEntries;
+			std::vector<std::pair<QualityTablesFormatter::FrequencyPosition, StatisticalValue> > frequencyEntries;
+			std::vector<std::pair<QualityTablesFormatter::BaselinePosition, StatisticalValue> > baselineEntries;
 			
 			void Save(StatisticalValue &value, unsigned kindIndex)
 			{
 				value.SetKindIndex(kindIndex);
-				switch(dimension)
+				if(isMerging)
+					collect(value);
+				else switch(dimension)
 				{
 					case QualityTablesFormatter::TimeDimension:
 						qualityData->StoreTimeValue(time, frequency, value);
@@ -292,6 +344,52 @@ class StatisticsCollection : public Serializable
 						break;
 				}
 			}
+			
+			void Merge()
+			{
+				switch(dimension)
+				{
+					case QualityTablesFormatter::TimeDimension:
+						qualityData->MergeTimeValues(timeEntries);
+						break;
+					case QualityTablesFormatter::FrequencyDimension:
+						qualityData->MergeFrequencyValues(frequencyEntries);
+						break;
+					case QualityTablesFormatter::BaselineDimension:
+						qualityData->MergeBaselineValues(baselineEntries);
+						break;
+					case QualityTablesFormatter::BaselineTimeDimension:
+						throw std::runtime_error("Merging baseline-time statistics is not supported");
+				}
+			}
+			
+			private:
+				void collect(const StatisticalValue &value)
+				{
+					switch(dimension)
+					{
+						case QualityTablesFormatter::TimeDimension: {
+							QualityTablesFormatter::TimePosition position;
+							position.time = time;
+							position.frequency = frequency;
+							timeEntries.push_back(std::make_pair(position, value));
+						} break;
+						case QualityTablesFormatter::FrequencyDimension: {
+							QualityTablesFormatter::FrequencyPosition position;
+							position.frequency = frequency;
+							frequencyEntries.push_back(std::make_pair(position, value));
+						} break;
+						case QualityTablesFormatter::BaselineDimension: {
+							QualityTablesFormatter::BaselinePosition position;
+							position.antenna1 = antenna1;
+							position.antenna2 = antenna2;
+							position.frequency = frequency;
+							baselineEntries.push_back(std::make_pair(position, value));
+						} break;
+						case QualityTablesFormatter::BaselineTimeDimension:
+							throw std::runtime_error("Merging baseline-time statistics is not supported");
+					}
+				}
 		};
 		
 		struct Indices
@@ -321,42 +419,28 @@ class StatisticsCollection : public Serializable
 			return *this;
 		}
 
-		template<bool IsDiff>
-		void addTimeAndBaseline(unsigned antenna1, unsigned antenna2, double time, double centralFrequency, int polarization, const float *reals, const float *imags, const bool *isRFI, const bool* origFlags, unsigned nsamples, unsigned step, unsigned stepRFI, unsigned stepFlags);
-		
-		template<bool IsDiff>
-		void addToStatistic(DefaultStatistics &statistic, unsigned polarization, unsigned long count, long double sum_R, long double sum_I, long double sumP2_R, long double sumP2_I, unsigned long rfiCount)
+		StatisticsAccumulator &bandAccumulator(unsigned band)
 		{
-			if(IsDiff)
-			{
-				statistic.dCount[polarization] += count;
-				statistic.dSum[polarization] += std::complex<long double>(sum_R, sum_I);
-				statistic.dSumP2[polarization] += std::complex<long double>(sumP2_R, sumP2_I);
-			} else {
-				statistic.count[polarization] += count;
-				statistic.sum[polarization] += std::complex<long double>(sum_R, sum_I);
-				statistic.sumP2[polarization] += std::complex<long double>(sumP2_R, sumP2_I);
-				statistic.rfiCount[polarization] += rfiCount;
-			}
+			std::map<unsigned, StatisticsAccumulator>::iterator i = _bands.find(band);
+			if(i == _bands.end())
+				throw std::runtime_error("StatisticsCollection: samples were added to a band that was not initialized");
+			return i->second;
 		}
-		template<bool IsDiff>
-		void addSingleNonRFISampleToStatistic(DefaultStatistics &statistic, unsigned polarization, long double sum_R, long double sum_I, long double sumP2_R, long double sumP2_I)
+		
+		/**
+		 * Moves the statistics that were accumulated by Add() and AddImage() into the maps.
+		 * This is logically const: the collection holds the same statistics afterwards.
+		 * The flush is serialized by _flushMutex, so const accessors can be called from
+		 * several threads at once, as long as no samples are added at the same time.
+		 */
+		void flushAccumulators() const;
+		
+		void clearAccumulators()
 		{
-			if(IsDiff)
-			{
-				++statistic.dCount[polarization];
-				statistic.dSum[polarization] += std::complex<long double>(sum_R, sum_I);
-				statistic.dSumP2[polarization] += std::complex<long double>(sumP2_R, sumP2_I);
-			} else {
-				++statistic.count[polarization];
-				statistic.sum[polarization] += std::complex<long double>(sum_R, sum_I);
-				statistic.sumP2[polarization] += std::complex<long double>(sumP2_R, sumP2_I);
-			}
+			for(std::map<unsigned, StatisticsAccumulator>::iterator i=_bands.begin();i!=_bands.end();++i)
+				i->second.Clear();
 		}
 		
-		template<bool IsDiff>
-		void addFrequency(unsigned band, int polarization, const float *reals, const float *imags, const bool *isRFI, const bool *origFlags, unsigned nsamples, unsigned step, unsigned stepRFI, unsigned stepFlags, bool shiftOneUp);
-		
 		void initializeEmptyStatistics(QualityTablesFormatter &qualityData, QualityTablesFormatter::StatisticDimension dimension) const
 		{
 			qualityData.InitializeEmptyStatistic(dimension, QualityTablesFormatter::RFICountStatistic, _polarizationCount);
@@ -401,15 +485,19 @@ class StatisticsCollection : public Serializable
 			saver.Save(value, indices.kindDSumP2);
 		}
 		
-		void saveTime(QualityTablesFormatter &qd) const
+		void saveTime(QualityTablesFormatter &qd, bool merge = false) const
 		{
-			initializeEmptyStatistics(qd, QualityTablesFormatter::TimeDimension);
+			if(merge)
+				qd.InitializeStatisticTable(QualityTablesFormatter::TimeDimension, _polarizationCount);
+			else
+				initializeEmptyStatistics(qd, QualityTablesFormatter::TimeDimension);
 			
 			Indices indices;
 			indices.fill(qd);
 				
 			StatisticSaver saver;
 			saver.dimension = QualityTablesFormatter::TimeDimension;
+			saver.isMerging = merge;
 			saver.qualityData = &qd;
 			
 			for(std::map<double, DoubleStatMap>::const_iterator j=_timeStatistics.begin();j!=_timeStatistics.end();++j)
@@ -425,17 +513,23 @@ class StatisticsCollection : public Serializable
 					saveEachStatistic(saver, stat, indices);
 				}
 			}
+			if(merge)
+				saver.Merge();
 		}
 		
-		void saveFrequency(QualityTablesFormatter &qd) const
+		void saveFrequency(QualityTablesFormatter &qd, bool merge = false) const
 		{
-			initializeEmptyStatistics(qd, QualityTablesFormatter::FrequencyDimension);
+			if(merge)
+				qd.InitializeStatisticTable(QualityTablesFormatter::FrequencyDimension, _polarizationCount);
+			else
+				initializeEmptyStatistics(qd, QualityTablesFormatter::FrequencyDimension);
 			
 			Indices indices;
 			indices.fill(qd);
 				
 			StatisticSaver saver;
 			saver.dimension = QualityTablesFormatter::FrequencyDimension;
+			saver.isMerging = merge;
 			saver.qualityData = &qd;
 			
 			for(DoubleStatMap::const_iterator i=_frequencyStatistics.begin();i!=_frequencyStatistics.end();++i)
@@ -445,17 +539,23 @@ class StatisticsCollection : public Serializable
 				
 				saveEachStatistic(saver, stat, indices);
 			}
+			if(merge)
+				saver.Merge();
 		}
 		
-		void saveBaseline(QualityTablesFormatter &qd) const
+		void saveBaseline(QualityTablesFormatter &qd, bool merge = false) const
 		{
-			initializeEmptyStatistics(qd, QualityTablesFormatter::BaselineDimension);
+			if(merge)
+				qd.InitializeStatisticTable(QualityTablesFormatter::BaselineDimension, _polarizationCount);
+			else
+				initializeEmptyStatistics(qd, QualityTablesFormatter::BaselineDimension);
 			
 			Indices indices;
 			indices.fill(qd);
 			
 			StatisticSaver saver;
 			saver.dimension = QualityTablesFormatter::BaselineDimension;
+			saver.isMerging = merge;
 			saver.frequency = centralFrequency();
 			saver.qualityData = &qd;
 			
@@ -476,6 +576,8 @@ class StatisticsCollection : public Serializable
 					saveEachStatistic(saver, stat, indices);
 				}
 			}
+			if(merge)
+				saver.Merge();
 		}
 		
 		DefaultStatistics &getTimeStatistic(double time, double centralFrequency)
@@ -902,8 +1004,8 @@ class StatisticsCollection : public Serializable
 		DoubleStatMap _frequencyStatistics;
 		std::map<double, BaselineStatisticsMap> _baselineStatistics;
 		
-		std::map<unsigned, std::vector< DefaultStatistics *> > _bands;
-		std::map<unsigned, double> _centralFrequencies;
+		std::map<unsigned, StatisticsAccumulator> _bands;
+		mutable boost::mutex _flushMutex;
 		
 		unsigned _polarizationCount;
 };
@@ -60,10 +60,21 @@ namespace rfiStrategy {
 				statistics.SetSeparateBaselineStatistics(_separateBaselineStatistics);
 				statistics.SetPerformClassification(_performClassification);
 				statistics.SetWriteImmediately(_writeImmediately);
+				TimeFrequencyData data;
+				TimeFrequencyMetaDataCPtr metaData;
+				artifacts.GetContaminatedPartInterior(data, metaData);
 				if(_comparison)
-					statistics.Add(artifacts.ContaminatedData(), artifacts.MetaData(), artifacts.OriginalData().GetSingleMask());
+				{
+					Mask2DCPtr originalMask = artifacts.OriginalData().GetSingleMask();
+					if(data.ImageWidth() != originalMask->Width())
+					{
+						const size_t left = artifacts.MetaData()->PartLeftBorder();
+						originalMask = originalMask->Trim(left, 0, left + data.ImageWidth(), originalMask->Height());
+					}
+					statistics.Add(data, metaData, originalMask);
+				}
 				else
-					statistics.Add(artifacts.ContaminatedData(), artifacts.MetaData());
+					statistics.Add(data, metaData);
 			}
 			virtual ActionType Type() const { return AddStatisticsActionType; }
 			
@@ -123,11 +123,11 @@ namespace rfiStrategy {
 		ImageSet *imageSet = artifacts.ImageSet();
 		BaselineReaderPtr reader = dynamic_cast<MSImageSet&>(*imageSet).Reader();
 
-		size_t scans = reader->Set().GetObservationTimesSet().size();
-
 		for(std::vector<BaselineSelector::SingleBaselineInfo>::const_iterator i=baselines.begin();
 			i!=baselines.end();++i)
 		{
+			// The selector has summed the parts of a baseline, so the whole baseline is flagged
+			size_t scans = reader->Set().GetObservationTimesSet(i->sequenceId).size();
 			size_t frequencyCount = reader->Set().FrequencyCount(i->band);
 			Mask2DPtr flaggedMask = Mask2D::CreateSetMaskPtr<true>(scans, frequencyCount);
 			std::vector<Mask2DCPtr> masks;
@@ -24,6 +24,47 @@
 #include <stdexcept>
 #include "../algorithms/thresholdtools.h"
 
+#include "../../util/bandthreadpool.h"
+
+namespace {
+	/**
+	 * One of the Image2D methods that fill the rows [yStart, yEnd) of the output of a
+	 * resolution change.
+	 */
+	typedef void (Image2D::*ResampleRows)(size_t factor, Image2D &output, size_t yStart, size_t yEnd) const;
+
+	/**
+	 * Runs a ResampleRows method in bands of output rows, so that the resolution of a
+	 * large image is changed with the threads of the BandThreadPool.
+	 */
+	class ResampleTask : public BandThreadPool::Task
+	{
+		public:
+			ResampleTask(ResampleRows function, const Image2D &input, Image2D &output, size_t factor) :
+				_function(function), _input(input), _output(output), _factor(factor)
+			{ }
+
+			virtual void Run(size_t start, size_t end)
+			{
+				(_input.*_function)(_factor, _output, start, end);
+			}
+
+			static Image2DPtr Execute(ResampleRows function, const Image2D &input, size_t factor, size_t outputWidth, size_t outputHeight)
+			{
+				Image2DPtr output = Image2D::CreateUnsetImagePtr(outputWidth, outputHeight);
+				ResampleTask task(function, input, *output, factor);
+				const size_t minBandRows = 65536 / (outputWidth + 1) + 1;
+				BandThreadPool::Run(task, outputHeight, minBandRows);
+				return output;
+			}
+		private:
+			ResampleRows _function;
+			const Image2D &_input;
+			Image2D &_output;
+			size_t _factor;
+	};
+}
+
 namespace rfiStrategy {
 	
 	void ChangeResolutionAction::Perform(class ArtifactSet &artifacts, class ProgressListener &listener)
@@ -104,7 +145,7 @@ namespace rfiStrategy {
 			for(size_t i=0;i<imageCount;++i)
 			{
 				Image2DCPtr image = timeFrequencyData.GetImage(i);
-				Image2DPtr newImage = image->ShrinkHorizontally(_timeDecreaseFactor);
+				Image2DPtr newImage = ResampleTask::Execute(&Image2D::ShrinkHorizontally, *image, _timeDecreaseFactor, (image->Width() + _timeDecreaseFactor - 1) / _timeDecreaseFactor, image->Height());
 				timeFrequencyData.SetImage(i, newImage);
 			}
 			size_t maskCount = timeFrequencyData.MaskCount();
@@ -146,7 +187,7 @@ namespace rfiStrategy {
 		for(size_t i=0;i<imageCount;++i)
 		{
 			Image2DCPtr image = timeFrequencyData.GetImage(i);
-			Image2DPtr newImage = image->ShrinkVertically(_frequencyDecreaseFactor);
+			Image2DPtr newImage = ResampleTask::Execute(&Image2D::ShrinkVertically, *image, _frequencyDecreaseFactor, image->Width(), (image->Height() + _frequencyDecreaseFactor - 1) / _frequencyDecreaseFactor);
 			timeFrequencyData.SetImage(i, newImage);
 		}
 		size_t maskCount = timeFrequencyData.MaskCount();
@@ -168,7 +209,7 @@ namespace rfiStrategy {
 			for(size_t i=0;i<imageCount;++i)
 			{
 				Image2DCPtr image = changedData.GetImage(i);
-				Image2DPtr newImage = image->EnlargeHorizontally(_timeDecreaseFactor, originalData.ImageWidth());
+				Image2DPtr newImage = ResampleTask::Execute(&Image2D::EnlargeHorizontally, *image, _timeDecreaseFactor, originalData.ImageWidth(), image->Height());
 				originalData.SetImage(i, newImage);
 			}
 		}
@@ -196,7 +237,7 @@ namespace rfiStrategy {
 			for(size_t i=0;i<imageCount;++i)
 			{
 				Image2DCPtr image = changedData.GetImage(i);
-				Image2DPtr newImage = image->EnlargeVertically(_frequencyDecreaseFactor, originalData.ImageHeight());
+				Image2DPtr newImage = ResampleTask::Execute(&Image2D::EnlargeVertically, *image, _frequencyDecreaseFactor, image->Width(), originalData.ImageHeight());
 				originalData.SetImage(i, newImage);
 			}
 		}
@@ -20,10 +20,14 @@
 #include "foreachbaselineaction.h"
 
 #include "../../msio/antennainfo.h"
+#include "../../msio/memoryaccounting.h"
+#include "../../msio/system.h"
 
 #include "../../util/aologger.h"
+#include "../../util/bandthreadpool.h"
 #include "../../util/stopwatch.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -51,31 +55,6 @@ namespace rfiStrategy {
 		} else
 		{
 			ImageSet *imageSet = artifacts.ImageSet();
-			MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(imageSet);
-			if(msImageSet != 0)
-			{
-				// Check memory usage
-				ImageSetIndex *tempIndex = msImageSet->StartIndex();
-				size_t timeStepCount = msImageSet->ObservationTimesVector(*tempIndex).size();
-				delete tempIndex;
-				size_t channelCount = msImageSet->GetBandInfo(0).channels.size();
-				size_t estMemorySizePerThread = 8/*bp complex*/ * 4 /*polarizations*/ * timeStepCount * channelCount * 3 /* approx copies of the data that will be made in memory*/;
-				AOLogger::Debug << "Estimate of memory each thread will use: " << estMemorySizePerThread/(1024*1024) << " MB.\n";
-				size_t compThreadCount = _threadCount;
-				if(compThreadCount > 0) --compThreadCount;
-				if(estMemorySizePerThread * compThreadCount > 12ul*1024ul*1024ul*1024ul)
-				{
-					size_t maxThreads = (12ul * 1024ul * 1024ul * 1024ul) / estMemorySizePerThread;
-					if(maxThreads < 1) maxThreads = 1;
-					AOLogger::Warn <<
-						"WARNING WARNING WARNING WARNING WARNING WARNING WARNING WARNING!\n"
-						"This measurement set is TOO LARGE to be processed with " << _threadCount << " threads!\n" <<
-						_threadCount << " threads would require " << ((estMemorySizePerThread*compThreadCount)/(1024*1024)) << " MB of memory approximately.\n"
-						"Number of threads that will actually be used: " << maxThreads << "\n"
-						"This might hurt performance a lot!\n\n";
-					_threadCount = maxThreads;
-				}
-			}
 			if(!_antennaeToSkip.empty())
 			{
 				AOLogger::Debug << "The following antenna's will be skipped: ";
@@ -106,33 +85,75 @@ namespace rfiStrategy {
 			_artifacts = &artifacts;
 			
 			_initPartIndex = 0;
-			_finishedBaselines = false;
-			_baselineCount = 0;
 			_baselineProgress = 0;
-			_nextIndex = 0;
 			
-			// Count the baselines that are to be processed
-			ImageSetIndex *iteratorIndex = imageSet->StartIndex();
-			while(iteratorIndex->IsValid())
-			{
-				if(IsBaselineSelected(*iteratorIndex))
-					++_baselineCount;
-				iteratorIndex->Next();
-			}
-			delete iteratorIndex;
+			// Determine the baselines that are to be processed
+			InitializeBaselineIndices(*imageSet);
+			_baselineCount = _baselineIndices.size();
 			AOLogger::Debug << "Will process " << _baselineCount << " baselines.\n";
 			
 			// Initialize thread data and threads
-			_loopIndex = imageSet->StartIndex();
+			size_t mathThreads = mathThreadCount();
+			// With fewer baselines than threads (e.g. single-dish or autocorrelation-only sets),
+			// the spare threads split the images of the baselines into bands instead. The
+			// threads that process a baseline take part in their bands themselves.
+			size_t bandThreadCount = BandThreadPool::ThreadCount();
+			if(_baselineCount < mathThreads)
+			{
+				const size_t baselineThreads = std::max<size_t>(_baselineCount, 1);
+				bandThreadCount = mathThreads - baselineThreads + 1;
+				mathThreads = baselineThreads;
+				AOLogger::Debug << "Fewer baselines than threads: " << mathThreads << " baseline threads, images are split in up to " << bandThreadCount << " bands.\n";
+			}
+			BandThreadPool::ScopedThreadCount bandThreads(bandThreadCount);
+			size_t readerThreads = _readerThreadCount > 0 ? _readerThreadCount : 1;
+			if(readerThreads > 1)
+				AOLogger::Info << "Using " << readerThreads << " reader threads: they take turns on reading the set, reads are not performed in parallel.\n";
+			_baselineQueue = new WorkStealingQueue<AdmittedBaseline>(mathThreads);
+			_activeReaderCount = readerThreads;
+			_readsInProgress = 0;
+			
+			size_t memoryLimit = _memoryLimit;
+			if(memoryLimit == 0)
+			{
+				long available = System::AvailableMemory();
+				if(available > 0)
+					memoryLimit = (available / 10) * 9;
+				else
+					memoryLimit = 12ul*1024ul*1024ul*1024ul;
+			}
+			// The sample pool may keep an eighth of the memory: that part is taken off the
+			// budget of the baselines, so that the memory limit also bounds the pooled blocks.
+			_poolMemory = memoryLimit / 8;
+			_poolThreadCount = mathThreads + readerThreads + (bandThreadCount - 1);
+			AOLogger::Debug << "Memory available for baselines: " << (memoryLimit - _poolMemory)/(1024*1024) << " MB, for recycling images: " << _poolMemory/(1024*1024) << " MB.\n";
+			_memoryBudget = new MemoryBudget(memoryLimit - _poolMemory);
+			// Until a baseline has been processed, assume that each complex sample of the four
+			// polarizations is copied about three times.
+			_bytesPerSample = 8 * 4 * 3;
+			_largestBaselineMemory = 0;
+			_hasMeasuredMemory = false;
+			_computeTimePerBaseline = 0.0;
+			_hasMeasuredComputeTime = false;
+			
+			// The limits of the sample pool are set from the measured baseline sizes
+			SamplePool::ScopedLimits poolLimits(0, 0);
+			_largestDataMemory = 0;
+			_largestWorkingMemory = 0;
+			_poolStatistics = SamplePool::Statistics();
+			_laterHeapAllocationCount = 0;
+
 			_progressTaskNo = new int[_threadCount];
 			_progressTaskCount = new int[_threadCount];
 			progress.OnStartTask(*this, 0, 1, "Initializing");
 
 			boost::thread_group threadGroup;
-			ReaderFunction reader(*this);
-			threadGroup.create_thread(reader);
+			for(unsigned i=0;i<readerThreads;++i)
+			{
+				ReaderFunction reader(*this);
+				threadGroup.create_thread(reader);
+			}
 			
-			size_t mathThreads = mathThreadCount();
 			for(unsigned i=0;i<mathThreads;++i)
 			{
 				PerformFunction function(*this, progress, i);
@@ -141,6 +162,23 @@ namespace rfiStrategy {
 			
 			threadGroup.join_all();
 			progress.OnEndTask(*this);
+			
+			AOLogger::Debug << "Baselines that were taken over by another thread: " << _baselineQueue->StealCount() << '\n';
+			AOLogger::Debug << "Memory used per sample: " << _bytesPerSample << " bytes, highest memory use of the baselines in memory: " << _memoryBudget->PeakUsed()/(1024*1024) << " MB.\n";
+			AOLogger::Debug << "Image and mask allocations: " << _poolStatistics.allocationCount
+				<< ", from the pool of the thread: " << _poolStatistics.threadPoolHitCount
+				<< ", from the shared pool: " << _poolStatistics.sharedPoolHitCount
+				<< ", from the heap: " << _poolStatistics.heapAllocationCount
+				<< " (" << _laterHeapAllocationCount << " after the first baseline of each thread).\n";
+			
+			// Baselines can only be left after an exception
+			std::vector<AdmittedBaseline> remaining = _baselineQueue->Abort();
+			for(std::vector<AdmittedBaseline>::iterator i=remaining.begin();i!=remaining.end();++i)
+				delete i->data;
+			delete _baselineQueue;
+			_baselineQueue = 0;
+			delete _memoryBudget;
+			_memoryBudget = 0;
 
 			if(_resultSet != 0)
 			{
@@ -151,7 +189,9 @@ namespace rfiStrategy {
 			delete[] _progressTaskCount;
 			delete[] _progressTaskNo;
 
-			delete _loopIndex;
+			for(std::vector<SizedIndex>::iterator i=_baselineIndices.begin();i!=_baselineIndices.end();++i)
+				delete i->index;
+			_baselineIndices.clear();
 
 			if(_exceptionOccured)
 				throw std::runtime_error("An exception occured in one of the sub tasks of the (multi-threaded) \"For-each baseline\"-action: the RFI strategy will not continue.");
@@ -206,33 +246,194 @@ namespace rfiStrategy {
 		}
 	}
 
-	class ImageSetIndex *ForEachBaselineAction::GetNextIndex()
+	void ForEachBaselineAction::InitializeBaselineIndices(ImageSet &imageSet)
 	{
-		boost::mutex::scoped_lock lock(_mutex);
-		while(_loopIndex->IsValid())
+		MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(&imageSet);
+		// A reader that reads the set in the background makes the sequences available one
+		// after the other, so the baselines of the first sequences should be started first.
+		bool loadsIncrementally = msImageSet != 0 && msImageSet->Reader() != 0 && msImageSet->Reader()->LoadsIncrementally();
+		ImageSetIndex *iteratorIndex = imageSet.StartIndex();
+		while(iteratorIndex->IsValid())
 		{
-			if(IsBaselineSelected(*_loopIndex))
+			if(IsBaselineSelected(*iteratorIndex))
 			{
-				ImageSetIndex *newIndex = _loopIndex->Copy();
-				_loopIndex->Next();
-
-				return newIndex;
+				SizedIndex sizedIndex;
+				sizedIndex.index = iteratorIndex->Copy();
+				sizedIndex.sampleCount = (msImageSet != 0) ? msImageSet->SampleCount(*iteratorIndex) : 0;
+				sizedIndex.loadOrder = loadsIncrementally ? msImageSet->GetSequenceId(*iteratorIndex) : 0;
+				_baselineIndices.push_back(sizedIndex);
 			}
-			_loopIndex->Next();
+			iteratorIndex->Next();
+		}
+		delete iteratorIndex;
+		
+		// When a large baseline would be started last, the other threads would be idle
+		// while it is processed. Baselines of equal size keep the order of the set.
+		std::stable_sort(_baselineIndices.begin(), _baselineIndices.end(), SizedIndex::StartOrder);
+		_nextIndex = 0;
+	}
+
+	class ImageSetIndex *ForEachBaselineAction::GetNextIndex(size_t &sampleCount)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if(_nextIndex < _baselineIndices.size())
+		{
+			ImageSetIndex *newIndex = _baselineIndices[_nextIndex].index->Copy();
+			sampleCount = _baselineIndices[_nextIndex].sampleCount;
+			++_nextIndex;
+			return newIndex;
 		}
 		return 0;
 	}
+	
+	size_t ForEachBaselineAction::ReserveReadCount(size_t maxBufferSize)
+	{
+		// Baselines that another reader is reading count as buffered too
+		boost::mutex::scoped_lock lock(_mutex);
+		size_t bufferedCount = _baselineQueue->Size() + _readsInProgress;
+		size_t count = bufferedCount < maxBufferSize ? maxBufferSize - bufferedCount : 0;
+		_readsInProgress += count;
+		return count;
+	}
+
+	/**
+	 * Returns reservations of ReserveReadCount() once the baselines have been pushed or
+	 * turned out not to be read.
+	 * @returns Whether an exception occurred, in which case the reader should stop.
+	 */
+	bool ForEachBaselineAction::ReleaseReadCount(size_t count)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_readsInProgress -= count;
+		return _exceptionOccured;
+	}
+	
+	void ForEachBaselineAction::RecordBaselineTime(double seconds)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if(_hasMeasuredComputeTime)
+			_computeTimePerBaseline = 0.75 * _computeTimePerBaseline + 0.25 * seconds;
+		else
+			_computeTimePerBaseline = seconds;
+		_hasMeasuredComputeTime = true;
+	}
+	
+	/**
+	 * The next batch holds the number of baselines that the math threads process while
+	 * the last batch was read. When reading is slower than processing, batches therefore
+	 * grow, so that the reader reads larger parts of the set at once. When processing is
+	 * slower, they shrink, so that less memory is taken by baselines that wait in the queue.
+	 */
+	size_t ForEachBaselineAction::NextBatchSize(double batchReadTime, size_t minBatchSize, size_t maxBatchSize)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if(minBatchSize == 0)
+			minBatchSize = 1;
+		if(!_hasMeasuredComputeTime || _computeTimePerBaseline <= 0.0)
+			return std::max(minBatchSize, maxBatchSize);
+		double processedCount = batchReadTime * mathThreadCount() / _computeTimePerBaseline;
+		if(processedCount >= (double) maxBatchSize)
+			return std::max(minBatchSize, maxBatchSize);
+		return std::max(minBatchSize, (size_t) processedCount + 1);
+	}
+
+	size_t ForEachBaselineAction::EstimateBaselineMemory(size_t sampleCount)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		// Without a size (i.e., for other sets than measurement sets), all baselines are
+		// assumed to be as large as the largest one so far.
+		if(sampleCount == 0)
+			return _largestBaselineMemory;
+		else
+			return (size_t) (_bytesPerSample * sampleCount);
+	}
+	
+	void ForEachBaselineAction::RecordBaselineMemory(size_t sampleCount, size_t bytes)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if(bytes > _largestBaselineMemory)
+			_largestBaselineMemory = bytes;
+		if(sampleCount != 0)
+		{
+			double bytesPerSample = (double) bytes / sampleCount;
+			// The first measurement replaces the initial guess
+			if(!_hasMeasuredMemory || bytesPerSample > _bytesPerSample)
+				_bytesPerSample = bytesPerSample;
+			_hasMeasuredMemory = true;
+		}
+	}
+	
+	/**
+	 * Each processing thread keeps the images and masks that it needs at most while
+	 * processing a baseline in its own pool. The images of the baselines that it has
+	 * finished go to the shared pool, from which the readers take them for the next
+	 * baselines. The blocks are kept while no baseline reserves them, so together the
+	 * pools of all threads and the shared pool are bounded by the part of the memory
+	 * limit that was kept out of the memory budget.
+	 */
+	void ForEachBaselineAction::UpdatePoolLimits(size_t dataBytes, size_t workingBytes)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if(dataBytes > _largestDataMemory || workingBytes > _largestWorkingMemory)
+		{
+			_largestDataMemory = std::max(dataBytes, _largestDataMemory);
+			_largestWorkingMemory = std::max(workingBytes, _largestWorkingMemory);
+			size_t
+				threadLimit = _largestWorkingMemory,
+				sharedLimit = _largestDataMemory * mathThreadCount();
+			const long double poolBytes = (long double) threadLimit * _poolThreadCount + sharedLimit;
+			if(poolBytes > _poolMemory)
+			{
+				const long double scale = _poolMemory / poolBytes;
+				threadLimit = (size_t) (threadLimit * scale);
+				sharedLimit = (size_t) (sharedLimit * scale);
+			}
+			SamplePool::SetLimits(threadLimit, sharedLimit);
+		}
+	}
+	
+	void ForEachBaselineAction::RecordPoolStatistics(const SamplePool::Statistics &statistics, size_t laterHeapAllocationCount)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		_poolStatistics += statistics;
+		_laterHeapAllocationCount += laterHeapAllocationCount;
+	}
+	
+	size_t ForEachBaselineAction::DataMemory(const TimeFrequencyData &data)
+	{
+		size_t bytes = 0;
+		for(size_t i=0;i!=data.ImageCount();++i)
+		{
+			const Image2DCPtr &image = data.GetImage(i);
+			bytes += image->Stride() * image->Height() * sizeof(num_t);
+		}
+		for(size_t i=0;i!=data.MaskCount();++i)
+		{
+			const Mask2DCPtr &mask = data.GetMask(i);
+			bytes += mask->Stride() * mask->Height() * sizeof(bool);
+		}
+		return bytes;
+	}
 
 	void ForEachBaselineAction::SetExceptionOccured()
 	{
 		boost::mutex::scoped_lock lock(_mutex);
 		_exceptionOccured = true;
+		lock.unlock();
+		
+		// Wakes up the other threads, which will stop
+		_memoryBudget->Abort();
+		std::vector<AdmittedBaseline> remaining = _baselineQueue->Abort();
+		for(std::vector<AdmittedBaseline>::iterator i=remaining.begin();i!=remaining.end();++i)
+			delete i->data;
 	}
 	
-	void ForEachBaselineAction::SetFinishedBaselines()
+	void ForEachBaselineAction::SetFinishedReader()
 	{
 		boost::mutex::scoped_lock lock(_mutex);
-		_finishedBaselines = true;
+		--_activeReaderCount;
+		if(_activeReaderCount == 0)
+			_baselineQueue->Finish();
 	}
 	
 	void ForEachBaselineAction::PerformFunction::operator()()
@@ -246,9 +447,18 @@ namespace rfiStrategy {
 			ArtifactSet newArtifacts(*_action._artifacts);
 			lock.unlock();
 			
-			BaselineData *baseline = _action.GetNextBaseline();
+			AdmittedBaseline admitted;
+			SamplePool::ResetThreadStatistics();
+			size_t firstHeapAllocationCount = 0;
+			bool isFirstBaseline = true;
 			
-			while(baseline != 0) {
+			while(_action._baselineQueue->Pop(_threadIndex, admitted)) {
+				BaselineData *baseline = admitted.data;
+				// The memory that is actually used is the data itself plus the largest
+				// amount of images and masks that the actions had allocated at once.
+				long usageBefore = MemoryAccounting::ThreadUsage();
+				MemoryAccounting::ResetThreadPeak();
+				size_t dataBytes = DataMemory(baseline->Data());
 				baseline->Index().Reattach(*privateImageSet);
 				
 				std::ostringstream progressStr;
@@ -267,15 +477,29 @@ namespace rfiStrategy {
 				newArtifacts.SetImageSetIndex(&baseline->Index());
 				newArtifacts.SetMetaData(baseline->MetaData());
 
+				Stopwatch watch(true);
 				_action.ActionBlock::Perform(newArtifacts, *this);
+				_action.RecordBaselineTime(watch.Seconds());
 				delete baseline;
+				
+				long peak = MemoryAccounting::ThreadPeak() - usageBefore;
+				_action.RecordBaselineMemory(admitted.sampleCount, dataBytes + (peak > 0 ? (size_t) peak : 0));
+				_action.UpdatePoolLimits(dataBytes, peak > 0 ? (size_t) peak : 0);
+				if(isFirstBaseline)
+				{
+					firstHeapAllocationCount = SamplePool::ThreadStatistics().heapAllocationCount;
+					isFirstBaseline = false;
+				}
+				_action._memoryBudget->Release(admitted.reservedBytes);
 	
-				baseline = _action.GetNextBaseline();
 				_action.IncBaselineProgress();
 			}
 	
 			if(_threadIndex == 0)
 				_action._resultSet = new ArtifactSet(newArtifacts);
+			
+			SamplePool::Statistics statistics = SamplePool::ThreadStatistics();
+			_action.RecordPoolStatistics(statistics, statistics.heapAllocationCount - firstHeapAllocationCount);
 
 		} catch(std::exception &e)
 		{
@@ -306,67 +530,197 @@ namespace rfiStrategy {
 	void ForEachBaselineAction::ReaderFunction::operator()()
 	{
 		Stopwatch watch(true);
-		bool finished = false;
-		size_t threadCount = _action.mathThreadCount();
-		size_t minRecommendedBufferSize, maxRecommendedBufferSize;
-		MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(_action._artifacts->ImageSet());
-		if(msImageSet != 0)
+		try {
+			size_t threadCount = _action.mathThreadCount();
+			size_t minRecommendedBufferSize, maxRecommendedBufferSize;
+			MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(_action._artifacts->ImageSet());
+			SamplePool::ResetThreadStatistics();
+			if(msImageSet != 0)
+			{
+				minRecommendedBufferSize = msImageSet->Reader()->GetMinRecommendedBufferSize(threadCount);
+				maxRecommendedBufferSize = msImageSet->Reader()->GetMaxRecommendedBufferSize(threadCount);
+				readWithPrefetching(*msImageSet, minRecommendedBufferSize, maxRecommendedBufferSize, watch);
+			} else {
+				minRecommendedBufferSize = 1;
+				maxRecommendedBufferSize = 2;
+				readSynchronously(minRecommendedBufferSize, maxRecommendedBufferSize, watch);
+			}
+			SamplePool::Statistics statistics = SamplePool::ThreadStatistics();
+			_action.RecordPoolStatistics(statistics, statistics.heapAllocationCount - _firstHeapAllocationCount);
+		} catch(std::exception &e)
 		{
-			minRecommendedBufferSize = msImageSet->Reader()->GetMinRecommendedBufferSize(threadCount);
-			maxRecommendedBufferSize = msImageSet->Reader()->GetMaxRecommendedBufferSize(threadCount) - _action.GetBaselinesInBufferCount();
-		} else {
-			minRecommendedBufferSize = 1;
-			maxRecommendedBufferSize = 2;
+			AOLogger::Error << "Error while reading baselines: " << e.what() << '\n';
+			_action.SetExceptionOccured();
 		}
-		
+		delete _pendingIndex;
+		_pendingIndex = 0;
+		_action.SetFinishedReader();
+		watch.Pause();
+		AOLogger::Debug << "Time spent on reading: " << watch.ToString() << '\n';
+	}
+	
+	void ForEachBaselineAction::ReaderFunction::readSynchronously(size_t minBufferSize, size_t maxBufferSize, Stopwatch &watch)
+	{
+		bool finished = false;
 		do {
 			watch.Pause();
-			_action.WaitForBufferAvailable(minRecommendedBufferSize);
+			_action._baselineQueue->WaitForSizeAtMost(minBufferSize);
 			
-			size_t wantedCount = maxRecommendedBufferSize - _action.GetBaselinesInBufferCount();
-			size_t requestedCount = 0;
+			size_t wantedCount = _action.ReserveReadCount(maxBufferSize);
+			std::vector<ImageSetIndex*> indices;
+			std::vector<AdmittedBaseline> baselines;
+			finished = !admitBaselines(wantedCount, true, indices, baselines);
 			
+			// The IO mutex is held for the whole read, so other readers wait for their turn
 			boost::mutex::scoped_lock lock(_action._artifacts->IOMutex());
 			watch.Start();
 			
-			for(size_t i=0;i<wantedCount;++i)
+			for(std::vector<ImageSetIndex*>::iterator i=indices.begin();i!=indices.end();++i)
 			{
-				ImageSetIndex *index = _action.GetNextIndex();
-				if(index != 0)
-				{
-					_action._artifacts->ImageSet()->AddReadRequest(*index);
-					++requestedCount;
-					delete index;
-				} else {
-					finished = true;
-					break;
-				}
+				_action._artifacts->ImageSet()->AddReadRequest(**i);
+				delete *i;
 			}
 			
-			if(requestedCount > 0)
+			if(!baselines.empty())
 			{
 				_action._artifacts->ImageSet()->PerformReadRequests();
-				watch.Pause();
 				
-				for(size_t i=0;i<requestedCount;++i)
-				{
-					BaselineData *baseline = _action._artifacts->ImageSet()->GetNextRequested();
-					
-					boost::mutex::scoped_lock bufferLock(_action._mutex);
-					_action._baselineBuffer.push(baseline);
-					bufferLock.unlock();
-				}
+				for(std::vector<AdmittedBaseline>::iterator i=baselines.begin();i!=baselines.end();++i)
+					i->data = _action._artifacts->ImageSet()->GetNextRequested();
 			}
 			
 			lock.unlock();
+			watch.Pause();
 			
-			_action._dataAvailable.notify_all();
+			// The baselines are distributed after releasing the IO lock, so that another
+			// reader can start reading in the meantime.
+			pushBaselines(baselines);
+			finished = _action.ReleaseReadCount(wantedCount) || finished;
+			
+			// Another reader has filled the buffer while this reader waited for the IO lock
+			if(wantedCount == 0)
+				boost::this_thread::yield();
 			watch.Start();
 		} while(!finished);
-		_action.SetFinishedBaselines();
-		_action._dataAvailable.notify_all();
-		watch.Pause();
-		AOLogger::Debug << "Time spent on reading: " << watch.ToString() << '\n';
+	}
+	
+	/**
+	 * The IO mutex is only held while adding a batch, and the batch is collected without
+	 * it, so that the math threads can write their flags while the set is being read.
+	 * The set performs the batches of all readers one after another.
+	 * When fewer batches than requested are in flight, the next batch is added before the
+	 * oldest one is collected. The batch size is adjusted after each collected batch by
+	 * NextBatchSize().
+	 */
+	void ForEachBaselineAction::ReaderFunction::readWithPrefetching(MSImageSet &imageSet, size_t minBufferSize, size_t maxBufferSize, Stopwatch &watch)
+	{
+		size_t batchCount = _action._prefetchBatchCount > 0 ? _action._prefetchBatchCount : 1;
+		size_t batchSize = maxBufferSize;
+		std::deque<PrefetchedBatch> inFlight;
+		bool finished = false;
+		while(!finished || !inFlight.empty())
+		{
+			bool isAdded = false;
+			if(!finished && inFlight.size() < batchCount)
+			{
+				// Without batches in flight, there is nothing to collect while waiting for room
+				bool mayWait = inFlight.empty();
+				if(mayWait)
+				{
+					watch.Pause();
+					_action._baselineQueue->WaitForSizeAtMost(minBufferSize);
+					watch.Start();
+				}
+				
+				size_t reservedCount = _action.ReserveReadCount(maxBufferSize * batchCount);
+				std::vector<ImageSetIndex*> indices;
+				PrefetchedBatch batch;
+				finished = !admitBaselines(std::min(reservedCount, batchSize), mayWait, indices, batch.baselines);
+				// Reserved reads that did not become part of the batch are returned right away
+				finished = _action.ReleaseReadCount(reservedCount - batch.baselines.size()) || finished;
+				
+				if(!batch.baselines.empty())
+				{
+					boost::mutex::scoped_lock lock(_action._artifacts->IOMutex());
+					for(std::vector<ImageSetIndex*>::iterator i=indices.begin();i!=indices.end();++i)
+					{
+						imageSet.AddReadRequest(**i);
+						delete *i;
+					}
+					batch.index = imageSet.PrefetchReadRequests();
+					lock.unlock();
+					inFlight.push_back(batch);
+					isAdded = true;
+				}
+			}
+			
+			if(!isAdded && !inFlight.empty())
+			{
+				PrefetchedBatch &batch = inFlight.front();
+				std::vector<BaselineData*> data;
+				double readTime = imageSet.GetPrefetched(batch.index, data);
+				for(size_t i=0;i!=batch.baselines.size();++i)
+					batch.baselines[i].data = data[i];
+				pushBaselines(batch.baselines);
+				finished = _action.ReleaseReadCount(batch.baselines.size()) || finished;
+				batchSize = _action.NextBatchSize(readTime, minBufferSize, maxBufferSize);
+				inFlight.pop_front();
+			}
+			else if(!isAdded)
+			{
+				// Another reader has filled the buffer
+				boost::this_thread::yield();
+			}
+		}
+	}
+	
+	/**
+	 * Takes the next indices and reserves their memory, until the given count is reached,
+	 * until a baseline does not fit in the memory budget or until all baselines have been
+	 * taken.
+	 * @param mayWait Whether to wait for memory for the first baseline. Waiting for the
+	 * others is not useful: they are read when there is room next time.
+	 * @returns @c false when no baselines are left or when the action was aborted.
+	 */
+	bool ForEachBaselineAction::ReaderFunction::admitBaselines(size_t count, bool mayWait, std::vector<ImageSetIndex*> &indices, std::vector<AdmittedBaseline> &baselines)
+	{
+		// Baselines are admitted before taking the IO lock, because math threads need
+		// that lock to write their flags before they release their memory.
+		for(size_t i=0;i<count;++i)
+		{
+			if(_pendingIndex == 0)
+			{
+				_pendingIndex = _action.GetNextIndex(_pendingSampleCount);
+				if(_pendingIndex == 0)
+					return false;
+			}
+			AdmittedBaseline baseline;
+			baseline.data = 0;
+			baseline.sampleCount = _pendingSampleCount;
+			baseline.reservedBytes = _action.EstimateBaselineMemory(_pendingSampleCount);
+			if(baselines.empty() && mayWait)
+			{
+				if(!_action._memoryBudget->Acquire(baseline.reservedBytes))
+					return false;
+			}
+			else if(!_action._memoryBudget->TryAcquire(baseline.reservedBytes))
+				break;
+			indices.push_back(_pendingIndex);
+			baselines.push_back(baseline);
+			_pendingIndex = 0;
+		}
+		return true;
+	}
+	
+	void ForEachBaselineAction::ReaderFunction::pushBaselines(const std::vector<AdmittedBaseline> &baselines)
+	{
+		for(std::vector<AdmittedBaseline>::const_iterator i=baselines.begin();i!=baselines.end();++i)
+			_action._baselineQueue->Push(*i);
+		if(_isFirstRead && !baselines.empty())
+		{
+			_firstHeapAllocationCount = SamplePool::ThreadStatistics().heapAllocationCount;
+			_isFirstRead = false;
+		}
 	}
 
 	void ForEachBaselineAction::SetProgress(ProgressListener &progress, int no, int count, std::string taskName, int threadId)
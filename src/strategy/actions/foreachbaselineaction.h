@@ -25,22 +25,46 @@
 
 #include "../imagesets/imageset.h"
 
-#include <stack>
+#include <deque>
 #include <set>
+#include <vector>
 
 #include <boost/thread/mutex.hpp>
-#include <boost/thread/condition.hpp>
 
+#include "../../msio/samplepool.h"
+
+#include "../../util/memorybudget.h"
 #include "../../util/progresslistener.h"
+#include "../../util/stopwatch.h"
+#include "../../util/workstealingqueue.h"
 
 namespace rfiStrategy {
 
 	/**
+		Performs the child actions on each selected baseline in parallel.
+		
+		One or more reader threads read the baselines, largest first, and distribute them
+		over the math threads with a WorkStealingQueue. A math thread that has no baselines
+		left takes one from another thread, so that all threads stay busy until the last
+		baseline.
+		
+		For measurement sets, the reads are prefetched: a reader keeps a number of batches
+		of read requests in flight in the MSImageSet, and only holds the IO mutex while
+		adding them. The size of the next batch follows from the time that the last batch
+		took to read and the measured time that processing a baseline takes, such that the
+		disk keeps reading while the math threads process the previous batch.
+		
+		A baseline is only read when the memory it needs fits in a MemoryBudget. The memory
+		that processing a baseline takes is measured per sample with MemoryAccounting, and
+		the largest measured value is used to estimate the next baselines. Hence, the number
+		of baselines that are processed concurrently is limited by memory instead of by a
+		fixed number of threads. An eighth of the memory limit is kept out of the budget
+		for the images and masks that the SamplePool recycles.
 		@author A.R. Offringa <offringa@astro.rug.nl>
 	*/
 	class ForEachBaselineAction : public ActionBlock {
 		public:
-			ForEachBaselineAction() : _threadCount(4), _selection(CrossCorrelations), _resultSet(0), _exceptionOccured(false),  _hasInitAntennae(false)
+			ForEachBaselineAction() : _threadCount(4), _readerThreadCount(1), _prefetchBatchCount(2), _memoryLimit(0), _selection(CrossCorrelations), _baselineQueue(0), _memoryBudget(0), _resultSet(0), _exceptionOccured(false),  _hasInitAntennae(false)
 			{
 			}
 			virtual ~ForEachBaselineAction()
@@ -61,6 +85,32 @@ namespace rfiStrategy {
 			size_t ThreadCount() const throw() { return _threadCount; }
 			void SetThreadCount(size_t threadCount) throw() { _threadCount = threadCount; }
 			
+			/**
+			 * Number of threads that read baselines. This does not make the reading itself
+			 * parallel: a reader holds the IO mutex of the artifacts for the whole read, and
+			 * a measurement set performs its prefetched batches one at a time. Extra readers
+			 * therefore take turns; they only let one reader admit and distribute its
+			 * baselines while another one reads.
+			 */
+			size_t ReaderThreadCount() const throw() { return _readerThreadCount; }
+			void SetReaderThreadCount(size_t readerThreadCount) throw() { _readerThreadCount = readerThreadCount; }
+			
+			/**
+			 * Number of batches of baselines that each reader keeps in flight while reading
+			 * a measurement set. With the default of two, the next batch is read while the
+			 * previous one is being processed.
+			 */
+			size_t PrefetchBatchCount() const throw() { return _prefetchBatchCount; }
+			void SetPrefetchBatchCount(size_t prefetchBatchCount) throw() { _prefetchBatchCount = prefetchBatchCount; }
+			
+			/**
+			 * Maximum number of bytes that the baselines in memory may use together. When
+			 * zero (the default), 90% of the available memory according to /proc/meminfo is
+			 * used.
+			 */
+			size_t MemoryLimit() const throw() { return _memoryLimit; }
+			void SetMemoryLimit(size_t memoryLimit) throw() { _memoryLimit = memoryLimit; }
+			
 			virtual ActionType Type() const { return ForEachBaselineActionType; }
 
 			std::set<size_t> &AntennaeToSkip() { return _antennaeToSkip; }
@@ -70,10 +120,20 @@ namespace rfiStrategy {
 			const std::set<size_t> &AntennaToInclude() const { return _antennaeToInclude; }
 		private:
 			bool IsBaselineSelected(ImageSetIndex &index);
-			class ImageSetIndex *GetNextIndex();
+			void InitializeBaselineIndices(ImageSet &imageSet);
+			class ImageSetIndex *GetNextIndex(size_t &sampleCount);
+			size_t ReserveReadCount(size_t maxBufferSize);
+			bool ReleaseReadCount(size_t count);
+			void RecordBaselineTime(double seconds);
+			size_t NextBatchSize(double batchReadTime, size_t minBatchSize, size_t maxBatchSize);
+			size_t EstimateBaselineMemory(size_t sampleCount);
+			void RecordBaselineMemory(size_t sampleCount, size_t bytes);
+			void UpdatePoolLimits(size_t dataBytes, size_t workingBytes);
+			void RecordPoolStatistics(const SamplePool::Statistics &statistics, size_t laterHeapAllocationCount);
+			static size_t DataMemory(const TimeFrequencyData &data);
 			
 			void SetExceptionOccured();
-			void SetFinishedBaselines();
+			void SetFinishedReader();
 			void SetProgress(ProgressListener &progress, int no, int count, std::string taskName, int threadId);
 			size_t mathThreadCount() const
 			{
@@ -97,35 +157,6 @@ namespace rfiStrategy {
 				++_baselineProgress;
 			}
 			
-			void WaitForBufferAvailable(size_t maxSize)
-			{
-				boost::mutex::scoped_lock lock(_mutex);
-				while(_baselineBuffer.size() > maxSize && !_exceptionOccured)
-					_dataProcessed.wait(lock);
-			}
-			
-			class BaselineData *GetNextBaseline()
-			{
-				boost::mutex::scoped_lock lock(_mutex);
-				while(_baselineBuffer.size() == 0 && !_exceptionOccured && !_finishedBaselines)
-					_dataAvailable.wait(lock);
-				if((_finishedBaselines && _baselineBuffer.size() == 0) || _exceptionOccured)
-					return 0;
-				else
-				{
-					BaselineData *next = _baselineBuffer.top();
-					_baselineBuffer.pop();
-					_dataProcessed.notify_one();
-					return next;
-				}
-			}
-
-			size_t GetBaselinesInBufferCount()
-			{
-				boost::mutex::scoped_lock lock(_mutex);
-				return _baselineBuffer.size();
-			}
-			
 			struct PerformFunction : public ProgressListener
 			{
 				PerformFunction(ForEachBaselineAction &action, ProgressListener &progress, size_t threadIndex)
@@ -146,28 +177,85 @@ namespace rfiStrategy {
 				virtual void OnException(const Action &action, std::exception &thrownException);
 			};
 			
+			/**
+			 * A baseline that was read, together with the memory that was reserved for it.
+			 */
+			struct AdmittedBaseline
+			{
+				BaselineData *data;
+				size_t sampleCount, reservedBytes;
+			};
+			
 			struct ReaderFunction
 			{
 				ReaderFunction(ForEachBaselineAction &action)
-				  : _action(action)
+				  : _action(action), _pendingIndex(0), _pendingSampleCount(0), _firstHeapAllocationCount(0), _isFirstRead(true)
 				{
 				}
 				void operator()();
 
 				ForEachBaselineAction &_action;
+				
+				private:
+					/**
+					 * Baselines for which a prefetch was requested, that have not been collected.
+					 */
+					struct PrefetchedBatch
+					{
+						size_t index;
+						std::vector<AdmittedBaseline> baselines;
+					};
+					
+					void readSynchronously(size_t minBufferSize, size_t maxBufferSize, Stopwatch &watch);
+					void readWithPrefetching(class MSImageSet &imageSet, size_t minBufferSize, size_t maxBufferSize, Stopwatch &watch);
+					bool admitBaselines(size_t count, bool mayWait, std::vector<ImageSetIndex*> &indices, std::vector<AdmittedBaseline> &baselines);
+					void pushBaselines(const std::vector<AdmittedBaseline> &baselines);
+					
+					// An index that did not fit in the memory budget is kept for the next read
+					ImageSetIndex *_pendingIndex;
+					size_t _pendingSampleCount;
+					size_t _firstHeapAllocationCount;
+					bool _isFirstRead;
+			};
+			
+			struct SizedIndex
+			{
+				ImageSetIndex *index;
+				size_t sampleCount;
+				// Sequence in which the reader makes the baseline available
+				size_t loadOrder;
+				
+				static bool StartOrder(const SizedIndex &left, const SizedIndex &right)
+				{
+					if(left.loadOrder != right.loadOrder)
+						return left.loadOrder < right.loadOrder;
+					else
+						return left.sampleCount > right.sampleCount;
+				}
 			};
 			
 			size_t _baselineCount, _nextIndex;
-			size_t _threadCount;
+			size_t _threadCount, _readerThreadCount, _prefetchBatchCount, _memoryLimit;
 			BaselineSelection _selection;
 
-			ImageSetIndex *_loopIndex;
+			std::vector<SizedIndex> _baselineIndices;
+			WorkStealingQueue<AdmittedBaseline> *_baselineQueue;
+			MemoryBudget *_memoryBudget;
+			double _bytesPerSample;
+			size_t _largestBaselineMemory;
+			bool _hasMeasuredMemory;
+			size_t _largestDataMemory, _largestWorkingMemory;
+			// Part of the memory limit for the sample pool, and the number of threads with a pool
+			size_t _poolMemory, _poolThreadCount;
+			// Moving average of the time it takes a math thread to process one baseline
+			double _computeTimePerBaseline;
+			bool _hasMeasuredComputeTime;
+			SamplePool::Statistics _poolStatistics;
+			size_t _laterHeapAllocationCount;
 			ArtifactSet *_artifacts, *_resultSet;
 			
 			boost::mutex _mutex;
-			boost::condition _dataAvailable, _dataProcessed;
-			std::stack<BaselineData*> _baselineBuffer;
-			bool _finishedBaselines;
+			size_t _activeReaderCount, _readsInProgress;
 
 			int *_progressTaskNo, *_progressTaskCount;
 			bool _exceptionOccured;
@@ -75,6 +75,8 @@ void ForEachMSAction::Perform(ArtifactSet &artifacts, ProgressListener &progress
 				MSImageSet *msImageSet = static_cast<MSImageSet*>(&*imageSet);
 				msImageSet->SetDataColumnName(_dataColumnName);
 				msImageSet->SetSubtractModel(_subtractModel);
+				msImageSet->SetMaxScanCountPerPart(_maxScanCountPerPart);
+				msImageSet->SetScanCountPartOverlap(_scanCountPartOverlap);
 			}
 			imageSet->Initialize();
 			
@@ -96,6 +98,8 @@ void ForEachMSAction::Perform(ArtifactSet &artifacts, ProgressListener &progress
 				
 				if(_threadCount != 0)
 					rfiStrategy::Strategy::SetThreadCount(*this, _threadCount);
+				if(_memoryLimit != 0)
+					rfiStrategy::Strategy::SetMemoryLimit(*this, _memoryLimit);
 			}
 			
 			std::auto_ptr<ImageSetIndex> index(imageSet->StartIndex());
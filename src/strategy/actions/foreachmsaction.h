@@ -32,7 +32,7 @@ namespace rfiStrategy {
 	class ForEachMSAction  : public ActionBlock {
 		public:
 			ForEachMSAction() : _readUVW(false), _dataColumnName("DATA"), _subtractModel(false), _skipIfAlreadyProcessed(false), _loadOptimizedStrategy(false), _baselineIOMode(AutoReadMode),
-			_threadCount(0)
+			_threadCount(0), _memoryLimit(0), _maxScanCountPerPart(0), _scanCountPartOverlap(100)
 			{
 			}
 			~ForEachMSAction()
@@ -75,6 +75,19 @@ namespace rfiStrategy {
 			
 			size_t LoadStrategyThreadCount() const { return _threadCount; }
 			void SetLoadStrategyThreadCount(size_t threadCount) { _threadCount = threadCount; }
+			
+			size_t LoadStrategyMemoryLimit() const { return _memoryLimit; }
+			void SetLoadStrategyMemoryLimit(size_t memoryLimit) { _memoryLimit = memoryLimit; }
+			
+			/**
+			 * Maximum number of time steps to process at once per baseline, or zero to process
+			 * each baseline as a whole. See MSImageSet::SetMaxScanCountPerPart().
+			 */
+			size_t MaxScanCountPerPart() const { return _maxScanCountPerPart; }
+			void SetMaxScanCountPerPart(size_t maxScanCount) { _maxScanCountPerPart = maxScanCount; }
+			
+			size_t ScanCountPartOverlap() const { return _scanCountPartOverlap; }
+			void SetScanCountPartOverlap(size_t overlap) { _scanCountPartOverlap = overlap; }
 		private:
 			std::vector<std::string> _filenames;
 			bool _readUVW;
@@ -85,6 +98,8 @@ namespace rfiStrategy {
 			bool _loadOptimizedStrategy;
 			BaselineIOMode _baselineIOMode;
 			size_t _threadCount;
+			size_t _memoryLimit;
+			size_t _maxScanCountPerPart, _scanCountPartOverlap;
 	};
 
 }
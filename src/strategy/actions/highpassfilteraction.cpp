@@ -14,6 +14,7 @@ void HighPassFilterAction::Perform(ArtifactSet &artifacts, ProgressListener &pro
 	filter.SetHWindowSize(_windowWidth);
 	filter.SetVKernelSigmaSq(_vKernelSigmaSq);
 	filter.SetVWindowSize(_windowHeight);
+	filter.SetMethod(_method);
 	Mask2DCPtr mask = data.GetSingleMask();
 	size_t imageCount = data.ImageCount();
 	
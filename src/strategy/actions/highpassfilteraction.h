@@ -24,6 +24,8 @@
 
 #include "../control/artifactset.h"
 
+#include "../algorithms/highpassfilter.h"
+
 namespace rfiStrategy {
 
 	/**
@@ -37,7 +39,8 @@ namespace rfiStrategy {
 				_windowHeight(45),
 				_hKernelSigmaSq(7.5),
 				_vKernelSigmaSq(15.0),
-				_mode(StoreContaminated)
+				_mode(StoreContaminated),
+				_method(HighPassFilter::GaussianKernelMethod)
 			{
 			}
 			virtual ~HighPassFilterAction()
@@ -56,17 +59,23 @@ namespace rfiStrategy {
 			double HKernelSigmaSq() const { return _hKernelSigmaSq; }
 			double VKernelSigmaSq() const { return _vKernelSigmaSq; }
 			enum Mode Mode() const { return _mode; }
+			enum HighPassFilter::Method Method() const { return _method; }
 			
 			void SetWindowWidth(unsigned width) { _windowWidth = width; }
 			void SetWindowHeight(unsigned height) { _windowHeight = height; }
 			void SetHKernelSigmaSq(double hSigmaSquared) { _hKernelSigmaSq = hSigmaSquared; }
 			void SetVKernelSigmaSq(double vSigmaSquared) { _vKernelSigmaSq = vSigmaSquared; }
 			void SetMode(enum Mode mode) { _mode = mode; }
+			/**
+			 * Selects how the low-pass convolution is computed; see HighPassFilter::Method.
+			 */
+			void SetMethod(enum HighPassFilter::Method method) { _method = method; }
 
 		private:
 			unsigned _windowWidth, _windowHeight;
 			double _hKernelSigmaSq, _vKernelSigmaSq;
 			enum Mode _mode;
+			enum HighPassFilter::Method _method;
 	};
 
 }
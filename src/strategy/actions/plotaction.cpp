@@ -90,8 +90,9 @@ namespace rfiStrategy {
 		if(artifacts.FrequencyFlagCountPlot() == 0)
 			throw BadUsageException("No frequency flag count plot in the artifact set");
 
-		TimeFrequencyData &data = artifacts.ContaminatedData();
-		TimeFrequencyMetaDataCPtr meta = artifacts.MetaData();
+		TimeFrequencyData data;
+		TimeFrequencyMetaDataCPtr meta;
+		artifacts.GetContaminatedPartInterior(data, meta);
 		artifacts.FrequencyFlagCountPlot()->Add(data, meta);
 	}
 
@@ -100,8 +101,9 @@ namespace rfiStrategy {
 		if(artifacts.FrequencyPowerPlot() == 0)
 			throw BadUsageException("No frequency power plot in the artifact set");
 
-		TimeFrequencyData &data = artifacts.ContaminatedData();
-		TimeFrequencyMetaDataCPtr meta = artifacts.MetaData();
+		TimeFrequencyData data;
+		TimeFrequencyMetaDataCPtr meta;
+		artifacts.GetContaminatedPartInterior(data, meta);
 		artifacts.FrequencyPowerPlot()->Add(data, meta);
 	}
 
@@ -110,8 +112,9 @@ namespace rfiStrategy {
 		if(artifacts.TimeFlagCountPlot() == 0)
 			throw BadUsageException("No time flag count plot in the artifact set");
 
-		TimeFrequencyData &data = artifacts.ContaminatedData();
-		TimeFrequencyMetaDataCPtr meta = artifacts.MetaData();
+		TimeFrequencyData data;
+		TimeFrequencyMetaDataCPtr meta;
+		artifacts.GetContaminatedPartInterior(data, meta);
 		artifacts.TimeFlagCountPlot()->Add(data, meta);
 	}
 
@@ -120,8 +123,9 @@ namespace rfiStrategy {
 		if(artifacts.FrequencyPowerPlot() == 0)
 			throw BadUsageException("No frequency power plot in the artifact set");
 
-		TimeFrequencyData &data = artifacts.ContaminatedData();
-		TimeFrequencyMetaDataCPtr meta = artifacts.MetaData();
+		TimeFrequencyData data;
+		TimeFrequencyMetaDataCPtr meta;
+		artifacts.GetContaminatedPartInterior(data, meta);
 		artifacts.FrequencyPowerPlot()->SetLogYAxis(_logYAxis);
 		artifacts.FrequencyPowerPlot()->StartNewLine(meta->Antenna1().name + " x " + meta->Antenna2().name);
 		artifacts.FrequencyPowerPlot()->Add(data, meta);
@@ -132,7 +136,9 @@ namespace rfiStrategy {
 		if(artifacts.PolarizationStatistics() == 0)
 			throw BadUsageException("No polarization statistics in the artifact set");
 
-		TimeFrequencyData &data = artifacts.ContaminatedData();
+		TimeFrequencyData data;
+		TimeFrequencyMetaDataCPtr meta;
+		artifacts.GetContaminatedPartInterior(data, meta);
 		artifacts.PolarizationStatistics()->Add(data);
 	}
 
@@ -166,7 +172,10 @@ namespace rfiStrategy {
 		class IterationsPlot *plot = artifacts.IterationsPlot();
 		if(plot != 0)
 		{
-			plot->Add(artifacts.ContaminatedData(), artifacts.MetaData());
+			TimeFrequencyData data;
+			TimeFrequencyMetaDataCPtr meta;
+			artifacts.GetContaminatedPartInterior(data, meta);
+			plot->Add(data, meta);
 		}
 	}
 
@@ -74,6 +74,20 @@ namespace rfiStrategy {
 		}
 	}
 
+	void Strategy::SetMemoryLimit(ActionContainer &strategy, size_t memoryLimit)
+	{
+		StrategyIterator i = StrategyIterator::NewStartIterator(strategy);
+		while(!i.PastEnd())
+		{
+			if(i->Type() == ForEachBaselineActionType)
+			{
+				ForEachBaselineAction &fobAction = static_cast<ForEachBaselineAction&>(*i);
+				fobAction.SetMemoryLimit(memoryLimit);
+			}
+			++i;
+		}
+	}
+
 	void Strategy::SetDataColumnName(Strategy &strategy, const std::string &dataColumnName)
 	{
 		StrategyIterator i = StrategyIterator::NewStartIterator(strategy);
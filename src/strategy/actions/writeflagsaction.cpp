@@ -60,11 +60,11 @@ namespace rfiStrategy {
 		}
 		lock.unlock();
 
-		std::vector<Mask2DCPtr> masks;
+		std::vector<BitMask2DCPtr> masks;
 		for(size_t i=0;i<artifacts.ContaminatedData().MaskCount();++i)
 		{
 			Mask2DCPtr mask = artifacts.ContaminatedData().GetMask(i);
-			masks.push_back(mask);
+			masks.push_back(BitMask2D::CreateFromMask(mask));
 		}
 		BufferItem newItem(masks, *artifacts.ImageSetIndex());
 		pushInBuffer(newItem);
@@ -92,15 +92,23 @@ namespace rfiStrategy {
 				AOLogger::Debug << "Flushing flags...\n";
 			lock.unlock();
 
-			boost::mutex::scoped_lock ioLock(*_parent->_ioMutex);
+			// A set that serializes its own IO is written without the IO mutex, so that the
+			// readers, which need that mutex to add their requests, are not held up
+			boost::mutex::scoped_lock ioLock(*_parent->_ioMutex, boost::defer_lock);
+			if(!_parent->_imageSet->HasConcurrentFlagWriting())
+				ioLock.lock();
 			while(!bufferCopy.empty())
 			{
 				BufferItem item = bufferCopy.top();
 				bufferCopy.pop();
-				_parent->_imageSet->AddWriteFlagsTask(*item._index, item._masks);
+				std::vector<Mask2DCPtr> masks;
+				for(std::vector<BitMask2DCPtr>::const_iterator i=item._masks.begin();i!=item._masks.end();++i)
+					masks.push_back((*i)->CreateMask());
+				_parent->_imageSet->AddWriteFlagsTask(*item._index, masks);
 			}
 			_parent->_imageSet->PerformWriteFlagsTask();
-			ioLock.unlock();
+			if(ioLock.owns_lock())
+				ioLock.unlock();
 
 			lock.lock();
 		} while(!_parent->_isFinishing || !_parent->_buffer.empty());
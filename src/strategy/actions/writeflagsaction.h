@@ -30,6 +30,7 @@
 #include <boost/thread/condition.hpp>
 #include <boost/thread/thread.hpp>
 
+#include "../../msio/bitmask2d.h"
 #include "../../msio/mask2d.h"
 
 namespace rfiStrategy {
@@ -54,8 +55,13 @@ namespace rfiStrategy {
 			void SetMaxBufferItems(size_t maxBufferItems) { _maxBufferItems = maxBufferItems; }
 			void SetMinBufferItemsForWriting(size_t minBufferItemsForWriting) { _minBufferItemsForWriting = minBufferItemsForWriting; }
 		private:
+			/**
+			 * A buffered item holds its masks packed as bit masks, so that the
+			 * buffered flags take 1/8 of the memory of the Mask2Ds they were
+			 * created from. They are unpacked again when they are written.
+			 */
 			struct BufferItem {
-				BufferItem(const std::vector<Mask2DCPtr> &masks, const ImageSetIndex &index)
+				BufferItem(const std::vector<BitMask2DCPtr> &masks, const ImageSetIndex &index)
 					: _masks(masks), _index(index.Copy())
 				{
 				}
@@ -72,7 +78,7 @@ namespace rfiStrategy {
 					_masks = source._masks;
 					_index = source._index->Copy();
 				}
-				std::vector<Mask2DCPtr> _masks;
+				std::vector<BitMask2DCPtr> _masks;
 				ImageSetIndex *_index;
 			};
 
@@ -43,10 +43,40 @@ void BaselineSelector::Add(Mask2DCPtr mask, TimeFrequencyMetaDataCPtr metaData)
 		baseline.band = metaData->Band().windowIndex;
 		baseline.sequenceId = metaData->SequenceId();
 
-		baseline.rfiCount = mask->GetCount<true>();
-		baseline.totalCount = mask->Width() * mask->Height();
+		size_t
+			left = metaData->PartLeftBorder(),
+			right = metaData->PartRightBorder();
+		if(left + right >= mask->Width())
+		{
+			left = 0;
+			right = 0;
+		}
+		const size_t endX = mask->Width() - right;
+		if(left == 0 && right == 0)
+			baseline.rfiCount = mask->GetCount<true>();
+		else {
+			baseline.rfiCount = 0;
+			for(size_t y=0;y<mask->Height();++y)
+			{
+				for(size_t x=left;x<endX;++x)
+				{
+					if(mask->Value(x, y))
+						++baseline.rfiCount;
+				}
+			}
+		}
+		baseline.totalCount = (endX - left) * mask->Height();
 
-		_baselines.push_back(baseline);
+		const BaselineKey key(baseline.antenna1, baseline.antenna2, baseline.band, baseline.sequenceId);
+		std::map<BaselineKey, size_t>::const_iterator existing = _baselineIndices.find(key);
+		if(existing == _baselineIndices.end())
+		{
+			_baselineIndices.insert(std::pair<BaselineKey, size_t>(key, _baselines.size()));
+			_baselines.push_back(baseline);
+		} else {
+			_baselines[existing->second].rfiCount += baseline.rfiCount;
+			_baselines[existing->second].totalCount += baseline.totalCount;
+		}
 	}
 }
 
@@ -77,6 +107,8 @@ void BaselineSelector::Search(std::vector<BaselineSelector::SingleBaselineInfo>
 	// Perform a first quick threshold to remove baselines which deviate a lot (e.g. 100% flagged
 	// baselines). Sometimes, there are a lot of them, causing instability if this would not be
 	// done.
+	// Searching reorders and removes baselines, so parts can no longer be added to them.
+	_baselineIndices.clear();
 	for(int i=_baselines.size()-1;i>=0;--i)
 	{
 		double currentValue = (double) _baselines[i].rfiCount / (double) _baselines[i].totalCount;
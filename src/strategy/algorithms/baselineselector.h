@@ -22,6 +22,7 @@
 #define BASELINE_SELECTOR_H
 
 #include <string>
+#include <map>
 #include <set>
 #include <vector>
 
@@ -90,6 +91,13 @@ namespace rfiStrategy {
 			typedef std::vector<SingleBaselineInfo> BaselineVector;
 			void Search(std::vector<BaselineSelector::SingleBaselineInfo> &markedBaselines);
 			void ImplyStations(const std::vector<BaselineSelector::SingleBaselineInfo> &markedBaselines, double maxRatio, std::set<unsigned> &badStations) const;
+			/**
+			 * Adds the flag statistics of a baseline. When the baseline is processed in
+			 * several parts of time, each part can be added separately: the
+			 * counts of parts of the same baseline are summed into one entry, and the time
+			 * steps in the part borders are skipped, as these are also part of the
+			 * neighbouring part.
+			 */
 			void Add(Mask2DCPtr mask, TimeFrequencyMetaDataCPtr metaData);
 			void Add(class DefaultStatistics &baselineStat, class AntennaInfo &antenna1, class AntennaInfo &antenna2);
 			
@@ -105,8 +113,25 @@ namespace rfiStrategy {
 			
 			size_t BaselineCount() const { return _baselines.size(); }
 		private:
+			struct BaselineKey
+			{
+				BaselineKey(int _antenna1, int _antenna2, int _band, unsigned _sequenceId) :
+					antenna1(_antenna1), antenna2(_antenna2), band(_band), sequenceId(_sequenceId)
+				{ }
+				bool operator<(const BaselineKey &rhs) const
+				{
+					if(antenna1 != rhs.antenna1) return antenna1 < rhs.antenna1;
+					if(antenna2 != rhs.antenna2) return antenna2 < rhs.antenna2;
+					if(band != rhs.band) return band < rhs.band;
+					return sequenceId < rhs.sequenceId;
+				}
+				int antenna1, antenna2, band;
+				unsigned sequenceId;
+			};
+
 			boost::mutex _mutex;
 			BaselineVector _baselines;
+			std::map<BaselineKey, size_t> _baselineIndices;
 			double _threshold, _absThreshold;
 			double _smoothingSigma;
 			bool _makePlot;
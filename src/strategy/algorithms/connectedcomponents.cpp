@@ -0,0 +1,115 @@
+#include "connectedcomponents.h"
+
+template<typename T>
+void ConnectedComponents::addRow(const T *row, size_t width, size_t y)
+{
+	_previousRowStart = _currentRowStart;
+	_currentRowStart = _runs.size();
+
+	size_t x = 0;
+	while(x < width)
+	{
+		if(row[x] == 0)
+		{
+			++x;
+			continue;
+		}
+		const T runClass = row[x];
+		Run run;
+		run.y = y;
+		run.xStart = x;
+		do { ++x; } while(x < width && row[x] == runClass);
+		run.xEnd = x;
+		run.component = 0;
+		_runs.push_back(run);
+		_runClasses.push_back((signed char) runClass);
+		_parents.push_back(_parents.size());
+	}
+
+	// Join with the touching runs of the previous row. Both rows are sorted, so this is
+	// a merge of the two lists of runs.
+	const size_t reach = _eightConnected ? 1 : 0;
+	size_t previous = _previousRowStart;
+	for(size_t current=_currentRowStart;current!=_runs.size();++current)
+	{
+		const Run &run = _runs[current];
+		// Skip the runs that end before this run starts (including the diagonal)
+		while(previous != _currentRowStart && _runs[previous].xEnd + reach <= run.xStart)
+			++previous;
+		for(size_t p=previous;p!=_currentRowStart && _runs[p].xStart < run.xEnd + reach;++p)
+		{
+			if(_runClasses[p] == _runClasses[current])
+				join(p, current);
+		}
+	}
+}
+
+void ConnectedComponents::finish()
+{
+	_areas.clear();
+	for(size_t i=0;i!=_runs.size();++i)
+	{
+		Run &run = _runs[i];
+		const size_t root = findRoot(i);
+		if(root == i)
+		{
+			run.component = _areas.size();
+			_areas.push_back(0);
+		}
+		else
+			run.component = _runs[root].component;
+		_areas[run.component] += run.xEnd - run.xStart;
+	}
+}
+
+void ConnectedComponents::Label(const Mask2D &mask)
+{
+	_runs.clear();
+	_runClasses.clear();
+	_parents.clear();
+	_previousRowStart = 0;
+	_currentRowStart = 0;
+	for(size_t y=0;y<mask.Height();++y)
+		addRow(mask.ValuePtr(0, y), mask.Width(), y);
+	finish();
+}
+
+void ConnectedComponents::Label(const signed char *const *classes, size_t width, size_t height)
+{
+	_runs.clear();
+	_runClasses.clear();
+	_parents.clear();
+	_previousRowStart = 0;
+	_currentRowStart = 0;
+	for(size_t y=0;y<height;++y)
+		addRow(classes[y], width, y);
+	finish();
+}
+
+void ConnectedComponents::RemoveSmallComponents(Mask2D &mask, size_t minArea) const
+{
+	for(std::vector<Run>::const_iterator i=_runs.begin();i!=_runs.end();++i)
+	{
+		if(_areas[i->component] < minArea)
+			mask.SetHorizontalValues(i->xStart, i->y, false, i->xEnd - i->xStart);
+	}
+}
+
+void ConnectedComponents::WriteSegments(SegmentedImage &output) const
+{
+	for(size_t y=0;y<output.Height();++y)
+	{
+		for(size_t x=0;x<output.Width();++x)
+			output.SetValue(x, y, 0);
+	}
+	if(_areas.empty())
+		return;
+	const size_t firstSegment = output.NewSegmentValue();
+	for(size_t i=1;i<_areas.size();++i)
+		output.NewSegmentValue();
+	for(std::vector<Run>::const_iterator i=_runs.begin();i!=_runs.end();++i)
+	{
+		for(size_t x=i->xStart;x!=i->xEnd;++x)
+			output.SetValue(x, i->y, firstSegment + i->component);
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef CONNECTED_COMPONENTS_H
+#define CONNECTED_COMPONENTS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "../../msio/mask2d.h"
+#include "../../msio/segmentedimage.h"
+
+/**
+ * Labels the connected components of a mask, or of an image of classes, in two passes
+ * over runs instead of samples.
+ *
+ * The first pass splits each row into runs of equal, non-zero class. Every run is joined
+ * with a union-find structure to the runs of the same class in the previous row that it
+ * touches. Afterwards, the components are numbered in the order of their first sample
+ * (the same order as a flood fill that starts at each unlabelled sample in row-major
+ * order), and their areas are known. The second pass, e.g. RemoveSmallComponents() or
+ * WriteSegments(), writes the result run by run.
+ *
+ * Components are four-connected, or eight-connected when requested. Diagonal
+ * neighbours only connect when they have the same class.
+ */
+class ConnectedComponents
+{
+	public:
+		struct Run
+		{
+			size_t y, xStart, xEnd;
+			size_t component;
+		};
+
+		ConnectedComponents(bool eightConnected) : _eightConnected(eightConnected)
+		{
+		}
+
+		/**
+		 * Labels the flagged samples of the mask.
+		 */
+		void Label(const Mask2D &mask);
+
+		/**
+		 * Labels an image of classes, given as one array per row. Samples of class zero are
+		 * background; neighbouring samples are only connected when they have the same class.
+		 */
+		void Label(const signed char *const *classes, size_t width, size_t height);
+
+		size_t ComponentCount() const { return _areas.size(); }
+
+		/**
+		 * Number of samples in the given component.
+		 */
+		size_t Area(size_t component) const { return _areas[component]; }
+
+		/**
+		 * The runs in row-major order.
+		 */
+		const std::vector<Run> &Runs() const { return _runs; }
+
+		/**
+		 * Unsets the samples of all components with an area smaller than minArea in the mask
+		 * that was labelled.
+		 */
+		void RemoveSmallComponents(Mask2D &mask, size_t minArea) const;
+
+		/**
+		 * Stores each component as a new segment in the segmented image, in the order of the
+		 * components. Samples that are not part of a component are set to zero.
+		 */
+		void WriteSegments(SegmentedImage &output) const;
+	private:
+		template<typename T>
+		void addRow(const T *row, size_t width, size_t y);
+		void finish();
+
+		size_t findRoot(size_t run)
+		{
+			while(_parents[run] != run)
+			{
+				// Path halving
+				_parents[run] = _parents[_parents[run]];
+				run = _parents[run];
+			}
+			return run;
+		}
+
+		void join(size_t runA, size_t runB)
+		{
+			size_t rootA = findRoot(runA), rootB = findRoot(runB);
+			// The root is always the first run of a component, which keeps the numbering in
+			// finish() in order of the first sample
+			if(rootA < rootB)
+				_parents[rootB] = rootA;
+			else if(rootB < rootA)
+				_parents[rootA] = rootB;
+		}
+
+		bool _eightConnected;
+		std::vector<Run> _runs;
+		std::vector<signed char> _runClasses;
+		std::vector<size_t> _parents;
+		std::vector<size_t> _areas;
+		// Runs of the previous row are _runs[_previousRowStart, _currentRowStart)
+		size_t _previousRowStart, _currentRowStart;
+};
+
+#endif
@@ -1,9 +1,389 @@
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include <xmmintrin.h>
 
 #include "highpassfilter.h"
+#include "../../util/bandthreadpool.h"
 #include "../../util/rng.h"
 
+namespace {
+	const unsigned BoxPassCount = 3;
+	
+	/**
+	 * Variance of a (truncated) convolution kernel of odd size around its centre.
+	 */
+	double kernelVariance(const num_t *kernel, unsigned size)
+	{
+		const int mid = size/2;
+		double sum = 0.0, weightedSum = 0.0;
+		for(int i=0;i!=(int) size;++i)
+		{
+			sum += kernel[i];
+			weightedSum += kernel[i] * double(i - mid) * double(i - mid);
+		}
+		return sum == 0.0 ? 0.0 : weightedSum / sum;
+	}
+	
+	/**
+	 * Calculates the radii of BoxPassCount box filters that, applied after each other,
+	 * approximate a Gaussian with the given variance. The boxes have two different odd
+	 * widths, and the number of boxes of each width is chosen such that the variance of the
+	 * combined filter is as close as possible to sigmaSq (Kovesi, "Fast almost-Gaussian
+	 * filtering", 2010).
+	 */
+	void calculateBoxRadii(double sigmaSq, size_t *radii)
+	{
+		const double n = BoxPassCount;
+		int lowerWidth = (int) floor(sqrt(12.0 * sigmaSq / n + 1.0));
+		if(lowerWidth % 2 == 0)
+			--lowerWidth;
+		if(lowerWidth < 1)
+			lowerWidth = 1;
+		const double w = lowerWidth;
+		int lowerCount = (int) round((12.0 * sigmaSq - n*w*w - 4.0*n*w - 3.0*n) / (-4.0*w - 4.0));
+		if(lowerCount < 0)
+			lowerCount = 0;
+		else if(lowerCount > (int) BoxPassCount)
+			lowerCount = BoxPassCount;
+		for(unsigned i=0;i!=BoxPassCount;++i)
+			radii[i] = (i < (unsigned) lowerCount) ? (lowerWidth-1)/2 : (lowerWidth+1)/2;
+	}
+	
+	/**
+	 * Averages each sample of the row over a box of 2 radius + 1 samples. Samples outside
+	 * the row count as zero, like in the kernel convolution. The running sum is kept in
+	 * double precision, so that subtracting a large value after it has left the box does
+	 * not leave a noticable residual.
+	 */
+	void boxFilterRow(const num_t *input, num_t *output, size_t size, size_t radius)
+	{
+		const double scale = 1.0 / (2 * radius + 1);
+		double sum = 0.0;
+		for(size_t x=0;x!=size && x<=radius;++x)
+			sum += input[x];
+		// In the middle part, a sample enters and a sample leaves the box. Their difference
+		// is added in one go, which keeps the dependency chain of the sum short.
+		const size_t middleEnd = (size > radius + 1) ? size - radius - 1 : 0;
+		size_t x = 0;
+		for(;x<radius && x<middleEnd;++x)
+		{
+			output[x] = sum * scale;
+			sum += input[x + radius + 1];
+		}
+		for(;x<middleEnd;++x)
+		{
+			output[x] = sum * scale;
+			sum += (double) input[x + radius + 1] - (double) input[x - radius];
+		}
+		for(;x<size;++x)
+		{
+			output[x] = sum * scale;
+			if(x >= radius)
+				sum -= input[x - radius];
+		}
+	}
+	
+	/**
+	 * Vertical version of boxFilterRow() for the columns [xStart, xEnd), which keeps one
+	 * running sum per column, so that the image is traversed row by row.
+	 */
+	void boxFilterColumns(const Image2D &input, Image2D &output, size_t radius, size_t xStart, size_t xEnd, std::vector<double> &sums)
+	{
+		const size_t width = xEnd - xStart, height = input.Height();
+		const double scale = 1.0 / (2 * radius + 1);
+		sums.assign(width, 0.0);
+		for(size_t y=0;y!=height && y<=radius;++y)
+		{
+			const num_t *inputPtr = input.ValuePtr(xStart, y);
+			for(size_t x=0;x!=width;++x)
+				sums[x] += inputPtr[x];
+		}
+		for(size_t y=0;y!=height;++y)
+		{
+			num_t *outputPtr = output.ValuePtr(xStart, y);
+			const bool
+				hasEntering = y + radius + 1 < height,
+				hasLeaving = y >= radius;
+			if(hasEntering && hasLeaving)
+			{
+				const num_t
+					*enteringPtr = input.ValuePtr(xStart, y + radius + 1),
+					*leavingPtr = input.ValuePtr(xStart, y - radius);
+				for(size_t x=0;x!=width;++x)
+				{
+					outputPtr[x] = sums[x] * scale;
+					sums[x] += (double) enteringPtr[x] - (double) leavingPtr[x];
+				}
+			} else {
+				for(size_t x=0;x!=width;++x)
+					outputPtr[x] = sums[x] * scale;
+				if(hasEntering)
+				{
+					const num_t *enteringPtr = input.ValuePtr(xStart, y + radius + 1);
+					for(size_t x=0;x!=width;++x)
+						sums[x] += enteringPtr[x];
+				}
+				if(hasLeaving)
+				{
+					const num_t *leavingPtr = input.ValuePtr(xStart, y - radius);
+					for(size_t x=0;x!=width;++x)
+						sums[x] -= leavingPtr[x];
+				}
+			}
+		}
+	}
+	
+	/**
+	 * The images and parameters of one step of the low-pass filter. Each step is
+	 * performed in bands of rows or columns with a FilterTask; the bands write disjoint
+	 * parts of the output and calculate every value as without bands.
+	 */
+	struct FilterStep
+	{
+		const Image2D *input;
+		const Mask2D *mask;
+		Image2D *output, *scratch;
+		const num_t *kernel;
+		unsigned kernelSize;
+		const size_t *radii;
+	};
+	
+	typedef void (*FilterBand)(const FilterStep &step, size_t start, size_t end);
+	
+	class FilterTask : public BandThreadPool::Task
+	{
+		public:
+			FilterTask(FilterBand function, const FilterStep &step) : _function(function), _step(step)
+			{ }
+			
+			virtual void Run(size_t start, size_t end)
+			{
+				_function(_step, start, end);
+			}
+			
+			static void InRows(FilterBand function, const FilterStep &step)
+			{
+				FilterTask task(function, step);
+				BandThreadPool::Run(task, step.output->Height(), 65536 / (step.output->Width() + 1) + 1);
+			}
+			
+			static void InColumns(FilterBand function, const FilterStep &step)
+			{
+				FilterTask task(function, step);
+				BandThreadPool::Run(task, step.output->Width(), 65536 / (step.output->Height() + 1) + 4, 4);
+			}
+		private:
+			FilterBand _function;
+			const FilterStep &_step;
+	};
+	
+	/**
+	 * Copies the input to the output and sets the weights (scratch) to one, or both to
+	 * zero for flagged and non-finite values.
+	 */
+	void makeWeightsInRowsSSE(const FilterStep &step, size_t yStart, size_t yEnd)
+	{
+		const size_t width = step.input->Width();
+		const __m128i zero4i = _mm_set_epi32(0, 0, 0, 0);
+		const __m128 zero4 = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
+		const __m128 one4 = _mm_set_ps(1.0, 1.0, 1.0, 1.0);
+		for(size_t y=yStart;y<yEnd;++y)
+		{
+			const bool *rowPtr = step.mask->ValuePtr(0, y);
+			const float *inputPtr = step.input->ValuePtr(0, y);
+			float *outputPtr = step.output->ValuePtr(0, y);
+			float *weightsPtr = step.scratch->ValuePtr(0, y);
+			const float *end = inputPtr + width;
+			while(inputPtr < end)
+			{
+				
+				// Assign each integer to one bool in the mask
+				// Convert false to 0xFFFFFFFF and true to 0
+				__m128 conditionMask = _mm_castsi128_ps(
+					_mm_cmpeq_epi32(_mm_set_epi32(rowPtr[3] || !std::isfinite(inputPtr[3]), rowPtr[2] || !std::isfinite(inputPtr[2]),
+																				rowPtr[1] || !std::isfinite(inputPtr[1]), rowPtr[0] || !std::isfinite(inputPtr[0])),
+													zero4i));
+				
+				_mm_store_ps(weightsPtr, _mm_or_ps(
+					_mm_and_ps(conditionMask, one4),
+					_mm_andnot_ps(conditionMask, zero4)
+				));
+				_mm_store_ps(outputPtr, _mm_or_ps(
+					_mm_and_ps(conditionMask, _mm_load_ps(inputPtr)),
+					_mm_andnot_ps(conditionMask, zero4)
+				));
+				
+				rowPtr += 4;
+				outputPtr += 4;
+				inputPtr += 4;
+				weightsPtr += 4;
+			}
+		}
+	}
+	
+	/**
+	 * Horizontal kernel convolution of the input into the (zeroed) output for the rows
+	 * [yBandStart, yBandEnd).
+	 */
+	void convolveRowsSSE(const FilterStep &step, size_t yBandStart, size_t yBandEnd)
+	{
+		const Image2D &image = *step.input;
+		Image2D &temp = *step.output;
+		const unsigned hKernelMid = step.kernelSize/2;
+		for(unsigned i=0; i<step.kernelSize; ++i) {
+			
+			const num_t k = step.kernel[i];
+			const __m128 k4 = _mm_set_ps(k, k, k, k);
+			unsigned
+				/* xStart is the first column to start writing to. Note that it might be larger
+				 * than the width. */
+				xStart = (i >= hKernelMid) ? 0 : (hKernelMid-i),
+				xEnd = (i <= hKernelMid) ? image.Width() : (image.Width()+hKernelMid > i ? (image.Width()-i+hKernelMid) : 0);
+			
+			for(unsigned y=yBandStart;y<yBandEnd;++y) {
+				
+				float *tempPtr = temp.ValuePtr(xStart, y);
+				const float *imagePtr = image.ValuePtr(xStart+i-hKernelMid, y);
+				
+				unsigned x = xStart;
+				for(;x+4<xEnd;x+=4) {
+					const __m128
+						imageVal = _mm_loadu_ps(imagePtr),
+						tempVal = _mm_loadu_ps(tempPtr);
+
+					// *tempPtr += k * (*imagePtr);
+					_mm_storeu_ps(tempPtr, _mm_add_ps(tempVal, _mm_mul_ps(imageVal, k4)));
+					
+					tempPtr += 4;
+					imagePtr += 4;
+				}
+				for(;x<xEnd;++x) {
+					*tempPtr += k * (*imagePtr);
+					++tempPtr;
+					++imagePtr;
+				}
+			}
+		}
+	}
+	
+	/**
+	 * Vertical kernel convolution of the input into the output rows
+	 * [yBandStart, yBandEnd), which are zeroed first. The rows of the input that are read
+	 * lie outside the band, so the horizontal step has to be finished for all rows.
+	 */
+	void convolveColumnsSSE(const FilterStep &step, size_t yBandStart, size_t yBandEnd)
+	{
+		const Image2D &temp = *step.input;
+		Image2D &image = *step.output;
+		for(size_t y=yBandStart;y<yBandEnd;++y)
+			std::fill(image.ValuePtr(0, y), image.ValuePtr(0, y) + image.Stride(), 0.0);
+		const unsigned vKernelMid = step.kernelSize/2;
+		for(unsigned i=0; i<step.kernelSize; ++i) {
+			const num_t k = step.kernel[i];
+			const __m128 k4 = _mm_set_ps(k, k, k, k);
+			const unsigned
+				yStart = std::max<unsigned>((i >= vKernelMid) ? 0 : (vKernelMid-i), yBandStart),
+				yEnd = std::min<unsigned>((i <= vKernelMid) ? image.Height() : ((image.Height()+vKernelMid>i) ? (image.Height()-i+vKernelMid) : 0), yBandEnd);
+			for(unsigned y=yStart;y<yEnd;++y) {
+				
+				const float *tempPtr = temp.ValuePtr(0, y+i-vKernelMid);
+				float *imagePtr = image.ValuePtr(0, y);
+				
+				unsigned x=0;
+				for(;x+4<image.Width();x += 4) {
+					
+					const __m128
+						imageVal = _mm_load_ps(imagePtr),
+						tempVal = _mm_load_ps(tempPtr);
+					
+					// *imagePtr += k * (*tempPtr);
+					_mm_store_ps(imagePtr, _mm_add_ps(imageVal, _mm_mul_ps(tempVal, k4)));
+					
+					tempPtr += 4;
+					imagePtr += 4;
+				}
+				for(;x<image.Width();++x) {
+					*imagePtr += k * (*tempPtr);
+					++tempPtr;
+					++imagePtr;
+				}
+			}
+		}
+	}
+	
+	/**
+	 * Horizontal box filter passes on the rows [yStart, yEnd) of the output, in place.
+	 */
+	void boxFilterRows(const FilterStep &step, size_t yStart, size_t yEnd)
+	{
+		const size_t width = step.output->Width();
+		std::vector<num_t> rowA(width), rowB(width);
+		for(size_t y=yStart;y!=yEnd;++y)
+		{
+			num_t *rowPtr = step.output->ValuePtr(0, y);
+			boxFilterRow(rowPtr, &rowA[0], width, step.radii[0]);
+			boxFilterRow(&rowA[0], &rowB[0], width, step.radii[1]);
+			boxFilterRow(&rowB[0], rowPtr, width, step.radii[2]);
+		}
+	}
+	
+	/**
+	 * Vertical box filter passes on the columns [xStart, xEnd), which alternate between
+	 * the output and the scratch image. The result ends up in the scratch image.
+	 */
+	void boxFilterColumnBand(const FilterStep &step, size_t xStart, size_t xEnd)
+	{
+		std::vector<double> sums;
+		boxFilterColumns(*step.output, *step.scratch, step.radii[0], xStart, xEnd, sums);
+		boxFilterColumns(*step.scratch, *step.output, step.radii[1], xStart, xEnd, sums);
+		boxFilterColumns(*step.output, *step.scratch, step.radii[2], xStart, xEnd, sums);
+	}
+	
+	/**
+	 * Divides the output by the input (the weights), or sets it to zero where the weight
+	 * is zero.
+	 */
+	void divideInRowsSSE(const FilterStep &step, size_t yStart, size_t yEnd)
+	{
+		const __m128 zero4 = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
+		
+		for(size_t y=yStart;y<yEnd;++y) {
+			float *leftHandPtr = step.output->ValuePtr(0, y);
+			const float *rightHandPtr = step.input->ValuePtr(0, y);
+			float *end = leftHandPtr + step.output->Width();
+			while(leftHandPtr < end)
+			{
+				__m128
+					l = _mm_load_ps(leftHandPtr),
+					r = _mm_load_ps(rightHandPtr);
+				__m128 conditionMask = _mm_cmpeq_ps(r, zero4);
+				_mm_store_ps(leftHandPtr, _mm_or_ps(
+					_mm_and_ps(conditionMask, zero4),
+					_mm_andnot_ps(conditionMask, _mm_div_ps(l, r))
+				));
+				leftHandPtr += 4;
+				rightHandPtr += 4;
+			}
+		}
+	}
+	
+	FilterStep makeStep(const Image2D *input, Image2D *output)
+	{
+		FilterStep step;
+		step.input = input;
+		step.mask = 0;
+		step.output = output;
+		step.scratch = 0;
+		step.kernel = 0;
+		step.kernelSize = 0;
+		step.radii = 0;
+		return step;
+	}
+}
+
 HighPassFilter::~HighPassFilter()
 {
 	delete[] _hKernel;
@@ -44,75 +424,38 @@ void HighPassFilter::applyLowPass(const Image2DPtr &image)
 void HighPassFilter::applyLowPassSSE(const Image2DPtr &image)
 {
 	Image2DPtr temp = Image2D::CreateZeroImagePtr(image->Width(), image->Height());
-	unsigned hKernelMid = _hWindowSize/2;
-	for(unsigned i=0; i<_hWindowSize; ++i) {
-		
-		const num_t k = _hKernel[i];
-		const __m128 k4 = _mm_set_ps(k, k, k, k);
-		unsigned
-			/* xStart is the first column to start writing to. Note that it might be larger
-			 * than the width. */
-			xStart = (i >= hKernelMid) ? 0 : (hKernelMid-i),
-			xEnd = (i <= hKernelMid) ? image->Width() : (image->Width()+hKernelMid > i ? (image->Width()-i+hKernelMid) : 0);
-		
-		for(unsigned y=0;y<image->Height();++y) {
-			
-			float *tempPtr = temp->ValuePtr(xStart, y);
-			const float *imagePtr = image->ValuePtr(xStart+i-hKernelMid, y);
-			
-			unsigned x = xStart;
-			for(;x+4<xEnd;x+=4) {
-				const __m128
-					imageVal = _mm_loadu_ps(imagePtr),
-					tempVal = _mm_loadu_ps(tempPtr);
-
-				// *tempPtr += k * (*imagePtr);
-				_mm_storeu_ps(tempPtr, _mm_add_ps(tempVal, _mm_mul_ps(imageVal, k4)));
-				
-				tempPtr += 4;
-				imagePtr += 4;
-			}
-			for(;x<xEnd;++x) {
-				*tempPtr += k * (*imagePtr);
-				++tempPtr;
-				++imagePtr;
-			}
-		}
-	}
+	FilterStep horizontal = makeStep(image.get(), temp.get());
+	horizontal.kernel = _hKernel;
+	horizontal.kernelSize = _hWindowSize;
+	FilterTask::InRows(convolveRowsSSE, horizontal);
 	
-	image->SetAll(0.0);
-	unsigned vKernelMid = _vWindowSize/2;
-	for(unsigned i=0; i<_vWindowSize; ++i) {
-		const num_t k = _vKernel[i];
-		const __m128 k4 = _mm_set_ps(k, k, k, k);
-		const unsigned
-			yStart = (i >= vKernelMid) ? 0 : (vKernelMid-i),
-			yEnd = (i <= vKernelMid) ? image->Height() : ((image->Height()+vKernelMid>i) ? (image->Height()-i+vKernelMid) : 0);
-		for(unsigned y=yStart;y<yEnd;++y) {
-			
-			const float *tempPtr = temp->ValuePtr(0, y+i-vKernelMid);
-			float *imagePtr = image->ValuePtr(0, y);
-			
-			unsigned x=0;
-			for(;x+4<image->Width();x += 4) {
-				
-				const __m128
-					imageVal = _mm_load_ps(imagePtr),
-					tempVal = _mm_load_ps(tempPtr);
-				
-				// *imagePtr += k * (*tempPtr);
-				_mm_store_ps(imagePtr, _mm_add_ps(imageVal, _mm_mul_ps(tempVal, k4)));
-				
-				tempPtr += 4;
-				imagePtr += 4;
-			}
-			for(;x<image->Width();++x) {
-				*imagePtr += k * (*tempPtr);
-				++tempPtr;
-				++imagePtr;
-			}
-		}
-	}
+	FilterStep vertical = makeStep(temp.get(), image.get());
+	vertical.kernel = _vKernel;
+	vertical.kernelSize = _vWindowSize;
+	FilterTask::InRows(convolveColumnsSSE, vertical);
+}
+
+void HighPassFilter::applyLowPassBoxFilter(const Image2DPtr &image)
+{
+	// The boxes are matched to the variance of the truncated kernels instead of to the
+	// sigma parameters, such that small windows still limit the smoothing (e.g., a window
+	// size of one disables it).
+	size_t hRadii[BoxPassCount], vRadii[BoxPassCount];
+	calculateBoxRadii(kernelVariance(_hKernel, _hWindowSize), hRadii);
+	calculateBoxRadii(kernelVariance(_vKernel, _vWindowSize), vRadii);
+	
+	// Horizontal passes are applied row by row in two row buffers per band
+	FilterStep horizontal = makeStep(image.get(), image.get());
+	horizontal.radii = hRadii;
+	FilterTask::InRows(boxFilterRows, horizontal);
+	
+	// Vertical passes alternate between the image and a temporary image
+	Image2DPtr temp = Image2D::CreateUnsetImagePtr(image->Width(), image->Height());
+	FilterStep vertical = makeStep(image.get(), image.get());
+	vertical.scratch = temp.get();
+	vertical.radii = vRadii;
+	FilterTask::InColumns(boxFilterColumnBand, vertical);
+	image->Swap(temp);
 }
 
 Image2DPtr HighPassFilter::ApplyHighPass(const Image2DCPtr &image, const Mask2DCPtr &mask)
@@ -124,13 +467,19 @@ Image2DPtr HighPassFilter::ApplyHighPass(const Image2DCPtr &image, const Mask2DC
 
 Image2DPtr HighPassFilter::ApplyLowPass(const Image2DCPtr &image, const Mask2DCPtr &mask)
 {
-	initializeKernel();
 	Image2DPtr
 		outputImage = Image2D::CreateUnsetImagePtr(image->Width(), image->Height()),
 		weights = Image2D::CreateUnsetImagePtr(image->Width(), image->Height());
 	setFlaggedValuesToZeroAndMakeWeightsSSE(image, outputImage, mask, weights);
-	applyLowPassSSE(outputImage);
-	applyLowPassSSE(weights);
+	initializeKernel();
+	if(_method == BoxFilterMethod)
+	{
+		applyLowPassBoxFilter(outputImage);
+		applyLowPassBoxFilter(weights);
+	} else {
+		applyLowPassSSE(outputImage);
+		applyLowPassSSE(weights);
+	}
 	elementWiseDivideSSE(outputImage, weights);
 	weights.reset();
 	return outputImage;
@@ -176,42 +525,10 @@ void HighPassFilter::setFlaggedValuesToZeroAndMakeWeights(const Image2DCPtr &inp
 
 void HighPassFilter::setFlaggedValuesToZeroAndMakeWeightsSSE(const Image2DCPtr &inputImage, const Image2DPtr &outputImage, const Mask2DCPtr &inputMask, const Image2DPtr &weightsOutput)
 {
-	const size_t width = inputImage->Width();
-	const __m128i zero4i = _mm_set_epi32(0, 0, 0, 0);
-	const __m128 zero4 = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
-	const __m128 one4 = _mm_set_ps(1.0, 1.0, 1.0, 1.0);
-	for(size_t y=0;y<inputImage->Height();++y)
-	{
-		const bool *rowPtr = inputMask->ValuePtr(0, y);
-		const float *inputPtr = inputImage->ValuePtr(0, y);
-		float *outputPtr = outputImage->ValuePtr(0, y);
-		float *weightsPtr = weightsOutput->ValuePtr(0, y);
-		const float *end = inputPtr + width;
-		while(inputPtr < end)
-		{
-			
-			// Assign each integer to one bool in the mask
-			// Convert false to 0xFFFFFFFF and true to 0
-			__m128 conditionMask = _mm_castsi128_ps(
-				_mm_cmpeq_epi32(_mm_set_epi32(rowPtr[3] || !isfinite(inputPtr[3]), rowPtr[2] || !isfinite(inputPtr[2]),
-																			rowPtr[1] || !isfinite(inputPtr[1]), rowPtr[0] || !isfinite(inputPtr[0])),
-												zero4i));
-			
-			_mm_store_ps(weightsPtr, _mm_or_ps(
-				_mm_and_ps(conditionMask, one4),
-				_mm_andnot_ps(conditionMask, zero4)
-			));
-			_mm_store_ps(outputPtr, _mm_or_ps(
-				_mm_and_ps(conditionMask, _mm_load_ps(inputPtr)),
-				_mm_andnot_ps(conditionMask, zero4)
-			));
-			
-			rowPtr += 4;
-			outputPtr += 4;
-			inputPtr += 4;
-			weightsPtr += 4;
-		}
-	}
+	FilterStep step = makeStep(inputImage.get(), outputImage.get());
+	step.mask = inputMask.get();
+	step.scratch = weightsOutput.get();
+	FilterTask::InRows(makeWeightsInRowsSSE, step);
 }
 
 void HighPassFilter::elementWiseDivide(const Image2DPtr &leftHand, const Image2DCPtr &rightHand)
@@ -228,25 +545,5 @@ void HighPassFilter::elementWiseDivide(const Image2DPtr &leftHand, const Image2D
 
 void HighPassFilter::elementWiseDivideSSE(const Image2DPtr &leftHand, const Image2DCPtr &rightHand)
 {
-	const __m128 zero4 = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
-	
-	for(unsigned y=0;y<leftHand->Height();++y) {
-		float *leftHandPtr = leftHand->ValuePtr(0, y);
-		const float *rightHandPtr = rightHand->ValuePtr(0, y);
-		float *end = leftHandPtr + leftHand->Width();
-		while(leftHandPtr < end)
-		{
-			__m128
-				l = _mm_load_ps(leftHandPtr),
-				r = _mm_load_ps(rightHandPtr);
-			__m128 conditionMask = _mm_cmpeq_ps(r, zero4);
-			_mm_store_ps(leftHandPtr, _mm_or_ps(
-				_mm_and_ps(conditionMask, zero4),
-				_mm_andnot_ps(conditionMask, _mm_div_ps(l, r))
-			));
-			leftHandPtr += 4;
-			rightHandPtr += 4;
-		}
-	}
+	FilterTask::InRows(divideInRowsSSE, makeStep(rightHand.get(), leftHand.get()));
 }
-
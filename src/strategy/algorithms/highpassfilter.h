@@ -11,10 +11,29 @@
 class HighPassFilter
 {
 	public:
+		/**
+		 * How the low-pass convolution is computed.
+		 */
+		enum Method {
+			/**
+			 * Convolve with the truncated Gaussian kernel. The cost per sample grows
+			 * linearly with the window sizes.
+			 */
+			GaussianKernelMethod,
+			/**
+			 * Approximate the Gaussian by three successive box filters in each direction,
+			 * of which the widths are chosen to match the variance of the truncated
+			 * Gaussian kernel. Each box filter is a running sum, hence the cost per sample
+			 * does not depend on the size of the kernel.
+			 */
+			BoxFilterMethod
+		};
+		
 		/**
 		 * Construct a new high pass filter with default parameters
 		 */
 		HighPassFilter() :
+		_method(GaussianKernelMethod),
 		_hKernel(0),
 		_hWindowSize(22),
 		_hKernelSigmaSq(7.5),
@@ -137,6 +156,24 @@ class HighPassFilter
 			_vKernel = 0;
 			_vKernelSigmaSq = newSigmaSquared;
 		}
+		
+		/**
+		 * The method used for the low-pass convolution.
+		 * @see Method
+		 */
+		enum Method Method() const
+		{
+			return _method;
+		}
+		
+		/**
+		 * Set the method used for the low-pass convolution.
+		 * @see Method
+		 */
+		void SetMethod(enum Method method)
+		{
+			_method = method;
+		}
 	private:
 		/**
 		 * Applies the low-pass convolution. Kernel has to be initialized
@@ -145,6 +182,13 @@ class HighPassFilter
 		void applyLowPass(const Image2DPtr &image);
 		void applyLowPassSSE(const Image2DPtr &image);
 		
+		/**
+		 * Applies the box filter approximation of the low-pass convolution. Kernel has
+		 * to be initialized before calling, because the box widths are derived from it.
+		 * @see BoxFilterMethod
+		 */
+		void applyLowPassBoxFilter(const Image2DPtr &image);
+		
 		void initializeKernel();
 		
 		void setFlaggedValuesToZeroAndMakeWeights(const Image2DCPtr &inputImage, const Image2DPtr &outputImage, const Mask2DCPtr &inputMask, const Image2DPtr &weightsOutput);
@@ -153,6 +197,8 @@ class HighPassFilter
 		void elementWiseDivide(const Image2DPtr &leftHand, const Image2DCPtr &rightHand);
 		void elementWiseDivideSSE(const Image2DPtr &leftHand, const Image2DCPtr &rightHand);
 		
+		enum Method _method;
+		
 		/**
 		 * The values of the kernel used in the convolution. This kernel is applied horizontally.
 		 */
@@ -18,6 +18,7 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 #include "morphology.h"
+#include "connectedcomponents.h"
 #include "statisticalflagger.h"
 
 #include "../../util/aologger.h"
@@ -38,24 +39,30 @@ void Morphology::SegmentByMaxLength(Mask2DCPtr mask, SegmentedImagePtr output)
 	
 	calculateOpenings(mask, lengthWidthValues);
 
+	// A segment is a four-connected area of flagged samples that are all part of a
+	// horizontal (positive value) or all of a vertical (negative value) opening.
+	signed char **classes = new signed char*[mask->Height()];
 	for(size_t y=0;y<mask->Height();++y)
 	{
-		for(size_t x=0;x<mask->Width();++x)
-			output->SetValue(x,y,0);
-	}
-	for(size_t y=0;y<mask->Height();++y)
-	{
+		classes[y] = new signed char[mask->Width()];
 		for(size_t x=0;x<mask->Width();++x)
 		{
-			if(mask->Value(x, y) && output->Value(x,y) == 0)
-			{
-				floodFill(mask, output, lengthWidthValues, x, y, output->NewSegmentValue());
-			}
+			if(!mask->Value(x, y))
+				classes[y][x] = 0;
+			else
+				classes[y][x] = lengthWidthValues[y][x] > 0 ? 1 : -1;
 		}
 	}
+	ConnectedComponents components(false);
+	components.Label(classes, mask->Width(), mask->Height());
+	components.WriteSegments(*output);
 		
 	for(size_t y=0;y<mask->Height();++y)
+	{
+		delete[] classes[y];
 		delete[] lengthWidthValues[y];
+	}
+	delete[] classes;
 	delete[] lengthWidthValues;
 }
 
@@ -254,64 +261,8 @@ void Morphology::calculateOpenings(Mask2DCPtr mask, Mask2DPtr *values, int **hCo
 	}
 }
 
-struct MorphologyPoint2D { size_t x, y; };
 struct MorphologyPoint3D { size_t x, y, z; };
 
-void Morphology::floodFill(Mask2DCPtr mask, SegmentedImagePtr output, const int *const *lengthWidthValues, size_t x, size_t y, size_t value)
-{
-	std::stack<MorphologyPoint2D> points;
-	MorphologyPoint2D startPoint;
-	startPoint.x = x;
-	startPoint.y = y;
-	points.push(startPoint);
-	do {
-		MorphologyPoint2D p = points.top();
-		points.pop();
-		output->SetValue(p.x, p.y, value);
-		int z = lengthWidthValues[p.y][p.x];
-		if(p.x > 0 && output->Value(p.x-1, p.y) == 0 && mask->Value(p.x-1,p.y))
-		{
-			int zl = lengthWidthValues[p.y][p.x-1];
-			if((zl > 0 && z > 0) || (zl < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x-1; newP.y = p.y;
-				points.push(newP);
-			}
-		}
-		if(p.x < mask->Width()-1 && output->Value(p.x+1, p.y)==0 && mask->Value(p.x+1,p.y))
-		{
-			int zr = lengthWidthValues[p.y][p.x+1];
-			if((zr > 0 && z > 0) || (zr < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x+1; newP.y = p.y;
-				points.push(newP);
-			}
-		}
-		if(p.y > 0 && output->Value(p.x, p.y-1)==0 && mask->Value(p.x,p.y-1))
-		{
-			int zt = lengthWidthValues[p.y-1][p.x];
-			if((zt > 0 && z > 0) || (zt < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x; newP.y = p.y-1;
-				points.push(newP);
-			}
-		}
-		if(p.y < mask->Height()-1 && output->Value(p.x, p.y+1)==0 && mask->Value(p.x,p.y+1))
-		{
-			int zb = lengthWidthValues[p.y+1][p.x];
-			if((zb > 0 && z > 0) || (zb < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x; newP.y = p.y+1;
-				points.push(newP);
-			}
-		}
-	} while(points.size() != 0);
-}
-
 void Morphology::floodFill(Mask2DCPtr mask, SegmentedImagePtr output, Mask2DPtr *matrices, size_t x, size_t y, size_t z, size_t value, int **hCounts, int **vCounts)
 {
 	std::stack<MorphologyPoint3D> points;
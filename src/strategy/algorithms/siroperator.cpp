@@ -0,0 +1,198 @@
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "../../msio/samplepool.h"
+
+#include "../../util/bandthreadpool.h"
+
+#include "siroperator.h"
+
+namespace {
+	/**
+	 * Number of columns that are dilated together: four SSE registers of four floats.
+	 */
+	const size_t BlockWidth = 16;
+
+	/**
+	 * Dilates the columns [x, x+count) of the mask with plain scalar code, for the
+	 * columns at the right edge that do not fill a block. The scratch buffers use the same
+	 * layout as for a full block.
+	 */
+	void operateColumnsScalar(Mask2D &mask, size_t x, size_t count, num_t eta, num_t *w, num_t *minW)
+	{
+		const size_t height = mask.Height();
+		const num_t
+			flaggedValue = eta,
+			unflaggedValue = eta - 1.0;
+		for(size_t i=0;i!=count;++i)
+		{
+			w[i] = 0.0;
+			minW[i] = 0.0;
+		}
+		for(size_t y=0;y!=height;++y)
+		{
+			const bool *row = mask.ValuePtr(x, y);
+			const num_t *wPrev = &w[y * BlockWidth];
+			num_t
+				*wCur = &w[(y+1) * BlockWidth],
+				*minCur = &minW[y * BlockWidth];
+			for(size_t i=0;i!=count;++i)
+			{
+				wCur[i] = wPrev[i] + (row[i] ? flaggedValue : unflaggedValue);
+				if(y+1 != height)
+					minCur[i + BlockWidth] = wCur[i] < minCur[i] ? wCur[i] : minCur[i];
+			}
+		}
+		num_t maxW[BlockWidth];
+		for(size_t i=0;i!=count;++i)
+			maxW[i] = w[height * BlockWidth + i];
+		for(size_t y=height;y!=0;)
+		{
+			--y;
+			bool *row = mask.ValuePtr(x, y);
+			const num_t
+				*wCur = &w[y * BlockWidth],
+				*minCur = &minW[y * BlockWidth];
+			for(size_t i=0;i!=count;++i)
+			{
+				row[i] = (maxW[i] - minCur[i] >= 0.0);
+				if(wCur[i] > maxW[i])
+					maxW[i] = wCur[i];
+			}
+		}
+	}
+}
+
+/**
+ * Dilates a band of rows or columns. The dilation of a row or column only depends on the
+ * row or column itself, so no halo is needed.
+ */
+class SIROperator::BandTask : public BandThreadPool::Task
+{
+	public:
+		BandTask(Mask2D &mask, num_t eta, bool horizontally) :
+			_mask(mask), _eta(eta), _horizontally(horizontally)
+		{ }
+
+		virtual void Run(size_t start, size_t end)
+		{
+			if(_horizontally)
+				operateHorizontally<Mask2D>(_mask, _eta, start, end);
+			else
+				operateVertically(_mask, _eta, start, end);
+		}
+	private:
+		Mask2D &_mask;
+		num_t _eta;
+		bool _horizontally;
+};
+
+void SIROperator::operateInBands(Mask2D &mask, num_t eta, bool horizontally)
+{
+	BandTask task(mask, eta, horizontally);
+	if(horizontally)
+		BandThreadPool::Run(task, mask.Height(), 65536 / (mask.Width() + 1) + 1);
+	else
+		// Bands of whole blocks, so that only the last band has a scalar remainder
+		BandThreadPool::Run(task, mask.Width(), 65536 / (mask.Height() + 1) + BlockWidth, BlockWidth);
+}
+
+/**
+ * The SSE version of the vertical SIR operator.
+ *
+ * Since the mask is stored row by row, 16 adjacent columns of a row are 16 consecutive
+ * bytes. These are expanded to four registers of four lanes that select η or η-1, and all
+ * 16 columns walk down the rows together, so that no transposition of the mask is needed.
+ * For each lane, the first pass stores the prefix sums W(y) and their running minima.
+ * The second pass walks back up, keeps the running maximum of W over the rows below y
+ * and writes the flag directly into the mask. The lanes perform the same float operations
+ * in the same order as Operate(), hence the results are identical.
+ *
+ * The scratch buffers hold (2 height + 1) x 16 floats and come from the SamplePool, so
+ * that the calls for consecutive baselines of a thread reuse the same memory.
+ */
+void SIROperator::operateVertically(Mask2D &mask, num_t eta, size_t xStart, size_t xEnd)
+{
+	const size_t height = mask.Height();
+	if(xStart == xEnd || height == 0)
+		return;
+
+	const size_t wSize = (height + 1) * BlockWidth, minSize = height * BlockWidth;
+	num_t *scratch = static_cast<num_t*>(SamplePool::Allocate((wSize + minSize) * sizeof(num_t)));
+	num_t
+		*w = scratch,
+		*minW = scratch + wSize;
+
+	const __m128
+		zero4 = _mm_setzero_ps(),
+		flagged4 = _mm_set1_ps(eta),
+		unflagged4 = _mm_set1_ps(eta - 1.0);
+	const __m128i
+		zero16 = _mm_setzero_si128(),
+		ones16 = _mm_set1_epi8(1);
+
+	const size_t blockEnd = xEnd - (xEnd - xStart) % BlockWidth;
+	for(size_t x=xStart;x!=blockEnd;x+=BlockWidth)
+	{
+		// First pass: W(y+1) = W(y) + values[y] and the minimum of W(0) ... W(y)
+		__m128 sum[4] = { zero4, zero4, zero4, zero4 };
+		__m128 minimum[4] = { zero4, zero4, zero4, zero4 };
+		for(size_t i=0;i!=4;++i)
+			_mm_store_ps(&w[i*4], zero4);
+		for(size_t y=0;y!=height;++y)
+		{
+			const __m128i flags =
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask.ValuePtr(x, y)));
+			const __m128i
+				low = _mm_unpacklo_epi8(flags, zero16),
+				high = _mm_unpackhi_epi8(flags, zero16);
+			const __m128i lanes[4] = {
+				_mm_unpacklo_epi16(low, zero16), _mm_unpackhi_epi16(low, zero16),
+				_mm_unpacklo_epi16(high, zero16), _mm_unpackhi_epi16(high, zero16)
+			};
+			num_t
+				*wRow = &w[(y+1) * BlockWidth],
+				*minRow = &minW[y * BlockWidth];
+			for(size_t i=0;i!=4;++i)
+			{
+				const __m128 isFlagged = _mm_castsi128_ps(_mm_cmpgt_epi32(lanes[i], zero16));
+				const __m128 values = _mm_or_ps(
+					_mm_and_ps(isFlagged, flagged4),
+					_mm_andnot_ps(isFlagged, unflagged4));
+				_mm_store_ps(&minRow[i*4], minimum[i]);
+				sum[i] = _mm_add_ps(sum[i], values);
+				_mm_store_ps(&wRow[i*4], sum[i]);
+				minimum[i] = _mm_min_ps(minimum[i], sum[i]);
+			}
+		}
+
+		// Second pass: flag y when max W(y+1) ... W(N) - min W(0) ... W(y) >= 0
+		__m128 maximum[4];
+		for(size_t i=0;i!=4;++i)
+			maximum[i] = _mm_load_ps(&w[height * BlockWidth + i*4]);
+		for(size_t y=height;y!=0;)
+		{
+			--y;
+			const num_t
+				*wRow = &w[y * BlockWidth],
+				*minRow = &minW[y * BlockWidth];
+			__m128i result[4];
+			for(size_t i=0;i!=4;++i)
+			{
+				const __m128 difference = _mm_sub_ps(maximum[i], _mm_load_ps(&minRow[i*4]));
+				result[i] = _mm_castps_si128(_mm_cmpge_ps(difference, zero4));
+				maximum[i] = _mm_max_ps(maximum[i], _mm_load_ps(&wRow[i*4]));
+			}
+			const __m128i packed = _mm_packs_epi16(
+				_mm_packs_epi32(result[0], result[1]),
+				_mm_packs_epi32(result[2], result[3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(mask.ValuePtr(x, y)),
+				_mm_and_si128(packed, ones16));
+		}
+	}
+
+	if(blockEnd != xEnd)
+		operateColumnsScalar(mask, blockEnd, xEnd - blockEnd, eta, w, minW);
+
+	SamplePool::Free(scratch, (wSize + minSize) * sizeof(num_t));
+}
@@ -4,7 +4,6 @@
 
 #include "../../msio/mask2d.h"
 #include "../../msio/types.h"
-#include "../../msio/xyswappedmask2d.h"
 
 /**
  * This class contains functions that implement an algorithm to dilate
@@ -133,35 +132,53 @@ class SIROperator
 		 */
 		static void OperateHorizontally(Mask2DPtr &mask, num_t eta)
 		{
-			operateHorizontally<Mask2D>(*mask, eta);
+			operateInBands(*mask, eta, true);
 		}
 		
 		/**
 		 * Performs a vertical dilation directly on a mask. Algorithm is equal to Dilate().
 		 * 
+		 * Instead of dilating one column at a time, 16 adjacent columns are dilated
+		 * together with SSE instructions, walking down the rows of the mask. The result is
+		 * identical to calling Operate() on each column.
+		 * 
 		 * @param [in,out] mask The input flag mask to be dilated.
 		 * @param [in] eta The η parameter that specifies the minimum number of good data
 		 * that any subsequence should have.
 		 */
 		static void OperateVertically(Mask2DPtr mask, num_t eta)
 		{
-			XYSwappedMask2D swappedMask(*mask);
-			operateHorizontally<XYSwappedMask2D>(swappedMask, eta);
+			operateInBands(*mask, eta, false);
 		}
 		
 	private:
 		SIROperator() { }
 
+		class BandTask;
+
 		/**
-		 * Performs a horizontal dilation directly on a mask. Algorithm is equal to Dilate().
-		 * This is the implementation.
+		 * Dilates the rows or the columns of the mask, which are independent, in bands
+		 * with the threads of the BandThreadPool.
+		 */
+		static void operateInBands(Mask2D &mask, num_t eta, bool horizontally);
+
+		/**
+		 * Performs a vertical dilation of the columns [xStart, xEnd) of the mask.
+		 */
+		static void operateVertically(Mask2D &mask, num_t eta, size_t xStart, size_t xEnd);
+
+		/**
+		 * Performs a horizontal dilation of the rows [rowStart, rowEnd) of the mask.
+		 * Algorithm is equal to Dilate(). This is the implementation.
 		 * 
 		 * @param [in,out] mask The input flag mask to be dilated.
 		 * @param [in] eta The η parameter that specifies the minimum number of good data
 		 * that any subsequence should have.
+		 * @param [in] rowStart First row to dilate.
+		 * @param [in] rowEnd Row after the last row to dilate.
 		 */
 		template<typename MaskLike>
-		static void operateHorizontally(MaskLike &mask, num_t eta)
+		static void operateHorizontally(MaskLike &mask, num_t eta, size_t rowStart, size_t rowEnd)
 		{
 			const unsigned
 				width = mask.Width(),
@@ -173,7 +190,7 @@ class SIROperator
 				*minIndices = new unsigned[wSize],
 				*maxIndices = new unsigned[wSize];
 			
-			for(unsigned row=0;row<mask.Height();++row)
+			for(unsigned row=rowStart;row<rowEnd;++row)
 			{
 				for(unsigned i=0 ; i<width ; ++i)
 				{
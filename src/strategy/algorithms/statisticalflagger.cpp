@@ -19,6 +19,8 @@
  ***************************************************************************/
 #include "statisticalflagger.h"
 
+#include "../../msio/bitmask2d.h"
+
 StatisticalFlagger::StatisticalFlagger()
 {
 }
@@ -78,43 +80,10 @@ void StatisticalFlagger::DilateFlagsHorizontally(Mask2DPtr mask, size_t timeSize
 {
 	if(timeSize != 0)
 	{
-		Mask2DPtr destination = Mask2D::CreateUnsetMaskPtr(mask->Width(), mask->Height());
-		if(timeSize > mask->Width()) timeSize = mask->Width();
-		const int intSize = (int) timeSize;
-		
-		for(size_t y=0;y<mask->Height();++y)
-		{
-			int dist = intSize + 1;
-			for(size_t x=0;x<timeSize;++x)
-			{
-				if(mask->Value(x, y))
-					dist = - intSize;
-				dist++;
-			}
-			for(size_t x=0;x<mask->Width() - timeSize;++x)
-			{
-				if(mask->Value(x + timeSize, y))
-					dist = -intSize;
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
-			}
-			for(size_t x=mask->Width() - timeSize;x<mask->Width();++x)
-			{
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
-			}
-		}
-		mask->Swap(destination);
+		BitMask2D *packed = BitMask2D::CreateFromMask(*mask);
+		packed->DilateHorizontally(timeSize);
+		packed->CopyTo(*mask);
+		delete packed;
 	}
 }
 
@@ -122,43 +91,10 @@ void StatisticalFlagger::DilateFlagsVertically(Mask2DPtr mask, size_t frequencyS
 {
 	if(frequencySize != 0)
 	{
-		Mask2DPtr destination = Mask2D::CreateUnsetMaskPtr(mask->Width(), mask->Height());
-		if(frequencySize > mask->Height()) frequencySize = mask->Height();
-		const int intSize = (int) frequencySize;
-		
-		for(size_t x=0;x<mask->Width();++x)
-		{
-			int dist = intSize + 1;
-			for(size_t y=0;y<frequencySize;++y)
-			{
-				if(mask->Value(x, y))
-					dist = - intSize;
-				dist++;
-			}
-			for(size_t y=0;y<mask->Height() - frequencySize;++y)
-			{
-				if(mask->Value(x, y + frequencySize))
-					dist = -intSize;
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
-			}
-			for(size_t y=mask->Height() - frequencySize;y<mask->Height();++y)
-			{
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
-			}
-		}
-		mask->Swap(destination);
+		BitMask2D *packed = BitMask2D::CreateFromMask(*mask);
+		packed->DilateVertically(frequencySize);
+		packed->CopyTo(*mask);
+		delete packed;
 	}
 }
 
@@ -29,6 +29,7 @@
 #include "localfitmethod.h"
 #include "thresholdmitigater.h"
 #include "thresholdtools.h"
+#include "tiledsumthreshold.h"
 
 ThresholdConfig::ThresholdConfig() :
 	_method(SumThreshold), _distribution(Gaussian), _verbose(false), _expFactor(0.0L), _fitMethod(0), _minConnectedSamples(1)
@@ -241,22 +242,25 @@ void ThresholdConfig::Execute(Image2DCPtr image, Mask2DPtr mask, bool additive,
 
 	size_t operationCount = _horizontalOperations.size() > _verticalOperations.size() ?
 		_horizontalOperations.size() : _verticalOperations.size();
-	for(unsigned i=0;i<operationCount;++i) {
-		switch(_method) {
-			case SumThreshold:
-			
+	switch(_method) {
+		case SumThreshold: {
+		TiledSumThreshold sumThreshold(image);
+		for(unsigned i=0;i<operationCount;++i) {
 			if(i < _horizontalOperations.size())
 			{
 				if(_verbose)
 					std::cout << "Performing SumThreshold with length " << _horizontalOperations[i].length 
 						<< ", threshold " << _horizontalOperations[i].threshold*factor << "..." << std::endl;
-				ThresholdMitigater::HorizontalSumThresholdLarge(image, mask, _horizontalOperations[i].length, _horizontalOperations[i].threshold*factor);
+				sumThreshold.AddHorizontalOperation(_horizontalOperations[i].length, _horizontalOperations[i].threshold*factor);
 			}
 			
 			if(i < _verticalOperations.size())
-				ThresholdMitigater::VerticalSumThresholdLarge(image, mask, _verticalOperations[i].length, _verticalOperations[i].threshold*factor);
-			break;
-			case VarThreshold:
+				sumThreshold.AddVerticalOperation(_verticalOperations[i].length, _verticalOperations[i].threshold*factor);
+		}
+		sumThreshold.Execute(mask);
+		} break;
+		case VarThreshold:
+		for(unsigned i=0;i<operationCount;++i) {
 			if(i < _horizontalOperations.size())
 			{
 				if(_verbose)
@@ -266,8 +270,8 @@ void ThresholdConfig::Execute(Image2DCPtr image, Mask2DPtr mask, bool additive,
 			}
 			if(i < _verticalOperations.size())
 				ThresholdMitigater::HorizontalVarThreshold(image, mask, _verticalOperations[i].length, _verticalOperations[i].threshold*factor);
-			break;
 		}
+		break;
 	}
 
 	if(_minConnectedSamples > 1)
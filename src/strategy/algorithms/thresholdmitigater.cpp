@@ -21,6 +21,7 @@
 
 #include "thresholdmitigater.h"
 #include "thresholdtools.h"
+#include "tiledsumthreshold.h"
 
 template<size_t Length>
 void ThresholdMitigater::HorizontalSumThreshold(Image2DCPtr input, Mask2DPtr mask, num_t threshold)
@@ -239,6 +240,54 @@ void ThresholdMitigater::HorizontalSumThresholdLargeSSE(Image2DCPtr input, Mask2
 	}	
 }
 
+enum ThresholdMitigater::Implementation ThresholdMitigater::BestImplementation()
+{
+	static const enum Implementation best = determineBestImplementation();
+	return best;
+}
+
+enum ThresholdMitigater::Implementation ThresholdMitigater::determineBestImplementation()
+{
+#ifdef HAVE_AVX2
+	__builtin_cpu_init();
+#ifdef HAVE_AVX512
+	if(__builtin_cpu_supports("avx512f"))
+		return AVX512Implementation;
+#endif
+	if(__builtin_cpu_supports("avx2"))
+		return AVX2Implementation;
+#endif
+	return SSEImplementation;
+}
+
+void ThresholdMitigater::VerticalSumThresholdLargeAVX2(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
+{
+	TiledSumThreshold sumThreshold(input, AVX2Implementation);
+	sumThreshold.AddVerticalOperation(length, threshold);
+	sumThreshold.Execute(mask);
+}
+
+void ThresholdMitigater::HorizontalSumThresholdLargeAVX2(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
+{
+	TiledSumThreshold sumThreshold(input, AVX2Implementation);
+	sumThreshold.AddHorizontalOperation(length, threshold);
+	sumThreshold.Execute(mask);
+}
+
+void ThresholdMitigater::VerticalSumThresholdLargeAVX512(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
+{
+	TiledSumThreshold sumThreshold(input, AVX512Implementation);
+	sumThreshold.AddVerticalOperation(length, threshold);
+	sumThreshold.Execute(mask);
+}
+
+void ThresholdMitigater::HorizontalSumThresholdLargeAVX512(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
+{
+	TiledSumThreshold sumThreshold(input, AVX512Implementation);
+	sumThreshold.AddHorizontalOperation(length, threshold);
+	sumThreshold.Execute(mask);
+}
+
 void ThresholdMitigater::HorizontalVarThreshold(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
 {
 	size_t width = input->Width()-length+1;
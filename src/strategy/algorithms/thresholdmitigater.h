@@ -65,14 +65,27 @@ class ThresholdMitigater{
 			VerticalSumThresholdLarge<Length>(input, mask, vThreshold);
 		}
 		
+		/**
+		 * The available implementations of the SumThreshold kernels. The SSE implementation
+		 * is always available, because SSE2 is required to compile.
+		 */
+		enum Implementation { ReferenceImplementation, SSEImplementation, AVX2Implementation, AVX512Implementation };
+		
+		/**
+		 * Returns the fastest implementation that was compiled in and is supported by the
+		 * processor. This is determined once with CPUID and then cached.
+		 */
+		static enum Implementation BestImplementation();
+		
 		static void VerticalSumThresholdLarge(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
 		{
-			VerticalSumThresholdLargeSSE(input, mask, length, threshold);
-			
-			// We could/should check maybe availability of SSE here. If no SSE is
-			// available, we should call:
-			
-			// VerticalSumThresholdLargeReference(input, mask, length, threshold);
+			switch(BestImplementation())
+			{
+				case ReferenceImplementation: VerticalSumThresholdLargeReference(input, mask, length, threshold); break;
+				case SSEImplementation: VerticalSumThresholdLargeSSE(input, mask, length, threshold); break;
+				case AVX2Implementation: VerticalSumThresholdLargeAVX2(input, mask, length, threshold); break;
+				case AVX512Implementation: VerticalSumThresholdLargeAVX512(input, mask, length, threshold); break;
+			}
 		}
 		
 		static void VerticalSumThresholdLargeReference(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
@@ -81,8 +94,39 @@ class ThresholdMitigater{
 		
 		static void HorizontalSumThresholdLarge(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold)
 		{
-			HorizontalSumThresholdLargeSSE(input, mask, length, threshold);
+			switch(BestImplementation())
+			{
+				case ReferenceImplementation: HorizontalSumThresholdLargeReference(input, mask, length, threshold); break;
+				case SSEImplementation: HorizontalSumThresholdLargeSSE(input, mask, length, threshold); break;
+				case AVX2Implementation: HorizontalSumThresholdLargeAVX2(input, mask, length, threshold); break;
+				case AVX512Implementation: HorizontalSumThresholdLargeAVX512(input, mask, length, threshold); break;
+			}
 		}
+		
+		/**
+		 * AVX2 version that processes 8 columns at a time, using TiledSumThreshold. Falls
+		 * back to the SSE version when the AVX2 kernels were not compiled in; the
+		 * caller should check the processor supports AVX2.
+		 */
+		static void VerticalSumThresholdLargeAVX2(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
+		
+		/**
+		 * AVX2 version that processes 8 rows at a time, by transposing tiles of 8 rows.
+		 * @see VerticalSumThresholdLargeAVX2()
+		 */
+		static void HorizontalSumThresholdLargeAVX2(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
+		
+		/**
+		 * AVX-512 version that processes 16 columns at a time. Falls back to the AVX2 version
+		 * when the AVX-512 kernels were not compiled in.
+		 */
+		static void VerticalSumThresholdLargeAVX512(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
+		
+		/**
+		 * AVX-512 version that processes tiles of 16 rows.
+		 * @see VerticalSumThresholdLargeAVX512()
+		 */
+		static void HorizontalSumThresholdLargeAVX512(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
 
 		static void VarThreshold(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
 		
@@ -91,6 +135,8 @@ class ThresholdMitigater{
 		static void VerticalVarThreshold(Image2DCPtr input, Mask2DPtr mask, size_t length, num_t threshold);
 	private:
 		ThresholdMitigater() { }
+		
+		static enum Implementation determineBestImplementation();
 };
 
 #endif
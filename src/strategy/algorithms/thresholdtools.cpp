@@ -17,12 +17,280 @@
  *   Free Software Foundation, Inc.,                                       *
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
+#include <algorithm>
+#include <cstring>
 #include <deque>
 
+#include "../../msio/samplepool.h"
+
+#include "../../util/bandthreadpool.h"
 #include "../../util/rng.h"
 
+#include "connectedcomponents.h"
 #include "thresholdtools.h"
 
+namespace {
+	/**
+	 * Scratch buffer for the selection of the winsorization limits. The block comes from
+	 * the SamplePool, so that the repeated calls of a thread (one per SumThreshold
+	 * iteration) reuse the same memory instead of allocating it on the heap.
+	 */
+	class ScratchBuffer
+	{
+		public:
+			ScratchBuffer(size_t size) :
+				_data(static_cast<num_t*>(SamplePool::Allocate(size * sizeof(num_t)))),
+				_size(size)
+			{ }
+			~ScratchBuffer()
+			{
+				SamplePool::Free(_data, _size * sizeof(num_t));
+			}
+			num_t *Data() const { return _data; }
+		private:
+			ScratchBuffer(const ScratchBuffer &) { }
+			void operator=(const ScratchBuffer &) { }
+			
+			num_t *_data;
+			size_t _size;
+	};
+	
+	/**
+	 * Minimum number of samples per band when the statistics of a single image are
+	 * calculated with several threads.
+	 */
+	const size_t MinBandSamples = 65536;
+	
+	size_t countUnflaggedRows(const Image2D &image, const Mask2D &mask, size_t yStart, size_t yEnd)
+	{
+		size_t unflaggedCount = 0;
+		for(size_t y=yStart;y<yEnd;++y)
+		{
+			const num_t *values = image.ValuePtr(0, y);
+			const bool *flags = mask.ValuePtr(0, y);
+			for(size_t x=0;x<image.Width();++x)
+				unflaggedCount += (!flags[x] && std::isfinite(values[x]));
+		}
+		return unflaggedCount;
+	}
+	
+	size_t copyUnflaggedRows(const Image2D &image, const Mask2D &mask, size_t yStart, size_t yEnd, num_t *dest)
+	{
+		size_t unflaggedCount = 0;
+		for(size_t y=yStart;y<yEnd;++y)
+		{
+			const num_t *values = image.ValuePtr(0, y);
+			const bool *flags = mask.ValuePtr(0, y);
+			for(size_t x=0;x<image.Width();++x)
+			{
+				if(!flags[x] && std::isfinite(values[x]))
+				{
+					dest[unflaggedCount] = values[x];
+					++unflaggedCount;
+				}
+			}
+		}
+		return unflaggedCount;
+	}
+	
+	/**
+	 * Copies the unflagged values of an image with several threads. The rows are divided
+	 * into chunks; the first run counts the values of each chunk and the second run copies
+	 * each chunk to the position after the values of the chunks before it. The values
+	 * therefore end up in the same order as with a single thread.
+	 */
+	class CopyUnflaggedTask : public BandThreadPool::Task
+	{
+		public:
+			CopyUnflaggedTask(const Image2D &image, const Mask2D &mask, num_t *dest, size_t chunkCount) :
+				_image(image), _mask(mask), _dest(dest), _chunkCount(chunkCount), _offsets(chunkCount + 1, 0), _copying(false)
+			{ }
+			
+			virtual void Run(size_t start, size_t end)
+			{
+				for(size_t chunk=start;chunk!=end;++chunk)
+				{
+					const size_t
+						yStart = _image.Height() * chunk / _chunkCount,
+						yEnd = _image.Height() * (chunk + 1) / _chunkCount;
+					if(_copying)
+						copyUnflaggedRows(_image, _mask, yStart, yEnd, _dest + _offsets[chunk]);
+					else
+						_offsets[chunk + 1] = countUnflaggedRows(_image, _mask, yStart, yEnd);
+				}
+			}
+			
+			/**
+			 * Turns the counts into offsets and returns the total count.
+			 */
+			size_t StartCopying()
+			{
+				for(size_t chunk=0;chunk!=_chunkCount;++chunk)
+					_offsets[chunk + 1] += _offsets[chunk];
+				_copying = true;
+				return _offsets[_chunkCount];
+			}
+		private:
+			const Image2D &_image;
+			const Mask2D &_mask;
+			num_t *_dest;
+			size_t _chunkCount;
+			std::vector<size_t> _offsets;
+			bool _copying;
+	};
+	
+	size_t copyUnflagged(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t *dest)
+	{
+		const size_t chunkCount = std::min(
+			BandThreadPool::BandCount(image->Width() * image->Height(), MinBandSamples), image->Height());
+		if(chunkCount <= 1)
+			return copyUnflaggedRows(*image, *mask, 0, image->Height(), dest);
+		CopyUnflaggedTask task(*image, *mask, dest, chunkCount);
+		BandThreadPool::Run(task, chunkCount, 1);
+		const size_t unflaggedCount = task.StartCopying();
+		BandThreadPool::Run(task, chunkCount, 1);
+		return unflaggedCount;
+	}
+	
+	/**
+	 * Counts the values below lowLimit and copies the values in [lowLimit, highLimit] to
+	 * band, in the order of the data. Written without branches, since whether a value is
+	 * below or inside the range is unpredictable. The unused write after the last value
+	 * inside the range stays within [band, band + size).
+	 */
+	void partitionRange(const num_t *data, size_t size, num_t lowLimit, num_t highLimit, num_t *band, size_t &belowCount, size_t &bandCount)
+	{
+		belowCount = 0;
+		bandCount = 0;
+		for(size_t i=0;i<size;++i)
+		{
+			const num_t value = data[i];
+			belowCount += (value < lowLimit);
+			band[bandCount] = value;
+			bandCount += (value >= lowLimit) & (value <= highLimit);
+		}
+	}
+	
+	/**
+	 * Runs partitionRange() on chunks of the data with several threads. Each chunk writes
+	 * its values at the same offset in the band buffer as in the data, after which the
+	 * chunks are moved together. The result is the same as for a single pass.
+	 */
+	class PartitionTask : public BandThreadPool::Task
+	{
+		public:
+			PartitionTask(const num_t *data, size_t size, num_t lowLimit, num_t highLimit, num_t *band, size_t chunkCount) :
+				_data(data), _size(size), _lowLimit(lowLimit), _highLimit(highLimit), _band(band), _chunkCount(chunkCount),
+				_belowCounts(chunkCount), _bandCounts(chunkCount)
+			{ }
+			
+			virtual void Run(size_t start, size_t end)
+			{
+				for(size_t chunk=start;chunk!=end;++chunk)
+				{
+					const size_t chunkStart = chunkBegin(chunk);
+					partitionRange(_data + chunkStart, chunkBegin(chunk + 1) - chunkStart, _lowLimit, _highLimit,
+						_band + chunkStart, _belowCounts[chunk], _bandCounts[chunk]);
+				}
+			}
+			
+			void Finish(size_t &belowCount, size_t &bandCount)
+			{
+				belowCount = 0;
+				bandCount = 0;
+				for(size_t chunk=0;chunk!=_chunkCount;++chunk)
+				{
+					belowCount += _belowCounts[chunk];
+					memmove(_band + bandCount, _band + chunkBegin(chunk), _bandCounts[chunk] * sizeof(num_t));
+					bandCount += _bandCounts[chunk];
+				}
+			}
+		private:
+			size_t chunkBegin(size_t chunk) const { return _size * chunk / _chunkCount; }
+			
+			const num_t *_data;
+			size_t _size;
+			num_t _lowLimit, _highLimit;
+			num_t *_band;
+			size_t _chunkCount;
+			std::vector<size_t> _belowCounts, _bandCounts;
+	};
+	
+	/**
+	 * Finds the values at the given (sorted) indices in O(n) with two selections. The
+	 * second selection only needs to consider the part above the low index, because the
+	 * first one already moved all smaller values below it.
+	 */
+	template<typename T, typename Compare>
+	void selectLimits(T *data, size_t size, size_t lowIndex, size_t highIndex, T &lowValue, T &highValue, Compare compare)
+	{
+		std::nth_element(data, data + lowIndex, data + size, compare);
+		lowValue = data[lowIndex];
+		if(highIndex > lowIndex)
+		{
+			std::nth_element(data + lowIndex + 1, data + highIndex, data + size, compare);
+			highValue = data[highIndex];
+		}
+		else
+			highValue = lowValue;
+	}
+	
+	/**
+	 * Returns the value at the given index of the sorted (finite) data, in one pass over
+	 * the data. Two values that enclose the index with high probability are taken from a
+	 * strided sample of the data. The pass counts the values below this range and copies
+	 * the values inside it to the band buffer, and only those few percent of the data are
+	 * selected with nth_element. When the sample was unlucky, the full data is selected
+	 * instead, so the result is always exact.
+	 * @param band Buffer with room for the full data.
+	 */
+	num_t selectValue(num_t *data, size_t size, size_t index, num_t *band)
+	{
+		if(size < 65536)
+		{
+			std::nth_element(data, data + index, data + size);
+			return data[index];
+		}
+		
+		// A sample of size^(2/3) values, with a margin of four standard deviations of the
+		// rank of the index in the sample.
+		const size_t sampleSize = (size_t) pow((double) size, 2.0/3.0);
+		const size_t stride = size / sampleSize;
+		std::vector<num_t> sample(sampleSize);
+		for(size_t i=0;i<sampleSize;++i)
+			sample[i] = data[i * stride];
+		const size_t
+			sampleIndex = index * sampleSize / size,
+			margin = 2 * (size_t) sqrt((double) sampleSize) + 1,
+			lowSampleIndex = sampleIndex > margin ? sampleIndex - margin : 0,
+			highSampleIndex = std::min(sampleIndex + margin, sampleSize - 1);
+		std::nth_element(sample.begin(), sample.begin() + lowSampleIndex, sample.end());
+		const num_t lowLimit = sample[lowSampleIndex];
+		std::nth_element(sample.begin() + lowSampleIndex, sample.begin() + highSampleIndex, sample.end());
+		const num_t highLimit = sample[highSampleIndex];
+		
+		size_t belowCount, bandCount;
+		const size_t chunkCount = BandThreadPool::BandCount(size, MinBandSamples);
+		if(chunkCount <= 1)
+			partitionRange(data, size, lowLimit, highLimit, band, belowCount, bandCount);
+		else {
+			PartitionTask task(data, size, lowLimit, highLimit, band, chunkCount);
+			BandThreadPool::Run(task, chunkCount, 1);
+			task.Finish(belowCount, bandCount);
+		}
+		
+		if(index >= belowCount && index < belowCount + bandCount)
+		{
+			std::nth_element(band, band + (index - belowCount), band + bandCount);
+			return band[index - belowCount];
+		}
+		else {
+			std::nth_element(data, data + index, data + size);
+			return data[index];
+		}
+	}
+}
+
 void ThresholdTools::MeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev)
 {
 	// Calculate mean
@@ -56,14 +324,14 @@ void ThresholdTools::MeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &m
 void ThresholdTools::WinsorizedMeanAndStdDev(const Image2DCPtr &image, num_t &mean, num_t &stddev)
 {
 	size_t size = image->Width() * image->Height();
-	num_t *data = new num_t[size];
-	image->CopyData(data);
-	std::sort(data, data + size, numLessThanOperator);
-	size_t lowIndex = (size_t) floor(0.1 * size);
-	size_t highIndex = (size_t) ceil(0.9 * size)-1;
-	num_t lowValue = data[lowIndex];
-	num_t highValue = data[highIndex];
-	delete[] data;
+	num_t lowValue, highValue;
+	{
+		ScratchBuffer data(size);
+		image->CopyData(data.Data());
+		size_t lowIndex = (size_t) floor(0.1 * size);
+		size_t highIndex = (size_t) ceil(0.9 * size)-1;
+		selectLimits(data.Data(), size, lowIndex, highIndex, lowValue, highValue, numLessThanOperator);
+	}
 
 	// Calculate mean
 	mean = 0.0;
@@ -123,11 +391,10 @@ void ThresholdTools::TrimmedMeanAndStdDev(const std::vector<T> &input, T &mean,
 			return;
 		}
 	std::vector<T> data(input);
-	std::sort(data.begin(), data.end(), numLessThanOperator);
 	size_t lowIndex = (size_t) floor(0.25 * data.size());
 	size_t highIndex = (size_t) ceil(0.75 * data.size())-1;
-	T lowValue = data[lowIndex];
-	T highValue = data[highIndex];
+	T lowValue, highValue;
+	selectLimits(&data[0], data.size(), lowIndex, highIndex, lowValue, highValue, numLessThanOperator);
 
 	// Calculate mean
 	mean = 0.0;
@@ -170,11 +437,10 @@ void ThresholdTools::WinsorizedMeanAndStdDev(const std::vector<T> &input, T &mea
 		stddev = 0.0;
 	} else {
 		std::vector<T> data(input);
-		std::sort(data.begin(), data.end(), numLessThanOperator);
 		size_t lowIndex = (size_t) floor(0.1 * data.size());
 		size_t highIndex = (size_t) ceil(0.9 * data.size())-1;
-		T lowValue = data[lowIndex];
-		T highValue = data[highIndex];
+		T lowValue, highValue;
+		selectLimits(&data[0], data.size(), lowIndex, highIndex, lowValue, highValue, numLessThanOperator);
 
 		// Calculate mean
 		mean = 0.0;
@@ -219,53 +485,34 @@ template void ThresholdTools::WinsorizedMeanAndStdDev(const std::vector<double>
 
 void ThresholdTools::WinsorizedMeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev)
 {
-	num_t *data = new num_t[image->Width() * image->Height()];
-	size_t unflaggedCount = 0;
-	for(size_t y=0;y<image->Height();++y)
-	{
-		for(size_t x=0;x<image->Width();++x)
-		{
-			num_t val = image->Value(x, y);
-			if(!mask->Value(x, y) && std::isfinite(val))
-			{
-				data[unflaggedCount] = image->Value(x, y);
-				++unflaggedCount;
-			}
-		}
-	}
+	ScratchBuffer scratch(image->Width() * image->Height());
+	num_t *data = scratch.Data();
+	const size_t unflaggedCount = copyUnflagged(image, mask, data);
 	size_t lowIndex = (size_t) floor(0.1 * unflaggedCount);
 	size_t highIndex = (size_t) ceil(0.9 * unflaggedCount);
 	if(highIndex > 0) --highIndex;
-	std::nth_element(data, data + lowIndex, data + unflaggedCount, numLessThanOperator);
-	num_t lowValue = data[lowIndex];
-	std::nth_element(data, data + highIndex, data + unflaggedCount, numLessThanOperator);
-	num_t highValue = data[highIndex];
+	num_t lowValue = 0.0, highValue = 0.0;
+	if(unflaggedCount > 0)
+	{
+		ScratchBuffer band(unflaggedCount);
+		lowValue = selectValue(data, unflaggedCount, lowIndex, band.Data());
+		highValue = selectValue(data, unflaggedCount, highIndex, band.Data());
+	}
 
-	// Calculate mean
+	// Calculate mean. Clamping instead of branching avoids mispredictions on the
+	// winsorized 20% of the values.
 	mean = 0.0;
 	for(size_t i = 0;i<unflaggedCount;++i) {
-		num_t value = data[i];
-		if(value < lowValue)
-			mean += lowValue;
-		else if(value > highValue)
-			mean += highValue;
-		else
-			mean += value;
+		mean += std::max(lowValue, std::min(highValue, data[i]));
 	}
 	if(unflaggedCount > 0)
 		mean /= (num_t) unflaggedCount;
 	// Calculate variance
 	stddev = 0.0;
 	for(size_t i = 0;i<unflaggedCount;++i) {
-		num_t value = data[i];
-		if(value < lowValue)
-			stddev += (lowValue-mean)*(lowValue-mean);
-		else if(value > highValue)
-			stddev += (highValue-mean)*(highValue-mean);
-		else
-			stddev += (value-mean)*(value-mean);
+		num_t value = std::max(lowValue, std::min(highValue, data[i]));
+		stddev += (value-mean)*(value-mean);
 	}
-	delete[] data;
 	if(unflaggedCount > 0)
 		stddev = sqrtn(1.54 * stddev / (num_t) unflaggedCount);
 	else
@@ -449,33 +696,22 @@ numl_t ThresholdTools::RMS(const Image2DCPtr &image, const Mask2DCPtr &mask)
 
 num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image, const Mask2DCPtr &mask)
 {
-	num_t *data = new num_t[image->Width() * image->Height()];
-	size_t unflaggedCount = 0;
-	for(size_t y=0;y<image->Height();++y)
+	ScratchBuffer scratch(image->Width() * image->Height());
+	num_t *data = scratch.Data();
+	const size_t unflaggedCount = copyUnflagged(image, mask, data);
+	size_t highIndex = (size_t) floor(0.9 * unflaggedCount);
+	num_t highValue = 0.0;
+	if(highIndex < unflaggedCount)
 	{
-		for(size_t x=0;x<image->Width();++x)
-		{
-			num_t val = image->Value(x, y);
-			if(!mask->Value(x, y) && std::isfinite(val))
-			{
-				data[unflaggedCount] = val;
-				++unflaggedCount;
-			}
-		}
+		ScratchBuffer band(unflaggedCount);
+		highValue = selectValue(data, unflaggedCount, highIndex, band.Data());
 	}
-	size_t highIndex = (size_t) floor(0.9 * unflaggedCount);
-	std::nth_element(data, data + highIndex, data + unflaggedCount);
-	num_t highValue = data[highIndex];
 	
 	num_t mode = 0.0;
 	for(size_t i = 0; i < unflaggedCount; ++i) {
-		num_t value = data[i];
-		if(value > highValue)
-			mode += highValue * highValue;
-		else
-			mode += value * value;
+		num_t value = std::min(highValue, data[i]);
+		mode += value * value;
 	}
-	delete[] data;
 	// The correction factor 1.0541 was found by running simulations
 	// It corresponds with the correction factor needed when winsorizing 10% of the 
 	// data, meaning that the highest 10% is set to the value exactly at the
@@ -489,12 +725,14 @@ num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image, const Mask2DCPtr
 num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image)
 {
 	size_t size = image->Width() * image->Height();
-	num_t *data = new num_t[size];
-	image->CopyData(data);
-	std::sort(data, data + size, numLessThanOperator);
-	size_t highIndex = (size_t) ceil(0.9 * size)-1;
-	num_t highValue = data[highIndex];
-	delete[] data;
+	num_t highValue;
+	{
+		ScratchBuffer data(size);
+		image->CopyData(data.Data());
+		size_t highIndex = (size_t) ceil(0.9 * size)-1;
+		std::nth_element(data.Data(), data.Data() + highIndex, data.Data() + size, numLessThanOperator);
+		highValue = data.Data()[highIndex];
+	}
 
 	num_t mode = 0.0;
 	for(size_t y = 0;y<image->Height();++y) {
@@ -518,11 +756,9 @@ num_t ThresholdTools::WinsorizedMode(const Image2DCPtr &image)
 
 void ThresholdTools::FilterConnectedSamples(Mask2DPtr mask, size_t minConnectedSampleArea, bool eightConnected)
 {
-	for(size_t y=0;y<mask->Height();++y) {
-		for(size_t x=0;x<mask->Width();++x)
-			if(mask->Value(x, y))
-				FilterConnectedSample(mask, x, y, minConnectedSampleArea, eightConnected);
-	}
+	ConnectedComponents components(eightConnected);
+	components.Label(*mask);
+	components.RemoveSmallComponents(*mask, minConnectedSampleArea);
 }
 
 struct ConnectedAreaCoord
@@ -594,44 +830,75 @@ void ThresholdTools::UnrollPhase(Image2DPtr image)
 	}
 }
 
-Image2DPtr ThresholdTools::ShrinkHorizontally(size_t factor, const Image2DCPtr &input, const Mask2DCPtr &mask)
-{
-	size_t oldWidth = input->Width();
-	size_t newWidth = (oldWidth + factor - 1) / factor;
-
-	Image2D *newImage = Image2D::CreateUnsetImage(newWidth, input->Height());
-
-	for(size_t x=0;x<newWidth;++x)
+namespace {
+	/**
+	 * Calculates the columns [start, end) of ThresholdTools::ShrinkHorizontally(). The
+	 * count of a column is accumulated over its rows, so the bands are made of columns.
+	 */
+	class ShrinkHorizontallyTask : public BandThreadPool::Task
 	{
-		size_t avgSize = factor;
-		if(avgSize + x*factor > oldWidth)
-			avgSize = oldWidth - x*factor;
-		size_t count = 0;
-
-		for(size_t y=0;y<input->Height();++y)
+		public:
+			ShrinkHorizontallyTask(size_t factor, const Image2D &input, const Mask2D &mask, Image2D &output) :
+				_factor(factor), _input(input), _mask(mask), _output(output)
+			{ }
+			
+			virtual void Run(size_t start, size_t end);
+		private:
+			size_t _factor;
+			const Image2D &_input;
+			const Mask2D &_mask;
+			Image2D &_output;
+	};
+	
+	void ShrinkHorizontallyTask::Run(size_t start, size_t end)
+	{
+		const size_t factor = _factor, oldWidth = _input.Width();
+		const Image2D *input = &_input;
+		const Mask2D *mask = &_mask;
+		Image2D *newImage = &_output;
+		for(size_t x=start;x<end;++x)
 		{
-			num_t sum = 0.0;
-			for(size_t binX=0;binX<avgSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				if(!mask->Value(curX, y))
-				{
-					sum += input->Value(curX, y);
-					++count;
-				}
-			}
-			if(count == 0)
+			size_t avgSize = factor;
+			if(avgSize + x*factor > oldWidth)
+				avgSize = oldWidth - x*factor;
+			size_t count = 0;
+
+			for(size_t y=0;y<input->Height();++y)
 			{
-				sum = 0.0;
+				num_t sum = 0.0;
 				for(size_t binX=0;binX<avgSize;++binX)
 				{
 					size_t curX = x*factor + binX;
-					sum += input->Value(curX, y);
-					++count;
+					if(!mask->Value(curX, y))
+					{
+						sum += input->Value(curX, y);
+						++count;
+					}
+				}
+				if(count == 0)
+				{
+					sum = 0.0;
+					for(size_t binX=0;binX<avgSize;++binX)
+					{
+						size_t curX = x*factor + binX;
+						sum += input->Value(curX, y);
+						++count;
+					}
 				}
+				newImage->SetValue(x, y, sum / (num_t) count);
 			}
-			newImage->SetValue(x, y, sum / (num_t) count);
 		}
 	}
+}
+
+Image2DPtr ThresholdTools::ShrinkHorizontally(size_t factor, const Image2DCPtr &input, const Mask2DCPtr &mask)
+{
+	size_t oldWidth = input->Width();
+	size_t newWidth = (oldWidth + factor - 1) / factor;
+
+	Image2D *newImage = Image2D::CreateUnsetImage(newWidth, input->Height());
+
+	ShrinkHorizontallyTask task(factor, *input, *mask, *newImage);
+	BandThreadPool::Run(task, newWidth, 65536 / (input->Height() + 1) + 1);
 	return Image2DPtr(newImage);
 }
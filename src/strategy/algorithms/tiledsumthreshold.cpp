@@ -0,0 +1,850 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#include "../../msio/image2d.h"
+
+#include "../../util/bandthreadpool.h"
+
+#include "tiledsumthreshold.h"
+
+/**
+ * @file
+ * AVX2 (8 wide) and AVX-512 (16 wide) versions of the SumThreshold algorithm.
+ *
+ * The kernels are compiled with function-specific target attributes, so that they
+ * are available even when the rest of the code is compiled for plain SSE2, and
+ * are selected at run time by ThresholdMitigater::BestImplementation().
+ *
+ * Each lane of a register processes one row (horizontal operations) or one column
+ * (vertical operations). Compared to the SSE version, the flags are loaded as a block
+ * of bytes and widened with a single instruction, instead of being gathered one by one.
+ */
+
+namespace {
+
+size_t lanesFor(enum ThresholdMitigater::Implementation implementation)
+{
+#ifdef HAVE_AVX512
+	if(implementation == ThresholdMitigater::AVX512Implementation)
+		return 16;
+#endif
+#ifdef HAVE_AVX2
+	if(implementation >= ThresholdMitigater::AVX2Implementation)
+		return 8;
+#endif
+	return 0;
+}
+
+#ifdef HAVE_AVX2
+
+/**
+ * Converts 8 bits into 8 bools (bytes with value 0 or 1), bit i ending up in byte i.
+ */
+inline uint64_t bitsToBools(unsigned bits)
+{
+	const uint64_t spread = ((uint64_t(bits & 0xFF) * 0x0101010101010101ULL) & 0x8040201008040201ULL) + 0x7F7F7F7F7F7F7F7FULL;
+	return (spread >> 7) & 0x0101010101010101ULL;
+}
+
+inline void orBools(bool *destination, uint64_t values)
+{
+	uint64_t current;
+	memcpy(&current, destination, sizeof(uint64_t));
+	current |= values;
+	memcpy(destination, &current, sizeof(uint64_t));
+}
+
+/**
+ * Returns all ones in each lane for which the flag is false (i.e., the sample should be
+ * used), and zero in the other lanes.
+ */
+__attribute__((target("avx2")))
+inline __m256i loadUnflagged8(const bool *flags)
+{
+	uint64_t eightFlags;
+	memcpy(&eightFlags, flags, sizeof(uint64_t));
+	const __m256i flags32 = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(eightFlags));
+	return _mm256_cmpeq_epi32(flags32, _mm256_setzero_si256());
+}
+
+/**
+ * Transposes 8 rows of 8 floats, such that columns[i] holds element i of all rows.
+ */
+__attribute__((target("avx2")))
+inline void transpose8x8(const __m256 *rows, __m256 *columns)
+{
+	const __m256
+		t0 = _mm256_unpacklo_ps(rows[0], rows[1]),
+		t1 = _mm256_unpackhi_ps(rows[0], rows[1]),
+		t2 = _mm256_unpacklo_ps(rows[2], rows[3]),
+		t3 = _mm256_unpackhi_ps(rows[2], rows[3]),
+		t4 = _mm256_unpacklo_ps(rows[4], rows[5]),
+		t5 = _mm256_unpackhi_ps(rows[4], rows[5]),
+		t6 = _mm256_unpacklo_ps(rows[6], rows[7]),
+		t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+	const __m256
+		s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0)),
+		s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2)),
+		s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0)),
+		s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2)),
+		s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0)),
+		s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2)),
+		s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0)),
+		s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+	columns[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+	columns[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+	columns[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+	columns[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+	columns[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+	columns[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+	columns[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+	columns[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+/**
+ * Transposes a block of 8x8 bools, by interleaving bytes, then pairs, then quads.
+ * Each of the 8 source rows starts @p sourceStride bytes after the previous one.
+ */
+inline void transposeBytes8x8(const bool *source, size_t sourceStride, bool *destination, size_t destinationStride)
+{
+	__m128i rows[8];
+	for(size_t r=0;r<8;++r)
+		rows[r] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + r * sourceStride));
+	const __m128i
+		a01 = _mm_unpacklo_epi8(rows[0], rows[1]),
+		a23 = _mm_unpacklo_epi8(rows[2], rows[3]),
+		a45 = _mm_unpacklo_epi8(rows[4], rows[5]),
+		a67 = _mm_unpacklo_epi8(rows[6], rows[7]),
+		b03lo = _mm_unpacklo_epi16(a01, a23),
+		b03hi = _mm_unpackhi_epi16(a01, a23),
+		b47lo = _mm_unpacklo_epi16(a45, a67),
+		b47hi = _mm_unpackhi_epi16(a45, a67);
+	const __m128i columnPairs[4] = {
+		_mm_unpacklo_epi32(b03lo, b47lo),
+		_mm_unpackhi_epi32(b03lo, b47lo),
+		_mm_unpacklo_epi32(b03hi, b47hi),
+		_mm_unpackhi_epi32(b03hi, b47hi) };
+	for(size_t c=0;c<4;++c)
+	{
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(destination + (c*2) * destinationStride), columnPairs[c]);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(destination + (c*2+1) * destinationStride), _mm_unpackhi_epi64(columnPairs[c], columnPairs[c]));
+	}
+}
+
+/**
+ * Buffer for a range of consecutive columns that moves through the image from left to
+ * right. The buffer is divided into tiles of rows, and the lanes (rows) of one column
+ * of a tile are stored next to each other. Column x is stored at position x modulo the
+ * number of columns, which is a power of two.
+ */
+template<typename T, typename Storage>
+class ColumnRing
+{
+	public:
+		void Initialize(size_t tileCount, size_t minimumColumns, size_t lanes)
+		{
+			size_t columns = 1;
+			while(columns < minimumColumns)
+				columns *= 2;
+			_columnMask = columns - 1;
+			_lanes = lanes;
+			_tileStride = columns * lanes;
+			_buffer.assign(tileCount * _tileStride, Storage());
+		}
+
+		T *Column(size_t tile, size_t x)
+		{
+			return reinterpret_cast<T*>(&_buffer[tile * _tileStride + (x & _columnMask) * _lanes]);
+		}
+	private:
+		std::vector<Storage> _buffer;
+		size_t _columnMask, _lanes, _tileStride;
+};
+
+typedef ColumnRing<bool, char> FlagRing;
+typedef ColumnRing<float, float> ValueRing;
+
+/**
+ * Copies the flags of the columns [xStart, xStart+lanes) into the ring. Rows after
+ * the height and columns after the width are flagged, such that they never
+ * contribute to a sum.
+ */
+void loadFlags(const Mask2D &mask, size_t xStart, size_t tileCount, size_t lanes, FlagRing &ring)
+{
+	const size_t width = mask.Width(), height = mask.Height();
+	for(size_t tile=0;tile<tileCount;++tile)
+	{
+		const size_t y = tile * lanes;
+		for(size_t rBlock=0;rBlock<lanes;rBlock+=8)
+		{
+			for(size_t cBlock=0;cBlock<lanes;cBlock+=8)
+			{
+				const size_t x = xStart + cBlock;
+				if(y + rBlock + 8 <= height && x + 8 <= width)
+					transposeBytes8x8(mask.ValuePtr(x, y + rBlock), mask.Stride(), ring.Column(tile, x) + rBlock, lanes);
+				else {
+					for(size_t c=0;c<8;++c)
+					{
+						for(size_t r=rBlock;r<rBlock+8;++r)
+							ring.Column(tile, x + c)[r] = (y + r < height && x + c < width) ? mask.Value(x + c, y + r) : true;
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Writes the flags of the columns [xStart, xStart+lanes) from the ring into the mask.
+ */
+void storeFlags(FlagRing &ring, size_t xStart, size_t tileCount, size_t lanes, Mask2D &mask)
+{
+	const size_t width = mask.Width(), height = mask.Height();
+	for(size_t tile=0;tile<tileCount;++tile)
+	{
+		const size_t y = tile * lanes;
+		for(size_t rBlock=0;rBlock<lanes;rBlock+=8)
+		{
+			for(size_t cBlock=0;cBlock<lanes;cBlock+=8)
+			{
+				const size_t x = xStart + cBlock;
+				if(y + rBlock + 8 <= height && x + 8 <= width)
+					transposeBytes8x8(ring.Column(tile, x) + rBlock, lanes, mask.ValuePtr(x, y + rBlock), mask.Stride());
+				else {
+					for(size_t c=0;c<8 && x + c<width;++c)
+					{
+						for(size_t r=rBlock;r<rBlock+8 && y + r<height;++r)
+							mask.SetValue(x + c, y + r, ring.Column(tile, x + c)[r]);
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Copies the values of the columns [xStart, xStart+lanes) into the ring. Samples
+ * outside the image are set to zero.
+ */
+__attribute__((target("avx2")))
+void loadValues(const Image2D &input, size_t xStart, size_t tileCount, size_t lanes, ValueRing &ring)
+{
+	const size_t width = input.Width(), height = input.Height();
+	for(size_t tile=0;tile<tileCount;++tile)
+	{
+		const size_t y = tile * lanes;
+		for(size_t rBlock=0;rBlock<lanes;rBlock+=8)
+		{
+			for(size_t cBlock=0;cBlock<lanes;cBlock+=8)
+			{
+				const size_t x = xStart + cBlock;
+				if(y + rBlock + 8 <= height && x + 8 <= width)
+				{
+					__m256 rows[8], columns[8];
+					for(size_t r=0;r<8;++r)
+						rows[r] = _mm256_loadu_ps(input.ValuePtr(x, y + rBlock + r));
+					transpose8x8(rows, columns);
+					for(size_t c=0;c<8;++c)
+						_mm256_storeu_ps(ring.Column(tile, x + c) + rBlock, columns[c]);
+				} else {
+					for(size_t c=0;c<8;++c)
+					{
+						for(size_t r=rBlock;r<rBlock+8;++r)
+							ring.Column(tile, x + c)[r] = (y + r < height && x + c < width) ? input.Value(x + c, y + r) : 0.0;
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Converts the flags of the columns [xStart, xStart+lanes) from the layout of the ring
+ * to a layout in which the lanes are columns, i.e., group[y*lanes + c] holds the flag
+ * of column xStart+c in row y.
+ */
+void gatherColumnGroup(FlagRing &ring, size_t xStart, size_t tileCount, size_t lanes, bool *group)
+{
+	for(size_t tile=0;tile<tileCount;++tile)
+	{
+		for(size_t rBlock=0;rBlock<lanes;rBlock+=8)
+		{
+			for(size_t cBlock=0;cBlock<lanes;cBlock+=8)
+				transposeBytes8x8(ring.Column(tile, xStart + cBlock) + rBlock, lanes, &group[(tile*lanes + rBlock)*lanes + cBlock], lanes);
+		}
+	}
+}
+
+/**
+ * Inverse of gatherColumnGroup().
+ */
+void scatterColumnGroup(const bool *group, size_t xStart, size_t tileCount, size_t lanes, FlagRing &ring)
+{
+	for(size_t tile=0;tile<tileCount;++tile)
+	{
+		for(size_t rBlock=0;rBlock<lanes;rBlock+=8)
+		{
+			for(size_t cBlock=0;cBlock<lanes;cBlock+=8)
+				transposeBytes8x8(&group[(tile*lanes + rBlock)*lanes + cBlock], lanes, ring.Column(tile, xStart + cBlock) + rBlock, lanes);
+		}
+	}
+}
+
+/**
+ * Moves the sliding window of one horizontal operation over the columns [xStart, xEnd)
+ * of one tile of 8 rows. Each column is first copied from the input to the output
+ * ring, after which flags of windows that exceed the threshold are or-ed into the
+ * output. The running sums and counts are kept in @\p sums and @\p counts between
+ * calls. Like in the other implementations, a sample is added, the window is checked
+ * and then the sample at the left is subtracted, so the sums are rounded identically.
+ */
+__attribute__((target("avx2")))
+void horizontalStepsAVX2(ValueRing &values, FlagRing &input, FlagRing &output, size_t tile, size_t xStart, size_t xEnd, size_t length, num_t threshold, float *sums, int32_t *counts)
+{
+	const __m256
+		threshold8Pos = _mm256_set1_ps(threshold),
+		threshold8Neg = _mm256_set1_ps(-threshold);
+	__m256 sum8 = _mm256_loadu_ps(sums);
+	__m256i count8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts));
+	for(size_t x=xStart;x<xEnd;++x)
+	{
+		const bool *flags = input.Column(tile, x);
+		memcpy(output.Column(tile, x), flags, 8);
+
+		// ** Add the 8 samples at the right **
+		__m256i unflagged = loadUnflagged8(flags);
+		// unflagged lanes hold -1, so subtracting increments the counters
+		count8 = _mm256_sub_epi32(count8, unflagged);
+		sum8 = _mm256_add_ps(sum8, _mm256_and_ps(_mm256_loadu_ps(values.Column(tile, x)), _mm256_castsi256_ps(unflagged)));
+
+		if(x + 1 >= length)
+		{
+			const size_t left = x + 1 - length;
+
+			// ** Check sum **
+			const __m256 avg8 = _mm256_div_ps(sum8, _mm256_cvtepi32_ps(count8));
+			const unsigned flagConditions =
+				_mm256_movemask_ps(_mm256_cmp_ps(avg8, threshold8Pos, _CMP_GT_OQ)) |
+				_mm256_movemask_ps(_mm256_cmp_ps(avg8, threshold8Neg, _CMP_LT_OQ));
+			if(flagConditions != 0)
+			{
+				const uint64_t outputValues = bitsToBools(flagConditions);
+				for(size_t i=0;i<length;++i)
+					orBools(output.Column(tile, left + i), outputValues);
+			}
+
+			// ** Subtract the 8 samples at the left **
+			unflagged = loadUnflagged8(input.Column(tile, left));
+			count8 = _mm256_add_epi32(count8, unflagged);
+			sum8 = _mm256_sub_ps(sum8, _mm256_and_ps(_mm256_loadu_ps(values.Column(tile, left)), _mm256_castsi256_ps(unflagged)));
+		}
+	}
+	_mm256_storeu_ps(sums, sum8);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), count8);
+}
+
+/**
+ * Runs the sliding window over @p count steps of 8 lanes. Step i has its values at
+ * values[i*valueStride] and its flags at flags[i*8]. Output should initially hold a
+ * copy of the flags; flags of windows that exceed the threshold are or-ed into it.
+ */
+template<size_t Length>
+__attribute__((target("avx2")))
+void sumThresholdAVX2(const float *values, size_t valueStride, const bool *flags, bool *output, size_t count, num_t threshold)
+{
+	const __m256
+		threshold8Pos = _mm256_set1_ps(threshold),
+		threshold8Neg = _mm256_set1_ps(-threshold);
+	__m256 sum8 = _mm256_setzero_ps();
+	__m256i count8 = _mm256_setzero_si256();
+	size_t right;
+	for(right=0;right+1<Length;++right)
+	{
+		const __m256i unflagged = loadUnflagged8(&flags[right*8]);
+		// unflagged lanes hold -1, so subtracting increments the counters
+		count8 = _mm256_sub_epi32(count8, unflagged);
+		sum8 = _mm256_add_ps(sum8, _mm256_and_ps(_mm256_loadu_ps(&values[right*valueStride]), _mm256_castsi256_ps(unflagged)));
+	}
+
+	size_t left = 0;
+	while(right < count)
+	{
+		// ** Add the 8 samples at the right **
+		__m256i unflagged = loadUnflagged8(&flags[right*8]);
+		count8 = _mm256_sub_epi32(count8, unflagged);
+		sum8 = _mm256_add_ps(sum8, _mm256_and_ps(_mm256_loadu_ps(&values[right*valueStride]), _mm256_castsi256_ps(unflagged)));
+
+		// ** Check sum **
+		const __m256 avg8 = _mm256_div_ps(sum8, _mm256_cvtepi32_ps(count8));
+		const unsigned flagConditions =
+			_mm256_movemask_ps(_mm256_cmp_ps(avg8, threshold8Pos, _CMP_GT_OQ)) |
+			_mm256_movemask_ps(_mm256_cmp_ps(avg8, threshold8Neg, _CMP_LT_OQ));
+		if(flagConditions != 0)
+		{
+			const uint64_t outputValues = bitsToBools(flagConditions);
+			for(size_t i=0;i<Length;++i)
+				orBools(&output[(left+i)*8], outputValues);
+		}
+
+		// ** Subtract the 8 samples at the left **
+		unflagged = loadUnflagged8(&flags[left*8]);
+		count8 = _mm256_add_epi32(count8, unflagged);
+		sum8 = _mm256_sub_ps(sum8, _mm256_and_ps(_mm256_loadu_ps(&values[left*valueStride]), _mm256_castsi256_ps(unflagged)));
+
+		++left;
+		++right;
+	}
+}
+
+#ifdef HAVE_AVX512
+
+/**
+ * Converts 16 integers to floats. The conversions are written with a zero pass-through
+ * operand, because the unmasked intrinsics leave it undefined, which GCC reports as an
+ * uninitialized use.
+ */
+__attribute__((target("avx512f")))
+inline __m512 toFloat16(__m512i values)
+{
+	return _mm512_mask_cvtepi32_ps(_mm512_setzero_ps(), 0xFFFF, values);
+}
+
+/**
+ * Returns a bit mask with a bit set for each of the 16 flags that is false.
+ */
+__attribute__((target("avx512f")))
+inline __mmask16 loadUnflagged16(const bool *flags)
+{
+	const __m512i flags32 = _mm512_mask_cvtepu8_epi32(_mm512_setzero_si512(), 0xFFFF, _mm_loadu_si128(reinterpret_cast<const __m128i*>(flags)));
+	return _mm512_cmpeq_epi32_mask(flags32, _mm512_setzero_si512());
+}
+
+/**
+ * 16 lane version of sumThresholdAVX2().
+ */
+template<size_t Length>
+__attribute__((target("avx512f")))
+void sumThresholdAVX512(const float *values, size_t valueStride, const bool *flags, bool *output, size_t count, num_t threshold)
+{
+	const __m512
+		threshold16Pos = _mm512_set1_ps(threshold),
+		threshold16Neg = _mm512_set1_ps(-threshold);
+	const __m512i ones16 = _mm512_set1_epi32(1);
+	__m512 sum16 = _mm512_setzero_ps();
+	__m512i count16 = _mm512_setzero_si512();
+	size_t right;
+	for(right=0;right+1<Length;++right)
+	{
+		const __mmask16 unflagged = loadUnflagged16(&flags[right*16]);
+		count16 = _mm512_mask_add_epi32(count16, unflagged, count16, ones16);
+		sum16 = _mm512_mask_add_ps(sum16, unflagged, sum16, _mm512_loadu_ps(&values[right*valueStride]));
+	}
+
+	size_t left = 0;
+	while(right < count)
+	{
+		// ** Add the 16 samples at the right **
+		__mmask16 unflagged = loadUnflagged16(&flags[right*16]);
+		count16 = _mm512_mask_add_epi32(count16, unflagged, count16, ones16);
+		sum16 = _mm512_mask_add_ps(sum16, unflagged, sum16, _mm512_loadu_ps(&values[right*valueStride]));
+
+		// ** Check sum **
+		const __m512 avg16 = _mm512_div_ps(sum16, toFloat16(count16));
+		const unsigned flagConditions =
+			_mm512_cmp_ps_mask(avg16, threshold16Pos, _CMP_GT_OQ) |
+			_mm512_cmp_ps_mask(avg16, threshold16Neg, _CMP_LT_OQ);
+		if(flagConditions != 0)
+		{
+			const uint64_t
+				outputValuesA = bitsToBools(flagConditions),
+				outputValuesB = bitsToBools(flagConditions >> 8);
+			for(size_t i=0;i<Length;++i)
+			{
+				bool *outputPtr = &output[(left+i)*16];
+				orBools(outputPtr, outputValuesA);
+				orBools(outputPtr + 8, outputValuesB);
+			}
+		}
+
+		// ** Subtract the 16 samples at the left **
+		unflagged = loadUnflagged16(&flags[left*16]);
+		count16 = _mm512_mask_sub_epi32(count16, unflagged, count16, ones16);
+		sum16 = _mm512_mask_sub_ps(sum16, unflagged, sum16, _mm512_loadu_ps(&values[left*valueStride]));
+
+		++left;
+		++right;
+	}
+}
+
+/**
+ * 16 lane version of horizontalStepsAVX2().
+ */
+__attribute__((target("avx512f")))
+void horizontalStepsAVX512(ValueRing &values, FlagRing &input, FlagRing &output, size_t tile, size_t xStart, size_t xEnd, size_t length, num_t threshold, float *sums, int32_t *counts)
+{
+	const __m512
+		threshold16Pos = _mm512_set1_ps(threshold),
+		threshold16Neg = _mm512_set1_ps(-threshold);
+	const __m512i ones16 = _mm512_set1_epi32(1);
+	__m512 sum16 = _mm512_loadu_ps(sums);
+	__m512i count16 = _mm512_loadu_si512(counts);
+	for(size_t x=xStart;x<xEnd;++x)
+	{
+		const bool *flags = input.Column(tile, x);
+		memcpy(output.Column(tile, x), flags, 16);
+
+		// ** Add the 16 samples at the right **
+		__mmask16 unflagged = loadUnflagged16(flags);
+		count16 = _mm512_mask_add_epi32(count16, unflagged, count16, ones16);
+		sum16 = _mm512_mask_add_ps(sum16, unflagged, sum16, _mm512_loadu_ps(values.Column(tile, x)));
+
+		if(x + 1 >= length)
+		{
+			const size_t left = x + 1 - length;
+
+			// ** Check sum **
+			const __m512 avg16 = _mm512_div_ps(sum16, toFloat16(count16));
+			const unsigned flagConditions =
+				_mm512_cmp_ps_mask(avg16, threshold16Pos, _CMP_GT_OQ) |
+				_mm512_cmp_ps_mask(avg16, threshold16Neg, _CMP_LT_OQ);
+			if(flagConditions != 0)
+			{
+				const uint64_t
+					outputValuesA = bitsToBools(flagConditions),
+					outputValuesB = bitsToBools(flagConditions >> 8);
+				for(size_t i=0;i<length;++i)
+				{
+					bool *outputPtr = output.Column(tile, left + i);
+					orBools(outputPtr, outputValuesA);
+					orBools(outputPtr + 8, outputValuesB);
+				}
+			}
+
+			// ** Subtract the 16 samples at the left **
+			unflagged = loadUnflagged16(input.Column(tile, left));
+			count16 = _mm512_mask_sub_epi32(count16, unflagged, count16, ones16);
+			sum16 = _mm512_mask_sub_ps(sum16, unflagged, sum16, _mm512_loadu_ps(values.Column(tile, left)));
+		}
+	}
+	_mm512_storeu_ps(sums, sum16);
+	_mm512_storeu_si512(counts, count16);
+}
+
+#endif // HAVE_AVX512
+
+typedef void (*HorizontalStepsFunction)(ValueRing &values, FlagRing &input, FlagRing &output, size_t tile, size_t xStart, size_t xEnd, size_t length, num_t threshold, float *sums, int32_t *counts);
+
+HorizontalStepsFunction selectHorizontalSteps(size_t lanes)
+{
+#ifdef HAVE_AVX512
+	if(lanes == 16)
+		return &horizontalStepsAVX512;
+#endif
+	return &horizontalStepsAVX2;
+}
+
+typedef void (*SumThresholdKernel)(const float *values, size_t valueStride, const bool *flags, bool *output, size_t count, num_t threshold);
+
+template<size_t Length>
+SumThresholdKernel kernelForLanes(size_t lanes)
+{
+#ifdef HAVE_AVX512
+	if(lanes == 16)
+		return &sumThresholdAVX512<Length>;
+#endif
+	return &sumThresholdAVX2<Length>;
+}
+
+SumThresholdKernel selectKernel(size_t lanes, size_t length)
+{
+	switch(length)
+	{
+		case 1: return kernelForLanes<1>(lanes);
+		case 2: return kernelForLanes<2>(lanes);
+		case 4: return kernelForLanes<4>(lanes);
+		case 8: return kernelForLanes<8>(lanes);
+		case 16: return kernelForLanes<16>(lanes);
+		case 32: return kernelForLanes<32>(lanes);
+		case 64: return kernelForLanes<64>(lanes);
+		case 128: return kernelForLanes<128>(lanes);
+		case 256: return kernelForLanes<256>(lanes);
+		default: throw BadUsageException("Invalid value for length");
+	}
+}
+
+/**
+ * A step in the pipeline of TiledSumThreshold::executeFused(). A stage performs
+ * either one horizontal operation or a run of consecutive vertical operations.
+ */
+struct Stage
+{
+	bool horizontal;
+	// The operations [first, end) that are performed by this stage
+	size_t first, end;
+	// The number of chunks this stage runs behind the loading of the mask
+	size_t lag;
+	// The number of columns before the current chunk that the stage accesses
+	size_t reach;
+};
+
+#endif // HAVE_AVX2
+
+} // anonymous namespace
+
+TiledSumThreshold::TiledSumThreshold(Image2DCPtr input) :
+	_input(input),
+	_implementation(ThresholdMitigater::BestImplementation()),
+	_lanes(lanesFor(_implementation))
+{
+}
+
+TiledSumThreshold::TiledSumThreshold(Image2DCPtr input, enum ThresholdMitigater::Implementation implementation) :
+	_input(input),
+	_implementation(implementation),
+	_lanes(lanesFor(implementation))
+{
+}
+
+/**
+ * Performs the operations on the columns [start, end) of the mask, by applying them on a
+ * copy of those columns plus the halo columns, of which only [start, end) are copied back.
+ * The bands read the flags from a copy of the input mask, because the bands next to them
+ * overwrite their halo.
+ */
+class TiledSumThreshold::BandTask : public BandThreadPool::Task
+{
+	public:
+		BandTask(const TiledSumThreshold &parent, Mask2DCPtr input, Mask2D &output) :
+			_parent(parent), _input(input), _output(output), _halo(parent.horizontalReach())
+		{ }
+
+		virtual void Run(size_t start, size_t end)
+		{
+			const size_t
+				width = _input->Width(),
+				height = _input->Height(),
+				haloStart = (start > _halo) ? start - _halo : 0,
+				haloEnd = std::min(end + _halo, width);
+			TiledSumThreshold band(_parent._input->Trim(haloStart, 0, haloEnd, height), _parent._implementation);
+			band._operations = _parent._operations;
+			Mask2DPtr bandMask = _input->Trim(haloStart, 0, haloEnd, height);
+			band.executeSingle(bandMask);
+			for(size_t y=0;y<height;++y)
+				memcpy(_output.ValuePtr(start, y), bandMask->ValuePtr(start - haloStart, y), (end - start) * sizeof(bool));
+		}
+	private:
+		const TiledSumThreshold &_parent;
+		Mask2DCPtr _input;
+		Mask2D &_output;
+		size_t _halo;
+};
+
+void TiledSumThreshold::Execute(Mask2DPtr mask)
+{
+	if(_operations.empty())
+		return;
+	// Bands are only made when the halo columns are a small part of them, since those are
+	// processed twice
+	const size_t minBandWidth = std::max<size_t>(8 * horizontalReach(), 1024);
+	if(BandThreadPool::BandCount(mask->Width(), minBandWidth) > 1)
+	{
+		BandTask task(*this, Mask2D::CreateCopy(mask), *mask);
+		BandThreadPool::Run(task, mask->Width(), minBandWidth);
+	}
+	else
+		executeSingle(mask);
+}
+
+void TiledSumThreshold::executeSingle(Mask2DPtr mask) const
+{
+	if(_lanes == 0 || mask->Width() == 0 || mask->Height() == 0)
+		executeOneByOne(mask);
+	else
+		executeFused(*mask);
+}
+
+size_t TiledSumThreshold::horizontalReach() const
+{
+	size_t reach = 0;
+	for(size_t i=0;i<_operations.size();++i)
+	{
+		if(_operations[i].horizontal)
+			reach += _operations[i].length - 1;
+	}
+	return reach;
+}
+
+void TiledSumThreshold::executeOneByOne(Mask2DPtr mask) const
+{
+	for(size_t i=0;i<_operations.size();++i)
+	{
+		const Operation &operation = _operations[i];
+		if(_implementation == ThresholdMitigater::ReferenceImplementation)
+		{
+			if(operation.horizontal)
+				ThresholdMitigater::HorizontalSumThresholdLargeReference(_input, mask, operation.length, operation.threshold);
+			else
+				ThresholdMitigater::VerticalSumThresholdLargeReference(_input, mask, operation.length, operation.threshold);
+		} else {
+			if(operation.horizontal)
+				ThresholdMitigater::HorizontalSumThresholdLargeSSE(_input, mask, operation.length, operation.threshold);
+			else
+				ThresholdMitigater::VerticalSumThresholdLargeSSE(_input, mask, operation.length, operation.threshold);
+		}
+	}
+}
+
+void TiledSumThreshold::executeFused(Mask2D &mask) const
+{
+#ifdef HAVE_AVX2
+	const size_t
+		width = _input->Width(),
+		height = _input->Height(),
+		lanes = _lanes,
+		tileCount = (height + lanes - 1) / lanes,
+		chunkCount = (width + lanes - 1) / lanes;
+
+	// Selecting the kernels also validates the lengths of all operations
+	std::vector<SumThresholdKernel> kernels;
+	for(size_t i=0;i<_operations.size();++i)
+		kernels.push_back(selectKernel(lanes, _operations[i].length));
+	const HorizontalStepsFunction horizontalSteps = selectHorizontalSteps(lanes);
+
+	// Flags of a column are final once all windows that contain it have been evaluated,
+	// so a horizontal stage delays the stages after it by the length of its window.
+	// Windows that do not fit leave the mask unchanged, as in the other implementations.
+	std::vector<Stage> stages;
+	size_t lag = 0, valueColumns = 0;
+	for(size_t i=0;i<_operations.size();)
+	{
+		Stage stage;
+		stage.horizontal = _operations[i].horizontal;
+		stage.first = i;
+		stage.end = i + 1;
+		stage.lag = lag;
+		stage.reach = 0;
+		if(stage.horizontal)
+		{
+			if(_operations[i].length <= width)
+				stage.reach = _operations[i].length - 1;
+			valueColumns = std::max(valueColumns, lanes * (lag + 1) + stage.reach);
+			lag += (stage.reach + lanes - 1) / lanes;
+		} else {
+			while(stage.end < _operations.size() && !_operations[stage.end].horizontal)
+				++stage.end;
+		}
+		stages.push_back(stage);
+		i = stage.end;
+	}
+	const size_t finalLag = lag;
+
+	// Ring i holds the flags before stage i, and the last ring holds the result. Each
+	// ring needs to hold the columns between the stage writing it and the stage reading
+	// it, plus the columns before the chunk that either of them accesses.
+	std::vector<FlagRing> flagRings(stages.size() + 1);
+	for(size_t i=0;i<=stages.size();++i)
+	{
+		const size_t
+			writerLag = (i == 0) ? 0 : stages[i-1].lag,
+			writerReach = (i == 0) ? 0 : stages[i-1].reach,
+			readerLag = (i == stages.size()) ? finalLag : stages[i].lag,
+			readerReach = (i == stages.size()) ? 0 : stages[i].reach;
+		flagRings[i].Initialize(tileCount, lanes * (readerLag - writerLag + 1) + std::max(writerReach, readerReach), lanes);
+	}
+	ValueRing valueRing;
+	if(valueColumns != 0)
+		valueRing.Initialize(tileCount, valueColumns, lanes);
+
+	std::vector<std::vector<float> > sums(stages.size());
+	std::vector<std::vector<int32_t> > counts(stages.size());
+	for(size_t i=0;i<stages.size();++i)
+	{
+		if(stages[i].horizontal)
+		{
+			sums[i].assign(tileCount * lanes, 0.0);
+			counts[i].assign(tileCount * lanes, 0);
+		}
+	}
+
+	const size_t groupSize = tileCount * lanes * lanes;
+	std::vector<char> groupBufferA(groupSize), groupBufferB(groupSize);
+	std::vector<float> valueBuffer;
+
+	for(size_t t=0;t<chunkCount+finalLag;++t)
+	{
+		if(t < chunkCount)
+		{
+			loadFlags(mask, t * lanes, tileCount, lanes, flagRings[0]);
+			if(valueColumns != 0)
+				loadValues(*_input, t * lanes, tileCount, lanes, valueRing);
+		}
+
+		for(size_t s=0;s<stages.size();++s)
+		{
+			const Stage &stage = stages[s];
+			if(t < stage.lag || t - stage.lag >= chunkCount)
+				continue;
+			const size_t xStart = (t - stage.lag) * lanes;
+			FlagRing &input = flagRings[s], &output = flagRings[s + 1];
+
+			if(stage.horizontal)
+			{
+				const Operation &operation = _operations[stage.first];
+				size_t x = xStart;
+				if(operation.length <= width)
+				{
+					x = std::min(xStart + lanes, width);
+					for(size_t tile=0;tile<tileCount;++tile)
+						horizontalSteps(valueRing, input, output, tile, xStart, x, operation.length, operation.threshold, &sums[s][tile * lanes], &counts[s][tile * lanes]);
+				}
+				// Copy the columns that were not processed, including the padding after the width
+				for(;x<xStart+lanes;++x)
+				{
+					for(size_t tile=0;tile<tileCount;++tile)
+						memcpy(output.Column(tile, x), input.Column(tile, x), lanes);
+				}
+			} else {
+				// The columns of a full chunk are read directly from the image, which has them
+				// next to each other already. Only the last chunk is copied into a padded buffer.
+				const float *values;
+				size_t valueStride;
+				if(xStart + lanes <= width)
+				{
+					values = _input->ValuePtr(xStart, 0);
+					valueStride = _input->Stride();
+				} else {
+					valueBuffer.assign(height * lanes, 0.0);
+					for(size_t y=0;y<height;++y)
+						memcpy(&valueBuffer[y * lanes], _input->ValuePtr(xStart, y), (width - xStart) * sizeof(float));
+					values = &valueBuffer[0];
+					valueStride = lanes;
+				}
+				bool
+					*flags = reinterpret_cast<bool*>(&groupBufferA[0]),
+					*groupOutput = reinterpret_cast<bool*>(&groupBufferB[0]);
+				gatherColumnGroup(input, xStart, tileCount, lanes, flags);
+				for(size_t i=stage.first;i<stage.end;++i)
+				{
+					if(_operations[i].length <= height)
+					{
+						memcpy(groupOutput, flags, groupSize);
+						kernels[i](values, valueStride, flags, groupOutput, height, _operations[i].threshold);
+						std::swap(flags, groupOutput);
+					}
+				}
+				scatterColumnGroup(flags, xStart, tileCount, lanes, output);
+			}
+		}
+
+		if(t >= finalLag)
+			storeFlags(flagRings.back(), (t - finalLag) * lanes, tileCount, lanes, mask);
+	}
+#endif
+}
@@ -0,0 +1,104 @@
+#ifndef TILED_SUMTHRESHOLD_H
+#define TILED_SUMTHRESHOLD_H
+
+#include <vector>
+
+#include "../../msio/image2d.h"
+#include "../../msio/mask2d.h"
+
+#include "thresholdmitigater.h"
+
+/**
+ * Applies a series of horizontal and vertical SumThreshold operations to one image,
+ * as is done by ThresholdConfig::Execute(). The result is identical to calling
+ * ThresholdMitigater::HorizontalSumThresholdLargeReference() and
+ * ThresholdMitigater::VerticalSumThresholdLargeReference() for each operation in
+ * the order in which they were added.
+ *
+ * All operations are performed in a single pass over the image, which moves through
+ * it in chunks of 8 (AVX2) or 16 (AVX-512) columns. Within a chunk, each tile of as
+ * many rows is processed such that each lane of a register processes one row (for a
+ * horizontal operation) or one column (for a vertical operation). The sliding windows
+ * use running sums in the same order as the reference, so the results are exact.
+ *
+ * Each horizontal operation is a stage of the pass, and so is each run of consecutive
+ * vertical operations. Since a horizontal window of length L changes the flags of the
+ * L-1 columns before the chunk, a stage runs behind the stage before it by enough
+ * chunks for those columns to be final. The flags between stages are kept in small
+ * ring buffers of transposed columns, so the intermediate results stay in the cache
+ * and no intermediate masks are made. Rows and columns outside the image are treated
+ * as flagged, so image sizes need not be a multiple of the tile size.
+ *
+ * When the processor does not support AVX2, the operations are performed one by one
+ * with the SSE or reference implementation.
+ *
+ * When the BandThreadPool has several threads, the image is split into bands of columns
+ * that are processed in parallel. A horizontal window of length L lets a flag depend on
+ * the L-1 columns at either side, so each band also reads the sum of (L-1) over the
+ * horizontal operations as halo columns at either side. Flags in the halo are not written
+ * back, hence the result is the same as without bands.
+ */
+class TiledSumThreshold
+{
+	public:
+		/**
+		 * Prepares a series of operations on the given image, using the fastest
+		 * implementation supported by the processor.
+		 */
+		TiledSumThreshold(Image2DCPtr input);
+
+		/**
+		 * Like TiledSumThreshold(Image2DCPtr), but uses the specified implementation.
+		 * The caller should make sure the processor supports it.
+		 */
+		TiledSumThreshold(Image2DCPtr input, enum ThresholdMitigater::Implementation implementation);
+
+		void AddHorizontalOperation(size_t length, num_t threshold)
+		{
+			_operations.push_back(Operation(true, length, threshold));
+		}
+
+		void AddVerticalOperation(size_t length, num_t threshold)
+		{
+			_operations.push_back(Operation(false, length, threshold));
+		}
+
+		/**
+		 * Performs all added operations on the mask, which should have the same size
+		 * as the image. The operations are kept, so Execute() can be called again on
+		 * a different mask.
+		 */
+		void Execute(Mask2DPtr mask);
+	private:
+		struct Operation
+		{
+			Operation(bool _horizontal, size_t _length, num_t _threshold) :
+				horizontal(_horizontal), length(_length), threshold(_threshold)
+			{ }
+			bool horizontal;
+			size_t length;
+			num_t threshold;
+		};
+
+		// Not implemented
+		TiledSumThreshold(const TiledSumThreshold &source);
+		void operator=(const TiledSumThreshold &source);
+
+		class BandTask;
+
+		void executeSingle(Mask2DPtr mask) const;
+		void executeOneByOne(Mask2DPtr mask) const;
+		void executeFused(Mask2D &mask) const;
+
+		/**
+		 * Number of columns at either side of a column that can influence its result.
+		 */
+		size_t horizontalReach() const;
+
+		Image2DCPtr _input;
+		enum ThresholdMitigater::Implementation _implementation;
+		size_t _lanes;
+		std::vector<Operation> _operations;
+};
+
+#endif
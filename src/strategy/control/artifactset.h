@@ -152,6 +152,42 @@ namespace rfiStrategy {
 				_metaData = metaData;
 			}
 
+			/**
+			 * Retrieves the contaminated data and meta data without the time steps that
+			 * overlap with neighbouring parts (see TimeFrequencyMetaData::PartLeftBorder()).
+			 * Actions that accumulate statistics over the whole set use this, so that the
+			 * overlapping time steps are not counted twice.
+			 */
+			void GetContaminatedPartInterior(TimeFrequencyData &data, TimeFrequencyMetaDataCPtr &metaData) const
+			{
+				data = _contaminatedData;
+				metaData = _metaData;
+				if(_metaData != 0 && _metaData->HasPartBorders())
+				{
+					const size_t
+						width = data.ImageWidth(),
+						left = _metaData->PartLeftBorder(),
+						right = _metaData->PartRightBorder();
+					if(left + right < width)
+					{
+						data.Trim(left, 0, width - right, data.ImageHeight());
+						TimeFrequencyMetaData *interior = new TimeFrequencyMetaData(*_metaData);
+						if(_metaData->HasObservationTimes() && _metaData->ObservationTimes().size() == width)
+						{
+							const std::vector<double> &times = _metaData->ObservationTimes();
+							interior->SetObservationTimes(std::vector<double>(times.begin() + left, times.end() - right));
+						}
+						if(_metaData->HasUVW() && _metaData->UVW().size() == width)
+						{
+							const std::vector<class UVW> &uvw = _metaData->UVW();
+							interior->SetUVW(std::vector<class UVW>(uvw.begin() + left, uvw.end() - right));
+						}
+						interior->SetPartBorders(0, 0);
+						metaData = TimeFrequencyMetaDataCPtr(interior);
+					}
+				}
+			}
+
 			boost::mutex &IOMutex()
 			{
 				return *_ioMutex;
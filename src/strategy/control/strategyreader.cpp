@@ -213,6 +213,15 @@ xmlNode *StrategyReader::getTextNode(xmlNode *node, const char *subNodeName, boo
 	throw StrategyReaderError(str.str());
 }
 
+bool StrategyReader::hasElement(xmlNode *node, const char *name) const
+{
+	for (xmlNode *curNode=node->children; curNode!=NULL; curNode=curNode->next) {
+		if(curNode->type == XML_ELEMENT_NODE && std::string((const char *) curNode->name) == name)
+			return true;
+	}
+	return false;
+}
+
 int StrategyReader::getInt(xmlNode *node, const char *name) const 
 {
 	xmlNode *valNode = getTextNode(node, name);
@@ -442,6 +451,12 @@ Action *StrategyReader::parseForEachBaselineAction(xmlNode *node)
 	ForEachBaselineAction *newAction = new ForEachBaselineAction();
 	newAction->SetSelection((BaselineSelection) getInt(node, "selection"));
 	newAction->SetThreadCount(getInt(node, "thread-count"));
+	// Files before format version 3.8 do not specify the number of readers
+	if(hasElement(node, "reader-thread-count"))
+		newAction->SetReaderThreadCount(getInt(node, "reader-thread-count"));
+	// Files before format version 3.9 do not specify the number of prefetched batches
+	if(hasElement(node, "prefetch-batch-count"))
+		newAction->SetPrefetchBatchCount(getInt(node, "prefetch-batch-count"));
 
 	for (xmlNode *curNode=node->children; curNode!=NULL; curNode=curNode->next) {
 		if(curNode->type == XML_ELEMENT_NODE)
@@ -583,6 +598,9 @@ Action *StrategyReader::parseHighPassFilterAction(xmlNode *node)
 	newAction->SetWindowWidth(getInt(node, "window-width"));
 	newAction->SetWindowHeight(getInt(node, "window-height"));
 	newAction->SetMode((enum HighPassFilterAction::Mode) getInt(node, "mode"));
+	// Files before format version 4.0 always use the Gaussian kernel
+	if(hasElement(node, "method"))
+		newAction->SetMethod((enum HighPassFilter::Method) getInt(node, "method"));
 	return newAction;
 }
 
@@ -55,6 +55,7 @@ class StrategyReader {
 		double getDouble(xmlNode *node, const char *name) const;
 		std::string getString(xmlNode *node, const char *name) const;
 		bool getBool(xmlNode *node, const char *name) const { return getInt(node,name) != 0; }
+		bool hasElement(xmlNode *node, const char *name) const;
 
 		class Action *parseAbsThresholdAction(xmlNode *node);
 		class Action *parseAdapter(xmlNode *node);
@@ -338,6 +338,8 @@ namespace rfiStrategy {
 		Attribute("type", "ForEachBaselineAction");
 		Write<int>("selection", action.Selection());
 		Write<int>("thread-count", action.ThreadCount());
+		Write<int>("reader-thread-count", action.ReaderThreadCount());
+		Write<int>("prefetch-batch-count", action.PrefetchBatchCount());
 		writeContainerItems(action);
 	}
 
@@ -417,6 +419,7 @@ namespace rfiStrategy {
 		Write<int>("window-width", action.WindowWidth());
 		Write<int>("window-height", action.WindowHeight());
 		Write<int>("mode", action.Mode());
+		Write<int>("method", action.Method());
 	}
 
 	void StrategyWriter::writeImagerAction(const ImagerAction &)
@@ -84,7 +84,11 @@ class Observatorium;
 // 3.5 : Added the AbsThresholdAction
 // 3.6 : Added the DirectionProfileAction and the EigenValueVerticalAction.
 // 3.7 : Added the NormalizeVarianceAction
-#define STRATEGY_FILE_FORMAT_VERSION 3.7
+// 3.8 : Added the reader-thread-count to the ForEachBaselineAction
+// 3.9 : Added the prefetch-batch-count to the ForEachBaselineAction
+// 4.0 : Added the method to the HighPassFilterAction (the reader treats versions as floats,
+//       hence not 3.10)
+#define STRATEGY_FILE_FORMAT_VERSION 4.0
 
 // The earliest format version which can be read by this version of the software
 #define STRATEGY_FILE_FORMAT_VERSION_REQUIRED 3.4
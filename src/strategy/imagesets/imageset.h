@@ -163,6 +163,12 @@ namespace rfiStrategy {
 			{
 				throw std::runtime_error("Not implemented");
 			}
+			/**
+			 * Whether the set serializes its reads and flag writes itself, so that flags
+			 * can be written while another thread reads, without holding the IO mutex of
+			 * the artifact set.
+			 */
+			virtual bool HasConcurrentFlagWriting() const { return false; }
 
 			void PerformWriteDataTask(const ImageSetIndex &index, const TimeFrequencyData &data)
 			{
@@ -18,7 +18,9 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <stdexcept>
 
@@ -31,6 +33,7 @@
 #include "../../msio/memorybaselinereader.h"
 
 #include "../../util/aologger.h"
+#include "../../util/stopwatch.h"
 
 namespace rfiStrategy {
 
@@ -51,21 +54,33 @@ namespace rfiStrategy {
 	
 	void MSImageSetIndex::Previous()
 	{
-		if(_sequenceIndex > 0)
-			--_sequenceIndex;
+		MSImageSet &set = static_cast<class MSImageSet&>(imageSet());
+		if(_partIndex > 0)
+			--_partIndex;
 		else {
-			_sequenceIndex = static_cast<class MSImageSet&>(imageSet())._sequences.size() - 1;
-			_isValid = false;
+			if(_sequenceIndex > 0)
+				--_sequenceIndex;
+			else {
+				_sequenceIndex = set._sequences.size() - 1;
+				_isValid = false;
+			}
+			_partIndex = set.PartCount(_sequenceIndex) - 1;
 		}
 	}
 	
 	void MSImageSetIndex::Next()
 	{
-		++_sequenceIndex;
-		if( _sequenceIndex >= static_cast<class MSImageSet&>(imageSet())._sequences.size() )
+		MSImageSet &set = static_cast<class MSImageSet&>(imageSet());
+		++_partIndex;
+		if(_partIndex >= set.PartCount(_sequenceIndex))
 		{
-			_sequenceIndex = 0;
-			_isValid = false;
+			_partIndex = 0;
+			++_sequenceIndex;
+			if( _sequenceIndex >= set._sequences.size() )
+			{
+				_sequenceIndex = 0;
+				_isValid = false;
+			}
 		}
 	}
 	
@@ -94,13 +109,29 @@ namespace rfiStrategy {
 					_reader = BaselineReaderPtr(new DirectBaselineReader(_msFile));
 					break;
 				case MemoryReadMode:
-					_reader = BaselineReaderPtr(new MemoryBaselineReader(_msFile));
+				case PackedMemoryReadMode:
+					if(_maxScanCountPerPart != 0)
+					{
+						AOLogger::Warn << "The memory reader holds the whole set in memory, so baselines will not be split in parts.\n";
+						_maxScanCountPerPart = 0;
+					}
+					_reader = BaselineReaderPtr(createMemoryReader(_ioMode == PackedMemoryReadMode));
 					break;
 				case AutoReadMode:
-					if(MemoryBaselineReader::IsEnoughMemoryAvailable(_msFile))
-						_reader = BaselineReaderPtr(new MemoryBaselineReader(_msFile));
-					else
+					// Parts are used to limit memory, so the memory reader would defeat their purpose
+					// The packed store lowers the precision of the data, so it is only used when
+					// it is explicitly requested.
+					if(_maxScanCountPerPart == 0 && MemoryBaselineReader::IsEnoughMemoryAvailable(_msFile))
+						_reader = BaselineReaderPtr(createMemoryReader(false));
+					else {
+						if(_maxScanCountPerPart == 0)
+						{
+							AOLogger::Warn << "The set does not fit in memory, so direct read mode (slower!) will be used.\n";
+							if(MemoryBaselineReader::IsEnoughMemoryAvailable(_msFile, true))
+								AOLogger::Warn << "The set would fit in memory with reduced precision; use -packed-memory-read to allow this.\n";
+						}
 						_reader = BaselineReaderPtr(new DirectBaselineReader(_msFile));
+					}
 					break;
 			}
 		}
@@ -110,45 +141,78 @@ namespace rfiStrategy {
 		_reader->SetReadData(true);
 	}
 
+	BaselineReader *MSImageSet::createMemoryReader(bool packSamples) const
+	{
+		MemoryBaselineReader *memoryReader = new MemoryBaselineReader(_msFile);
+		memoryReader->SetPackSamples(packSamples);
+		return memoryReader;
+	}
+
+	size_t MSImageSet::ScanCount(size_t sequenceIndex)
+	{
+		return _reader->Set().GetObservationTimesSet(_sequences[sequenceIndex].sequenceId).size();
+	}
+	
+	size_t MSImageSet::PartCount(size_t sequenceIndex)
+	{
+		if(_maxScanCountPerPart == 0)
+			return 1;
+		size_t scanCount = ScanCount(sequenceIndex);
+		size_t partCount = (scanCount + _maxScanCountPerPart - 1) / _maxScanCountPerPart;
+		return partCount == 0 ? 1 : partCount;
+	}
+
 	size_t MSImageSet::StartIndex(const MSImageSetIndex &index)
 	{
-		//size_t startIndex =
-		//	(_timeScanCount * index._partIndex) / _partCount - LeftBorder(index);
-		//return startIndex;
-		return 0;
+		size_t startIndex =
+			(ScanCount(index._sequenceIndex) * index._partIndex) / PartCount(index._sequenceIndex) - LeftBorder(index);
+		return startIndex;
 	}
 
 	size_t MSImageSet::EndIndex(const MSImageSetIndex &index)
 	{
-		//size_t endIndex =
-		//	(_timeScanCount * (index._partIndex+1)) / _partCount + RightBorder(index);
-		//return endIndex;
-		return _reader->Set().GetObservationTimesSet(GetSequenceId(index)).size();
+		size_t endIndex =
+			(ScanCount(index._sequenceIndex) * (index._partIndex+1)) / PartCount(index._sequenceIndex) + RightBorder(index);
+		return endIndex;
 	}
 
+	size_t MSImageSet::partLength(size_t sequenceIndex, size_t partIndex)
+	{
+		size_t
+			scanCount = ScanCount(sequenceIndex),
+			partCount = PartCount(sequenceIndex);
+		return (scanCount * (partIndex+1)) / partCount - (scanCount * partIndex) / partCount;
+	}
+
+	/**
+	 * The borders are limited to the length of the neighbouring part, such that the
+	 * flags of a border all come from that one part (see restoreBorderFlags()).
+	 */
 	size_t MSImageSet::LeftBorder(const MSImageSetIndex &index)
 	{
-		//if(index._partIndex > 0)
-		//	return _scanCountPartOverlap/2;
-		//else
+		if(index._partIndex > 0)
+			return std::min(_scanCountPartOverlap/2, partLength(index._sequenceIndex, index._partIndex-1));
+		else
 			return 0;
 	}
 
 	size_t MSImageSet::RightBorder(const MSImageSetIndex &index)
 	{
-		//if(index._partIndex + 1 < _partCount)
-		//	return _scanCountPartOverlap/2 + _scanCountPartOverlap%2;
-		//else
+		if(index._partIndex + 1 < PartCount(index._sequenceIndex))
+			return std::min(_scanCountPartOverlap/2 + _scanCountPartOverlap%2, partLength(index._sequenceIndex, index._partIndex+1));
+		else
 			return 0;
 	}
 
 	std::vector<double> MSImageSet::ObservationTimesVector(const ImageSetIndex &index)
 	{
 		const MSImageSetIndex &msIndex = static_cast<const MSImageSetIndex &>(index);
-		// StartIndex(msIndex), EndIndex(msIndex)
 		unsigned sequenceId = _sequences[msIndex._sequenceIndex].sequenceId;
 		const std::set<double> &obsTimesSet = _reader->Set().GetObservationTimesSet(sequenceId);
-		std::vector<double> obs(obsTimesSet.begin(), obsTimesSet.end());
+		std::set<double>::const_iterator start = obsTimesSet.begin(), end = obsTimesSet.begin();
+		std::advance(start, StartIndex(msIndex));
+		std::advance(end, EndIndex(msIndex));
+		std::vector<double> obs(start, end);
 		return obs;
 	}
 			
@@ -160,7 +224,9 @@ namespace rfiStrategy {
 		metaData->SetAntenna2(_set.GetAntennaInfo(GetAntenna2(msIndex)));
 		metaData->SetBand(_set.GetBandInfo(GetBand(msIndex)));
 		metaData->SetField(_set.GetFieldInfo(GetField(msIndex)));
+		metaData->SetSequenceId(_sequences[msIndex._sequenceIndex].sequenceId);
 		metaData->SetObservationTimes(ObservationTimesVector(msIndex));
+		metaData->SetPartBorders(LeftBorder(msIndex), RightBorder(msIndex));
 		if(_reader != 0)
 		{
 			metaData->SetUVW(uvw);
@@ -195,6 +261,12 @@ namespace rfiStrategy {
 			sstream
 				<< ", seq " << sequenceId;
 		}
+		size_t partCount = static_cast<class MSImageSet&>(imageSet()).PartCount(_sequenceIndex);
+		if(partCount > 1)
+		{
+			sstream
+				<< ", part " << (_partIndex+1) << '/' << partCount;
+		}
 		return sstream.str();
 	}
 
@@ -217,7 +289,9 @@ namespace rfiStrategy {
 	void MSImageSet::WriteFlags(const ImageSetIndex &index, TimeFrequencyData &data)
 	{
 		ImageSet::AddWriteFlagsTask(index, data);
+		boost::mutex::scoped_lock lock(*_readerMutex);
 		_reader->PerformFlagWriteRequests();
+		_reader->FinishFlagWriting();
 	}
 
 	void MSImageSet::AddReadRequest(const ImageSetIndex &index)
@@ -228,7 +302,13 @@ namespace rfiStrategy {
 	
 	void MSImageSet::PerformReadRequests()
 	{
-		for(std::vector<BaselineData>::iterator i=_baselineData.begin();i!=_baselineData.end();++i)
+		boost::mutex::scoped_lock lock(*_readRequestMutex);
+		readBaselines(_baselineData);
+	}
+	
+	void MSImageSet::readBaselines(std::vector<BaselineData> &baselines)
+	{
+		for(std::vector<BaselineData>::iterator i=baselines.begin();i!=baselines.end();++i)
 		{
 			MSImageSetIndex &index = static_cast<MSImageSetIndex&>(i->Index());
 			_reader->AddReadRequest(GetAntenna1(index), GetAntenna2(index), GetBand(index), GetSequenceId(index), StartIndex(index), EndIndex(index));
@@ -236,18 +316,80 @@ namespace rfiStrategy {
 		
 		_reader->PerformReadRequests();
 		
-		for(std::vector<BaselineData>::iterator i=_baselineData.begin();i!=_baselineData.end();++i)
+		for(std::vector<BaselineData>::iterator i=baselines.begin();i!=baselines.end();++i)
 		{
 			if(!i->Data().IsEmpty())
 				throw std::runtime_error("ReadRequest() called, but a previous read request was not completely processed by calling GetNextRequested().");
 			std::vector<UVW> uvw;
 			TimeFrequencyData data = _reader->GetNextResult(uvw);
+			if(_readFlags)
+				restoreBorderFlags(static_cast<MSImageSetIndex&>(i->Index()), data);
 			i->SetData(data);
 			TimeFrequencyMetaDataCPtr metaData = createMetaData(i->Index(), uvw);
 			i->SetMetaData(metaData);
 		}
 	}
 	
+	/**
+	 * The border of a part holds time steps of the neighbouring part. When that part has
+	 * been read before, its flags may already have been written, and the border would
+	 * depend on whether that write was done before this read. Therefore, the first of
+	 * two neighbouring parts that is read keeps the flags of the time steps that form the
+	 * border of the other part, and the other part replaces its border flags with them.
+	 * When the other part is read first, the flags of the first cannot have been written
+	 * yet, so that what it reads is already what was in the set before.
+	 */
+	void MSImageSet::restoreBorderFlags(const MSImageSetIndex &index, TimeFrequencyData &data)
+	{
+		const size_t
+			width = data.ImageWidth(),
+			leftBorder = LeftBorder(index),
+			rightBorder = RightBorder(index);
+		BorderFlagMap &borderFlags = *_originalBorderFlags;
+		if(leftBorder != 0)
+		{
+			PartBorder border(index._sequenceIndex, index._partIndex, true);
+			BorderFlagMap::iterator original = borderFlags.find(border);
+			if(original != borderFlags.end())
+			{
+				for(size_t m=0;m<data.MaskCount();++m)
+				{
+					Mask2DPtr mask = Mask2D::CreateCopy(data.GetMask(m));
+					mask->CopyFrom(original->second[m], 0, 0);
+					data.SetMask(m, mask);
+				}
+				borderFlags.erase(original);
+			} else {
+				MSImageSetIndex previous(index);
+				previous._partIndex = index._partIndex - 1;
+				std::vector<Mask2DCPtr> &flags = borderFlags[PartBorder(index._sequenceIndex, previous._partIndex, false)];
+				for(size_t m=0;m<data.MaskCount();++m)
+					flags.push_back(data.GetMask(m)->Trim(leftBorder, 0, leftBorder + RightBorder(previous), data.ImageHeight()));
+			}
+		}
+		if(rightBorder != 0)
+		{
+			PartBorder border(index._sequenceIndex, index._partIndex, false);
+			BorderFlagMap::iterator original = borderFlags.find(border);
+			if(original != borderFlags.end())
+			{
+				for(size_t m=0;m<data.MaskCount();++m)
+				{
+					Mask2DPtr mask = Mask2D::CreateCopy(data.GetMask(m));
+					mask->CopyFrom(original->second[m], width - rightBorder, 0);
+					data.SetMask(m, mask);
+				}
+				borderFlags.erase(original);
+			} else {
+				MSImageSetIndex next(index);
+				next._partIndex = index._partIndex + 1;
+				std::vector<Mask2DCPtr> &flags = borderFlags[PartBorder(index._sequenceIndex, next._partIndex, true)];
+				for(size_t m=0;m<data.MaskCount();++m)
+					flags.push_back(data.GetMask(m)->Trim(width - rightBorder - LeftBorder(next), 0, width - rightBorder, data.ImageHeight()));
+			}
+		}
+	}
+	
 	BaselineData *MSImageSet::GetNextRequested()
 	{
 		BaselineData top = _baselineData.front();
@@ -257,9 +399,109 @@ namespace rfiStrategy {
 		return new BaselineData(top);
 	}
 	
+	size_t MSImageSet::PrefetchReadRequests()
+	{
+		boost::mutex::scoped_lock lock(_prefetchMutex);
+		if(_prefetchThread == 0)
+		{
+			PrefetchFunction function(*this);
+			_prefetchThread = new boost::thread(function);
+		}
+		PrefetchBatch *batch = new PrefetchBatch();
+		batch->baselines.swap(_baselineData);
+		batch->isRead = false;
+		batch->readTime = 0.0;
+		size_t batchIndex = _nextPrefetchBatch;
+		++_nextPrefetchBatch;
+		_prefetchBatches.insert(std::pair<size_t, PrefetchBatch*>(batchIndex, batch));
+		_prefetchQueue.push_back(batch);
+		_prefetchChange.notify_all();
+		return batchIndex;
+	}
+	
+	double MSImageSet::GetPrefetched(size_t batchIndex, std::vector<BaselineData*> &baselines)
+	{
+		boost::mutex::scoped_lock lock(_prefetchMutex);
+		std::map<size_t, PrefetchBatch*>::iterator batchPtr = _prefetchBatches.find(batchIndex);
+		if(batchPtr == _prefetchBatches.end())
+			throw std::runtime_error("GetPrefetched() was called for a batch that was not prefetched or was already collected.");
+		PrefetchBatch *batch = batchPtr->second;
+		while(!batch->isRead)
+			_prefetchChange.wait(lock);
+		_prefetchBatches.erase(batchPtr);
+		lock.unlock();
+		
+		if(!batch->error.empty())
+		{
+			std::string error = batch->error;
+			delete batch;
+			throw std::runtime_error(error);
+		}
+		for(std::vector<BaselineData>::const_iterator i=batch->baselines.begin();i!=batch->baselines.end();++i)
+			baselines.push_back(new BaselineData(*i));
+		double readTime = batch->readTime;
+		delete batch;
+		return readTime;
+	}
+	
+	void MSImageSet::prefetchBatches()
+	{
+		boost::mutex::scoped_lock lock(_prefetchMutex);
+		while(true)
+		{
+			while(_prefetchQueue.empty() && !_stopPrefetching)
+				_prefetchChange.wait(lock);
+			if(_stopPrefetching)
+				break;
+			PrefetchBatch *batch = _prefetchQueue.front();
+			_prefetchQueue.pop_front();
+			lock.unlock();
+			
+			double readTime = 0.0;
+			std::string error;
+			try {
+				// Flags are written under the reader mutex, so they need not wait for the read
+				boost::mutex::scoped_lock readRequestLock(*_readRequestMutex);
+				Stopwatch watch(true);
+				readBaselines(batch->baselines);
+				readTime = watch.Seconds();
+			} catch(std::exception &e)
+			{
+				error = e.what();
+			}
+			
+			lock.lock();
+			batch->readTime = readTime;
+			batch->error = error;
+			batch->isRead = true;
+			_prefetchChange.notify_all();
+		}
+	}
+	
+	void MSImageSet::stopPrefetching()
+	{
+		boost::mutex::scoped_lock lock(_prefetchMutex);
+		if(_prefetchThread != 0)
+		{
+			_stopPrefetching = true;
+			_prefetchChange.notify_all();
+			lock.unlock();
+			_prefetchThread->join();
+			delete _prefetchThread;
+			lock.lock();
+			_prefetchThread = 0;
+		}
+		// Batches are only left when their reader stopped because of an error
+		for(std::map<size_t, PrefetchBatch*>::iterator i=_prefetchBatches.begin();i!=_prefetchBatches.end();++i)
+			delete i->second;
+		_prefetchBatches.clear();
+		_prefetchQueue.clear();
+	}
+	
 	void MSImageSet::AddWriteFlagsTask(const ImageSetIndex &index, std::vector<Mask2DCPtr> &flags)
 	{
 		const MSImageSetIndex &msIndex = static_cast<const MSImageSetIndex&>(index);
+		boost::mutex::scoped_lock lock(*_readerMutex);
 		initReader();
 		size_t a1 = _sequences[msIndex._sequenceIndex].antenna1;
 		size_t a2 = _sequences[msIndex._sequenceIndex].antenna2;
@@ -279,11 +521,12 @@ namespace rfiStrategy {
 		}
 		else allFlags = flags;
 		
-		_reader->AddWriteTask(allFlags, a1, a2, b, s);
+		_reader->AddWriteTask(allFlags, a1, a2, b, s, StartIndex(msIndex), EndIndex(msIndex), LeftBorder(msIndex), RightBorder(msIndex));
 	}
 	
 	void MSImageSet::PerformWriteFlagsTask()
 	{
+		boost::mutex::scoped_lock lock(*_readerMutex);
 		_reader->PerformFlagWriteRequests();
 	}
 
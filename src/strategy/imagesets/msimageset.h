@@ -20,10 +20,17 @@
 #ifndef MSIMAGESET_H
 #define MSIMAGESET_H
 
+#include <deque>
+#include <map>
 #include <set>
 #include <string>
 #include <stdexcept>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "../../msio/antennainfo.h"
 #include "../../msio/timefrequencydata.h"
 #include "../../msio/timefrequencymetadata.h"
@@ -44,7 +51,7 @@ namespace rfiStrategy {
 		public:
 			friend class MSImageSet;
 			
-			MSImageSetIndex(class rfiStrategy::ImageSet &set) : ImageSetIndex(set), _sequenceIndex(0), _isValid(true) { }
+			MSImageSetIndex(class rfiStrategy::ImageSet &set) : ImageSetIndex(set), _sequenceIndex(0), _partIndex(0), _isValid(true) { }
 			
 			virtual void Previous();
 			virtual void Next();
@@ -56,11 +63,14 @@ namespace rfiStrategy {
 			{
 				MSImageSetIndex *index = new MSImageSetIndex(imageSet());
 				index->_sequenceIndex = _sequenceIndex;
+				index->_partIndex = _partIndex;
 				index->_isValid = _isValid;
 				return index;
 			}
 		private:
 			size_t _sequenceIndex;
+			// The index of the time chunk within the sequence (see MSImageSet::SetMaxScanCountPerPart())
+			size_t _partIndex;
 			bool _isValid;
 	};
 	
@@ -76,14 +86,22 @@ namespace rfiStrategy {
 				_readDipoleCrossPolarisations(true),
 				_readStokesI(false),
 				_scanCountPartOverlap(100),
+				_maxScanCountPerPart(0),
 				_readFlags(true),
 				_readUVW(false),
-				_ioMode(ioMode)
+				_ioMode(ioMode),
+				_readerMutex(new boost::mutex()),
+				_readRequestMutex(new boost::mutex()),
+				_originalBorderFlags(new BorderFlagMap()),
+				_prefetchThread(0),
+				_stopPrefetching(false),
+				_nextPrefetchBatch(0)
 			{
 			}
 			
 			~MSImageSet()
 			{
+				stopPrefetching();
 			}
 
 			virtual MSImageSet *Copy()
@@ -99,9 +117,13 @@ namespace rfiStrategy {
 				newSet->_readDipoleCrossPolarisations = _readDipoleCrossPolarisations;
 				newSet->_readStokesI = _readStokesI;
 				newSet->_scanCountPartOverlap = _scanCountPartOverlap;
+				newSet->_maxScanCountPerPart = _maxScanCountPerPart;
 				newSet->_readFlags = _readFlags;
 				newSet->_readUVW = _readUVW;
 				newSet->_ioMode = _ioMode;
+				newSet->_readerMutex = _readerMutex;
+				newSet->_readRequestMutex = _readRequestMutex;
+				newSet->_originalBorderFlags = _originalBorderFlags;
 				return newSet;
 			}
 	
@@ -112,6 +134,23 @@ namespace rfiStrategy {
 			virtual void AddReadRequest(const ImageSetIndex &index);
 			virtual void PerformReadRequests();
 			virtual BaselineData *GetNextRequested();
+			
+			/**
+			 * Reads the requests that were added with AddReadRequest() in the background.
+			 * Unlike PerformReadRequests(), this call does not wait for the read, so that the
+			 * caller does not need to hold the IO mutex while the baselines are read. Batches
+			 * are read one after the other, in the order in which they were added.
+			 * @returns The number by which the batch can be collected with GetPrefetched().
+			 */
+			size_t PrefetchReadRequests();
+			
+			/**
+			 * Waits until the given batch has been read and returns its baselines in the
+			 * order in which they were requested. The caller takes ownership of them. An
+			 * error that occurred while reading the batch is thrown here.
+			 * @returns The time in seconds that reading the batch took.
+			 */
+			double GetPrefetched(size_t batch, std::vector<BaselineData*> &baselines);
 
 			virtual void AddWriteFlagsTask(const ImageSetIndex &index, std::vector<Mask2DCPtr> &flags);
 			virtual void PerformWriteFlagsTask();
@@ -193,15 +232,53 @@ namespace rfiStrategy {
 				return _set.GetFieldInfo(fieldIndex);
 			}
 			std::vector<double> ObservationTimesVector(const ImageSetIndex &index);
+			/**
+			 * Number of samples (channels times timesteps) in one polarisation of the baseline,
+			 * determined without reading the baseline.
+			 */
+			size_t SampleCount(const ImageSetIndex &index)
+			{
+				const MSImageSetIndex &msIndex = static_cast<const MSImageSetIndex&>(index);
+				return _set.GetBandInfo(GetBand(index)).channels.size() * (EndIndex(msIndex) - StartIndex(msIndex));
+			}
+			
+			/**
+			 * Splits the time axis of each baseline into parts of at most the given number of
+			 * time steps, each of which is read, flagged and written separately. This bounds
+			 * the memory used per baseline by the part size instead of by the length of the
+			 * observation. Zero (the default) processes each baseline as a whole.
+			 * Parts are only supported by the direct and indirect readers; in auto read mode,
+			 * the direct reader is selected.
+			 */
+			void SetMaxScanCountPerPart(size_t maxScanCount)
+			{
+				if(_reader != 0)
+					throw std::runtime_error("Trying to set the part size after creating the reader!");
+				_maxScanCountPerPart = maxScanCount;
+			}
+			size_t MaxScanCountPerPart() const { return _maxScanCountPerPart; }
+			
+			/**
+			 * Number of time steps by which consecutive parts overlap. Flagging algorithms that
+			 * look at neighbouring time steps, such as SumThreshold and the high-pass filter, see
+			 * the overlapping time steps as context, but only the flags of the time steps within
+			 * the part are written. A border does not extend beyond the neighbouring part, and
+			 * it always holds the flags that were in the set before the neighbouring part was
+			 * flagged, so that the result does not depend on the order of reading and writing.
+			 */
+			void SetScanCountPartOverlap(size_t overlap) { _scanCountPartOverlap = overlap; }
+			size_t ScanCountPartOverlap() const { return _scanCountPartOverlap; }
 			size_t BandCount() const { return _bandCount; }
 			size_t FieldCount() const { return _fieldCount; }
 			size_t SequenceCount() const { return _sequencesPerBaselineCount; }
 			virtual void WriteFlags(const ImageSetIndex &index, TimeFrequencyData &data);
+			virtual bool HasConcurrentFlagWriting() const { return true; }
 			void SetReadFlags(bool readFlags) { _readFlags = readFlags; }
 			BaselineReaderPtr Reader() { return _reader; }
 			virtual void PerformWriteDataTask(const ImageSetIndex &index, std::vector<Image2DCPtr> realImages, std::vector<Image2DCPtr> imaginaryImages)
 			{
 				const MSImageSetIndex &msIndex = static_cast<const MSImageSetIndex&>(index);
+				boost::mutex::scoped_lock lock(*_readerMutex);
 				_reader->PerformDataWriteTask(realImages, imaginaryImages, GetAntenna1(msIndex), GetAntenna2(msIndex), GetBand(msIndex), GetSequenceId(msIndex));
 			}
 			void SetReadUVW(bool readUVW)
@@ -217,15 +294,71 @@ namespace rfiStrategy {
 				_readDipoleCrossPolarisations(true),
 				_readStokesI(false),
 				_scanCountPartOverlap(100),
+				_maxScanCountPerPart(0),
 				_readFlags(true),
 				_readUVW(false),
-				_ioMode(AutoReadMode)
+				_ioMode(AutoReadMode),
+				_readerMutex(new boost::mutex()),
+				_readRequestMutex(new boost::mutex()),
+				_originalBorderFlags(new BorderFlagMap()),
+				_prefetchThread(0),
+				_stopPrefetching(false),
+				_nextPrefetchBatch(0)
 			{ }
+			
+			/**
+			 * Baselines that are read by the prefetch thread.
+			 */
+			struct PrefetchBatch
+			{
+				std::vector<BaselineData> baselines;
+				bool isRead;
+				double readTime;
+				std::string error;
+			};
+			
+			struct PrefetchFunction
+			{
+				PrefetchFunction(MSImageSet &imageSet) : _imageSet(imageSet) { }
+				void operator()() { _imageSet.prefetchBatches(); }
+				MSImageSet &_imageSet;
+			};
+			
+			/**
+			 * Identifies the left or right border of a part of a sequence.
+			 */
+			struct PartBorder
+			{
+				PartBorder(size_t _sequenceIndex, size_t _partIndex, bool _isLeft) :
+					sequenceIndex(_sequenceIndex), partIndex(_partIndex), isLeft(_isLeft)
+				{ }
+				bool operator<(const PartBorder &rhs) const
+				{
+					if(sequenceIndex != rhs.sequenceIndex)
+						return sequenceIndex < rhs.sequenceIndex;
+					if(partIndex != rhs.partIndex)
+						return partIndex < rhs.partIndex;
+					return isLeft < rhs.isLeft;
+				}
+				size_t sequenceIndex, partIndex;
+				bool isLeft;
+			};
+			typedef std::map<PartBorder, std::vector<Mask2DCPtr> > BorderFlagMap;
+			
+
 			size_t StartIndex(const MSImageSetIndex &index);
 			size_t EndIndex(const MSImageSetIndex &index);
 			size_t LeftBorder(const MSImageSetIndex &index);
 			size_t RightBorder(const MSImageSetIndex &index);
+			size_t PartCount(size_t sequenceIndex);
+			size_t partLength(size_t sequenceIndex, size_t partIndex);
+			size_t ScanCount(size_t sequenceIndex);
 			void initReader();
+			void readBaselines(std::vector<BaselineData> &baselines);
+			void restoreBorderFlags(const MSImageSetIndex &index, TimeFrequencyData &data);
+			void prefetchBatches();
+			void stopPrefetching();
+			BaselineReader *createMemoryReader(bool packSamples) const;
 			size_t FindBaselineIndex(size_t antenna1, size_t antenna2, size_t band, size_t sequenceId);
 			TimeFrequencyMetaDataCPtr createMetaData(const ImageSetIndex &index, std::vector<UVW> &uvw);
 
@@ -237,10 +370,30 @@ namespace rfiStrategy {
 			bool _readDipoleAutoPolarisations, _readDipoleCrossPolarisations, _readStokesI;
 			std::vector<MeasurementSet::Sequence> _sequences;
 			size_t _bandCount, _fieldCount, _sequencesPerBaselineCount;
-			size_t _scanCountPartOverlap;
+			size_t _scanCountPartOverlap, _maxScanCountPerPart;
 			bool _readFlags, _readUVW;
 			BaselineIOMode _ioMode;
 			std::vector<BaselineData> _baselineData;
+			
+			// The reader is shared by all copies of the set, and the prefetch thread and the
+			// flag writing threads use it without the IO mutex. Therefore, the copies share
+			// two mutexes: the reader mutex serializes the write requests and the read
+			// request mutex serializes the read requests. The reader performs reads and
+			// writes concurrently, and locks the table itself.
+			boost::shared_ptr<boost::mutex> _readerMutex, _readRequestMutex;
+			
+			// The flags of the borders of parts whose neighbouring part has been read
+			// before them, as they were before that neighbour was flagged. Only used by
+			// readBaselines(), under the read request mutex.
+			boost::shared_ptr<BorderFlagMap> _originalBorderFlags;
+			
+			boost::thread *_prefetchThread;
+			bool _stopPrefetching;
+			size_t _nextPrefetchBatch;
+			std::map<size_t, PrefetchBatch*> _prefetchBatches;
+			std::deque<PrefetchBatch*> _prefetchQueue;
+			boost::mutex _prefetchMutex;
+			boost::condition _prefetchChange;
 	};
 
 }
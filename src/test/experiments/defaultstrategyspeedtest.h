@@ -25,7 +25,9 @@
 
 #include "../../strategy/algorithms/mitigationtester.h"
 #include "../../strategy/algorithms/siroperator.h"
+#include "../../strategy/algorithms/thresholdtools.h"
 #include "../../strategy/algorithms/thresholdmitigater.h"
+#include "../../strategy/algorithms/tiledsumthreshold.h"
 
 #include "../../strategy/actions/baselineselectionaction.h"
 #include "../../strategy/actions/changeresolutionaction.h"
@@ -67,6 +69,7 @@ class DefaultStrategySpeedTest : public UnitTest {
 			AddTest(TimeHighPassFilter(), "Timing high-pass filter");
 			AddTest(TimeStrategy(), "Timing strategy");
 			AddTest(TimeSSEHighPassFilterStrategy(), "Timing SSE high-pass filter strategy");
+			AddTest(TimeWinsorizedStatistics(), "Timing winsorized statistics");
 		}
 		
 		DefaultStrategySpeedTest(const std::string &) : UnitTest("Default strategy speed test")
@@ -111,6 +114,15 @@ class DefaultStrategySpeedTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TimeWinsorizedStatistics : public Asserter
+		{
+			void operator()();
+			/**
+			 * The sort-based implementation that ThresholdTools used before it selected
+			 * the winsorization limits, as a reference for the timing and results.
+			 */
+			static void sortedWinsorizedMeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev);
+		};
 		
 		static void prepareStrategy(rfiStrategy::ArtifactSet &artifacts);
 };
@@ -393,7 +405,44 @@ inline void DefaultStrategySpeedTest::TimeSumThresholdN::operator()()
 		Stopwatch watchD(true);
 		ThresholdMitigater::VerticalSumThresholdLargeSSE(input, maskD, length, threshold);
 		AOLogger::Info << "SSE Vertical, length " << length << ": " << watchD.ToString() << '\n';
+		
+		if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX2Implementation)
+		{
+			Mask2DPtr maskE = Mask2D::CreateCopy(artifacts.OriginalData().GetSingleMask());
+			Stopwatch watchE(true);
+			ThresholdMitigater::HorizontalSumThresholdLargeAVX2(input, maskE, length, threshold);
+			AOLogger::Info << "Horizontal AVX2, length " << length << ": " << watchE.ToString() << '\n';
+			
+			Mask2DPtr maskF = Mask2D::CreateCopy(artifacts.OriginalData().GetSingleMask());
+			Stopwatch watchF(true);
+			ThresholdMitigater::VerticalSumThresholdLargeAVX2(input, maskF, length, threshold);
+			AOLogger::Info << "AVX2 Vertical, length " << length << ": " << watchF.ToString() << '\n';
+		}
+		
+		if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX512Implementation)
+		{
+			Mask2DPtr maskG = Mask2D::CreateCopy(artifacts.OriginalData().GetSingleMask());
+			Stopwatch watchG(true);
+			ThresholdMitigater::HorizontalSumThresholdLargeAVX512(input, maskG, length, threshold);
+			AOLogger::Info << "Horizontal AVX-512, length " << length << ": " << watchG.ToString() << '\n';
+			
+			Mask2DPtr maskH = Mask2D::CreateCopy(artifacts.OriginalData().GetSingleMask());
+			Stopwatch watchH(true);
+			ThresholdMitigater::VerticalSumThresholdLargeAVX512(input, maskH, length, threshold);
+			AOLogger::Info << "AVX-512 Vertical, length " << length << ": " << watchH.ToString() << '\n';
+		}
 	}
+	
+	Mask2DPtr mask = Mask2D::CreateCopy(artifacts.OriginalData().GetSingleMask());
+	Stopwatch watch(true);
+	TiledSumThreshold tiledSumThreshold(artifacts.OriginalData().GetSingleImage());
+	for(unsigned i=0;i<9;++i)
+	{
+		tiledSumThreshold.AddHorizontalOperation(config.GetHorizontalLength(i), config.GetHorizontalThreshold(i));
+		tiledSumThreshold.AddVerticalOperation(config.GetVerticalLength(i), config.GetVerticalThreshold(i));
+	}
+	tiledSumThreshold.Execute(mask);
+	AOLogger::Info << "Tiled series of all lengths: " << watch.ToString() << '\n';
 }
 
 inline void DefaultStrategySpeedTest::TimeRankOperator::operator()()
@@ -426,6 +475,71 @@ inline void DefaultStrategySpeedTest::TimeRankOperator::operator()()
 		<< ", " << ( operatorTime * 100.0 / totalTime) << "%\n";
 }
 
+inline void DefaultStrategySpeedTest::TimeWinsorizedStatistics::sortedWinsorizedMeanAndStdDev(const Image2DCPtr &image, const Mask2DCPtr &mask, num_t &mean, num_t &stddev)
+{
+	num_t *data = new num_t[image->Width() * image->Height()];
+	size_t unflaggedCount = 0;
+	for(size_t y=0;y<image->Height();++y)
+	{
+		for(size_t x=0;x<image->Width();++x)
+		{
+			if(!mask->Value(x, y) && std::isfinite(image->Value(x, y)))
+			{
+				data[unflaggedCount] = image->Value(x, y);
+				++unflaggedCount;
+			}
+		}
+	}
+	std::sort(data, data + unflaggedCount);
+	const num_t
+		lowValue = data[(size_t) floor(0.1 * unflaggedCount)],
+		highValue = data[(size_t) ceil(0.9 * unflaggedCount) - 1];
+	mean = 0.0;
+	for(size_t i=0;i<unflaggedCount;++i)
+		mean += std::max(lowValue, std::min(highValue, data[i]));
+	mean /= (num_t) unflaggedCount;
+	stddev = 0.0;
+	for(size_t i=0;i<unflaggedCount;++i)
+	{
+		const num_t value = std::max(lowValue, std::min(highValue, data[i]));
+		stddev += (value-mean)*(value-mean);
+	}
+	stddev = sqrtn(1.54 * stddev / (num_t) unflaggedCount);
+	delete[] data;
+}
+
+inline void DefaultStrategySpeedTest::TimeWinsorizedStatistics::operator()()
+{
+	const unsigned
+		width = 10000,
+		height = 256,
+		repeatCount = 10;
+	Mask2DPtr rfi = Mask2D::CreateUnsetMaskPtr(width, height);
+	Image2DCPtr image = MitigationTester::CreateTestSet(26, rfi, width, height);
+	
+	num_t sortedMean = 0.0, sortedStddev = 0.0;
+	Stopwatch sortWatch(true);
+	for(unsigned i=0;i<repeatCount;++i)
+		sortedWinsorizedMeanAndStdDev(image, rfi, sortedMean, sortedStddev);
+	sortWatch.Pause();
+	
+	num_t mean = 0.0, stddev = 0.0;
+	Stopwatch selectWatch(true);
+	for(unsigned i=0;i<repeatCount;++i)
+		ThresholdTools::WinsorizedMeanAndStdDev(image, rfi, mean, stddev);
+	selectWatch.Pause();
+	
+	// The sums are taken in a different order, so the results are only approximately equal
+	AssertLessThan(fabs(mean - sortedMean), 1e-3 * sortedStddev, "Mean of selection and sort-based implementation");
+	AssertLessThan(fabs(stddev - sortedStddev), 1e-3 * sortedStddev, "Standard deviation of selection and sort-based implementation");
+	
+	AOLogger::Info
+		<< "Winsorized mean and stddev of " << width << " x " << height << " samples, " << repeatCount << " times:\n"
+		<< "  sort-based: " << sortWatch.ToShortString() << '\n'
+		<< "  selection: " << selectWatch.ToShortString() << " ("
+		<< (sortWatch.Seconds() / selectWatch.Seconds()) << " x faster)\n";
+}
+
 inline void DefaultStrategySpeedTest::TimeSSEHighPassFilterStrategy::operator()()
 {
 	rfiStrategy::Strategy *strategy = new rfiStrategy::Strategy();
@@ -34,6 +34,7 @@ class HighPassFilterExperiment : public UnitTest {
 		{
 			AddTest(TimeFitting(), "Timing 'Fitting' algorithm");
 			AddTest(TimeHighPassFilter(), "Timing 'high-pass filter' algorithm");
+			AddTest(TimeBoxHighPassFilter(), "Timing 'high-pass filter' algorithm with box filters");
 			AddTest(TimeFlaggedFitting(), "Timing 'Fitting' algorithm with 50% flags");
 			AddTest(TimeFlaggedHighPassFilter(), "Timing 'high-pass filter' algorithm with 50% flags");
 		}
@@ -81,6 +82,10 @@ class HighPassFilterExperiment : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TimeBoxHighPassFilter : public Asserter
+		{
+			void operator()();
+		};
 		struct TimeFlaggedFitting : public Asserter
 		{
 			void operator()();
@@ -123,6 +128,23 @@ inline void HighPassFilterExperiment::TimeHighPassFilter::operator()()
 	std::cout << " time token: " << watch.ToString() << ' ';
 }
 
+inline void HighPassFilterExperiment::TimeBoxHighPassFilter::operator()()
+{
+	Image2DPtr image;
+	Mask2DPtr mask;
+	Initialize(image, mask);
+	
+	HighPassFilter filter;
+	filter.SetHWindowSize(21);
+	filter.SetVWindowSize(41);
+	filter.SetHKernelSigmaSq(2.5);
+	filter.SetVKernelSigmaSq(5.0);
+	filter.SetMethod(HighPassFilter::BoxFilterMethod);
+	Stopwatch watch(true);
+	filter.ApplyHighPass(image, mask);
+	std::cout << " time token: " << watch.ToString() << ' ';
+}
+
 inline void HighPassFilterExperiment::TimeFlaggedFitting::operator()()
 {
 	Image2DPtr image;
@@ -0,0 +1,136 @@
+#ifndef AOFLAGGER_BITMASK2DTEST_H
+#define AOFLAGGER_BITMASK2DTEST_H
+
+#include <sstream>
+
+#include "../../msio/bitmask2d.h"
+#include "../../msio/mask2d.h"
+
+#include "../../util/rng.h"
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/maskasserter.h"
+#include "../testingtools/unittest.h"
+
+class BitMask2DTest : public UnitTest {
+	public:
+		BitMask2DTest() : UnitTest("Bit-packed mask")
+		{
+			AddTest(TestConversion(), "Conversion from and to Mask2D");
+			AddTest(TestCombining(), "Join, intersect and invert");
+			AddTest(TestDilation(), "Dilation");
+		}
+
+	private:
+		struct TestConversion : public Asserter
+		{
+			void operator()();
+		};
+		struct TestCombining : public Asserter
+		{
+			void operator()();
+		};
+		struct TestDilation : public Asserter
+		{
+			void operator()();
+		};
+
+		static Mask2DPtr createRandomMask(size_t width, size_t height, double probability)
+		{
+			Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(width, height);
+			for(size_t y=0;y<height;++y)
+			{
+				for(size_t x=0;x<width;++x)
+					mask->SetValue(x, y, RNG::Uniform() < probability);
+			}
+			return mask;
+		}
+};
+
+inline void BitMask2DTest::TestConversion::operator()()
+{
+	// Widths around the word size, to test the partially filled last words
+	const size_t widths[] = { 1, 7, 8, 63, 64, 65, 131 };
+	for(size_t i=0;i<7;++i)
+	{
+		Mask2DPtr mask = createRandomMask(widths[i], 5, 0.5);
+		BitMask2DPtr packed = BitMask2D::CreateFromMask(mask);
+		std::stringstream s;
+		s << "Width " << widths[i];
+		AssertEquals(packed->GetCount<true>(), mask->GetCount<true>(), "Count of true values, " + s.str());
+		AssertEquals(packed->GetCount<false>(), mask->GetCount<false>(), "Count of false values, " + s.str());
+
+		Mask2DPtr unpacked = packed->CreateMask();
+		MaskAsserter::AssertEqualMasks(unpacked, mask, "Round trip conversion, " + s.str());
+	}
+
+	BitMask2DPtr empty = BitMask2D::CreateSetMaskPtr<false>(100, 3);
+	AssertTrue(empty->AllFalse(), "AllFalse() on empty mask");
+	empty->SetValue(99, 2, true);
+	AssertFalse(empty->AllFalse(), "AllFalse() on mask with one flag");
+	AssertEquals(BitMask2D::CreateSetMaskPtr<true>(100, 3)->GetCount<true>(), (size_t) 300, "Count of fully set mask");
+}
+
+inline void BitMask2DTest::TestCombining::operator()()
+{
+	Mask2DPtr
+		maskA = createRandomMask(77, 9, 0.3),
+		maskB = createRandomMask(77, 9, 0.3);
+	BitMask2DPtr
+		packedA = BitMask2D::CreateFromMask(maskA),
+		packedB = BitMask2D::CreateFromMask(maskB);
+
+	Mask2DPtr expected = Mask2D::CreateCopy(maskA);
+	expected->Join(maskB);
+	BitMask2DPtr joined = BitMask2D::CreateCopy(packedA);
+	joined->Join(packedB);
+	MaskAsserter::AssertEqualMasks(joined->CreateMask(), expected, "Join");
+
+	expected = Mask2D::CreateCopy(maskA);
+	expected->Intersect(maskB);
+	BitMask2DPtr intersected = BitMask2D::CreateCopy(packedA);
+	intersected->Intersect(packedB);
+	MaskAsserter::AssertEqualMasks(intersected->CreateMask(), expected, "Intersect");
+
+	expected = Mask2D::CreateCopy(maskA);
+	expected->Invert();
+	BitMask2DPtr inverted = BitMask2D::CreateCopy(packedA);
+	inverted->Invert();
+	MaskAsserter::AssertEqualMasks(inverted->CreateMask(), expected, "Invert");
+	AssertEquals(inverted->GetCount<true>(), expected->GetCount<true>(), "Count after invert");
+}
+
+inline void BitMask2DTest::TestDilation::operator()()
+{
+	const size_t distances[] = { 1, 2, 3, 5, 13, 64, 70, 200 };
+	for(size_t i=0;i<8;++i)
+	{
+		Mask2DPtr mask = createRandomMask(150, 150, 0.005);
+		BitMask2DPtr packed = BitMask2D::CreateFromMask(mask);
+		packed->DilateHorizontally(distances[i]);
+		packed->DilateVertically(distances[i]);
+
+		// Straightforward reference implementation
+		const int d = distances[i];
+		Mask2DPtr expected = Mask2D::CreateSetMaskPtr<false>(150, 150);
+		for(int y=0;y<150;++y)
+		{
+			for(int x=0;x<150;++x)
+			{
+				if(mask->Value(x, y))
+				{
+					for(int ey=std::max(0, y-d);ey<std::min(150, y+d+1);++ey)
+					{
+						for(int ex=std::max(0, x-d);ex<std::min(150, x+d+1);++ex)
+							expected->SetValue(ex, ey, true);
+					}
+				}
+			}
+		}
+		std::stringstream s;
+		s << "Dilation with distance " << d;
+		MaskAsserter::AssertEqualMasks(packed->CreateMask(), expected, s.str());
+	}
+}
+
+#endif
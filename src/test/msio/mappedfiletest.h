@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_MAPPEDFILETEST_H
+#define AOFLAGGER_MAPPEDFILETEST_H
+
+#include <cstdio>
+#include <fstream>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../msio/mappedfile.h"
+
+class MappedFileTest : public UnitTest {
+	public:
+		MappedFileTest() : UnitTest("Memory-mapped files")
+		{
+			AddTest(TestReadWrite(), "Reading and writing through the mapping");
+		}
+
+	private:
+		struct TestReadWrite : public Asserter
+		{
+			void operator()();
+		};
+};
+
+inline void MappedFileTest::TestReadWrite::operator()()
+{
+	const char *filename = "mappedfiletest.tmp";
+	{
+		std::ofstream file(filename, std::ios_base::binary);
+		for(size_t i=0;i!=10000;++i)
+		{
+			float value = i;
+			file.write(reinterpret_cast<const char*>(&value), sizeof(float));
+		}
+	}
+	{
+		MappedFile mapping(filename, true);
+		AssertEquals(mapping.Size(), (size_t) 10000 * sizeof(float));
+		float *values = reinterpret_cast<float*>(mapping.Data());
+		mapping.WillNeed(5000 * sizeof(float), 5000 * sizeof(float));
+		AssertEquals(values[0], 0.0f);
+		AssertEquals(values[9999], 9999.0f);
+		values[1234] = -1.0f;
+		mapping.Sync();
+		// A range that does not start on a page
+		values[5678] = -2.0f;
+		mapping.Sync(5678 * sizeof(float), sizeof(float));
+		mapping.Sync(9999 * sizeof(float), 100 * sizeof(float));
+	}
+	{
+		std::ifstream file(filename, std::ios_base::binary);
+		file.seekg(1234 * sizeof(float));
+		float value;
+		file.read(reinterpret_cast<char*>(&value), sizeof(float));
+		AssertEquals(value, -1.0f, "Value written through mapping");
+		file.seekg(5678 * sizeof(float));
+		file.read(reinterpret_cast<char*>(&value), sizeof(float));
+		AssertEquals(value, -2.0f, "Value synced as range");
+	}
+	std::remove(filename);
+}
+
+#endif
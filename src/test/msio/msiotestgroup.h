@@ -22,12 +22,21 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "bitmask2dtest.h"
+#include "mappedfiletest.h"
+#include "packedimage2dtest.h"
+#include "samplepooltest.h"
+
 class MSIOTestGroup : public TestGroup {
 	public:
 		MSIOTestGroup() : TestGroup("Measurement set input/output") { }
 		
 		virtual void Initialize()
 		{
+			Add(new BitMask2DTest());
+			Add(new MappedFileTest());
+			Add(new PackedImage2DTest());
+			Add(new SamplePoolTest());
 		}
 };
 
@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_PACKEDIMAGE2DTEST_H
+#define AOFLAGGER_PACKEDIMAGE2DTEST_H
+
+#include <cmath>
+#include <limits>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../msio/image2d.h"
+#include "../../msio/packedimage2d.h"
+
+class PackedImage2DTest : public UnitTest {
+	public:
+		PackedImage2DTest() : UnitTest("Packed images")
+		{
+			AddTest(TestPacking(), "Packing of single values");
+			AddTest(TestImages(), "Packing of images");
+		}
+
+	private:
+		struct TestPacking : public Asserter
+		{
+			void operator()();
+		};
+		struct TestImages : public Asserter
+		{
+			void operator()();
+		};
+};
+
+inline void PackedImage2DTest::TestPacking::operator()()
+{
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(1.0)), 1.0f);
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(-0.375)), -0.375f);
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(0.0)), 0.0f);
+
+	// 1 + 2^-8 lies halfway between 1 and 1 + 2^-7, and is rounded to the even value 1;
+	// 1 + 3*2^-8 lies halfway between 1 + 2^-7 and 1 + 2^-6 and is rounded up.
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(1.0 + 1.0/256.0)), 1.0f, "Tie to even below");
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(1.0 + 3.0/256.0)), 1.0f + 1.0f/64.0f, "Tie to even above");
+
+	const float inf = std::numeric_limits<float>::infinity();
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(inf)), inf, "Infinity");
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(-inf)), -inf, "Negative infinity");
+	AssertTrue(std::isnan(PackedImage2D::Unpack(PackedImage2D::Pack(std::numeric_limits<float>::quiet_NaN()))), "NaN");
+	// The largest float would round to infinity
+	AssertEquals(PackedImage2D::Unpack(PackedImage2D::Pack(std::numeric_limits<float>::max())), inf, "Overflow");
+
+	// A NaN with only low mantissa bits set should not become an infinity
+	uint32_t nanBits = 0x7F800001;
+	float signallingNaN;
+	memcpy(&signallingNaN, &nanBits, sizeof(float));
+	AssertTrue(std::isnan(PackedImage2D::Unpack(PackedImage2D::Pack(signallingNaN))), "NaN with low bits");
+
+	for(float value = 1e-30f; value < 1e30f; value *= 1.37f)
+	{
+		const float unpacked = PackedImage2D::Unpack(PackedImage2D::Pack(value));
+		AssertTrue(std::fabs(unpacked - value) <= value / 256.0f, "Relative error");
+	}
+}
+
+inline void PackedImage2DTest::TestImages::operator()()
+{
+	// An odd width tests both the vectorized and the remaining values of a row
+	const size_t width = 13, height = 5;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			image->SetValue(x, y, (x * 0.7 - 4.0) * (y + 1) * 1.001);
+	}
+	image->SetValue(2, 1, std::numeric_limits<num_t>::quiet_NaN());
+	image->SetValue(3, 1, 1.0 + 1.0/256.0);
+
+	PackedImage2DPtr packed = PackedImage2D::CreateFromImage(image);
+	AssertEquals(packed->Width(), width);
+	AssertEquals(packed->Height(), height);
+	AssertEquals(packed->Stride() % 8, (size_t) 0, "Stride");
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+		{
+			if(x == 2 && y == 1)
+				AssertTrue(std::isnan(packed->Value(x, y)), "NaN in image");
+			else
+				AssertEquals(*packed->ValuePtr(x, y), PackedImage2D::Pack(image->Value(x, y)), "Vectorized packing");
+		}
+	}
+
+	Image2DPtr unpacked = packed->CreateImage();
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+		{
+			if(x != 2 || y != 1)
+				AssertEquals(unpacked->Value(x, y), PackedImage2D::Unpack(*packed->ValuePtr(x, y)), "Vectorized unpacking");
+		}
+	}
+	AssertTrue(std::isnan(unpacked->Value(2, 1)), "NaN in unpacked image");
+
+	PackedImage2DPtr zero = PackedImage2D::CreateZeroImagePtr(width, height);
+	AssertEquals(zero->Value(width-1, height-1), (num_t) 0.0);
+}
+
+#endif
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_SAMPLEPOOLTEST_H
+#define AOFLAGGER_SAMPLEPOOLTEST_H
+
+#include <boost/thread.hpp>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../msio/image2d.h"
+#include "../../msio/mask2d.h"
+#include "../../msio/samplepool.h"
+
+class SamplePoolTest : public UnitTest {
+	public:
+		SamplePoolTest() : UnitTest("Sample pool")
+		{
+			AddTest(TestReuse(), "Reuse of freed blocks");
+			AddTest(TestSharedPool(), "Blocks freed by another thread");
+			AddTest(TestImages(), "Recycling images and masks");
+		}
+
+	private:
+		struct TestReuse : public Asserter
+		{
+			void operator()();
+		};
+		struct TestSharedPool : public Asserter
+		{
+			void operator()();
+		};
+		struct TestImages : public Asserter
+		{
+			void operator()();
+		};
+
+		struct Freer
+		{
+			Freer(void *block, size_t bytes) : _block(block), _bytes(bytes) { }
+			void operator()() { SamplePool::Free(_block, _bytes); }
+			void *_block;
+			size_t _bytes;
+		};
+};
+
+inline void SamplePoolTest::TestReuse::operator()()
+{
+	// Without limits, nothing is kept
+	SamplePool::Release();
+	SamplePool::ResetThreadStatistics();
+	void *block = SamplePool::Allocate(100000);
+	SamplePool::Free(block, 100000);
+	AssertEquals(SamplePool::ThreadPoolBytes(), (size_t) 0, "Pool is disabled by default");
+	AssertEquals(SamplePool::ThreadStatistics().heapFreeCount, (size_t) 1);
+
+	SamplePool::ScopedLimits limits(1024*1024, 1024*1024);
+	SamplePool::ResetThreadStatistics();
+
+	block = SamplePool::Allocate(100000);
+	AssertEquals((size_t) block % 64, (size_t) 0, "Alignment");
+	SamplePool::Free(block, 100000);
+	AssertTrue(SamplePool::ThreadPoolBytes() >= (size_t) 100000);
+
+	// A slightly smaller request is in the same size class
+	void *reused = SamplePool::Allocate(99000);
+	AssertEquals(reused, block, "Block was reused");
+	void *other = SamplePool::Allocate(200000);
+	AssertTrue(other != block);
+	SamplePool::Free(reused, 99000);
+	SamplePool::Free(other, 200000);
+
+	SamplePool::Statistics statistics = SamplePool::ThreadStatistics();
+	AssertEquals(statistics.allocationCount, (size_t) 3);
+	AssertEquals(statistics.threadPoolHitCount, (size_t) 1);
+	AssertEquals(statistics.heapAllocationCount, (size_t) 2);
+
+	AssertTrue(SamplePool::Allocate(0) == 0, "Empty request");
+	SamplePool::Release();
+	AssertEquals(SamplePool::ThreadPoolBytes(), (size_t) 0);
+}
+
+inline void SamplePoolTest::TestSharedPool::operator()()
+{
+	SamplePool::Release();
+	SamplePool::ScopedLimits limits(0, 1024*1024);
+	SamplePool::ResetThreadStatistics();
+
+	// Another thread can not keep the block itself, so it ends up in the shared pool
+	void *block = SamplePool::Allocate(50000);
+	boost::thread thread(Freer(block, 50000));
+	thread.join();
+	AssertEquals(SamplePool::SharedPoolBytes(), (size_t) 53248);
+
+	void *reused = SamplePool::Allocate(50000);
+	AssertEquals(reused, block, "Block was reused");
+	AssertEquals(SamplePool::ThreadStatistics().sharedPoolHitCount, (size_t) 1);
+	AssertEquals(SamplePool::SharedPoolBytes(), (size_t) 0);
+
+	// Without room in either pool, blocks go back to the heap
+	SamplePool::SetLimits(0, 0);
+	SamplePool::Free(reused, 50000);
+	AssertEquals(SamplePool::ThreadStatistics().heapFreeCount, (size_t) 1);
+	AssertEquals(SamplePool::SharedPoolBytes(), (size_t) 0);
+}
+
+inline void SamplePoolTest::TestImages::operator()()
+{
+	SamplePool::Release();
+	SamplePool::ScopedLimits limits(16*1024*1024, 0);
+	Image2DPtr image = Image2D::CreateZeroImagePtr(300, 200);
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<true>(300, 200);
+	image.reset();
+	mask.reset();
+
+	// The second time, the samples, row pointers and objects all come from the pool
+	SamplePool::ResetThreadStatistics();
+	image = Image2D::CreateZeroImagePtr(300, 200);
+	mask = Mask2D::CreateSetMaskPtr<false>(300, 200);
+	SamplePool::Statistics statistics = SamplePool::ThreadStatistics();
+	AssertEquals(statistics.allocationCount, (size_t) 6);
+	AssertEquals(statistics.heapAllocationCount, (size_t) 0);
+	AssertEquals(image->Value(299, 199), (num_t) 0.0);
+	AssertFalse(mask->Value(299, 199));
+	SamplePool::Release();
+}
+
+#endif
@@ -0,0 +1,163 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_LOGHISTOGRAMTEST_H
+#define AOFLAGGER_LOGHISTOGRAMTEST_H
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../quality/loghistogram.h"
+
+class LogHistogramTest : public UnitTest {
+	public:
+		LogHistogramTest() : UnitTest("Log histogram")
+		{
+			AddTest(TestBinning(), "Binning amplitudes");
+			AddTest(TestAddingRows(), "Adding rows");
+			AddTest(TestSerialization(), "Serialization");
+		}
+		
+	private:
+		struct TestBinning : public Asserter
+		{
+			void operator()();
+		};
+		struct TestAddingRows : public Asserter
+		{
+			void operator()();
+		};
+		struct TestSerialization : public Asserter
+		{
+			void operator()();
+		};
+		
+		static void AssertEqualHistograms(Asserter &asserter, const LogHistogram &a, const LogHistogram &b, const std::string &description)
+		{
+			LogHistogram::const_iterator i = a.begin(), j = b.begin();
+			while(i != a.end() && j != b.end())
+			{
+				asserter.AssertEquals(i.value(), j.value(), description + " (value)");
+				asserter.AssertEquals(i.unnormalizedCount(), j.unnormalizedCount(), description + " (count)");
+				++i;
+				++j;
+			}
+			asserter.AssertTrue(i == a.end() && j == b.end(), description + " (number of bins)");
+		}
+};
+
+void LogHistogramTest::TestBinning::operator()()
+{
+	// Amplitudes over many decades, also close to bin boundaries
+	for(double exponent=-40.0;exponent<=40.0;exponent+=0.00123)
+	{
+		const double amplitude = pow10(exponent);
+		LogHistogram histogram;
+		histogram.Add(amplitude);
+		const double logValue = 100.0*log10(amplitude);
+		const double expected = pow10(round(logValue)/100.0);
+		// Amplitudes that are extremely close to a boundary may be binned differently
+		if(std::fabs(logValue - floor(logValue) - 0.5) > 1e-9)
+			AssertEquals(histogram.begin().value(), expected, "Central amplitude");
+		AssertEquals(histogram.begin().unnormalizedCount(), 1ul, "Count");
+	}
+	
+	LogHistogram histogram;
+	histogram.Add(0.0);
+	histogram.Add(-2.0);
+	histogram.Add(5.0);
+	histogram.Add(std::numeric_limits<double>::quiet_NaN());
+	histogram.Add(std::numeric_limits<double>::infinity());
+	LogHistogram::const_iterator i = histogram.begin();
+	AssertAlmostEqual(i.value(), -pow10(round(100.0*log10(2.0))/100.0), "Negative amplitude");
+	++i;
+	AssertEquals(i.value(), 0.0, "Zero amplitude");
+	++i;
+	AssertAlmostEqual(i.value(), pow10(round(100.0*log10(5.0))/100.0), "Positive amplitude");
+	++i;
+	AssertTrue(i == histogram.end(), "Non-finite amplitudes are skipped");
+	AssertAlmostEqual(histogram.MaxAmplitude(), pow10(round(100.0*log10(5.0))/100.0), "MaxAmplitude()");
+}
+
+void LogHistogramTest::TestAddingRows::operator()()
+{
+	std::vector<float> amplitudes;
+	for(size_t i=0;i!=1001;++i)
+		amplitudes.push_back((i % 7 == 3) ? -(float) i : (float) pow10((double) i * 0.037 - 20.0));
+	amplitudes[10] = 0.0f;
+	amplitudes[11] = std::numeric_limits<float>::denorm_min();
+	amplitudes[12] = std::numeric_limits<float>::quiet_NaN();
+	amplitudes[13] = std::numeric_limits<float>::infinity();
+	amplitudes[14] = std::numeric_limits<float>::max();
+	
+	bool *selection = new bool[amplitudes.size()];
+	LogHistogram rowHistogram, sampleHistogram, selectedRowHistogram, selectedSampleHistogram;
+	for(size_t i=0;i!=amplitudes.size();++i)
+	{
+		selection[i] = (i % 3) == 0;
+		sampleHistogram.Add(amplitudes[i]);
+		if(selection[i])
+			selectedSampleHistogram.Add(amplitudes[i]);
+	}
+	// Start at an unaligned position and end with a few remaining samples
+	rowHistogram.Add(amplitudes[0]);
+	rowHistogram.Add(&amplitudes[1], amplitudes.size() - 1);
+	selectedRowHistogram.Add(&amplitudes[0], selection, amplitudes.size());
+	delete[] selection;
+	
+	AssertEqualHistograms(*this, rowHistogram, sampleHistogram, "Row added at once");
+	AssertEqualHistograms(*this, selectedRowHistogram, selectedSampleHistogram, "Selected part of row");
+	
+	LogHistogram sum(rowHistogram);
+	sum.Add(selectedRowHistogram);
+	sum -= selectedRowHistogram;
+	AssertEqualHistograms(*this, sum, rowHistogram, "Adding and subtracting");
+}
+
+void LogHistogramTest::TestSerialization::operator()()
+{
+	LogHistogram histogram, other;
+	for(size_t i=0;i!=100;++i)
+		histogram.Add((double) i * 0.5 - 10.0);
+	size_t histogramBinCount = 0;
+	for(LogHistogram::const_iterator i=histogram.begin();i!=histogram.end();++i)
+		++histogramBinCount;
+	other.Add(1000.0);
+	other -= histogram;
+	histogram.Add(other);
+	
+	std::stringstream stream;
+	histogram.Serialize(stream);
+	LogHistogram copy;
+	copy.Unserialize(stream);
+	AssertEqualHistograms(*this, copy, histogram, "Unserialized histogram");
+	
+	// Subtracting creates empty bins, which should remain
+	size_t binCount = 0;
+	for(LogHistogram::const_iterator i=other.begin();i!=other.end();++i)
+		++binCount;
+	AssertEquals(binCount, histogramBinCount + 1, "Number of bins after subtracting");
+}
+
+#endif
@@ -41,6 +41,7 @@ class QualityTablesFormatterTest : public UnitTest {
 			AddTest(TestKindOperations(), "Statistic kind operations");
 			AddTest(TestKindNames(), "Statistic kind names");
 			AddTest(TestStoreStatistics(), "Storing statistics");
+			AddTest(TestMergeStatistics(), "Merging statistics");
 		}
     virtual ~QualityTablesFormatterTest()
 		{
@@ -82,6 +83,10 @@ class QualityTablesFormatterTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestMergeStatistics : public Asserter
+		{
+			void operator()();
+		};
 };
 
 void QualityTablesFormatterTest::TestConstructor::operator()()
@@ -207,6 +212,46 @@ void QualityTablesFormatterTest::TestStoreStatistics::operator()()
 	qd.RemoveTable(QualityTablesFormatter::TimeStatisticTable);
 }
 
+void QualityTablesFormatterTest::TestMergeStatistics::operator()()
+{
+	QualityTablesFormatter qd("QualityTest.MS");
+	
+	qd.RemoveAllQualityTables();
+	qd.InitializeStatisticTable(QualityTablesFormatter::TimeDimension, 2);
+	const unsigned sumIndex = qd.StoreKindName(QualityTablesFormatter::SumStatistic);
+	
+	StatisticalValue value(2);
+	value.SetKindIndex(sumIndex);
+	value.SetValue(0, std::complex<float>(1.0, 2.0));
+	value.SetValue(1, std::complex<float>(3.0, 4.0));
+	std::vector<std::pair<QualityTablesFormatter::TimePosition, StatisticalValue> > newEntries;
+	QualityTablesFormatter::TimePosition position;
+	position.time = 60.0;
+	position.frequency = 107000000.0;
+	newEntries.push_back(std::make_pair(position, value));
+	qd.MergeTimeValues(newEntries);
+	AssertEquals(qd.QueryStatisticEntryCount(QualityTablesFormatter::TimeDimension, sumIndex), 1u, "Entry count after first merge");
+	
+	// Merging again should sum the value of the existing row and append the new time
+	position.time = 70.0;
+	newEntries.push_back(std::make_pair(position, value));
+	qd.InitializeStatisticTable(QualityTablesFormatter::TimeDimension, 2);
+	qd.MergeTimeValues(newEntries);
+	AssertEquals(qd.QueryStatisticEntryCount(QualityTablesFormatter::TimeDimension, sumIndex), 2u, "Entry count after second merge");
+	
+	std::vector<std::pair<QualityTablesFormatter::TimePosition, StatisticalValue> > entries;
+	qd.QueryTimeStatistic(sumIndex, entries);
+	AssertEquals(entries.size(), (size_t) 2, "entries.size()");
+	AssertEquals(entries[0].first.time, 60.0, "time of merged row");
+	AssertEquals(entries[0].second.Value(0), std::complex<float>(2.0, 4.0), "Merged Value(0)");
+	AssertEquals(entries[0].second.Value(1), std::complex<float>(6.0, 8.0), "Merged Value(1)");
+	AssertEquals(entries[1].first.time, 70.0, "time of appended row");
+	AssertEquals(entries[1].second.Value(0), std::complex<float>(1.0, 2.0), "Appended Value(0)");
+	
+	qd.RemoveTable(QualityTablesFormatter::KindNameTable);
+	qd.RemoveTable(QualityTablesFormatter::TimeStatisticTable);
+}
+
 void QualityTablesFormatterTest::TestKindNames::operator()()
 {
 	AssertEquals(QualityTablesFormatter::KindToName(QualityTablesFormatter::MeanStatistic), "Mean");
@@ -22,6 +22,7 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "loghistogramtest.h"
 #include "qualitytablesformattertest.h"
 #include "statisticscollectiontest.h"
 #include "statisticsderivatortest.h"
@@ -32,6 +33,7 @@ class QualityTestGroup : public TestGroup {
 		
 		virtual void Initialize()
 		{
+			Add(new LogHistogramTest());
 			Add(new QualityTablesFormatterTest());
 			Add(new StatisticsCollectionTest());
 			Add(new StatisticsDerivatorTest());
@@ -22,6 +22,7 @@
 
 #include <cmath>
 #include <iomanip>
+#include <limits>
 
 #include "../testingtools/asserter.h"
 #include "../testingtools/unittest.h"
@@ -37,6 +38,7 @@ class StatisticsCollectionTest : public UnitTest {
 			AddTest(TestStatisticsCollecting(), "Collecting statistics");
 			AddTest(TestImageCollecting(), "Collecting from image");
 			AddTest(TestComparison<false>(), "Add() and AddImage() do the same thing");
+			AddTest(TestPartlyFlaggedSamples(), "Collecting partly flagged and non-finite samples");
 			//AddTest(TestComparison<true>(), "Speed of collecting");
 		}
 	private:
@@ -88,6 +90,10 @@ class StatisticsCollectionTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestPartlyFlaggedSamples : public Asserter
+		{
+			void operator()();
+		};
 		template<bool SpeedTest>
 		struct TestComparison : public Asserter
 		{
@@ -243,6 +249,57 @@ void StatisticsCollectionTest::TestImageCollecting::operator()()
 	AssertEquals(statistics.sum->real(), 6.0, "real sum");
 }
 
+void StatisticsCollectionTest::TestPartlyFlaggedSamples::operator()()
+{
+	// An odd number of channels, such that both the vectorized and the remaining samples are used
+	const size_t nChannels = 7;
+	StatisticsCollection collection(1);
+	double frequencies[nChannels];
+	for(size_t c=0;c!=nChannels;++c)
+		frequencies[c] = 100 + c;
+	collection.InitializeBand(0, frequencies, nChannels);
+	float
+		reals[nChannels] = { 1.0, 2.0, std::numeric_limits<float>::quiet_NaN(), 4.0, 5.0, 7.0, 10.0 },
+		imags[nChannels] = { 0.5, -1.0, 3.0, 2.0, std::numeric_limits<float>::infinity(), 1.0, -2.0 };
+	bool
+		isRFI[nChannels] = { false, false, false, true, false, false, false },
+		isPreFlagged[nChannels] = { false, false, false, false, false, false, true };
+	collection.Add(0, 1, 0.0, 0, 0, reals, imags, isRFI, isPreFlagged, nChannels, 1, 1, 1);
+	
+	const std::map<double, DefaultStatistics> &statistics = collection.FrequencyStatistics();
+	AssertEquals(statistics.size(), nChannels, "Number of channels");
+	for(size_t c=0;c!=nChannels;++c)
+	{
+		const DefaultStatistics &stat = statistics.find(frequencies[c])->second;
+		const bool isValid = !isPreFlagged[c] && std::isfinite(reals[c]) && std::isfinite(imags[c]);
+		const bool isGood = isValid && !isRFI[c];
+		AssertEquals(stat.count[0], isGood ? 1ul : 0ul, "Count");
+		AssertEquals(stat.rfiCount[0], (isValid && isRFI[c]) ? 1ul : 0ul, "RFI count");
+		AssertEquals((double) stat.sum[0].real(), isGood ? reals[c] : 0.0, "Sum");
+		AssertEquals((double) stat.sumP2[0].imag(), isGood ? imags[c]*imags[c] : 0.0, "Sum of squares");
+		
+		unsigned long dCount = 0;
+		double dSum = 0.0;
+		for(size_t d=(c==0 ? 0 : c-1);d!=c+1 && d+1!=nChannels;++d)
+		{
+			if(!isPreFlagged[d] && !isPreFlagged[d+1] && !isRFI[d] && !isRFI[d+1] &&
+				std::isfinite(reals[d]) && std::isfinite(imags[d]) && std::isfinite(reals[d+1]) && std::isfinite(imags[d+1]))
+			{
+				++dCount;
+				dSum += (reals[d+1] - reals[d]) * M_SQRT1_2;
+			}
+		}
+		AssertEquals(stat.dCount[0], dCount, "Difference count");
+		AssertAlmostEqual((double) stat.dSum[0].real(), dSum, "Difference sum");
+	}
+	
+	DefaultStatistics global(1);
+	collection.GetGlobalCrossBaselineStatistics(global);
+	AssertEquals(global.count[0], 3ul, "Baseline count");
+	AssertEquals(global.rfiCount[0], 1ul, "Baseline RFI count");
+	AssertEquals(global.dCount[0], 1ul, "Baseline difference count");
+}
+
 template<bool SpeedTest>
 void StatisticsCollectionTest::TestComparison<SpeedTest>::operator()()
 {
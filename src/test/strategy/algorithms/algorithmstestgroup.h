@@ -22,6 +22,7 @@
 
 #include "../../testingtools/testgroup.h"
 
+#include "connectedcomponentstest.h"
 #include "convolutionstest.h"
 #include "dilationtest.h"
 #include "eigenvaluetest.h"
@@ -39,6 +40,7 @@ class AlgorithmsTestGroup : public TestGroup {
 		
 		virtual void Initialize()
 		{
+			Add(new ConnectedComponentsTest());
 			Add(new ConvolutionsTest());
 			Add(new DilationTest());
 			Add(new EigenvalueTest());
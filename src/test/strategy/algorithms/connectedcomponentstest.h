@@ -0,0 +1,176 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_CONNECTEDCOMPONENTSTEST_H
+#define AOFLAGGER_CONNECTEDCOMPONENTSTEST_H
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../msio/mask2d.h"
+#include "../../../msio/segmentedimage.h"
+
+#include "../../../strategy/algorithms/connectedcomponents.h"
+#include "../../../strategy/algorithms/thresholdtools.h"
+
+class ConnectedComponentsTest : public UnitTest {
+	public:
+		ConnectedComponentsTest() : UnitTest("Connected components")
+		{
+			AddTest(TestLabelling(), "Labelling a mask");
+			AddTest(TestClasses(), "Labelling classes");
+			AddTest(TestFilterEquivalence(), "Equivalence with flood fill filter");
+		}
+		
+	private:
+		struct TestLabelling : public Asserter
+		{
+			void operator()();
+		};
+		struct TestClasses : public Asserter
+		{
+			void operator()();
+		};
+		struct TestFilterEquivalence : public Asserter
+		{
+			void operator()();
+		};
+		
+		static std::string maskToString(Mask2DCPtr mask)
+		{
+			std::stringstream s;
+			for(unsigned y=0;y<mask->Height();++y)
+			{
+				for(unsigned x=0;x<mask->Width();++x)
+					s << (mask->Value(x, y) ? 'x' : ' ');
+				s << '\n';
+			}
+			return s.str();
+		}
+		
+		static void setMask(Mask2DPtr mask, const std::string &str)
+		{
+			std::string::const_iterator i = str.begin();
+			for(unsigned y=0;y<mask->Height();++y)
+			{
+				for(unsigned x=0;x<mask->Width();++x)
+				{
+					mask->SetValue(x, y, (*i) == 'x');
+					++i;
+				}
+				++i; // newline
+			}
+		}
+};
+
+inline void ConnectedComponentsTest::TestLabelling::operator()()
+{
+	Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(6, 4);
+	setMask(mask,
+		"xx  x \n"
+		"  x x \n"
+		" x  xx\n"
+		"x     \n");
+	
+	ConnectedComponents fourConnected(false);
+	fourConnected.Label(*mask);
+	AssertEquals(fourConnected.ComponentCount(), (size_t) 5, "Four-connected component count");
+	AssertEquals(fourConnected.Area(0), (size_t) 2, "Area of first component");
+	AssertEquals(fourConnected.Area(1), (size_t) 4, "Area of second component");
+	AssertEquals(fourConnected.Area(2), (size_t) 1, "Area of third component");
+	
+	ConnectedComponents eightConnected(true);
+	eightConnected.Label(*mask);
+	AssertEquals(eightConnected.ComponentCount(), (size_t) 2, "Eight-connected component count");
+	AssertEquals(eightConnected.Area(0), (size_t) 5, "Area of first component");
+	AssertEquals(eightConnected.Area(1), (size_t) 4, "Area of second component");
+	
+	fourConnected.RemoveSmallComponents(*mask, 2);
+	AssertEquals(maskToString(mask),
+		"xx  x \n"
+		"    x \n"
+		"    xx\n"
+		"      \n", "Removing components smaller than two samples");
+	
+	Mask2DPtr empty = Mask2D::CreateSetMaskPtr<false>(3, 3);
+	fourConnected.Label(*empty);
+	AssertEquals(fourConnected.ComponentCount(), (size_t) 0, "Empty mask");
+}
+
+inline void ConnectedComponentsTest::TestClasses::operator()()
+{
+	// Touching areas of different classes are separate components. The class -1
+	// sample in the last row touches the class -1 row only diagonally.
+	const signed char
+		row0[] = { 1, 1, 0, 0 },
+		row1[] = { -1, -1, 0, 0 },
+		row2[] = { 0, 0, -1, 1 };
+	const signed char *classes[] = { row0, row1, row2 };
+	
+	ConnectedComponents components(false);
+	components.Label(classes, 4, 3);
+	AssertEquals(components.ComponentCount(), (size_t) 4, "Four-connected count");
+	
+	SegmentedImagePtr segments = SegmentedImage::CreateUnsetPtr(4, 3);
+	components.WriteSegments(*segments);
+	AssertEquals(segments->SegmentCount(), (size_t) 4, "SegmentCount()");
+	AssertEquals(segments->Value(0, 0), (size_t) 1, "First segment");
+	AssertEquals(segments->Value(1, 1), (size_t) 2, "Second segment");
+	AssertEquals(segments->Value(2, 2), (size_t) 3, "Third segment");
+	AssertEquals(segments->Value(3, 2), (size_t) 4, "Fourth segment");
+	AssertEquals(segments->Value(3, 0), (size_t) 0, "Background");
+	
+	ConnectedComponents eightConnected(true);
+	eightConnected.Label(classes, 4, 3);
+	AssertEquals(eightConnected.ComponentCount(), (size_t) 3, "Eight-connected count");
+	AssertEquals(eightConnected.Area(1), (size_t) 3, "Diagonally connected area");
+}
+
+inline void ConnectedComponentsTest::TestFilterEquivalence::operator()()
+{
+	srand(1);
+	for(unsigned eight=0;eight!=2;++eight)
+	{
+		Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(200, 100);
+		for(unsigned y=0;y<mask->Height();++y)
+		{
+			for(unsigned x=0;x<mask->Width();++x)
+				mask->SetValue(x, y, rand() % 100 < 45);
+		}
+		Mask2DPtr expected = Mask2D::CreateCopy(mask);
+		// Flood fill from every flagged sample, as FilterConnectedSamples() used to do.
+		for(unsigned y=0;y<expected->Height();++y)
+		{
+			for(unsigned x=0;x<expected->Width();++x)
+			{
+				if(expected->Value(x, y))
+					ThresholdTools::FilterConnectedSample(expected, x, y, 10, eight!=0);
+			}
+		}
+		
+		ThresholdTools::FilterConnectedSamples(mask, 10, eight!=0);
+		AssertTrue(mask->Equals(expected), eight!=0 ? "Eight-connected filter" : "Four-connected filter");
+	}
+}
+
+#endif
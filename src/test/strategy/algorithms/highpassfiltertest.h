@@ -30,6 +30,9 @@
 #include "../../../strategy/algorithms/localfitmethod.h"
 #include "../../../strategy/algorithms/highpassfilter.h"
 
+#include "../../../util/bandthreadpool.h"
+#include "../../../util/rng.h"
+
 class HighPassFilterTest : public UnitTest {
 	public:
 		HighPassFilterTest() : UnitTest("High-pass filter algorithm")
@@ -39,6 +42,8 @@ class HighPassFilterTest : public UnitTest {
 			AddTest(TestFilterWithMask(), "Low-pass filter algorithm with mask");
 			AddTest(TestCompletelyMaskedImage(), "Low-pass filter algorithm with completely set mask");
 			AddTest(TestNaNImage(), "Low-pass filter algorithm with NaNs");
+			AddTest(TestBoxFilterMethod(), "Box filter approximation");
+			AddTest(TestBands(), "Filter in bands");
 		}
 		
 	private:
@@ -62,6 +67,29 @@ class HighPassFilterTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestBoxFilterMethod : public Asserter
+		{
+			void operator()();
+		};
+		struct TestBands : public Asserter
+		{
+			void operator()();
+		};
+		
+		static double relativeRMSDifference(const Image2DCPtr &expected, const Image2DCPtr &actual)
+		{
+			double sumSqDiff = 0.0, sumSq = 0.0;
+			for(size_t y=0;y<expected->Height();++y)
+			{
+				for(size_t x=0;x<expected->Width();++x)
+				{
+					const double diff = expected->Value(x, y) - actual->Value(x, y);
+					sumSqDiff += diff * diff;
+					sumSq += expected->Value(x, y) * expected->Value(x, y);
+				}
+			}
+			return sqrt(sumSqDiff / sumSq);
+		}
 		
 };
 
@@ -180,4 +208,78 @@ inline void HighPassFilterTest::TestNaNImage::operator()()
 	ImageAsserter::AssertFinite(image, "Low-pass convolution with NaNs");
 }
 
+inline void HighPassFilterTest::TestBoxFilterMethod::operator()()
+{
+	const size_t width = 500, height = 128;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+		{
+			image->SetValue(x, y, RNG::Gaussian() + 10.0*sin(x*0.01) + 5.0*cos(y*0.05));
+			mask->SetValue(x, y, RNG::Uniform() < 0.1);
+		}
+	}
+	// The parameters of the default strategy, with and without keeping transients
+	const unsigned windowWidths[2] = { 21, 1 };
+	for(size_t i=0;i!=2;++i)
+	{
+		HighPassFilter kernelFilter, boxFilter;
+		kernelFilter.SetHWindowSize(windowWidths[i]);
+		kernelFilter.SetHKernelSigmaSq(2.5);
+		kernelFilter.SetVWindowSize(31);
+		kernelFilter.SetVKernelSigmaSq(5.0);
+		boxFilter.SetHWindowSize(windowWidths[i]);
+		boxFilter.SetHKernelSigmaSq(2.5);
+		boxFilter.SetVWindowSize(31);
+		boxFilter.SetVKernelSigmaSq(5.0);
+		boxFilter.SetMethod(HighPassFilter::BoxFilterMethod);
+		
+		Image2DPtr
+			expected = kernelFilter.ApplyHighPass(image, mask),
+			actual = boxFilter.ApplyHighPass(image, mask);
+		const double difference = relativeRMSDifference(expected, actual);
+		std::stringstream s;
+		s << "Box filter matches kernel (window width " << windowWidths[i] << ", relative RMS difference " << difference << ")";
+		AssertLessThan(difference, 0.05, s.str());
+	}
+	
+	HighPassFilter boxFilter;
+	boxFilter.SetMethod(HighPassFilter::BoxFilterMethod);
+	image->SetValue(3, 3, std::numeric_limits<float>::quiet_NaN());
+	ImageAsserter::AssertFinite(boxFilter.ApplyLowPass(image, mask), "Box filter with NaNs");
+	
+	// A fully masked image is zero, like with the kernel
+	image = boxFilter.ApplyLowPass(image, Mask2D::CreateSetMaskPtr<true>(width, height));
+	ImageAsserter::AssertConstant(image, 0.0, "Box filter with fully masked image");
+}
+
+inline void HighPassFilterTest::TestBands::operator()()
+{
+	const size_t width = 1001, height = 301;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+		{
+			image->SetValue(x, y, RNG::Gaussian() + 10.0*sin(x*0.01));
+			mask->SetValue(x, y, RNG::Uniform() < 0.1);
+		}
+	}
+	image->SetValue(500, 150, std::numeric_limits<float>::quiet_NaN());
+	
+	for(size_t method=0;method!=2;++method)
+	{
+		HighPassFilter filter;
+		filter.SetMethod(method == 0 ? HighPassFilter::GaussianKernelMethod : HighPassFilter::BoxFilterMethod);
+		Image2DPtr expected = filter.ApplyLowPass(image, mask);
+		BandThreadPool::SetThreadCount(4);
+		Image2DPtr actual = filter.ApplyLowPass(image, mask);
+		BandThreadPool::SetThreadCount(1);
+		ImageAsserter::AssertEqual(actual, expected, method == 0 ? "Kernel in bands" : "Box filter in bands");
+	}
+}
+
 #endif
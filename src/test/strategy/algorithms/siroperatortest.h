@@ -27,6 +27,7 @@
 
 #include "../../../strategy/algorithms/siroperator.h"
 
+#include "../../../util/bandthreadpool.h"
 #include "../../../util/rng.h"
 
 class SIROperatorTest : public UnitTest {
@@ -38,6 +39,8 @@ class SIROperatorTest : public UnitTest {
 			AddTest(TestTimeApplication(), "Time application");
 			AddTest(TestFrequencyApplication(), "Frequency application");
 			AddTest(TestTimeApplicationSpeed(), "Time application speed");
+			AddTest(TestVerticalEquivalence(), "Vertical equivalence");
+			AddTest(TestBands(), "Dilation in bands");
 		}
 		
 	private:
@@ -66,6 +69,14 @@ class SIROperatorTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestVerticalEquivalence : public Asserter
+		{
+			void operator()();
+		};
+		struct TestBands : public Asserter
+		{
+			void operator()();
+		};
 		
 		static std::string flagsToString(const bool *flags, unsigned size)
 		{
@@ -356,4 +367,70 @@ inline void SIROperatorTest::TestTimeApplicationSpeed::operator()()
 	SIROperator::OperateHorizontally(mask, 0.1);
 }
 
+inline void SIROperatorTest::TestVerticalEquivalence::operator()()
+{
+	// Widths that fill whole blocks of columns, partial blocks and only a partial block
+	const unsigned widths[] = { 1, 7, 16, 35, 64 };
+	const unsigned heights[] = { 1, 2, 17, 300 };
+	const num_t etas[] = { 0.0, 0.1, 0.2, 0.4, 0.7, 1.0 };
+	const double flagRatios[] = { 0.05, 0.3, 0.8 };
+	for(unsigned wi=0;wi!=5;++wi)
+	{
+		for(unsigned hi=0;hi!=4;++hi)
+		{
+			const unsigned width = widths[wi], height = heights[hi];
+			Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(width, height);
+			bool *column = new bool[height];
+			for(unsigned ei=0;ei!=6;++ei)
+			{
+				for(unsigned ri=0;ri!=3;++ri)
+				{
+					for(unsigned y=0;y<height;++y)
+					{
+						for(unsigned x=0;x<width;++x)
+							mask->SetValue(x, y, RNG::Uniform() < flagRatios[ri]);
+					}
+					Mask2DPtr expected = Mask2D::CreateCopy(mask);
+					for(unsigned x=0;x<width;++x)
+					{
+						for(unsigned y=0;y<height;++y)
+							column[y] = expected->Value(x, y);
+						SIROperator::Operate(column, height, etas[ei]);
+						for(unsigned y=0;y<height;++y)
+							expected->SetValue(x, y, column[y]);
+					}
+					
+					SIROperator::OperateVertically(mask, etas[ei]);
+					std::stringstream s;
+					s << "width=" << width << ", height=" << height << ", eta=" << etas[ei];
+					AssertEquals(maskToString(mask), maskToString(expected), s.str());
+				}
+			}
+			delete[] column;
+		}
+	}
+}
+
+inline void SIROperatorTest::TestBands::operator()()
+{
+	// Height and width are not multiples of the band granularity
+	const unsigned width = 1003, height = 301;
+	Mask2DPtr input = Mask2D::CreateUnsetMaskPtr(width, height);
+	for(unsigned y=0;y<height;++y)
+	{
+		for(unsigned x=0;x<width;++x)
+			input->SetValue(x, y, RNG::Uniform() < 0.2);
+	}
+	Mask2DPtr expected = Mask2D::CreateCopy(input);
+	SIROperator::OperateHorizontally(expected, 0.3);
+	SIROperator::OperateVertically(expected, 0.3);
+	
+	Mask2DPtr mask = Mask2D::CreateCopy(input);
+	BandThreadPool::SetThreadCount(4);
+	SIROperator::OperateHorizontally(mask, 0.3);
+	SIROperator::OperateVertically(mask, 0.3);
+	BandThreadPool::SetThreadCount(1);
+	AssertEquals(maskToString(mask), maskToString(expected));
+}
+
 #endif
@@ -27,6 +27,10 @@
 #include "../../../strategy/algorithms/mitigationtester.h"
 #include "../../../strategy/algorithms/thresholdconfig.h"
 #include "../../../strategy/algorithms/thresholdmitigater.h"
+#include "../../../strategy/algorithms/tiledsumthreshold.h"
+
+#include "../../../util/bandthreadpool.h"
+#include "../../../util/rng.h"
 
 #include "../../testingtools/asserter.h"
 #include "../../testingtools/maskasserter.h"
@@ -39,6 +43,9 @@ class SumThresholdTest : public UnitTest {
 			AddTest(VerticalSumThresholdSSE(), "SumThreshold optimized SSE version (vertical)");
 			AddTest(HorizontalSumThresholdSSE(), "SumThreshold optimized SSE version (horizontal)");
 			AddTest(Stability(), "SumThreshold stability");
+			AddTest(VectorizedImplementations(), "SumThreshold AVX2 and AVX-512 versions");
+			AddTest(TiledSeries(), "SumThreshold series on tiles");
+			AddTest(BandedSeries(), "SumThreshold series in bands of columns");
 		}
 		
 	private:
@@ -54,6 +61,18 @@ class SumThresholdTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct VectorizedImplementations : public Asserter
+		{
+			void operator()();
+		};
+		struct TiledSeries : public Asserter
+		{
+			void operator()();
+		};
+		struct BandedSeries : public Asserter
+		{
+			void operator()();
+		};
 };
 
 void SumThresholdTest::VerticalSumThresholdSSE::operator()()
@@ -162,4 +181,196 @@ void SumThresholdTest::Stability::operator()()
 	}
 }
 
+void SumThresholdTest::VectorizedImplementations::operator()()
+{
+	// Sizes that are not a multiple of the vector widths test the padded last tiles
+	const unsigned sizes[3][2] = { { 2048, 256 }, { 515, 77 }, { 83, 300 } };
+	for(unsigned s=0;s<3;++s)
+	{
+		const unsigned
+			width = sizes[s][0],
+			height = sizes[s][1];
+		Mask2DPtr
+			mask1 = Mask2D::CreateUnsetMaskPtr(width, height),
+			mask2 = Mask2D::CreateUnsetMaskPtr(width, height);
+		Image2DPtr
+			real = MitigationTester::CreateTestSet(26, mask1, width, height),
+			imag = MitigationTester::CreateTestSet(26, mask2, width, height);
+		TimeFrequencyData data(XXPolarisation, real, imag);
+		Image2DCPtr image = data.GetSingleImage();
+		
+		ThresholdConfig config;
+		config.InitializeLengthsDefault(9);
+		num_t mode = image->GetMode();
+		config.InitializeThresholdsFromFirstThreshold(6.0 * mode, ThresholdConfig::Rayleigh);
+		for(unsigned i=0;i<9;++i)
+		{
+			const unsigned length = config.GetHorizontalLength(i);
+			const double threshold = config.GetHorizontalThreshold(i);
+			
+			// Start with some flags, such that the counting of unflagged samples is tested
+			Mask2DPtr reference = Mask2D::CreateSetMaskPtr<false>(width, height);
+			for(unsigned y=0;y<height;y+=3)
+				reference->SetValue((y*7)%width, y, true);
+			Mask2DPtr
+				avx2 = Mask2D::CreateCopy(reference),
+				avx512 = Mask2D::CreateCopy(reference),
+				horizontalReference = Mask2D::CreateCopy(reference);
+			
+			ThresholdMitigater::VerticalSumThresholdLargeReference(image, reference, length, threshold);
+			std::stringstream s;
+			s << "length " << length << ", size " << width << " x " << height;
+			if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX2Implementation)
+			{
+				ThresholdMitigater::VerticalSumThresholdLargeAVX2(image, avx2, length, threshold);
+				MaskAsserter::AssertEqualMasks(avx2, reference, "Vertical AVX2, " + s.str());
+			}
+			if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX512Implementation)
+			{
+				ThresholdMitigater::VerticalSumThresholdLargeAVX512(image, avx512, length, threshold);
+				MaskAsserter::AssertEqualMasks(avx512, reference, "Vertical AVX-512, " + s.str());
+			}
+			
+			avx2 = Mask2D::CreateCopy(horizontalReference);
+			avx512 = Mask2D::CreateCopy(horizontalReference);
+			ThresholdMitigater::HorizontalSumThresholdLargeReference(image, horizontalReference, length, threshold);
+			if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX2Implementation)
+			{
+				ThresholdMitigater::HorizontalSumThresholdLargeAVX2(image, avx2, length, threshold);
+				MaskAsserter::AssertEqualMasks(avx2, horizontalReference, "Horizontal AVX2, " + s.str());
+			}
+			if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX512Implementation)
+			{
+				ThresholdMitigater::HorizontalSumThresholdLargeAVX512(image, avx512, length, threshold);
+				MaskAsserter::AssertEqualMasks(avx512, horizontalReference, "Horizontal AVX-512, " + s.str());
+			}
+		}
+	}
+}
+
+void SumThresholdTest::TiledSeries::operator()()
+{
+	const unsigned sizes[4][2] = { { 2048, 256 }, { 515, 77 }, { 300, 13 }, { 5, 300 } };
+	for(unsigned s=0;s<4;++s)
+	{
+		const unsigned
+			width = sizes[s][0],
+			height = sizes[s][1];
+		Image2DPtr image = Image2D::CreateZeroImagePtr(width, height);
+		for(unsigned y=0;y<height;++y)
+		{
+			for(unsigned x=0;x<width;++x)
+				image->SetValue(x, y, RNG::Gaussian());
+		}
+		// Add a few broadband and line-shaped features
+		for(unsigned x=width/3;x<width;x+=width/3+1)
+		{
+			for(unsigned y=0;y<height;++y)
+				image->AddValue(x, y, 1.5);
+		}
+		for(unsigned y=height/4;y<height;y+=height/4+1)
+		{
+			for(unsigned x=0;x<width;++x)
+				image->AddValue(x, y, 1.0);
+		}
+		Mask2DPtr startMask = Mask2D::CreateSetMaskPtr<false>(width, height);
+		for(unsigned y=0;y<height;y+=3)
+			startMask->SetValue((y*7)%width, y, true);
+
+		ThresholdConfig config;
+		config.InitializeLengthsDefault(9);
+		config.InitializeThresholdsFromFirstThreshold(4.0, ThresholdConfig::Rayleigh);
+
+		// Alternating directions (as in the default strategy), only horizontal, only vertical,
+		// and long windows first with some consecutive vertical operations
+		for(unsigned directions=0;directions<4;++directions)
+		{
+			Mask2DPtr reference = Mask2D::CreateCopy(startMask);
+			TiledSumThreshold
+				avx2(image, ThresholdMitigater::AVX2Implementation),
+				avx512(image, ThresholdMitigater::AVX512Implementation);
+			for(unsigned j=0;j<9;++j)
+			{
+				const unsigned i = (directions == 3) ? 8 - j : j;
+				const unsigned length = config.GetHorizontalLength(i);
+				const num_t threshold = config.GetHorizontalThreshold(i);
+				if(directions != 2 && !(directions == 3 && i%3 == 1))
+				{
+					ThresholdMitigater::HorizontalSumThresholdLargeReference(image, reference, length, threshold);
+					avx2.AddHorizontalOperation(length, threshold);
+					avx512.AddHorizontalOperation(length, threshold);
+				}
+				if(directions != 1)
+				{
+					ThresholdMitigater::VerticalSumThresholdLargeReference(image, reference, length, threshold);
+					avx2.AddVerticalOperation(length, threshold);
+					avx512.AddVerticalOperation(length, threshold);
+				}
+			}
+
+			std::stringstream str;
+			str << "directions " << directions << ", size " << width << " x " << height;
+			if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX2Implementation)
+			{
+				Mask2DPtr mask = Mask2D::CreateCopy(startMask);
+				avx2.Execute(mask);
+				MaskAsserter::AssertEqualMasks(mask, reference, "AVX2, " + str.str());
+				// The operations are kept for a second run
+				mask = Mask2D::CreateCopy(startMask);
+				avx2.Execute(mask);
+				MaskAsserter::AssertEqualMasks(mask, reference, "AVX2 second run, " + str.str());
+			}
+			if(ThresholdMitigater::BestImplementation() >= ThresholdMitigater::AVX512Implementation)
+			{
+				Mask2DPtr mask = Mask2D::CreateCopy(startMask);
+				avx512.Execute(mask);
+				MaskAsserter::AssertEqualMasks(mask, reference, "AVX-512, " + str.str());
+			}
+		}
+	}
+}
+
+void SumThresholdTest::BandedSeries::operator()()
+{
+	// Wide enough for several bands with both short (3) and long (9) series of windows
+	const unsigned width = 8500, height = 24;
+	Image2DPtr image = Image2D::CreateZeroImagePtr(width, height);
+	for(unsigned y=0;y<height;++y)
+	{
+		for(unsigned x=0;x<width;++x)
+			image->SetValue(x, y, RNG::Gaussian());
+	}
+	for(unsigned x=0;x<width;x+=97)
+	{
+		for(unsigned y=0;y<height;++y)
+			image->AddValue(x, y, 2.0);
+	}
+	for(unsigned x=1000;x<1600;++x)
+		image->AddValue(x, height/2, 1.0);
+	Mask2DPtr startMask = Mask2D::CreateSetMaskPtr<false>(width, height);
+
+	for(unsigned count=3;count<=9;count+=6)
+	{
+		ThresholdConfig config;
+		config.InitializeLengthsDefault(count);
+		config.InitializeThresholdsFromFirstThreshold(4.0, ThresholdConfig::Rayleigh);
+		TiledSumThreshold series(image);
+		for(unsigned i=0;i<count;++i)
+		{
+			series.AddHorizontalOperation(config.GetHorizontalLength(i), config.GetHorizontalThreshold(i));
+			series.AddVerticalOperation(config.GetVerticalLength(i), config.GetVerticalThreshold(i));
+		}
+
+		Mask2DPtr reference = Mask2D::CreateCopy(startMask);
+		series.Execute(reference);
+
+		Mask2DPtr mask = Mask2D::CreateCopy(startMask);
+		BandThreadPool::SetThreadCount(4);
+		AssertTrue(BandThreadPool::BandCount(width, 1024) > 1, "Image is split");
+		series.Execute(mask);
+		BandThreadPool::SetThreadCount(1);
+		MaskAsserter::AssertEqualMasks(mask, reference, "Banded series");
+	}
+}
+
 #endif
@@ -20,11 +20,18 @@
 #ifndef AOFLAGGER_THRESHOLDTOOLSTEST_H
 #define AOFLAGGER_THRESHOLDTOOLSTEST_H
 
+#include <algorithm>
+#include <vector>
+
 #include "../../../msio/mask2d.h"
 
 #include "../../../strategy/algorithms/thresholdtools.h"
 
+#include "../../../util/bandthreadpool.h"
+#include "../../../util/rng.h"
+
 #include "../../testingtools/asserter.h"
+#include "../../testingtools/imageasserter.h"
 #include "../../testingtools/unittest.h"
 
 class ThresholdToolsTest : public UnitTest {
@@ -33,6 +40,8 @@ class ThresholdToolsTest : public UnitTest {
 		{
 			AddTest(WinsorizedMaskedMeanVar(), "Winsorized, masked mean and variance");
 			AddTest(WinsorizedMaskedMode(), "Winsorized, masked mode");
+			AddTest(WinsorizedLargeImage(), "Winsorized statistics of large image");
+			AddTest(Bands(), "Statistics and shrinking in bands");
 		}
 		
 	private:
@@ -44,6 +53,14 @@ class ThresholdToolsTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct WinsorizedLargeImage : public Asserter
+		{
+			void operator()();
+		};
+		struct Bands : public Asserter
+		{
+			void operator()();
+		};
 };
 
 void ThresholdToolsTest::WinsorizedMaskedMeanVar::operator()()
@@ -136,4 +153,63 @@ void ThresholdToolsTest::WinsorizedMaskedMode::operator()()
 	// the Winsorized variance. Therefore, don't test it here. TODO
 }
 
+void ThresholdToolsTest::WinsorizedLargeImage::operator()()
+{
+	// Large enough to select the limits from a sample. The values 0 to 9 each occur
+	// 30000 times in random order, so the 10% and 90% limits are 1 and 8.
+	const size_t width = 1000, height = 300;
+	std::vector<num_t> values(width * height);
+	for(size_t i=0;i<values.size();++i)
+		values[i] = i / 30000;
+	std::random_shuffle(values.begin(), values.end());
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			image->SetValue(x, y, values[y * width + x]);
+	}
+	Mask2DCPtr emptyMask = Mask2D::CreateSetMaskPtr<false>(width, height);
+	
+	num_t mean, stddev;
+	ThresholdTools::WinsorizedMeanAndStdDev(image, emptyMask, mean, stddev);
+	AssertAlmostEqual(mean, 4.5, "Mean");
+	AssertAlmostEqual(stddev, sqrt(1.54 * 6.65), "Standard deviation");
+	
+	num_t mode = ThresholdTools::WinsorizedMode(image, emptyMask);
+	AssertAlmostEqual(mode, sqrt(285.0 / 20.0) * 1.0541, "Mode");
+}
+
+void ThresholdToolsTest::Bands::operator()()
+{
+	const size_t width = 1000, height = 401;
+	Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+	Mask2DPtr mask = Mask2D::CreateUnsetMaskPtr(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+		{
+			image->SetValue(x, y, RNG::Gaussian());
+			mask->SetValue(x, y, RNG::Uniform() < 0.1);
+		}
+	}
+	
+	num_t expectedMean, expectedStddev;
+	ThresholdTools::WinsorizedMeanAndStdDev(image, mask, expectedMean, expectedStddev);
+	const num_t expectedMode = ThresholdTools::WinsorizedMode(image, mask);
+	Image2DPtr expectedShrunk = ThresholdTools::ShrinkHorizontally(3, image, mask);
+	
+	BandThreadPool::SetThreadCount(4);
+	num_t mean, stddev;
+	ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev);
+	const num_t mode = ThresholdTools::WinsorizedMode(image, mask);
+	Image2DPtr shrunk = ThresholdTools::ShrinkHorizontally(3, image, mask);
+	BandThreadPool::SetThreadCount(1);
+	
+	// The values are copied in the same order, so the results are identical
+	AssertEquals(mean, expectedMean, "Mean");
+	AssertEquals(stddev, expectedStddev, "Standard deviation");
+	AssertEquals(mode, expectedMode, "Mode");
+	ImageAsserter::AssertEqual(shrunk, expectedShrunk, "Shrunk image");
+}
+
 #endif
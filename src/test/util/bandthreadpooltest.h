@@ -0,0 +1,207 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_BANDTHREADPOOLTEST_H
+#define AOFLAGGER_BANDTHREADPOOLTEST_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../baseexception.h"
+
+#include "../../util/bandthreadpool.h"
+
+class BandThreadPoolTest : public UnitTest {
+	public:
+		BandThreadPoolTest() : UnitTest("Band thread pool")
+		{
+			AddTest(TestCoverage(), "Bands cover the range once");
+			AddTest(TestGranularity(), "Band granularity");
+			AddTest(TestException(), "Exception in a band");
+			AddTest(TestNested(), "Nested bands");
+		}
+		
+	private:
+		struct TestCoverage : public Asserter
+		{
+			void operator()();
+		};
+		struct TestGranularity : public Asserter
+		{
+			void operator()();
+		};
+		struct TestException : public Asserter
+		{
+			void operator()();
+		};
+		struct TestNested : public Asserter
+		{
+			void operator()();
+		};
+		
+		/**
+		 * Counts how often each index was processed and stores the bands.
+		 */
+		class CountTask : public BandThreadPool::Task
+		{
+			public:
+				CountTask(size_t size) : counts(size, 0) { }
+				virtual void Run(size_t start, size_t end)
+				{
+					boost::mutex::scoped_lock lock(mutex);
+					for(size_t i=start;i!=end;++i)
+						++counts[i];
+					bands.push_back(std::make_pair(start, end));
+				}
+				std::vector<size_t> counts;
+				std::vector<std::pair<size_t, size_t> > bands;
+				boost::mutex mutex;
+		};
+		
+		template<typename ExceptionType>
+		class ThrowingTask : public BandThreadPool::Task
+		{
+			public:
+				virtual void Run(size_t start, size_t)
+				{
+					if(start != 0)
+						throw ExceptionType("band failed");
+				}
+		};
+		
+		/**
+		 * Runs a CountTask from within each band.
+		 */
+		class NestedTask : public BandThreadPool::Task
+		{
+			public:
+				NestedTask() : innerBandCount(0) { }
+				virtual void Run(size_t, size_t)
+				{
+					CountTask inner(100);
+					BandThreadPool::Run(inner, 100, 1);
+					boost::mutex::scoped_lock lock(mutex);
+					innerBandCount += inner.bands.size();
+				}
+				size_t innerBandCount;
+				boost::mutex mutex;
+		};
+		
+		static size_t wrongCount(const CountTask &task)
+		{
+			size_t count = 0;
+			for(size_t i=0;i!=task.counts.size();++i)
+			{
+				if(task.counts[i] != 1)
+					++count;
+			}
+			return count;
+		}
+};
+
+inline void BandThreadPoolTest::TestCoverage::operator()()
+{
+	AssertEquals(BandThreadPool::ThreadCount(), (size_t) 1, "Disabled by default");
+	CountTask serial(1000);
+	BandThreadPool::Run(serial, 1000, 1);
+	AssertEquals(serial.bands.size(), (size_t) 1, "Single band without threads");
+	AssertEquals(wrongCount(serial), (size_t) 0);
+	
+	BandThreadPool::SetThreadCount(4);
+	AssertEquals(BandThreadPool::BandCount(1000, 1), (size_t) 4);
+	AssertEquals(BandThreadPool::BandCount(1000, 300), (size_t) 3);
+	AssertEquals(BandThreadPool::BandCount(1000, 2000), (size_t) 1);
+	for(size_t size=1;size!=50;++size)
+	{
+		CountTask task(size);
+		BandThreadPool::Run(task, size, 1);
+		AssertEquals(wrongCount(task), (size_t) 0, "Every index processed once");
+		AssertEquals(task.bands.size(), std::min(size, (size_t) 4));
+	}
+	BandThreadPool::SetThreadCount(1);
+}
+
+inline void BandThreadPoolTest::TestGranularity::operator()()
+{
+	BandThreadPool::SetThreadCount(3);
+	CountTask task(100);
+	BandThreadPool::Run(task, 100, 1, 16);
+	AssertEquals(wrongCount(task), (size_t) 0);
+	for(size_t i=0;i!=task.bands.size();++i)
+	{
+		AssertEquals(task.bands[i].first % 16, (size_t) 0, "Band starts at a multiple of the granularity");
+		if(task.bands[i].second != 100)
+			AssertEquals(task.bands[i].second % 16, (size_t) 0, "Band ends at a multiple of the granularity");
+	}
+	BandThreadPool::SetThreadCount(1);
+}
+
+inline void BandThreadPoolTest::TestException::operator()()
+{
+	try {
+		BandThreadPool::ScopedThreadCount threads(4);
+		ThrowingTask<std::out_of_range> task;
+		bool thrown = false;
+		try {
+			BandThreadPool::Run(task, 100, 1);
+		} catch(std::out_of_range &e) {
+			thrown = true;
+			AssertEquals(std::string(e.what()), std::string("band failed"));
+		}
+		AssertTrue(thrown, "Standard exception is passed to the caller with its type");
+		
+		ThrowingTask<BadUsageException> badUsageTask;
+		thrown = false;
+		try {
+			BandThreadPool::Run(badUsageTask, 100, 1);
+		} catch(BadUsageException &e) {
+			thrown = true;
+			AssertEquals(std::string(e.what()), std::string("band failed"));
+		}
+		AssertTrue(thrown, "Project exception is passed to the caller with its type");
+		
+		// The pool is still usable afterwards
+		CountTask countTask(100);
+		BandThreadPool::Run(countTask, 100, 1);
+		AssertEquals(wrongCount(countTask), (size_t) 0);
+		
+		BandThreadPool::Run(badUsageTask, 100, 1);
+	} catch(BadUsageException &) {
+	}
+	AssertEquals(BandThreadPool::ThreadCount(), (size_t) 1, "Thread count is restored after an exception");
+}
+
+inline void BandThreadPoolTest::TestNested::operator()()
+{
+	BandThreadPool::SetThreadCount(4);
+	NestedTask task;
+	BandThreadPool::Run(task, 4, 1);
+	AssertEquals(task.innerBandCount, (size_t) 4, "Runs inside a band are not split");
+	BandThreadPool::SetThreadCount(1);
+}
+
+#endif
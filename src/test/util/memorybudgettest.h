@@ -0,0 +1,87 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_MEMORYBUDGETTEST_H
+#define AOFLAGGER_MEMORYBUDGETTEST_H
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../msio/image2d.h"
+#include "../../msio/mask2d.h"
+#include "../../msio/memoryaccounting.h"
+
+#include "../../util/memorybudget.h"
+
+class MemoryBudgetTest : public UnitTest {
+	public:
+		MemoryBudgetTest() : UnitTest("Memory budget")
+		{
+			AddTest(TestAdmission(), "Admission of requests");
+			AddTest(TestAccounting(), "Accounting of image memory");
+		}
+		
+	private:
+		struct TestAdmission : public Asserter
+		{
+			void operator()();
+		};
+		struct TestAccounting : public Asserter
+		{
+			void operator()();
+		};
+};
+
+inline void MemoryBudgetTest::TestAdmission::operator()()
+{
+	MemoryBudget budget(100);
+	AssertTrue(budget.TryAcquire(60));
+	AssertFalse(budget.TryAcquire(60), "Request exceeding the budget");
+	AssertTrue(budget.TryAcquire(40));
+	AssertEquals(budget.Used(), (size_t) 100);
+	budget.Release(60);
+	budget.Release(40);
+	AssertEquals(budget.Used(), (size_t) 0);
+	
+	// A request larger than the budget is granted when nothing is in use
+	AssertTrue(budget.Acquire(250));
+	AssertFalse(budget.TryAcquire(1));
+	AssertEquals(budget.PeakUsed(), (size_t) 250);
+	budget.Release(250);
+	
+	budget.Abort();
+	AssertFalse(budget.Acquire(10), "Acquire after Abort()");
+}
+
+inline void MemoryBudgetTest::TestAccounting::operator()()
+{
+	long usageBefore = MemoryAccounting::ThreadUsage();
+	MemoryAccounting::ResetThreadPeak();
+	size_t expected;
+	{
+		Image2DPtr image = Image2D::CreateZeroImagePtr(100, 10);
+		Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(100, 10);
+		expected = image->Stride() * image->Height() * sizeof(num_t) + mask->Stride() * mask->Height() * sizeof(bool);
+		AssertTrue(MemoryAccounting::ThreadUsage() - usageBefore >= (long) expected);
+	}
+	AssertEquals(MemoryAccounting::ThreadUsage(), usageBefore, "Usage after freeing");
+	AssertTrue(MemoryAccounting::ThreadPeak() - usageBefore >= (long) expected, "Peak usage");
+}
+
+#endif
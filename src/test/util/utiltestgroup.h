@@ -22,7 +22,10 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "bandthreadpooltest.h"
+#include "memorybudgettest.h"
 #include "numberparsertest.h"
+#include "workstealingqueuetest.h"
 
 class UtilTestGroup : public TestGroup {
 	public:
@@ -30,7 +33,10 @@ class UtilTestGroup : public TestGroup {
 		
 		virtual void Initialize()
 		{
+			Add(new BandThreadPoolTest());
+			Add(new MemoryBudgetTest());
 			Add(new NumberParserTest());
+			Add(new WorkStealingQueueTest());
 		}
 };
 
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by A.R. Offringa   *
+ *   offringa@astro.rug.nl   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef AOFLAGGER_WORKSTEALINGQUEUETEST_H
+#define AOFLAGGER_WORKSTEALINGQUEUETEST_H
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../util/workstealingqueue.h"
+
+class WorkStealingQueueTest : public UnitTest {
+	public:
+		WorkStealingQueueTest() : UnitTest("Work stealing queue")
+		{
+			AddTest(TestOrder(), "Order of taken items");
+			AddTest(TestThreads(), "Concurrent workers");
+		}
+		
+	private:
+		struct TestOrder : public Asserter
+		{
+			void operator()();
+		};
+		struct TestThreads : public Asserter
+		{
+			void operator()();
+		};
+		
+		struct Worker
+		{
+			Worker(WorkStealingQueue<size_t> &queue, size_t index, std::vector<size_t> &takenCounts, boost::mutex &mutex) :
+				_queue(queue), _index(index), _takenCounts(takenCounts), _mutex(mutex)
+			{ }
+			void operator()()
+			{
+				size_t item;
+				while(_queue.Pop(_index, item))
+				{
+					boost::mutex::scoped_lock lock(_mutex);
+					++_takenCounts[item];
+				}
+			}
+			WorkStealingQueue<size_t> &_queue;
+			size_t _index;
+			std::vector<size_t> &_takenCounts;
+			boost::mutex &_mutex;
+		};
+};
+
+inline void WorkStealingQueueTest::TestOrder::operator()()
+{
+	WorkStealingQueue<size_t> queue(3);
+	for(size_t i=0;i!=9;++i)
+		queue.Push(i);
+	AssertEquals(queue.Size(), (size_t) 9);
+	
+	// Worker 0 received items 0, 3 and 6 and takes them first-in first-out
+	size_t item;
+	AssertTrue(queue.Pop(0, item));
+	AssertEquals(item, (size_t) 0);
+	AssertTrue(queue.Pop(0, item));
+	AssertEquals(item, (size_t) 3);
+	AssertTrue(queue.Pop(0, item));
+	AssertEquals(item, (size_t) 6);
+	AssertEquals(queue.StealCount(), (size_t) 0);
+	
+	// Then it steals the last item of a fullest other worker
+	AssertTrue(queue.Pop(0, item));
+	AssertEquals(item, (size_t) 7);
+	AssertEquals(queue.StealCount(), (size_t) 1);
+	AssertTrue(queue.Pop(0, item));
+	AssertEquals(item, (size_t) 8);
+	
+	// Worker 1 still has its first items
+	AssertTrue(queue.Pop(1, item));
+	AssertEquals(item, (size_t) 1);
+	AssertEquals(queue.Size(), (size_t) 3);
+	
+	queue.Finish();
+	size_t count = 0;
+	while(queue.Pop(2, item))
+		++count;
+	AssertEquals(count, (size_t) 3);
+	AssertEquals(queue.Size(), (size_t) 0);
+	AssertFalse(queue.Pop(0, item));
+}
+
+inline void WorkStealingQueueTest::TestThreads::operator()()
+{
+	const size_t workerCount = 4, itemCount = 2000;
+	WorkStealingQueue<size_t> queue(workerCount);
+	std::vector<size_t> takenCounts(itemCount, 0);
+	boost::mutex mutex;
+	
+	boost::thread_group threads;
+	for(size_t i=0;i!=workerCount;++i)
+		threads.create_thread(Worker(queue, i, takenCounts, mutex));
+	for(size_t i=0;i!=itemCount;++i)
+	{
+		queue.WaitForSizeAtMost(8);
+		queue.Push(i);
+	}
+	queue.Finish();
+	threads.join_all();
+	
+	size_t wrongCount = 0;
+	for(size_t i=0;i!=itemCount;++i)
+	{
+		if(takenCounts[i] != 1)
+			++wrongCount;
+	}
+	AssertEquals(wrongCount, (size_t) 0, "Every item was taken exactly once");
+	AssertEquals(queue.Size(), (size_t) 0);
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include "bandthreadpool.h"
+
+#include <deque>
+#include <vector>
+
+#include <boost/exception_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "../baseexception.h"
+
+namespace {
+	/**
+	 * One call to BandThreadPool::Run().
+	 */
+	struct Job
+	{
+		BandThreadPool::Task *task;
+		size_t remainingBands;
+		bool failed;
+		boost::exception_ptr error;
+	};
+
+	struct Band
+	{
+		Job *job;
+		size_t start, end;
+	};
+
+	/**
+	 * Set while a thread processes a band, so that nested calls to Run() are serial.
+	 */
+	void noCleanup(bool *) { }
+	bool inBandValue = true;
+	boost::thread_specific_ptr<bool> inBand(noCleanup);
+
+	class Pool
+	{
+		public:
+			Pool() : _threadCount(1), _workers(0), _stop(false) { }
+
+			~Pool() { stopWorkers(); }
+
+			void SetThreadCount(size_t threadCount)
+			{
+				if(threadCount == 0)
+					threadCount = 1;
+				if(threadCount == _threadCount)
+					return;
+				stopWorkers();
+				_threadCount = threadCount;
+				if(_threadCount > 1)
+				{
+					_workers = new boost::thread_group();
+					for(size_t i=1;i<_threadCount;++i)
+						_workers->create_thread(WorkerFunction(*this));
+				}
+			}
+
+			size_t ThreadCount() const { return _threadCount; }
+
+			/**
+			 * Queues the bands and helps processing queued bands until all bands of
+			 * the job are finished.
+			 */
+			void Run(Job &job, const std::vector<Band> &bands)
+			{
+				boost::mutex::scoped_lock lock(_mutex);
+				job.remainingBands = bands.size();
+				_bands.insert(_bands.end(), bands.begin(), bands.end());
+				_bandAvailable.notify_all();
+				while(job.remainingBands != 0)
+				{
+					if(_bands.empty())
+						_bandFinished.wait(lock);
+					else {
+						Band band = _bands.front();
+						_bands.pop_front();
+						lock.unlock();
+						process(band);
+						lock.lock();
+					}
+				}
+			}
+		private:
+			struct WorkerFunction
+			{
+				explicit WorkerFunction(Pool &pool) : _pool(pool) { }
+				void operator()() { _pool.workerLoop(); }
+				Pool &_pool;
+			};
+
+			void workerLoop()
+			{
+				while(true)
+				{
+					Band band;
+					{
+						boost::mutex::scoped_lock lock(_mutex);
+						while(_bands.empty() && !_stop)
+							_bandAvailable.wait(lock);
+						if(_stop)
+							return;
+						band = _bands.front();
+						_bands.pop_front();
+					}
+					process(band);
+				}
+			}
+
+			void process(const Band &band)
+			{
+				bool failed = true;
+				boost::exception_ptr error;
+				inBand.reset(&inBandValue);
+				// boost::current_exception() only knows the standard exceptions, hence
+				// the exceptions of this project are copied with their own type.
+				try {
+					band.job->task->Run(band.start, band.end);
+					failed = false;
+				} catch(BadUsageException &e) {
+					error = boost::copy_exception(e);
+				} catch(ConfigurationException &e) {
+					error = boost::copy_exception(e);
+				} catch(IOException &e) {
+					error = boost::copy_exception(e);
+				} catch(...) {
+					error = boost::current_exception();
+				}
+				inBand.reset(0);
+
+				boost::mutex::scoped_lock lock(_mutex);
+				Job &job = *band.job;
+				if(failed && !job.failed)
+				{
+					job.failed = true;
+					job.error = error;
+				}
+				--job.remainingBands;
+				if(job.remainingBands == 0)
+					_bandFinished.notify_all();
+			}
+
+			void stopWorkers()
+			{
+				if(_workers != 0)
+				{
+					{
+						boost::mutex::scoped_lock lock(_mutex);
+						_stop = true;
+						_bandAvailable.notify_all();
+					}
+					_workers->join_all();
+					delete _workers;
+					_workers = 0;
+					_stop = false;
+				}
+			}
+
+			size_t _threadCount;
+			boost::thread_group *_workers;
+			bool _stop;
+			std::deque<Band> _bands;
+			boost::mutex _mutex;
+			boost::condition _bandAvailable, _bandFinished;
+	};
+
+	Pool &pool()
+	{
+		static Pool instance;
+		return instance;
+	}
+}
+
+void BandThreadPool::SetThreadCount(size_t threadCount)
+{
+	pool().SetThreadCount(threadCount);
+}
+
+size_t BandThreadPool::ThreadCount()
+{
+	return pool().ThreadCount();
+}
+
+size_t BandThreadPool::BandCount(size_t size, size_t minBandSize)
+{
+	const size_t threadCount = pool().ThreadCount();
+	if(threadCount <= 1 || inBand.get() != 0)
+		return 1;
+	size_t bandCount = (minBandSize == 0) ? threadCount : size / minBandSize;
+	if(bandCount > threadCount)
+		bandCount = threadCount;
+	return bandCount == 0 ? 1 : bandCount;
+}
+
+void BandThreadPool::Run(Task &task, size_t size, size_t minBandSize, size_t granularity)
+{
+	if(size == 0)
+		return;
+	const size_t bandCount = BandCount(size, minBandSize);
+	if(granularity == 0)
+		granularity = 1;
+
+	Job job;
+	job.task = &task;
+	job.failed = false;
+	std::vector<Band> bands;
+	size_t start = 0;
+	for(size_t i=1;i<=bandCount;++i)
+	{
+		const size_t end = (i == bandCount) ? size : (size * i / bandCount) / granularity * granularity;
+		if(end > start)
+		{
+			Band band;
+			band.job = &job;
+			band.start = start;
+			band.end = end;
+			bands.push_back(band);
+			start = end;
+		}
+	}
+
+	if(bands.size() <= 1)
+		task.Run(0, size);
+	else {
+		pool().Run(job, bands);
+		if(job.failed)
+			boost::rethrow_exception(job.error);
+	}
+}
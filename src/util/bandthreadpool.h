@@ -0,0 +1,91 @@
+#ifndef BAND_THREAD_POOL_H
+#define BAND_THREAD_POOL_H
+
+#include <cstddef>
+
+/**
+ * Splits the work on a single large image over several threads. ForEachBaselineAction
+ * processes different baselines in parallel, which gives nothing when there are fewer
+ * baselines than cores, e.g. for single-dish sets or when one big image is flagged with
+ * AOFlagger::Run(). The heavy kernels therefore divide their image into bands of rows or
+ * columns and run the bands with Run(), which uses a thread pool that is shared by the
+ * whole process.
+ *
+ * The pool is disabled (a thread count of one) until SetThreadCount() is called, in which
+ * case Run() simply processes the whole range on the calling thread. The calling thread
+ * always takes part in the work, so a thread count of n starts n-1 worker threads.
+ * Several threads may call Run() at the same time; their bands share the workers. A band
+ * that calls Run() itself is processed serially, so kernels can be nested freely.
+ *
+ * Kernels are responsible for splitting their work such that the result does not depend
+ * on the number of bands. When the output of a band depends on input outside of it, the
+ * band reads a halo of extra rows or columns.
+ */
+class BandThreadPool
+{
+	public:
+		/**
+		 * The work of a kernel on a range of rows or columns.
+		 */
+		class Task
+		{
+			public:
+				virtual ~Task() { }
+
+				/**
+				 * Processes the band [start, end). Called concurrently for different bands.
+				 */
+				virtual void Run(size_t start, size_t end) = 0;
+		};
+
+		/**
+		 * Sets the thread count for the lifetime of the object, and restores the previous
+		 * count when it is destroyed, also when this happens because of an exception.
+		 */
+		class ScopedThreadCount
+		{
+			public:
+				explicit ScopedThreadCount(size_t threadCount) : _previousThreadCount(ThreadCount())
+				{
+					SetThreadCount(threadCount);
+				}
+				
+				~ScopedThreadCount()
+				{
+					SetThreadCount(_previousThreadCount);
+				}
+			private:
+				ScopedThreadCount(const ScopedThreadCount &) { }
+				void operator=(const ScopedThreadCount &) { }
+				
+				size_t _previousThreadCount;
+		};
+
+		/**
+		 * Sets the number of threads, including the calling thread, that process the bands
+		 * of one call to Run(). Should not be called while Run() is being executed.
+		 * @see ScopedThreadCount
+		 */
+		static void SetThreadCount(size_t threadCount);
+
+		static size_t ThreadCount();
+
+		/**
+		 * Returns the number of bands that Run() would make of the given range.
+		 */
+		static size_t BandCount(size_t size, size_t minBandSize);
+
+		/**
+		 * Splits [0, size) into at most ThreadCount() bands of at least minBandSize, runs
+		 * task.Run() for each band and waits until all bands are finished. The band
+		 * boundaries are multiples of granularity. When a band throws an exception, the
+		 * other bands are still finished, after which the exception of the first failing
+		 * band is rethrown. Exceptions from baseexception.h and the standard exceptions
+		 * keep their type; other exceptions are rethrown as boost::unknown_exception.
+		 */
+		static void Run(Task &task, size_t size, size_t minBandSize, size_t granularity = 1);
+	private:
+		BandThreadPool() { }
+};
+
+#endif
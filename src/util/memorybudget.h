@@ -0,0 +1,100 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+/**
+ * Limits the total number of bytes that concurrent tasks may use. A task acquires
+ * its (estimated) number of bytes before it starts, and releases them when it is
+ * done. A request is always granted when nothing is in use, so that a task that is
+ * larger than the whole budget still runs, albeit on its own.
+ */
+class MemoryBudget : private boost::noncopyable
+{
+	public:
+		MemoryBudget(size_t budget) : _budget(budget), _used(0), _peakUsed(0), _aborted(false)
+		{
+		}
+		
+		/**
+		 * Blocks until the given number of bytes fits in the budget.
+		 * @returns @c false when Abort() was called.
+		 */
+		bool Acquire(size_t bytes)
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			while(!fits(bytes) && !_aborted)
+				_released.wait(lock);
+			if(_aborted)
+				return false;
+			use(bytes);
+			return true;
+		}
+		
+		/**
+		 * Like Acquire(), but returns @c false instead of waiting when the bytes do not fit.
+		 */
+		bool TryAcquire(size_t bytes)
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			if(!fits(bytes) || _aborted)
+				return false;
+			use(bytes);
+			return true;
+		}
+		
+		void Release(size_t bytes)
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			_used -= bytes;
+			_released.notify_all();
+		}
+		
+		/**
+		 * Wakes up all waiting threads, after which no more requests are granted.
+		 */
+		void Abort()
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			_aborted = true;
+			_released.notify_all();
+		}
+		
+		size_t Budget() const { return _budget; }
+		
+		size_t Used() const
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			return _used;
+		}
+		
+		size_t PeakUsed() const
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			return _peakUsed;
+		}
+	private:
+		bool fits(size_t bytes) const
+		{
+			return _used == 0 || _used + bytes <= _budget;
+		}
+		
+		void use(size_t bytes)
+		{
+			_used += bytes;
+			if(_used > _peakUsed)
+				_peakUsed = _used;
+		}
+		
+		const size_t _budget;
+		size_t _used, _peakUsed;
+		bool _aborted;
+		mutable boost::mutex _mutex;
+		boost::condition _released;
+};
+
+#endif
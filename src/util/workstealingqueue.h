@@ -0,0 +1,229 @@
+#ifndef WORK_STEALING_QUEUE_H
+#define WORK_STEALING_QUEUE_H
+
+#include <deque>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+/**
+ * Distributes work items over a fixed number of worker threads. Each worker has its own
+ * deque with its own lock, so that workers taking work do not contend with each other.
+ * A worker takes items from the front of its own deque, and when that is empty, it
+ * steals an item from the back of the fullest deque of the other workers.
+ *
+ * Producers add items with Push(), which spreads them round-robin over the workers.
+ * Items that are pushed first are therefore also taken first: when producers push the
+ * largest items first, the largest items are started first, while stolen items are
+ * the ones that were pushed last. Because work can be stolen, all workers stay busy
+ * as long as there are items anywhere in the queue.
+ *
+ * The shared lock is only taken to update the total number of items, to let idle
+ * workers sleep and to let producers wait for space (see WaitForSizeAtMost()).
+ */
+template<typename T>
+class WorkStealingQueue : private boost::noncopyable
+{
+	public:
+		WorkStealingQueue(size_t workerCount) :
+			_deques(workerCount),
+			_nextWorker(0),
+			_size(0),
+			_pushCount(0),
+			_stealCount(0),
+			_finished(false),
+			_aborted(false)
+		{
+		}
+
+		size_t WorkerCount() const { return _deques.size(); }
+
+		/**
+		 * Adds an item to the deque of the next worker.
+		 */
+		void Push(const T &item)
+		{
+			size_t worker;
+			{
+				boost::mutex::scoped_lock lock(_mutex);
+				worker = _nextWorker;
+				_nextWorker = (_nextWorker + 1) % _deques.size();
+				// Counted before it can be taken, so that the size never drops below zero
+				++_size;
+			}
+			WorkerDeque &deque = _deques[worker];
+			{
+				boost::mutex::scoped_lock dequeLock(deque.mutex);
+				deque.items.push_back(item);
+			}
+			boost::mutex::scoped_lock lock(_mutex);
+			++_pushCount;
+			_itemAvailable.notify_all();
+		}
+
+		/**
+		 * Takes the next item for the given worker. When no items are available, this
+		 * call blocks until an item is pushed, until Finish() has been called and all
+		 * items have been taken, or until Abort() is called.
+		 * @returns @c false when there is no more work for this worker.
+		 */
+		bool Pop(size_t worker, T &item)
+		{
+			while(true)
+			{
+				size_t pushCount;
+				{
+					boost::mutex::scoped_lock lock(_mutex);
+					if(_aborted)
+						return false;
+					pushCount = _pushCount;
+				}
+				if(takeOwn(worker, item) || steal(worker, item))
+				{
+					boost::mutex::scoped_lock lock(_mutex);
+					--_size;
+					_itemTaken.notify_all();
+					return true;
+				}
+				// All deques were empty: sleep until something new was pushed. The push
+				// count prevents missing items that were pushed during the search.
+				boost::mutex::scoped_lock lock(_mutex);
+				while(_pushCount == pushCount && !_finished && !_aborted)
+					_itemAvailable.wait(lock);
+				if(_pushCount == pushCount)
+					return false;
+			}
+		}
+
+		/**
+		 * Blocks until the queue holds at most the given number of items, or the queue
+		 * was aborted.
+		 */
+		void WaitForSizeAtMost(size_t maxSize)
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			while(_size > maxSize && !_aborted)
+				_itemTaken.wait(lock);
+		}
+
+		/**
+		 * Signals that no more items will be pushed.
+		 */
+		void Finish()
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			_finished = true;
+			_itemAvailable.notify_all();
+		}
+
+		/**
+		 * Wakes up all waiting threads and makes Pop() return @c false. The items that
+		 * are still in the queue are returned, so that the caller can free them.
+		 */
+		std::vector<T> Abort()
+		{
+			std::vector<T> remaining;
+			{
+				boost::mutex::scoped_lock lock(_mutex);
+				_aborted = true;
+				_itemAvailable.notify_all();
+				_itemTaken.notify_all();
+			}
+			for(typename std::vector<WorkerDeque>::iterator i=_deques.begin();i!=_deques.end();++i)
+			{
+				boost::mutex::scoped_lock dequeLock(i->mutex);
+				remaining.insert(remaining.end(), i->items.begin(), i->items.end());
+				i->items.clear();
+			}
+			return remaining;
+		}
+
+		size_t Size() const
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			return _size;
+		}
+
+		/**
+		 * Number of items that were taken by a worker other than the one they were
+		 * pushed to.
+		 */
+		size_t StealCount() const
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+			return _stealCount;
+		}
+	private:
+		struct WorkerDeque
+		{
+			WorkerDeque() { }
+			// Deques are only copied while constructing the vector, when they are empty.
+			WorkerDeque(const WorkerDeque &) { }
+			boost::mutex mutex;
+			std::deque<T> items;
+		};
+
+		bool takeOwn(size_t worker, T &item)
+		{
+			WorkerDeque &deque = _deques[worker];
+			boost::mutex::scoped_lock dequeLock(deque.mutex);
+			if(deque.items.empty())
+				return false;
+			item = deque.items.front();
+			deque.items.pop_front();
+			return true;
+		}
+
+		bool steal(size_t worker, T &item)
+		{
+			// Try the fullest other deque first. The sizes can change during the search,
+			// so when that one turned out empty, the other deques are tried as well.
+			size_t victim = worker, victimSize = 0;
+			for(size_t i=0;i!=_deques.size();++i)
+			{
+				if(i != worker)
+				{
+					boost::mutex::scoped_lock dequeLock(_deques[i].mutex);
+					if(_deques[i].items.size() > victimSize)
+					{
+						victim = i;
+						victimSize = _deques[i].items.size();
+					}
+				}
+			}
+			if(victim != worker && stealFrom(victim, item))
+				return true;
+			for(size_t i=0;i!=_deques.size();++i)
+			{
+				if(i != worker && stealFrom(i, item))
+					return true;
+			}
+			return false;
+		}
+
+		bool stealFrom(size_t victim, T &item)
+		{
+			WorkerDeque &deque = _deques[victim];
+			{
+				boost::mutex::scoped_lock dequeLock(deque.mutex);
+				if(deque.items.empty())
+					return false;
+				item = deque.items.back();
+				deque.items.pop_back();
+			}
+			boost::mutex::scoped_lock lock(_mutex);
+			++_stealCount;
+			return true;
+		}
+
+		std::vector<WorkerDeque> _deques;
+
+		mutable boost::mutex _mutex;
+		boost::condition _itemAvailable, _itemTaken;
+		size_t _nextWorker, _size, _pushCount, _stealCount;
+		bool _finished, _aborted;
+};
+
+#endif